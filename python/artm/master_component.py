@@ -506,7 +506,7 @@ class MasterComponent(object):
         if batches_folder is not None:
             for name in os.listdir(batches_folder):
                 _, extension = os.path.splitext(name)
-                if extension == '.batch':
+                if extension in ('.batch', '.cbatch'):
                     args.batch_filename.append(os.path.join(batches_folder, name))
         if batches is not None:
             for batch in batches:
@@ -760,12 +760,15 @@ class MasterComponent(object):
             for topic_name in topic_names:
                 args.topic_name.append(topic_name)
 
-        theta_matrix_info = self._lib.ArtmRequestThetaMatrixExternal(self.master_id, args)
+        # the first call only returns the size of the matrix, the second one writes the values into numpy_ndarray
+        empty_ndarray = numpy.zeros(shape=(0, 0), dtype=numpy.float32)
+        theta_matrix_info = self._lib.ArtmRequestThetaMatrixToBuffer(self.master_id, args, empty_ndarray)
 
         num_rows = len(theta_matrix_info.item_id)
         num_cols = theta_matrix_info.num_topics
         numpy_ndarray = numpy.zeros(shape=(num_rows, num_cols), dtype=numpy.float32)
-        self._lib.ArtmCopyRequestedObject(numpy_ndarray)
+        if numpy_ndarray.size > 0:
+            theta_matrix_info = self._lib.ArtmRequestThetaMatrixToBuffer(self.master_id, args, numpy_ndarray)
 
         return theta_matrix_info, numpy_ndarray
 
@@ -803,12 +806,25 @@ class MasterComponent(object):
         if use_sparse_format is not None:
             args.matrix_layout = constants.MatrixLayout_Sparse
 
-        phi_matrix_info = self._lib.ArtmRequestTopicModelExternal(self.master_id, args)
+        if use_sparse_format is not None:
+            phi_matrix_info = self._lib.ArtmRequestTopicModelExternal(self.master_id, args)
+
+            num_rows = len(phi_matrix_info.token)
+            num_cols = phi_matrix_info.num_topics
+            numpy_ndarray = numpy.zeros(shape=(num_rows, num_cols), dtype=numpy.float32)
+            self._lib.ArtmCopyRequestedObject(numpy_ndarray)
+
+            return phi_matrix_info, numpy_ndarray
+
+        # the first call only returns the size of the matrix, the second one writes the values into numpy_ndarray
+        empty_ndarray = numpy.zeros(shape=(0, 0), dtype=numpy.float32)
+        phi_matrix_info = self._lib.ArtmRequestTopicModelToBuffer(self.master_id, args, empty_ndarray)
 
         num_rows = len(phi_matrix_info.token)
         num_cols = phi_matrix_info.num_topics
         numpy_ndarray = numpy.zeros(shape=(num_rows, num_cols), dtype=numpy.float32)
-        self._lib.ArtmCopyRequestedObject(numpy_ndarray)
+        if numpy_ndarray.size > 0:
+            phi_matrix_info = self._lib.ArtmRequestTopicModelToBuffer(self.master_id, args, numpy_ndarray)
 
         return phi_matrix_info, numpy_ndarray
 
@@ -149,6 +149,11 @@ ARTM_API = [
         [('master_id', int), ('args', messages.GetThetaMatrixArgs)],
         request=messages.ThetaMatrix,
     ),
+    CallSpec(
+        'ArtmRequestThetaMatrixToBuffer',
+        [('master_id', int), ('args', messages.GetThetaMatrixArgs), ('matrix', numpy.ndarray)],
+        request=messages.ThetaMatrix,
+    ),
     CallSpec(
         'ArtmRequestTopicModel',
         [('master_id', int), ('args', messages.GetTopicModelArgs)],
@@ -159,6 +164,11 @@ ARTM_API = [
         [('master_id', int), ('args', messages.GetTopicModelArgs)],
         request=messages.TopicModel,
     ),
+    CallSpec(
+        'ArtmRequestTopicModelToBuffer',
+        [('master_id', int), ('args', messages.GetTopicModelArgs), ('matrix', numpy.ndarray)],
+        request=messages.TopicModel,
+    ),
     CallSpec(
         'ArtmRequestScore',
         [('master_id', int), ('args', messages.GetScoreValueArgs)],
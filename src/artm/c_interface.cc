@@ -8,7 +8,6 @@
 #include "boost/filesystem.hpp"
 #include "boost/thread/tss.hpp"
 #include "boost/thread/thread.hpp"
-#include "boost/date_time/posix_time/posix_time.hpp"
 
 #include "glog/logging.h"
 
@@ -302,20 +301,8 @@ int64_t ArtmAwaitOperation(int operation_id, int64_t length, const char* await_o
     AsyncProcessBatchesManager& manager = AsyncProcessBatchesManager::singleton();
     std::shared_ptr<artm::core::BatchManager> batch_manager = manager.Get(operation_id);
 
-    const int timeout = args.timeout_milliseconds();
-    auto time_start = boost::posix_time::microsec_clock::local_time();
-    for (;;) {
-      if (batch_manager->IsEverythingProcessed()) {
-        return ARTM_SUCCESS;
-      }
-
-      boost::this_thread::sleep(boost::posix_time::milliseconds(::artm::core::kIdleLoopFrequency));
-      auto time_end = boost::posix_time::microsec_clock::local_time();
-      if (timeout >= 0) {
-        if ((time_end - time_start).total_milliseconds() >= timeout) {
-          break;
-        }
-      }
+    if (batch_manager->Wait(args.timeout_milliseconds())) {
+      return ARTM_SUCCESS;
     }
 
     set_last_error("The operation is still in progress. Call ArtmAwaitOperation() later.");
@@ -358,7 +345,7 @@ int64_t ArtmRequestLoadBatch(const char* filename) {
   try {
     EnableLogging();
     auto batch = std::make_shared< ::artm::Batch>();
-    ::artm::core::Helpers::LoadMessage(filename, batch.get());
+    ::artm::core::Helpers::LoadBatch(filename, batch.get());
     SerializeToString(*batch, last_message());
     return static_cast<int64_t>(last_message()->size());
   } CATCH_EXCEPTIONS;
@@ -583,6 +570,23 @@ int64_t ArtmRequestExternal(int master_id, int64_t length, const char* args_blob
   } CATCH_EXCEPTIONS;
 }
 
+template<typename ArgsT, typename ResultT>
+int64_t ArtmRequestToBuffer(int master_id, int64_t length, const char* args_blob,
+                            int64_t address_length, char* address) {
+  try {
+    ArgsT args;
+    ResultT result;
+    ParseFromArray(args_blob, length, &args);
+    ::artm::core::FixAndValidateMessage(&args, /* throw_error =*/ true);
+    std::string description = ::artm::core::DescribeMessage(args);
+    LOG_IF(INFO, !description.empty()) << "Pass " << description << " to MasterComponent::Request (to buffer)";
+    master_component(master_id)->Request(args, &result, address_length, address);
+    ::artm::core::FixAndValidateMessage(&result, /* throw_error =*/ false);
+    SerializeToString(result, last_message());
+    return static_cast<int64_t>(last_message()->size());
+  } CATCH_EXCEPTIONS;
+}
+
 int64_t ArtmRequestScore(int master_id, int64_t length, const char* args) {
   return ArtmRequest< ::artm::GetScoreValueArgs,
                       ::artm::ScoreData>(master_id, length, args);
@@ -627,6 +631,12 @@ int64_t ArtmRequestThetaMatrixExternal(int master_id, int64_t length, const char
                               ::artm::ThetaMatrix>(master_id, length, args);
 }
 
+int64_t ArtmRequestThetaMatrixToBuffer(int master_id, int64_t length, const char* args,
+                                       int64_t address_length, char* address) {
+  return ArtmRequestToBuffer< ::artm::GetThetaMatrixArgs,
+                              ::artm::ThetaMatrix>(master_id, length, args, address_length, address);
+}
+
 int64_t ArtmRequestTopicModel(int master_id, int64_t length, const char* args) {
   return ArtmRequest< ::artm::GetTopicModelArgs,
                       ::artm::TopicModel>(master_id, length, args);
@@ -637,6 +647,12 @@ int64_t ArtmRequestTopicModelExternal(int master_id, int64_t length, const char*
                               ::artm::TopicModel>(master_id, length, args);
 }
 
+int64_t ArtmRequestTopicModelToBuffer(int master_id, int64_t length, const char* args,
+                                      int64_t address_length, char* address) {
+  return ArtmRequestToBuffer< ::artm::GetTopicModelArgs,
+                              ::artm::TopicModel>(master_id, length, args, address_length, address);
+}
+
 int64_t ArtmRequestTransformMasterModel(int master_id, int64_t length, const char* args) {
   return ArtmRequest< ::artm::TransformMasterModelArgs,
                       ::artm::ThetaMatrix>(master_id, length, args);
@@ -72,6 +72,14 @@ extern "C" {
   DLL_PUBLIC int64_t ArtmRequestTopicModel(int master_id, int64_t length, const char* get_model_args);
   DLL_PUBLIC int64_t ArtmRequestTopicModelExternal(int master_id, int64_t length, const char* get_model_args);
 
+  // Write theta or phi values straight into 'address' (dense or sparse layout, as in ArtmRequestXxxExternal),
+  // and return the length of ThetaMatrix / TopicModel message without the weights.
+  // Zero 'address_length' only computes the message; its num_values field defines the required size of the buffer.
+  DLL_PUBLIC int64_t ArtmRequestThetaMatrixToBuffer(int master_id, int64_t length, const char* get_theta_args,
+                                                    int64_t address_length, char* address);
+  DLL_PUBLIC int64_t ArtmRequestTopicModelToBuffer(int master_id, int64_t length, const char* get_model_args,
+                                                   int64_t address_length, char* address);
+
   DLL_PUBLIC int64_t ArtmRequestScore(int master_id, int64_t length, const char* get_score_args);
   DLL_PUBLIC int64_t ArtmRequestScoreArray(int master_id, int64_t length, const char* get_score_args);
 
@@ -2,12 +2,15 @@
 
 #include "artm/core/batch_manager.h"
 
+#include "boost/date_time/posix_time/posix_time.hpp"
+#include "boost/thread/locks.hpp"
+
 #include "artm/core/thread_safe_holder.h"
 
 namespace artm {
 namespace core {
 
-BatchManager::BatchManager() : lock_(), in_progress_() { }
+BatchManager::BatchManager() : lock_(), everything_processed_(), in_progress_() { }
 
 void BatchManager::Add(const boost::uuids::uuid& task_id) {
   boost::lock_guard<boost::mutex> guard(lock_);
@@ -22,6 +25,20 @@ bool BatchManager::IsEverythingProcessed() const {
 void BatchManager::Callback(const boost::uuids::uuid& task_id) {
   boost::lock_guard<boost::mutex> guard(lock_);
   in_progress_.erase(task_id);
+  if (in_progress_.empty()) {
+    everything_processed_.notify_all();
+  }
+}
+
+bool BatchManager::Wait(int timeout_milliseconds) const {
+  boost::unique_lock<boost::mutex> lock(lock_);
+  if (timeout_milliseconds < 0) {
+    everything_processed_.wait(lock, [this]() { return in_progress_.empty(); });  // NOLINT
+    return true;
+  }
+
+  return everything_processed_.timed_wait(lock, boost::posix_time::milliseconds(timeout_milliseconds),
+                                          [this]() { return in_progress_.empty(); });  // NOLINT
 }
 
 }  // namespace core
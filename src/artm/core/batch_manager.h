@@ -6,6 +6,7 @@
 #include <string>
 
 #include "boost/thread.hpp"
+#include "boost/thread/condition_variable.hpp"
 #include "boost/thread/mutex.hpp"
 #include "boost/utility.hpp"
 #include "boost/uuid/uuid.hpp"
@@ -32,8 +33,13 @@ class BatchManager : boost::noncopyable {
   // Marks task as completed
   void Callback(const boost::uuids::uuid& task_id);
 
+  // Blocks until all added tasks are processed, or until timeout expires.
+  // Negative timeout means to wait infinitely. Returns the result of IsEverythingProcessed().
+  bool Wait(int timeout_milliseconds = -1) const;
+
  private:
   mutable boost::mutex lock_;
+  mutable boost::condition_variable everything_processed_;
   std::set<boost::uuids::uuid> in_progress_;
 };
 
@@ -0,0 +1,242 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#include "artm/core/batch_prefetcher.h"
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+
+#include "boost/exception/diagnostic_information.hpp"
+
+#include "glog/logging.h"
+
+#include "artm/core/helpers.h"
+#include "artm/core/processor_input.h"
+
+namespace artm {
+namespace core {
+
+namespace {
+
+const int64_t kNanosecondsPerMillisecond = 1000000;
+
+int64_t ElapsedNanoseconds(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Reads one value from each page of token weights, so that the processor does not stall
+// on page faults of the memory-mapped file (token ids are already read by the ColumnarBatch constructor).
+void TouchPages(const ColumnarBatch& batch) {
+  const int kValuesPerPage = 4096 / sizeof(float);
+  float sum = 0.0f;
+  for (int i = 0; i < batch.nnz(); i += kValuesPerPage) {
+    sum += batch.token_weight()[i];
+  }
+
+  volatile float sink = sum;
+  (void) sink;
+}
+
+}  // namespace
+
+std::shared_ptr<LoadedBatch> LoadedBatch::Load(const std::string& full_filename) {
+  auto retval = std::make_shared<LoadedBatch>();
+  retval->message = std::make_shared<Batch>();
+  retval->byte_size = 0;
+  if (ColumnarBatch::IsColumnarBatch(full_filename)) {
+    retval->columnar_batch = std::make_shared<ColumnarBatch>(full_filename);
+    retval->columnar_batch->ToBatch(retval->message.get(), /* include_item_tokens = */ false);
+    retval->byte_size += retval->columnar_batch->byte_size();
+  } else {
+    Helpers::LoadMessage(full_filename, retval->message.get());
+  }
+
+  retval->byte_size += retval->message->SpaceUsed();
+  return retval;
+}
+
+BatchPrefetcher::BatchPrefetcher()
+    : lock_(), state_changed_(), entries_(), pending_(), num_batches_(0), memory_budget_(0),
+      num_ready_(0), ready_byte_size_(0), peak_ready_byte_size_(0), is_stopping_(false), thread_(),
+      num_prefetched_batches_(0), num_prefetch_misses_(0), prefetch_time_ns_(0),
+      processor_load_time_ns_(0), processor_wait_time_ns_(0), processor_compute_time_ns_(0) { }
+
+BatchPrefetcher::~BatchPrefetcher() {
+  Reconfigure(0, 0);
+}
+
+void BatchPrefetcher::Reconfigure(int num_batches, int64_t memory_budget) {
+  num_batches = std::max(num_batches, 0);
+  {
+    boost::lock_guard<boost::mutex> guard(lock_);
+    num_batches_ = num_batches;
+    memory_budget_ = memory_budget;
+    is_stopping_ = (num_batches == 0);
+    state_changed_.notify_all();
+  }
+
+  if (num_batches == 0 && thread_.joinable()) {
+    thread_.join();
+  }
+
+  if (num_batches > 0 && !thread_.joinable()) {
+    boost::thread t(&BatchPrefetcher::ThreadFunction, this);
+    thread_.swap(t);
+  }
+}
+
+void BatchPrefetcher::Add(const std::shared_ptr<ProcessorInput>& part) {
+  if (!part->has_batch_filename()) {
+    return;
+  }
+
+  boost::lock_guard<boost::mutex> guard(lock_);
+  if (num_batches_ == 0) {
+    return;
+  }
+
+  Entry& entry = entries_[part.get()];
+  entry.part = part;
+  entry.state = Pending;
+  entry.batch.reset();
+  pending_.push_back(part.get());
+  state_changed_.notify_all();
+}
+
+std::shared_ptr<LoadedBatch> BatchPrefetcher::Take(const ProcessorInput& part) {
+  boost::unique_lock<boost::mutex> lock(lock_);
+  auto iter = entries_.find(&part);
+  if (iter == entries_.end()) {
+    return nullptr;
+  }
+
+  if (iter->second.state == Loading) {
+    auto start = std::chrono::steady_clock::now();
+    while (iter->second.state == Loading) {
+      state_changed_.wait(lock);
+    }
+
+    processor_wait_time_ns_ += ElapsedNanoseconds(start);
+  }
+
+  std::shared_ptr<LoadedBatch> retval;
+  if (iter->second.state == Ready) {
+    retval = iter->second.batch;
+    num_ready_--;
+    ready_byte_size_ -= retval->byte_size;
+  } else {
+    num_prefetch_misses_++;
+  }
+
+  // The entry might still be referenced from pending_; ThreadFunction skips such keys.
+  entries_.erase(iter);
+  state_changed_.notify_all();
+  return retval;
+}
+
+void BatchPrefetcher::RecordProcessorTime(int64_t load_time_ns, int64_t compute_time_ns) {
+  processor_load_time_ns_ += load_time_ns;
+  processor_compute_time_ns_ += compute_time_ns;
+}
+
+void BatchPrefetcher::RequestPipelineInfo(MasterComponentInfo::PipelineInfo* info) const {
+  {
+    boost::lock_guard<boost::mutex> guard(lock_);
+    info->set_prefetched_byte_size(ready_byte_size_);
+    info->set_peak_prefetched_byte_size(peak_ready_byte_size_);
+  }
+
+  info->set_num_prefetched_batches(num_prefetched_batches_);
+  info->set_num_prefetch_misses(num_prefetch_misses_);
+  info->set_prefetch_time_ms(prefetch_time_ns_ / kNanosecondsPerMillisecond);
+  info->set_processor_load_time_ms(processor_load_time_ns_ / kNanosecondsPerMillisecond);
+  info->set_processor_wait_time_ms(processor_wait_time_ns_ / kNanosecondsPerMillisecond);
+  info->set_processor_compute_time_ms(processor_compute_time_ns_ / kNanosecondsPerMillisecond);
+}
+
+bool BatchPrefetcher::CanStartLoading() {
+  // Drop the keys of the entries that were already taken by the processors
+  while (!pending_.empty()) {
+    auto iter = entries_.find(pending_.front());
+    if (iter != entries_.end() && iter->second.state == Pending) {
+      break;
+    }
+
+    pending_.pop_front();
+  }
+
+  if (pending_.empty() || num_ready_ >= num_batches_) {
+    return false;
+  }
+
+  // Always allow one batch, even if it alone exceeds the budget
+  return num_ready_ == 0 || ready_byte_size_ < memory_budget_;
+}
+
+void BatchPrefetcher::ThreadFunction() {
+  try {
+    Helpers::SetThreadName(-1, "Prefetch thread");
+    LOG(INFO) << "Prefetch thread started";
+
+    for (;;) {
+      const ProcessorInput* key = nullptr;
+      std::string batch_filename;
+      {
+        boost::unique_lock<boost::mutex> lock(lock_);
+        while (!is_stopping_ && !CanStartLoading()) {
+          state_changed_.wait(lock);
+        }
+
+        if (is_stopping_) {
+          LOG(INFO) << "Prefetch thread stopped";
+          break;
+        }
+
+        key = pending_.front();
+        pending_.pop_front();
+
+        Entry& entry = entries_[key];
+        entry.state = Loading;
+        batch_filename = entry.part->batch_filename();
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      std::shared_ptr<LoadedBatch> batch;
+      try {
+        batch = LoadedBatch::Load(batch_filename);
+        if (batch->columnar_batch != nullptr) {
+          TouchPages(*batch->columnar_batch);
+        }
+      } catch (std::exception& ex) {
+        // The processor will try to load the batch again and report the error
+        LOG(WARNING) << "Unable to prefetch " << batch_filename << ", " << ex.what();
+        batch.reset();
+      }
+
+      prefetch_time_ns_ += ElapsedNanoseconds(start);
+
+      {
+        // Entries in the Loading state are never erased (see Take)
+        boost::lock_guard<boost::mutex> guard(lock_);
+        Entry& entry = entries_[key];
+        if (batch != nullptr) {
+          entry.state = Ready;
+          entry.batch = batch;
+          num_ready_++;
+          ready_byte_size_ += batch->byte_size;
+          peak_ready_byte_size_ = std::max(peak_ready_byte_size_, ready_byte_size_);
+          num_prefetched_batches_++;
+        } else {
+          entry.state = Failed;
+        }
+
+        state_changed_.notify_all();
+      }
+    }
+  }
+  catch (...) {
+    LOG(FATAL) << boost::current_exception_diagnostic_information();
+  }
+}
+
+}  // namespace core
+}  // namespace artm
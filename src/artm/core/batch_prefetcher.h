@@ -0,0 +1,101 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "boost/thread.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/utility.hpp"
+
+#include "artm/core/common.h"
+#include "artm/core/columnar_batch.h"
+
+namespace artm {
+namespace core {
+
+class ProcessorInput;
+
+// LoadedBatch holds a batch read from disk, either by BatchPrefetcher or by the processor itself.
+// For columnar batches the message only contains the tokens, the ids and the titles of the items
+// (see ColumnarBatch::ToBatch), and the CSR arrays stay in the memory-mapped file.
+struct LoadedBatch {
+  std::shared_ptr<Batch> message;
+  std::shared_ptr<ColumnarBatch> columnar_batch;  // nullptr for protobuf batches
+  int64_t byte_size;
+
+  // Throws DiskReadException or CorruptedMessageException if the batch can not be loaded.
+  static std::shared_ptr<LoadedBatch> Load(const std::string& full_filename);
+};
+
+// BatchPrefetcher class runs a dedicated I/O thread that reads and decodes the batches
+// of queued ProcessorInputs ahead of the processors, so that processors spend their time on the E-step
+// rather than on disk reads and protobuf parsing. Batches are prefetched in the order of Add calls.
+// At most num_batches batches are held in memory, and a new batch is not started
+// when the ready batches already take more than memory_budget bytes.
+// Batches that were not prefetched in time (or could not be loaded) are loaded by the processors themselves,
+// so that prefetching never changes the results.
+// The class also collects per-stage timing (see RequestPipelineInfo)
+// to tell whether the processing is I/O-bound or compute-bound.
+class BatchPrefetcher : boost::noncopyable {
+ public:
+  BatchPrefetcher();
+  ~BatchPrefetcher();
+
+  // Starts or stops the I/O thread; num_batches = 0 disables prefetching.
+  void Reconfigure(int num_batches, int64_t memory_budget);
+
+  // Schedules the batch of a processor input for prefetching.
+  // Must be called before the input is pushed into the processor queue.
+  void Add(const std::shared_ptr<ProcessorInput>& part);
+
+  // Returns the batch prefetched for the processor input, waiting if the batch is being loaded right now.
+  // Returns nullptr if the batch was not prefetched; then the caller should load the batch on its own.
+  std::shared_ptr<LoadedBatch> Take(const ProcessorInput& part);
+
+  // Processors report the time spent on loading batches and on processing them.
+  void RecordProcessorTime(int64_t load_time_ns, int64_t compute_time_ns);
+
+  void RequestPipelineInfo(MasterComponentInfo::PipelineInfo* info) const;
+
+ private:
+  enum EntryState { Pending, Loading, Ready, Failed };
+
+  struct Entry {
+    std::shared_ptr<ProcessorInput> part;
+    EntryState state;
+    std::shared_ptr<LoadedBatch> batch;
+  };
+
+  void ThreadFunction();
+  bool CanStartLoading();  // requires lock_, drops stale keys from pending_
+
+  mutable boost::mutex lock_;
+  boost::condition_variable state_changed_;
+  std::map<const ProcessorInput*, Entry> entries_;
+  std::deque<const ProcessorInput*> pending_;
+
+  int num_batches_;
+  int64_t memory_budget_;
+  int num_ready_;
+  int64_t ready_byte_size_;
+  int64_t peak_ready_byte_size_;
+  bool is_stopping_;
+  boost::thread thread_;
+
+  std::atomic<int64_t> num_prefetched_batches_;
+  std::atomic<int64_t> num_prefetch_misses_;
+  std::atomic<int64_t> prefetch_time_ns_;
+  std::atomic<int64_t> processor_load_time_ns_;
+  std::atomic<int64_t> processor_wait_time_ns_;
+  std::atomic<int64_t> processor_compute_time_ns_;
+};
+
+}  // namespace core
+}  // namespace artm
@@ -0,0 +1,79 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#include "artm/core/batch_token_id_cache.h"
+
+#include "boost/thread/locks.hpp"
+
+#include "artm/core/token.h"
+
+namespace artm {
+namespace core {
+
+BatchTokenIdCache::BatchTokenIdCache()
+    : lock_(), entries_(), num_token_ids_(0), hit_count_(0), miss_count_(0) { }
+
+std::shared_ptr<std::vector<int>> BatchTokenIdCache::CalculateTokenIds(const Batch& batch,
+                                                                       const PhiMatrix& phi_matrix) {
+  auto token_id = std::make_shared<std::vector<int>>(batch.token_size(), -1);
+  for (int token_index = 0; token_index < batch.token_size(); ++token_index) {
+    (*token_id)[token_index] = phi_matrix.token_index(Token(batch.class_id(token_index), batch.token(token_index)));
+  }
+
+  return token_id;
+}
+
+std::shared_ptr<const std::vector<int>> BatchTokenIdCache::FindTokenIds(const Batch& batch,
+                                                                        const PhiMatrix& phi_matrix) {
+  if (!batch.has_id()) {
+    return CalculateTokenIds(batch, phi_matrix);
+  }
+
+  const int64_t shape_version = phi_matrix.shape_version();
+  {
+    boost::lock_guard<boost::mutex> guard(lock_);
+    auto iter = entries_.find(batch.id());
+    if (iter != entries_.end()) {
+      for (const Entry& entry : iter->second) {
+        if (entry.shape_version == shape_version && static_cast<int>(entry.token_id->size()) == batch.token_size()) {
+          hit_count_++;
+          return entry.token_id;
+        }
+      }
+    }
+  }
+
+  // Hash the tokens outside of the lock, so that processors do not wait for each other
+  std::shared_ptr<const std::vector<int>> token_id = CalculateTokenIds(batch, phi_matrix);
+  miss_count_++;
+
+  boost::lock_guard<boost::mutex> guard(lock_);
+  if (num_token_ids_ + batch.token_size() > kMaxTokenIds) {
+    entries_.clear();
+    num_token_ids_ = 0;
+  }
+
+  std::vector<Entry>& batch_entries = entries_[batch.id()];
+  if (static_cast<int>(batch_entries.size()) >= kMaxVersionsPerBatch) {
+    num_token_ids_ -= batch_entries.back().token_id->size();
+    batch_entries.pop_back();
+  }
+
+  Entry entry = { shape_version, token_id };
+  batch_entries.insert(batch_entries.begin(), entry);
+  num_token_ids_ += token_id->size();
+  return token_id;
+}
+
+void BatchTokenIdCache::Clear() {
+  boost::lock_guard<boost::mutex> guard(lock_);
+  entries_.clear();
+  num_token_ids_ = 0;
+}
+
+int64_t BatchTokenIdCache::ByteSize() const {
+  boost::lock_guard<boost::mutex> guard(lock_);
+  return sizeof(int) * num_token_ids_;
+}
+
+}  // namespace core
+}  // namespace artm
@@ -0,0 +1,62 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "boost/thread/mutex.hpp"
+#include "boost/utility.hpp"
+
+#include "artm/core/common.h"
+#include "artm/core/phi_matrix.h"
+
+namespace artm {
+namespace core {
+
+// BatchTokenIdCache class caches the translation of batch tokens into token ids of phi matrices,
+// so that the tokens of each batch are hashed once per fit rather than once per pass.
+// Entries are keyed by batch id and PhiMatrix::shape_version, therefore they become stale
+// as soon as the tokens of the matrix change (AddToken, Clear), and are reused
+// by all matrices that share the same tokens (e.g. by p_wt and n_wt created with Reshape).
+// As the theta cache (see CacheManager), this class assumes that batch id identifies the content of the batch.
+class BatchTokenIdCache : boost::noncopyable {
+ public:
+  BatchTokenIdCache();
+
+  // Returns the index of each batch token in phi_matrix (PhiMatrix::kUndefIndex if there is no such token).
+  std::shared_ptr<const std::vector<int>> FindTokenIds(const Batch& batch, const PhiMatrix& phi_matrix);
+
+  void Clear();
+  int64_t ByteSize() const;
+  int64_t hit_count() const { return hit_count_; }
+  int64_t miss_count() const { return miss_count_; }
+
+  static std::shared_ptr<std::vector<int>> CalculateTokenIds(const Batch& batch, const PhiMatrix& phi_matrix);
+
+ private:
+  // Each batch keeps the translations for a few latest shape versions (e.g. for p_wt and for r_wt).
+  static const int kMaxVersionsPerBatch = 2;
+
+  // The cache is dropped when it holds more token ids than this
+  static const int64_t kMaxTokenIds = 64 * 1024 * 1024;
+
+  struct Entry {
+    int64_t shape_version;
+    std::shared_ptr<const std::vector<int>> token_id;
+  };
+
+  mutable boost::mutex lock_;
+  std::unordered_map<std::string, std::vector<Entry>> entries_;  // latest versions go first
+  int64_t num_token_ids_;
+  std::atomic<int64_t> hit_count_;
+  std::atomic<int64_t> miss_count_;
+};
+
+}  // namespace core
+}  // namespace artm
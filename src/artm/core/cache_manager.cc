@@ -10,6 +10,7 @@
 #include "artm/core/helpers.h"
 #include "artm/core/instance.h"
 #include "artm/core/dense_phi_matrix.h"
+#include "artm/core/external_matrix_writer.h"
 #include "artm/core/protobuf_helpers.h"
 
 namespace fs = boost::filesystem;
@@ -17,22 +18,73 @@ namespace fs = boost::filesystem;
 namespace artm {
 namespace core {
 
-ThetaCacheEntry::ThetaCacheEntry()
-    : theta_matrix_(std::make_shared<ThetaMatrix>())
-    , filename_() { }
+namespace {
 
-ThetaCacheEntry::~ThetaCacheEntry() {
-  if (!filename_.empty()) {
-    try { fs::remove(fs::path(filename_)); }
-    catch (...) { }
+// Holds the spin lock of a row of ptd matrix (see PhiMatrixFrame::Lock), so that whole rows are read and written
+// concurrently by the processors. Matrices that are not based on PhiMatrixFrame are not locked.
+class PtdRowGuard : boost::noncopyable {
+ public:
+  PtdRowGuard(PhiMatrixFrame* frame, int token_id) : frame_(frame), token_id_(token_id) {
+    if (frame_ != nullptr) {
+      frame_->Lock(token_id_);
+    }
+  }
+
+  ~PtdRowGuard() {
+    if (frame_ != nullptr) {
+      frame_->Unlock(token_id_);
+    }
   }
+
+ private:
+  PhiMatrixFrame* frame_;
+  int token_id_;
+};
+
+PhiMatrixFrame* AsFrame(const std::shared_ptr<const PhiMatrix>& phi_matrix) {
+  return dynamic_cast<PhiMatrixFrame*>(const_cast<PhiMatrix*>(phi_matrix.get()));
 }
 
+}  // namespace
+
+// Removes the folder when the last owner is destroyed; by then the files of all entries are removed.
+class CacheManager::SpillFolder : boost::noncopyable {
+ public:
+  explicit SpillFolder(const std::string& path) : path_(path) { }
+
+  ~SpillFolder() {
+    try { fs::remove(fs::path(path_)); }
+    catch (...) { }
+  }
+
+  const std::string& path() const { return path_; }
+
+ private:
+  std::string path_;
+};
+
 CacheManager::CacheManager(const std::string& disk_path, Instance* instance)
-    : lock_()
+    : ptd_lock_()
     , disk_path_(disk_path)
     , instance_(instance)
-    , cache_() {
+    , cache_()
+    , cache_lock_()
+    , lru_()
+    , lru_slots_()
+    , byte_size_(0)
+    , num_hits_(0)
+    , num_disk_hits_(0)
+    , num_misses_(0)
+    , num_evictions_(0)
+    , spill_folder_() {
+  if (disk_path_.empty()) {
+    boost::uuids::uuid uuid = boost::uuids::random_generator()();
+    fs::path folder("artm_theta_cache_" + boost::lexical_cast<std::string>(uuid));
+    try { folder = fs::temp_directory_path() / folder; }
+    catch (...) { }  // use the current folder
+    spill_folder_ = std::make_shared<SpillFolder>(folder.string());
+  }
+
   Clear();
 }
 
@@ -41,7 +93,14 @@ CacheManager::~CacheManager() {
 }
 
 void CacheManager::Clear() {
-  cache_.clear();
+  {
+    boost::lock_guard<boost::mutex> guard(cache_lock_);
+    cache_.clear();
+    lru_.clear();
+    lru_slots_.clear();
+    byte_size_ = 0;
+  }
+
   std::string ptd_name = (instance_ != nullptr) ? instance_->config()->ptd_name() : std::string();
   if (!ptd_name.empty()) {
     std::shared_ptr<PhiMatrix> ptd(
@@ -59,24 +118,93 @@ void CacheManager::RequestMasterComponentInfo(MasterComponentInfo* master_info)
 
     MasterComponentInfo::CacheEntryInfo* info = master_info->add_cache_entry();
     info->set_key(boost::lexical_cast<std::string>(key));
-    info->set_byte_size(entry->theta_matrix()->ByteSize());
+    info->set_byte_size(entry->ByteSize());
+
+    MasterComponentInfo::ThetaCacheInfo* theta_cache = master_info->mutable_theta_cache();
+    theta_cache->set_num_entries(theta_cache->num_entries() + 1);
+    if (!entry->file_name().empty()) {
+      theta_cache->set_num_disk_entries(theta_cache->num_disk_entries() + 1);
+      theta_cache->set_disk_byte_size(theta_cache->disk_byte_size() + entry->file_size());
+    }
   }
+
+  boost::lock_guard<boost::mutex> guard(cache_lock_);
+  MasterComponentInfo::ThetaCacheInfo* theta_cache = master_info->mutable_theta_cache();
+  theta_cache->set_memory_budget(memory_budget());
+  theta_cache->set_byte_size(byte_size_);
+  theta_cache->set_num_hits(num_hits_);
+  theta_cache->set_num_disk_hits(num_disk_hits_);
+  theta_cache->set_num_misses(num_misses_);
+  theta_cache->set_num_evictions(num_evictions_);
 }
 
-// ToDo(sashafrey): this method has grown too big and complicated.
-// It needs to be refactored.
-static bool PopulateThetaMatrixFromCacheEntry(const ThetaMatrix& cache,
-                                              const GetThetaMatrixArgs& get_theta_args,
-                                              ::artm::ThetaMatrix* theta_matrix) {
+int64_t CacheManager::memory_budget() const {
+  return (instance_ != nullptr) ? instance_->config()->theta_cache_memory_budget() : 0;
+}
+
+std::string CacheManager::disk_folder() const {
+  return disk_path_.empty() ? spill_folder_->path() : disk_path_;
+}
+
+void CacheManager::AddToLru(const std::string& batch_id, const ThetaCacheEntry& entry) const {
+  RemoveFromLru(batch_id);
+  if (!entry.file_name().empty()) {
+    return;  // the entry is already on disk
+  }
+
+  lru_.push_front(batch_id);
+  LruSlot slot = { lru_.begin(), entry.ByteSize() };
+  lru_slots_.insert(std::make_pair(batch_id, slot));
+  byte_size_ += slot.byte_size;
+}
+
+void CacheManager::RemoveFromLru(const std::string& batch_id) const {
+  auto iter = lru_slots_.find(batch_id);
+  if (iter != lru_slots_.end()) {
+    byte_size_ -= iter->second.byte_size;
+    lru_.erase(iter->second.position);
+    lru_slots_.erase(iter);
+  }
+}
+
+std::shared_ptr<ThetaCacheEntry> CacheManager::SaveToDisk(const ThetaCacheEntry& entry) const {
+  boost::uuids::uuid uuid = boost::uuids::random_generator()();
+  fs::path file(fs::path(disk_folder()) / (boost::lexical_cast<std::string>(uuid) + ".cache"));
+  try {
+    Helpers::CreateFolderIfNotExists(disk_folder());
+    entry.Save(file.string());
+    std::shared_ptr<ThetaCacheEntry> disk_entry = ThetaCacheEntry::Load(file.string(), /* remove_file = */ true);
+    if (!disk_path_.empty()) {
+      return disk_entry;
+    }
+
+    // The entry keeps the spill folder; its file is removed before the folder
+    std::shared_ptr<SpillFolder> folder = spill_folder_;
+    auto release = [disk_entry, folder](ThetaCacheEntry*) mutable {  // NOLINT
+      disk_entry.reset();
+      folder.reset();
+    };
+    return std::shared_ptr<ThetaCacheEntry>(disk_entry.get(), release);
+  } catch (...) {
+    LOG(ERROR) << "Unable to save cache entry to " << disk_folder();
+    try { fs::remove(file); }
+    catch (...) { }
+  }
+
+  return nullptr;
+}
+
+// Returns indices of cache topics, requested by GetThetaMatrixArgs.topic_name (all topics by default)
+static std::vector<int> FindTopicsToUse(const ::google::protobuf::RepeatedPtrField< ::std::string>& cache_topic_name,
+                                        const GetThetaMatrixArgs& get_theta_args,
+                                        bool* use_all_topics) {
   auto& args_topic_name = get_theta_args.topic_name();
-  const bool has_sparse_format = get_theta_args.matrix_layout() == MatrixLayout_Sparse;
-  const bool sparse_cache = cache.topic_indices_size() > 0;
-  bool use_all_topics = false;
+  *use_all_topics = false;
 
   std::vector<int> topics_to_use;
   if (args_topic_name.size() != 0) {
     for (int i = 0; i < args_topic_name.size(); ++i) {
-      int topic_index = repeated_field_index_of(cache.topic_name(), args_topic_name.Get(i));
+      int topic_index = repeated_field_index_of(cache_topic_name, args_topic_name.Get(i));
       if (topic_index == -1) {
         std::stringstream ss;
         ss << "GetThetaMatrixArgs.topic_name[" << i << "] == " << args_topic_name.Get(i)
@@ -84,21 +212,28 @@ static bool PopulateThetaMatrixFromCacheEntry(const ThetaMatrix& cache,
         BOOST_THROW_EXCEPTION(artm::core::InvalidOperation(ss.str()));
       }
 
-      assert(topic_index >= 0 && topic_index < cache.topic_name_size());
+      assert(topic_index >= 0 && topic_index < cache_topic_name.size());
       topics_to_use.push_back(topic_index);
     }
   } else {  // use all topics
-    assert(cache.topic_name_size() > 0);
-    for (int i = 0; i < cache.topic_name_size(); ++i) {
+    assert(cache_topic_name.size() > 0);
+    for (int i = 0; i < cache_topic_name.size(); ++i) {
       topics_to_use.push_back(i);
     }
-    use_all_topics = true;
+    *use_all_topics = true;
   }
 
-  // Populate num_topics and topic_name fields in the resulting message
+  return topics_to_use;
+}
+
+// Populates num_topics and topic_name fields in the resulting message,
+// or verifies them if they were populated from the previous cache entry
+static void PopulateTopicNames(const ::google::protobuf::RepeatedPtrField< ::std::string>& cache_topic_name,
+                               const std::vector<int>& topics_to_use,
+                               ::artm::ThetaMatrix* theta_matrix) {
   ::google::protobuf::RepeatedPtrField< ::std::string> result_topic_name;
   for (int topic_index : topics_to_use) {
-    result_topic_name.Add()->assign(cache.topic_name(topic_index));
+    result_topic_name.Add()->assign(cache_topic_name.Get(topic_index));
   }
 
   if (theta_matrix->topic_name_size() == 0) {
@@ -120,53 +255,62 @@ static bool PopulateThetaMatrixFromCacheEntry(const ThetaMatrix& cache,
       }
     }
   }
+}
 
-  bool has_title = (cache.item_title_size() == cache.item_id_size());
-  for (int item_index = 0; item_index < cache.item_id_size(); ++item_index) {
+// Returns the value of the topic in a row of a sparse cache entry, or zero if the row has no such value
+static float FindSparseValue(const ThetaCacheEntry& cache, int item_index, int topic_index) {
+  const int* topic_indices = cache.item_topic_index(item_index);
+  const int value_size = cache.item_value_size(item_index);
+  const int* found = std::find(topic_indices, topic_indices + value_size, topic_index);
+  return (found != topic_indices + value_size) ? cache.item_values(item_index)[found - topic_indices] : 0.0f;
+}
+
+static bool PopulateThetaMatrixFromCacheEntry(const ThetaCacheEntry& cache,
+                                              const GetThetaMatrixArgs& get_theta_args,
+                                              ::artm::ThetaMatrix* theta_matrix) {
+  const bool has_sparse_format = get_theta_args.matrix_layout() == MatrixLayout_Sparse;
+  const bool sparse_cache = cache.sparse();
+  bool use_all_topics = false;
+
+  std::vector<int> topics_to_use = FindTopicsToUse(cache.topic_name(), get_theta_args, &use_all_topics);
+  PopulateTopicNames(cache.topic_name(), topics_to_use, theta_matrix);
+
+  for (int item_index = 0; item_index < cache.item_size(); ++item_index) {
     theta_matrix->add_item_id(cache.item_id(item_index));
-    if (has_title) {
-      theta_matrix->add_item_title(cache.item_title(item_index));
-    }
+    theta_matrix->add_item_title(cache.item_title(item_index).data(), cache.item_title(item_index).size());
     ::artm::FloatArray* theta_vec = theta_matrix->add_item_weights();
 
-    const artm::FloatArray& item_theta = cache.item_weights(item_index);
+    const float* item_theta = cache.item_values(item_index);
     if (!has_sparse_format) {
+      theta_vec->mutable_value()->Reserve(static_cast<int>(topics_to_use.size()));
       if (sparse_cache) {
         // dense output -- sparse cache
-        for (unsigned index = 0; index < topics_to_use.size(); ++index) {
-          int topic_index = repeated_field_index_of(cache.topic_indices(item_index).value(), topics_to_use[index]);
-          theta_vec->add_value(topic_index != -1 ? item_theta.value(topic_index) : 0.0f);
+        for (int topic_index : topics_to_use) {
+          theta_vec->add_value(FindSparseValue(cache, item_index, topic_index));
         }
       } else {
         // dense output -- dense cache
         for (int topic_index : topics_to_use) {
-          theta_vec->add_value(item_theta.value(topic_index));
+          theta_vec->add_value(item_theta[topic_index]);
         }
       }
     } else {
       ::artm::IntArray* sparse_topic_indices = theta_matrix->add_topic_indices();
       if (sparse_cache) {
         // sparse output -- sparse cache
-        for (int index = 0; index < cache.topic_indices(item_index).value_size(); ++index) {
-          int topic_index = cache.topic_indices(item_index).value(index);
-          if (use_all_topics) {
-            theta_vec->add_value(item_theta.value(index));
+        const int* topic_indices = cache.item_topic_index(item_index);
+        for (int index = 0; index < cache.item_value_size(item_index); ++index) {
+          int topic_index = topic_indices[index];
+          if (use_all_topics ||
+              std::find(topics_to_use.begin(), topics_to_use.end(), topic_index) != topics_to_use.end()) {
+            theta_vec->add_value(item_theta[index]);
             sparse_topic_indices->add_value(topic_index);
-          } else {
-            for (unsigned i = 0; i < topics_to_use.size(); ++i) {
-              if (topics_to_use[i] == topic_index) {
-                theta_vec->add_value(item_theta.value(index));
-                sparse_topic_indices->add_value(topic_index);
-                break;
-              }
-            }
           }
         }
       } else {
         // sparse output -- dense cache
         for (unsigned index = 0; index < topics_to_use.size(); index++) {
-          int topic_index = topics_to_use[index];
-          float value = item_theta.value(topic_index);
+          float value = item_theta[topics_to_use[index]];
           if (value >= get_theta_args.eps()) {
             theta_vec->add_value(value);
             sparse_topic_indices->add_value(index);
@@ -179,24 +323,77 @@ static bool PopulateThetaMatrixFromCacheEntry(const ThetaMatrix& cache,
   return true;
 }
 
+// Writes a row of a dense cache entry (or of ptd matrix), following the rules of PopulateThetaMatrixFromCacheEntry
+static void WriteDenseCacheRow(const float* item_theta, const std::vector<int>& topics_to_use,
+                               const GetThetaMatrixArgs& get_theta_args, ExternalMatrixWriter* writer) {
+  if (!writer->sparse()) {
+    for (int topic_index : topics_to_use) {
+      writer->AddValue(item_theta[topic_index]);
+    }
+  } else {
+    for (unsigned index = 0; index < topics_to_use.size(); index++) {
+      float value = item_theta[topics_to_use[index]];
+      if (value >= get_theta_args.eps()) {
+        writer->AddValue(index, value);
+      }
+    }
+  }
+}
+
+// Writes the values of a cache entry, following the rules of PopulateThetaMatrixFromCacheEntry.
+// When the writer is counting the values the rows are also added to 'theta_matrix' (without item_weights).
+static void WriteCacheEntry(const ThetaCacheEntry& cache,
+                            const std::vector<int>& topics_to_use, bool use_all_topics,
+                            const GetThetaMatrixArgs& get_theta_args,
+                            ExternalMatrixWriter* writer,
+                            ::artm::ThetaMatrix* theta_matrix) {
+  const bool sparse_cache = cache.sparse();
+  for (int item_index = 0; item_index < cache.item_size(); ++item_index) {
+    const float* item_theta = cache.item_values(item_index);
+    if (!writer->needs_values()) {
+      writer->SkipValues(static_cast<int>(topics_to_use.size()));
+    } else if (!sparse_cache) {
+      WriteDenseCacheRow(item_theta, topics_to_use, get_theta_args, writer);
+    } else if (!writer->sparse()) {
+      // dense output -- sparse cache
+      for (int topic_index : topics_to_use) {
+        writer->AddValue(FindSparseValue(cache, item_index, topic_index));
+      }
+    } else {
+      // sparse output -- sparse cache
+      const int* topic_indices = cache.item_topic_index(item_index);
+      for (int index = 0; index < cache.item_value_size(item_index); ++index) {
+        int topic_index = topic_indices[index];
+        if (use_all_topics ||
+            std::find(topics_to_use.begin(), topics_to_use.end(), topic_index) != topics_to_use.end()) {
+          writer->AddValue(topic_index, item_theta[index]);
+        }
+      }
+    }
+
+    if (writer->EndRow() && writer->counting()) {
+      theta_matrix->add_item_id(cache.item_id(item_index));
+      theta_matrix->add_item_title(cache.item_title(item_index).data(), cache.item_title(item_index).size());
+    }
+  }
+}
+
 void CacheManager::RequestThetaMatrix(const GetThetaMatrixArgs& get_theta_args,
                                       ::artm::ThetaMatrix* theta_matrix) const {
   std::string ptd_name = (instance_ != nullptr) ? instance_->config()->ptd_name() : std::string();
   if (!ptd_name.empty()) {
-    boost::lock_guard<boost::mutex> guard(lock_);
+    boost::shared_lock<boost::shared_mutex> guard(ptd_lock_);
     std::shared_ptr<const ::artm::core::PhiMatrix> phi_matrix = instance_->GetPhiMatrixSafe(ptd_name);
-    ThetaMatrix cached_theta;
-    cached_theta.mutable_topic_name()->CopyFrom(phi_matrix->topic_name());
+    PhiMatrixFrame* frame = AsFrame(phi_matrix);
+    ThetaCacheEntry cached_theta(phi_matrix->topic_name(), /* sparse = */ false);
+    cached_theta.Reserve(phi_matrix->token_size());
     std::vector<float> values; values.resize(phi_matrix->topic_size());
     for (int token_id = 0; token_id < phi_matrix->token_size(); token_id++) {
-      Token token = phi_matrix->token(token_id);
-      cached_theta.add_item_title(token.keyword);
-      cached_theta.add_item_id(-1);  // not available
-      ::artm::FloatArray* item_weights = cached_theta.add_item_weights();
-      phi_matrix->get(token_id, &values);
-      for (int topic_index = 0; topic_index < phi_matrix->topic_size(); topic_index++) {
-        item_weights->add_value(values[topic_index]);
+      {
+        PtdRowGuard row_guard(frame, token_id);
+        phi_matrix->get(token_id, &values);
       }
+      cached_theta.AddItem(-1, phi_matrix->token(token_id).keyword, values.data());  // item id is not available
     }
 
     PopulateThetaMatrixFromCacheEntry(cached_theta, get_theta_args, theta_matrix);
@@ -205,20 +402,84 @@ void CacheManager::RequestThetaMatrix(const GetThetaMatrixArgs& get_theta_args,
 
   auto keys = cache_.keys();
   for (const auto &key : keys) {
-    std::shared_ptr<ThetaMatrix> cached_theta = FindCacheEntry(key);
+    std::shared_ptr<const ThetaCacheEntry> cached_theta = FindCacheEntry(key);
     if (cached_theta != nullptr) {
       PopulateThetaMatrixFromCacheEntry(*cached_theta, get_theta_args, theta_matrix);
     }
   }
 }
 
-std::shared_ptr<ThetaMatrix> CacheManager::FindCacheEntry(const Batch& batch) const {
+void CacheManager::RequestThetaMatrix(const GetThetaMatrixArgs& get_theta_args,
+                                      ::artm::ThetaMatrix* theta_matrix,
+                                      int64_t address_length, char* address) const {
+  const bool sparse = get_theta_args.matrix_layout() == MatrixLayout_Sparse;
+  std::string ptd_name = (instance_ != nullptr) ? instance_->config()->ptd_name() : std::string();
+  if (!ptd_name.empty()) {
+    boost::shared_lock<boost::shared_mutex> guard(ptd_lock_);
+    std::shared_ptr<const ::artm::core::PhiMatrix> phi_matrix = instance_->GetPhiMatrixSafe(ptd_name);
+    PhiMatrixFrame* frame = AsFrame(phi_matrix);
+    bool use_all_topics = false;
+    std::vector<int> topics_to_use = FindTopicsToUse(phi_matrix->topic_name(), get_theta_args, &use_all_topics);
+    PopulateTopicNames(phi_matrix->topic_name(), topics_to_use, theta_matrix);
+
+    std::vector<float> values(phi_matrix->topic_size());
+    auto write_rows = [&](ExternalMatrixWriter* writer) {
+      for (int token_id = 0; token_id < phi_matrix->token_size(); token_id++) {
+        if (writer->needs_values()) {
+          {
+            PtdRowGuard row_guard(frame, token_id);
+            phi_matrix->get(token_id, &values);
+          }
+          WriteDenseCacheRow(values.data(), topics_to_use, get_theta_args, writer);
+        } else {
+          writer->SkipValues(static_cast<int>(topics_to_use.size()));
+        }
+
+        if (writer->EndRow() && writer->counting()) {
+          theta_matrix->add_item_title(phi_matrix->token(token_id).keyword);
+          theta_matrix->add_item_id(-1);  // not available
+        }
+      }
+    };
+
+    theta_matrix->set_num_values(ExternalMatrixWriter::Write(sparse, address_length, address, write_rows));
+    return;
+  }
+
+  // Entries are looked up only once for both passes of the writer
+  std::vector<std::shared_ptr<const ThetaCacheEntry>> entries;
+  std::vector<std::vector<int>> topics_to_use;
+  std::vector<bool> use_all_topics;
+  for (const auto &key : cache_.keys()) {
+    std::shared_ptr<const ThetaCacheEntry> cached_theta = FindCacheEntry(key);
+    if (cached_theta == nullptr) {
+      continue;
+    }
+
+    bool use_all_entry_topics = false;
+    entries.push_back(cached_theta);
+    topics_to_use.push_back(FindTopicsToUse(cached_theta->topic_name(), get_theta_args, &use_all_entry_topics));
+    use_all_topics.push_back(use_all_entry_topics);
+    PopulateTopicNames(cached_theta->topic_name(), topics_to_use.back(), theta_matrix);
+  }
+
+  auto write_rows = [&](ExternalMatrixWriter* writer) {
+    for (unsigned i = 0; i < entries.size(); ++i) {
+      WriteCacheEntry(*entries[i], topics_to_use[i], use_all_topics[i], get_theta_args, writer, theta_matrix);
+    }
+  };
+
+  theta_matrix->set_num_values(ExternalMatrixWriter::Write(sparse, address_length, address, write_rows));
+}
+
+std::shared_ptr<const ThetaCacheEntry> CacheManager::FindCacheEntry(const Batch& batch) const {
   std::string ptd_name = (instance_ != nullptr) ? instance_->config()->ptd_name() : std::string();
   if (!ptd_name.empty()) {
-    boost::lock_guard<boost::mutex> guard(lock_);
+    boost::shared_lock<boost::shared_mutex> guard(ptd_lock_);
     std::shared_ptr<const ::artm::core::PhiMatrix> phi_matrix = instance_->GetPhiMatrixSafe(ptd_name);
-    auto cached_theta = std::make_shared<ThetaMatrix>();
-    cached_theta->mutable_topic_name()->CopyFrom(phi_matrix->topic_name());
+    PhiMatrixFrame* frame = AsFrame(phi_matrix);
+    auto cached_theta = std::make_shared<ThetaCacheEntry>(phi_matrix->topic_name(), /* sparse = */ false);
+    cached_theta->Reserve(batch.item_size());
     std::vector<float> values; values.resize(phi_matrix->topic_size());
     for (int item_id = 0; item_id < batch.item_size(); item_id++) {
       Token token(DocumentsClass, batch.item(item_id).title());
@@ -232,84 +493,145 @@ std::shared_ptr<ThetaMatrix> CacheManager::FindCacheEntry(const Batch& batch) co
         continue;
       }
 
-      cached_theta->add_item_title(batch.item(item_id).title());
-      cached_theta->add_item_id(batch.item(item_id).id());
-      ::artm::FloatArray* item_weights = cached_theta->add_item_weights();
-      phi_matrix->get(token_index, &values);
-      for (int topic_index = 0; topic_index < phi_matrix->topic_size(); topic_index++) {
-        item_weights->add_value(values[topic_index]);
+      {
+        PtdRowGuard row_guard(frame, token_index);
+        phi_matrix->get(token_index, &values);
       }
+      cached_theta->AddItem(batch.item(item_id).id(), batch.item(item_id).title(), values.data());
     }
 
     return cached_theta;
   }
 
-  return FindCacheEntry(batch.id());
-}
-
-std::shared_ptr<ThetaMatrix> CacheManager::FindCacheEntry(const std::string& batch_id) const {
-  std::shared_ptr<ThetaCacheEntry> retval = cache_.get(batch_id);
-  if (retval == nullptr) {
-    return nullptr;
-  }
-  if (retval->filename().empty()) {
-    return retval->theta_matrix();
+  std::shared_ptr<const ThetaCacheEntry> entry = FindCacheEntry(batch.id());
+  boost::lock_guard<boost::mutex> guard(cache_lock_);
+  if (entry == nullptr) {
+    num_misses_++;
+  } else if (!entry->file_name().empty()) {
+    num_disk_hits_++;
+  } else {
+    num_hits_++;
+    auto iter = lru_slots_.find(batch.id());
+    if (iter != lru_slots_.end()) {
+      lru_.splice(lru_.begin(), lru_, iter->second.position);
+    }
   }
 
-  try {
-    std::shared_ptr<ThetaMatrix> copy(std::make_shared<ThetaMatrix>());
-    Helpers::LoadMessage(retval->filename(), copy.get());
-    return copy;
-  } catch (...) {
-    LOG(ERROR) << "Unable to reload cache for " << retval->filename();
-  }
+  return entry;
+}
 
-  return nullptr;
+std::shared_ptr<const ThetaCacheEntry> CacheManager::FindCacheEntry(const std::string& batch_id) const {
+  return cache_.get(batch_id);
 }
 
-void CacheManager::UpdateCacheEntry(const std::string& batch_id, const ThetaMatrix& theta_matrix) const {
+void CacheManager::UpdateCacheEntry(const std::string& batch_id, std::shared_ptr<ThetaCacheEntry> entry) const {
   std::string ptd_name = (instance_ != nullptr) ? instance_->config()->ptd_name() : std::string();
   if (!ptd_name.empty()) {
-    boost::lock_guard<boost::mutex> guard(lock_);
     std::shared_ptr<const ::artm::core::PhiMatrix> phi_matrix = instance_->GetPhiMatrixSafe(ptd_name);
     PhiMatrix* mutable_phi_matrix = const_cast<PhiMatrix*>(phi_matrix.get());
-    for (int i = 0; i < theta_matrix.item_title_size(); i++) {
-      Token token(DocumentsClass, theta_matrix.item_title(i));
-      int token_id = phi_matrix->token_index(token);
-      if (token_id < 0) {
-        token_id = mutable_phi_matrix->AddToken(token);
+    PhiMatrixFrame* frame = AsFrame(phi_matrix);
+
+    // Documents are looked up under a shared lock, and ptd_lock_ is only acquired exclusively
+    // when some of the documents are new (adding tokens may reallocate the rows of the matrix).
+    std::vector<Token> tokens;
+    std::vector<int> token_ids;
+    tokens.reserve(entry->item_size());
+    token_ids.reserve(entry->item_size());
+    bool has_new_tokens = false;
+    {
+      boost::shared_lock<boost::shared_mutex> guard(ptd_lock_);
+      for (int i = 0; i < entry->item_size(); i++) {
+        tokens.push_back(Token(DocumentsClass, entry->item_title(i).to_string()));
+        token_ids.push_back(phi_matrix->token_index(tokens.back()));
+        has_new_tokens = has_new_tokens || (token_ids.back() < 0);
       }
-      for (int topic_index = 0; topic_index < theta_matrix.topic_name_size(); topic_index++) {
-        mutable_phi_matrix->set(token_id, topic_index, theta_matrix.item_weights(i).value(topic_index));
+    }
+
+    if (has_new_tokens) {
+      boost::unique_lock<boost::shared_mutex> guard(ptd_lock_);
+      for (int i = 0; i < entry->item_size(); i++) {
+        if (token_ids[i] < 0) {
+          token_ids[i] = mutable_phi_matrix->AddToken(tokens[i]);
+        }
+      }
+    }
+
+    // Each row is written as a whole, so that it is packed only once.
+    // Dense entries without the topics of the matrix (e.g. with predict_class_id) only add the documents.
+    if (!entry->sparse() && entry->topic_size() != phi_matrix->topic_size()) {
+      return;
+    }
+
+    boost::shared_lock<boost::shared_mutex> guard(ptd_lock_);
+    std::vector<float> values(phi_matrix->topic_size(), 0.0f);
+    for (int i = 0; i < entry->item_size(); i++) {
+      const float* item_values = entry->item_values(i);
+      if (entry->sparse()) {
+        std::fill(values.begin(), values.end(), 0.0f);
+        for (int index = 0; index < entry->item_value_size(i); index++) {
+          values[entry->item_topic_index(i)[index]] = item_values[index];
+        }
+      } else {
+        std::copy(item_values, item_values + values.size(), values.begin());
       }
+
+      PtdRowGuard row_guard(frame, token_ids[i]);
+      mutable_phi_matrix->set(token_ids[i], values);
     }
     return;
   }
 
-  std::shared_ptr<ThetaCacheEntry> new_entry(std::make_shared<ThetaCacheEntry>());
-  if (disk_path_.empty()) {
-    new_entry->theta_matrix()->CopyFrom(theta_matrix);
-  } else {
-    boost::uuids::uuid uuid = boost::uuids::random_generator()();
-    fs::path file(boost::lexical_cast<std::string>(uuid) + ".cache");
-    try {
-      Helpers::SaveMessage(file.string(), disk_path_, theta_matrix);
-      new_entry->mutable_filename()->assign((fs::path(disk_path_) / file).string());
-    } catch (...) {
-      LOG(ERROR) << "Unable to save cache entry to " << disk_path_;
-      cache_.set(batch_id, nullptr);
-      return;
+  const int64_t budget = memory_budget();
+  if (budget <= 0 && !disk_path_.empty()) {
+    std::shared_ptr<ThetaCacheEntry> disk_entry = SaveToDisk(*entry);
+    boost::lock_guard<boost::mutex> guard(cache_lock_);
+    cache_.set(batch_id, disk_entry);
+    RemoveFromLru(batch_id);
+    return;
+  }
+
+  // Least recently used entries over the budget are removed from the LRU list under the lock,
+  // and then written to disk without holding it
+  std::vector<std::pair<std::string, std::shared_ptr<ThetaCacheEntry>>> victims;
+  {
+    boost::lock_guard<boost::mutex> guard(cache_lock_);
+    cache_.set(batch_id, entry);
+    AddToLru(batch_id, *entry);
+    while (budget > 0 && byte_size_ > budget && !lru_.empty()) {
+      const std::string victim_id = lru_.back();
+      victims.push_back(std::make_pair(victim_id, cache_.get(victim_id)));
+      RemoveFromLru(victim_id);
     }
   }
 
-  cache_.set(batch_id, new_entry);
+  for (auto& victim : victims) {
+    std::shared_ptr<ThetaCacheEntry> disk_entry = SaveToDisk(*victim.second);
+    boost::lock_guard<boost::mutex> guard(cache_lock_);
+    if (cache_.get(victim.first) != victim.second) {
+      continue;  // the entry has been replaced or removed in the meantime
+    }
+
+    if (disk_entry != nullptr) {
+      cache_.set(victim.first, disk_entry);
+      num_evictions_++;
+    } else {
+      AddToLru(victim.first, *victim.second);  // keep the entry in memory
+    }
+  }
 }
 
 void CacheManager::CopyFrom(const CacheManager& cache_manager) {
   disk_path_ = cache_manager.disk_path_;
   auto keys = cache_manager.cache_.keys();
+  boost::lock_guard<boost::mutex> guard(cache_lock_);
   for (const auto& key : keys) {
-    cache_.set(key, cache_manager.cache_.get(key));
+    std::shared_ptr<ThetaCacheEntry> entry = cache_manager.cache_.get(key);
+    cache_.set(key, entry);
+    if (entry != nullptr) {
+      AddToLru(key, *entry);
+    } else {
+      RemoveFromLru(key);
+    }
   }
 }
 
@@ -3,15 +3,20 @@
 #pragma once
 
 #include <algorithm>
+#include <list>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "boost/thread/locks.hpp"
 #include "boost/thread/mutex.hpp"
+#include "boost/thread/shared_mutex.hpp"
 #include "boost/utility.hpp"
 
 #include "artm/core/common.h"
+#include "artm/core/theta_cache_entry.h"
 #include "artm/core/thread_safe_holder.h"
 
 namespace artm {
@@ -19,20 +24,6 @@ namespace core {
 
 class Instance;
 
-class ThetaCacheEntry : boost::noncopyable {
- public:
-  ThetaCacheEntry();
-  ~ThetaCacheEntry();
-
-  std::shared_ptr<ThetaMatrix> theta_matrix() { return theta_matrix_; }
-  const std::string& filename() const { return filename_; }
-  std::string* mutable_filename() { return &filename_; }
-
- private:
-  std::shared_ptr<ThetaMatrix> theta_matrix_;
-  std::string filename_;
-};
-
 // CacheManager class is responsible for caching ThetaMatrix in between calls to different APIs.
 // This class is used when the user calls FitOffline / FitOnline / Transfor to store the resulting theta matrix.
 // (at least when theta_matrix_type is set to ThetaMatrixType_Cache).
@@ -41,16 +32,20 @@ class ThetaCacheEntry : boost::noncopyable {
 // The key in the cache corresponds to 'batch.id' field.
 //
 // CacheManager can also store the cache as a PhiMatrix.
-// Note that this mode might be slower due to lock/guards that prevent several threads
-// from calling PhiMatrix::AddToken simultaneously (on the same phi matrix).
+// In this mode the rows of the matrix are read and written as a whole under the striped spin locks
+// of the matrix (see PhiMatrixFrame::Lock), and ptd_lock_ is only acquired exclusively
+// to add new documents with PhiMatrix::AddToken.
 // This mode is activated by setting a non-empty MasterModelConfig.ptd_name, indicating a name of ptd matrix.
 // To have access to phi matrices CacheManager stores a pointer to the Instance object.
 // These are the three "modus operandi" options for CacheManager:
 // - disk_path is empty, instance is nullptr --- caching happens in CacheManager::cache_
 // - disk_path is not empty, instance is nullptr --- caching happens in CacheManager::cache_,
-//   but the actual entries are stored on disk
+//   but the actual entries are stored on disk (and mapped into memory, see ThetaCacheEntry::Load)
 // - instance is not nullptr and ptd_name is not empty --- chaching happens in PhiMatrix named as ptd_name.
 //   (in this case disk_path is ignored).
+// With a non-zero MasterModelConfig.theta_cache_memory_budget entries are first kept in memory,
+// and once their size exceeds the budget the least recently used entries are evicted to disk
+// (to disk_path, or to a temporary folder when disk_path is empty).
 class CacheManager : boost::noncopyable {
  public:
   explicit CacheManager(const std::string& disk_path, Instance* instance);
@@ -60,17 +55,57 @@ class CacheManager : boost::noncopyable {
   void Clear();
   void RequestThetaMatrix(const GetThetaMatrixArgs& get_theta_args,
                           ::artm::ThetaMatrix* theta_matrix) const;
-  std::shared_ptr<ThetaMatrix> FindCacheEntry(const Batch& batch) const;
-  void UpdateCacheEntry(const std::string& batch_id, const ThetaMatrix& theta_matrix) const;
+
+  // Writes the values of theta matrix straight into a caller-provided buffer (see ExternalMatrixWriter),
+  // without creating item_weights in 'theta_matrix'. Zero address_length only requests the size (num_values).
+  void RequestThetaMatrix(const GetThetaMatrixArgs& get_theta_args,
+                          ::artm::ThetaMatrix* theta_matrix,
+                          int64_t address_length, char* address) const;
+  // Finds the entry to reuse theta of the batch (counted as a hit or a miss in ThetaCacheInfo).
+  std::shared_ptr<const ThetaCacheEntry> FindCacheEntry(const Batch& batch) const;
+
+  // Stores the entry of the batch. The entry must not be modified after it is cached;
+  // with disk_path (and no memory budget) the entry is written to disk, and the cache keeps the mapped file instead.
+  void UpdateCacheEntry(const std::string& batch_id, std::shared_ptr<ThetaCacheEntry> entry) const;
   void CopyFrom(const CacheManager& cache_manager);
 
  private:
-  mutable boost::mutex lock_;
+  mutable boost::shared_mutex ptd_lock_;
   std::string disk_path_;
   Instance* instance_;
   mutable ThreadSafeCollectionHolder<std::string, ThetaCacheEntry> cache_;
 
-  std::shared_ptr<ThetaMatrix> FindCacheEntry(const std::string& batch_id) const;
+  struct LruSlot {
+    std::list<std::string>::iterator position;
+    int64_t byte_size;
+  };
+
+  // Entries in memory, ordered from the most to the least recently used, and the counters of ThetaCacheInfo.
+  // All changes of cache_ happen under cache_lock_, so that an evicted entry can not replace a newer one.
+  mutable boost::mutex cache_lock_;
+  mutable std::list<std::string> lru_;
+  mutable std::unordered_map<std::string, LruSlot> lru_slots_;
+  mutable int64_t byte_size_;
+  mutable int64_t num_hits_;
+  mutable int64_t num_disk_hits_;
+  mutable int64_t num_misses_;
+  mutable int64_t num_evictions_;
+
+  // Folder for the evicted entries when disk_path is empty. The evicted entries share the folder,
+  // so it is removed only after the last of them, even when they outlive CacheManager (see CopyFrom).
+  class SpillFolder;
+  std::shared_ptr<SpillFolder> spill_folder_;
+
+  std::shared_ptr<const ThetaCacheEntry> FindCacheEntry(const std::string& batch_id) const;
+  int64_t memory_budget() const;
+  std::string disk_folder() const;
+
+  // Writes the entry to disk and returns the mapped entry, or nullptr if the entry can not be written.
+  std::shared_ptr<ThetaCacheEntry> SaveToDisk(const ThetaCacheEntry& entry) const;
+
+  // These functions require cache_lock_ to be acquired.
+  void AddToLru(const std::string& batch_id, const ThetaCacheEntry& entry) const;
+  void RemoveFromLru(const std::string& batch_id) const;
 };
 
 }  // namespace core
@@ -0,0 +1,73 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#include "artm/core/class_id_registry.h"
+
+#include <utility>
+
+#include "boost/thread/locks.hpp"
+
+namespace artm {
+namespace core {
+
+const int ClassIdRegistry::kUndefIndex;
+
+int ClassIdRegistry::Register(const ClassId& class_id) {
+  boost::lock_guard<boost::mutex> guard(lock_);
+  auto iter = class_id_to_index_.find(class_id);
+  if (iter != class_id_to_index_.end()) {
+    return iter->second;
+  }
+
+  const int class_index = static_cast<int>(class_ids_.size());
+  class_ids_.push_back(class_id);
+  class_id_to_index_.insert(std::make_pair(class_id, class_index));
+  return class_index;
+}
+
+int ClassIdRegistry::Find(const ClassId& class_id) const {
+  boost::lock_guard<boost::mutex> guard(lock_);
+  auto iter = class_id_to_index_.find(class_id);
+  return (iter == class_id_to_index_.end()) ? kUndefIndex : iter->second;
+}
+
+ClassId ClassIdRegistry::class_id(int class_index) const {
+  boost::lock_guard<boost::mutex> guard(lock_);
+  return class_ids_[class_index];
+}
+
+int ClassIdRegistry::size() const {
+  boost::lock_guard<boost::mutex> guard(lock_);
+  return static_cast<int>(class_ids_.size());
+}
+
+ClassWeights::ClassWeights(const ProcessBatchesArgs& args) : use_all_classes_(true), weight_(), is_set_() {
+  for (int i = 0; i < args.class_id_size(); ++i) {
+    Add(args.class_id(i), args.class_weight(i));
+  }
+}
+
+void ClassWeights::Add(const ClassId& class_id, float weight) {
+  use_all_classes_ = false;
+  const int class_index = ClassIdRegistry::singleton().Register(class_id);
+  if (class_index >= static_cast<int>(weight_.size())) {
+    weight_.resize(class_index + 1, 0.0f);
+    is_set_.resize(class_index + 1, false);
+  }
+
+  if (!is_set_[class_index]) {
+    weight_[class_index] = weight;
+    is_set_[class_index] = true;
+  }
+}
+
+std::vector<float> ClassWeights::token_weights(const Batch& batch) const {
+  std::vector<int> class_index = ClassIdRegistry::singleton().FindAll(batch.class_id());
+  std::vector<float> retval(class_index.size(), 1.0f);
+  for (int token_index = 0; token_index < static_cast<int>(class_index.size()); ++token_index) {
+    retval[token_index] = weight(class_index[token_index]);
+  }
+  return retval;
+}
+
+}  // namespace core
+}  // namespace artm
@@ -0,0 +1,125 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#pragma once
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "boost/thread/mutex.hpp"
+#include "boost/utility.hpp"
+
+#include "artm/core/common.h"
+#include "artm/core/token.h"
+
+namespace artm {
+namespace core {
+
+// ClassIdRegistry assigns small sequential indices 0, 1, 2, ... to class ids (modalities).
+// Phi matrices keep the class index of each token (see PhiMatrix::class_index), so that the hot loops
+// can keep per-class data (weights, normalizers, filters) in arrays instead of maps keyed by ClassId.
+// The registry is shared by all master components (as ThreadSafeDictionaryCollection),
+// so that class indices of different matrices can be compared. Class ids are never removed.
+class ClassIdRegistry : boost::noncopyable {
+ public:
+  static const int kUndefIndex = -1;
+
+  static ClassIdRegistry& singleton() {
+    // Mayers singleton is thread safe in C++11
+    static ClassIdRegistry registry;
+    return registry;
+  }
+
+  // Returns the index of the class id, registering it if needed.
+  int Register(const ClassId& class_id);
+
+  // Returns the index of the class id, or kUndefIndex if it was never registered.
+  int Find(const ClassId& class_id) const;
+
+  ClassId class_id(int class_index) const;
+  int size() const;
+
+  // Returns the class index of each element of a sequence of class ids (e.g. Batch.class_id).
+  // Consecutive tokens usually share the class id, so the registry is only looked up once per run.
+  template<class T>
+  std::vector<int> FindAll(const T& class_ids) const {
+    std::vector<int> retval;
+    retval.reserve(class_ids.size());
+    const ClassId* last_class_id = nullptr;
+    for (const ClassId& class_id : class_ids) {
+      if (last_class_id == nullptr || *last_class_id != class_id) {
+        retval.push_back(Find(class_id));
+        last_class_id = &class_id;
+      } else {
+        retval.push_back(retval.back());
+      }
+    }
+    return retval;
+  }
+
+ private:
+  ClassIdRegistry() { }
+
+  mutable boost::mutex lock_;
+  std::unordered_map<ClassId, int> class_id_to_index_;
+  std::deque<ClassId> class_ids_;
+};
+
+// ClassIdSet is a set of class ids, tested by class index.
+// An empty list of class ids means all classes (as in configs of regularizers and scores).
+class ClassIdSet {
+ public:
+  ClassIdSet() : use_all_classes_(true), is_member_() { }
+
+  template<class T>
+  explicit ClassIdSet(const T& class_ids) : use_all_classes_(class_ids.size() == 0), is_member_() {
+    for (const ClassId& class_id : class_ids) {
+      const int class_index = ClassIdRegistry::singleton().Register(class_id);
+      if (class_index >= static_cast<int>(is_member_.size())) {
+        is_member_.resize(class_index + 1, false);
+      }
+      is_member_[class_index] = true;
+    }
+  }
+
+  bool use_all_classes() const { return use_all_classes_; }
+  bool contains(int class_index) const {
+    return use_all_classes_ ||
+           (class_index >= 0 && class_index < static_cast<int>(is_member_.size()) && is_member_[class_index]);
+  }
+
+ private:
+  bool use_all_classes_;
+  std::vector<bool> is_member_;
+};
+
+// ClassWeights keeps the weights of classes, e.g. given by class_id and class_weight fields of ProcessBatchesArgs.
+// Classes that are not listed have zero weight; if no classes are listed, all classes have weight 1.
+class ClassWeights {
+ public:
+  ClassWeights() : use_all_classes_(true), weight_(), is_set_() { }
+  explicit ClassWeights(const ProcessBatchesArgs& args);
+
+  // Sets the weight of the class, unless it was already set.
+  void Add(const ClassId& class_id, float weight);
+
+  bool use_all_classes() const { return use_all_classes_; }
+  float weight(int class_index) const {
+    if (use_all_classes_) {
+      return 1.0f;
+    }
+    return (class_index >= 0 && class_index < static_cast<int>(weight_.size())) ? weight_[class_index] : 0.0f;
+  }
+
+  // Returns the weight of each token of the batch.
+  std::vector<float> token_weights(const Batch& batch) const;
+
+ private:
+  bool use_all_classes_;
+  std::vector<float> weight_;
+  std::vector<bool> is_set_;
+};
+
+}  // namespace core
+}  // namespace artm
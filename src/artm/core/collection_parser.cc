@@ -26,11 +26,13 @@
 #include "artm/utility/ifstream_or_cin.h"
 #include "artm/utility/progress_printer.h"
 
+#include "artm/core/columnar_batch.h"
 #include "artm/core/cooccurrence_collector.h"
 #include "artm/core/common.h"
 #include "artm/core/exceptions.h"
 #include "artm/core/helpers.h"
 #include "artm/core/protobuf_helpers.h"
+#include "artm/core/token_index.h"
 #include "artm/core/transaction_type.h"
 
 using ::artm::utility::ifstream_or_cin;
@@ -222,7 +224,7 @@ CollectionParserInfo CollectionParser::ParseDocwordBagOfWordsUci(TokenMap* token
       if (batch.item_size() >= config_.num_items_per_batch()) {
         batch.set_id(boost::lexical_cast<std::string>(boost::uuids::random_generator()()));
         batch.add_transaction_typename(DefaultTransactionTypeName);
-        ::artm::core::Helpers::SaveBatch(batch, config_.target_folder(), batch_name_generator.next_name(batch));
+        SaveBatch(batch, config_, batch_name_generator.next_name(batch));
         num_batches++;
         batch.Clear();
         batch_dictionary.clear();
@@ -272,7 +274,7 @@ CollectionParserInfo CollectionParser::ParseDocwordBagOfWordsUci(TokenMap* token
 
     batch.set_id(boost::lexical_cast<std::string>(boost::uuids::random_generator()()));
     batch.add_transaction_typename(DefaultTransactionTypeName);
-    ::artm::core::Helpers::SaveBatch(batch, config_.target_folder(), batch_name_generator.next_name(batch));
+    SaveBatch(batch, config_, batch_name_generator.next_name(batch));
     num_batches++;
   }
 
@@ -306,7 +308,7 @@ CollectionParser::TokenMap CollectionParser::ParseVocabBagOfWordsUci() {
   ifstream_or_cin stream_or_cin(config_.vocab_file_path());
   std::istream& vocab = stream_or_cin.get_stream();
 
-  std::unordered_map<Token, int, TokenHasher> token_to_token_id;
+  TokenIndex token_to_token_id;
 
   TokenMap token_info;
   std::string str;
@@ -334,18 +336,18 @@ CollectionParser::TokenMap CollectionParser::ParseVocabBagOfWordsUci() {
     }
 
     ClassId class_id = (strs.size() == 2) ? strs[1] : DefaultClass;
-    Token token(class_id, strs[0]);
 
-    if (token_to_token_id.find(token) != token_to_token_id.end()) {
+    // ids of the tokens in token_to_token_id match the line numbers, as duplicates are not allowed
+    const int existing_token_id = token_to_token_id.Add(class_id, strs[0]);
+    if (existing_token_id != token_id) {
       std::stringstream ss;
-      ss << "Token (" << token.keyword << ", " << token.class_id << "' found twice, lines "
-         << (token_to_token_id.find(token)->second + 1)
+      ss << "Token (" << strs[0] << ", " << class_id << "' found twice, lines "
+         << (existing_token_id + 1)
          << " and " << (token_id + 1) << ", file " << config_.vocab_file_path();
       BOOST_THROW_EXCEPTION(InvalidOperation(ss.str()));
     }
 
-    token_info.insert(std::make_pair(token_id, CollectionParserTokenInfo(token.keyword, token.class_id)));
-    token_to_token_id.insert(std::make_pair(token, token_id));
+    token_info.insert(std::make_pair(token_id, CollectionParserTokenInfo(strs[0], class_id)));
     token_id++;
   }
 
@@ -375,8 +377,7 @@ class CollectionParser::BatchCollector {
  private:
   Item *item_;
   Batch batch_;
-  std::unordered_map<Token, int, TokenHasher> local_map_;
-  std::unordered_map<Token, CollectionParserTokenInfo, TokenHasher> global_map_;
+  TokenIndex local_map_;  // ids of the tokens are their indices in batch_
   float total_token_weight_;
   int64_t total_items_count_;
   int64_t total_tokens_count_;
@@ -410,24 +411,14 @@ class CollectionParser::BatchCollector {
     item_->add_transaction_typename_id(id_iter->second);
 
     for (int i = 0; i < class_ids.size(); ++i) {
-      Token token(class_ids[i], tokens[i]);
-
-      if (global_map_.find(token) == global_map_.end()) {
-        global_map_.insert(std::make_pair(token, CollectionParserTokenInfo(token.keyword, token.class_id)));
-      }
-      if (local_map_.find(token) == local_map_.end()) {
-        local_map_.insert(std::make_pair(token, batch_.token_size()));
-        batch_.add_token(token.keyword);
-        batch_.add_class_id(token.class_id);
+      const int local_token_id = local_map_.Add(class_ids[i], tokens[i]);
+      if (local_token_id == batch_.token_size()) {
+        batch_.add_token(tokens[i]);
+        batch_.add_class_id(class_ids[i]);
       }
 
-      CollectionParserTokenInfo& token_info = global_map_[token];
-      int local_token_id = local_map_[token];
-
       item_->add_token_id(local_token_id);
       item_->add_token_weight(token_weights[i]);
-      token_info.items_count++;
-      token_info.token_weight += token_weights[i];
       total_token_weight_ += token_weights[i];
       total_tokens_count_ += 1;
     }
@@ -466,7 +457,7 @@ class CollectionParser::BatchCollector {
 
     Batch batch;
     batch.Swap(&batch_);
-    local_map_.clear();
+    local_map_.Clear();
     tt_name_to_id_.clear();
     return batch;
   }
@@ -496,7 +487,7 @@ CollectionParserInfo CollectionParser::ParseVowpalWabbit() {
 
   int global_line_no = 0;
 
-  std::unordered_map<Token, bool, TokenHasher> token_map;
+  TokenIndex token_map;
   CollectionParserInfo parser_info;
 
   ::artm::core::CooccurrenceCollector cooc_collector(collection_parser_config);
@@ -555,7 +546,7 @@ CollectionParserInfo CollectionParser::ParseVowpalWabbit() {
       // Every pair of valid tokens (e.g. both exist in vocab) is saved in this storage
       // After walking through a batch of documents all the statistics will be dumped to the external storage
       // and then this storage will be destroyed
-      CooccurrenceStatisticsHolder cooc_stat_holder;
+      CooccurrenceStatisticsHolder cooc_stat_holder(&cooc_collector);
       // For every token from vocab keep the information about the last document this token occured in
 
       // ToDo (MichaelSolotky): consider the case if there is no vocab
@@ -738,7 +729,7 @@ CollectionParserInfo CollectionParser::ParseVowpalWabbit() {
         // This is implemented in ReadAndMergeCooccurrenceBatches(), so the next step is to call this method
         // Sorting is needed before storing all pairs of tokens to the external storage
         // (it's for the future aggregation)
-        cooc_collector.UploadOnDisk(cooc_stat_holder);
+        cooc_collector.UploadOnDisk(&cooc_stat_holder);
       }
 
       if (all_strs_for_batch.size() > 0) {
@@ -747,10 +738,10 @@ CollectionParserInfo CollectionParser::ParseVowpalWabbit() {
           std::lock_guard<std::mutex> guard(token_map_access);
           batch = batch_collector.FinishBatch(&parser_info);
           for (int token_id = 0; token_id < batch.token_size(); ++token_id) {
-            token_map[artm::core::Token(batch.class_id(token_id), batch.token(token_id))] = true;
+            token_map.Add(batch.class_id(token_id), batch.token(token_id));
           }
         }
-        ::artm::core::Helpers::SaveBatch(batch, collection_parser_config.target_folder(), batch_name);
+        SaveBatch(batch, collection_parser_config, batch_name);
       }
     }  // End of collection parsing
 
@@ -799,12 +790,27 @@ CollectionParserInfo CollectionParser::ParseVowpalWabbit() {
     if (cooc_collector.NumOfCooccurrenceBatches() != 0) {
       cooc_collector.ReadAndMergeCooccurrenceBatches();
     }
+    parser_info.set_cooc_bytes_spilled(cooc_collector.bytes_spilled());
+    parser_info.set_cooc_peak_memory(cooc_collector.peak_memory());
   }
 
   parser_info.set_dictionary_size(token_map.size());
   return parser_info;
 }
 
+void CollectionParser::SaveBatch(const Batch& batch, const CollectionParserConfig& config, const std::string& name) {
+  if (config.batch_format() == CollectionParserConfig_BatchFormat_Columnar) {
+    if (ColumnarBatch::CanSave(batch)) {
+      ColumnarBatch::Save(batch, config.target_folder(), name);
+      return;
+    }
+
+    LOG(WARNING) << "Batch " << name << " has complex transactions and will be saved in protobuf format";
+  }
+
+  ::artm::core::Helpers::SaveBatch(batch, config.target_folder(), name);
+}
+
 CollectionParserInfo CollectionParser::Parse() {
   TokenMap token_map;
   switch (config_.format()) {
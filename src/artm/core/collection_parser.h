@@ -67,6 +67,9 @@ class CollectionParser : boost::noncopyable {
   TokenMap ParseVocabBagOfWordsUci();
   TokenMap ParseVocabMatrixMarket();
 
+  // Saves batch in the format requested by CollectionParserConfig.batch_format.
+  static void SaveBatch(const Batch& batch, const CollectionParserConfig& config, const std::string& name);
+
   CollectionParserConfig config_;
 };
 
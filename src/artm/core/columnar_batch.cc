@@ -0,0 +1,309 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#include "artm/core/columnar_batch.h"
+
+#include <string.h>
+
+#include <fstream>
+#include <vector>
+
+#include "boost/filesystem.hpp"
+#include "boost/lexical_cast.hpp"
+#include "boost/uuid/uuid_io.hpp"
+
+#include "artm/core/helpers.h"
+#include "artm/core/token.h"
+
+namespace artm {
+namespace core {
+
+namespace {
+
+const char kColumnarBatchMagic[8] = { 'A', 'R', 'T', 'M', 'C', 'B', 'A', 'T' };
+const int kColumnarBatchVersion = 1;
+const int64_t kSectionAlignment = 8;
+
+int64_t AlignOffset(int64_t offset) {
+  return (offset + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+}
+
+template<typename T>
+void WriteSection(std::ofstream* fout, int64_t offset, const std::vector<T>& values) {
+  fout->seekp(offset);
+  if (!values.empty()) {
+    fout->write(reinterpret_cast<const char*>(&values[0]), sizeof(T) * values.size());
+  }
+}
+
+}  // namespace
+
+ColumnarBatch::ColumnarBatch(const std::string& full_filename)
+    : file_(), header_(nullptr), string_index_(nullptr), strings_(nullptr),
+      item_id_(nullptr), row_ptr_(nullptr), token_id_(nullptr), token_weight_(nullptr) {
+  try {
+    file_.open(full_filename);
+  } catch (std::exception& ex) {
+    BOOST_THROW_EXCEPTION(DiskReadException("Unable to open file " + full_filename + ", " + ex.what()));
+  }
+
+  const int64_t file_size = static_cast<int64_t>(file_.size());
+  const char* data = file_.data();
+  auto corrupted = [&full_filename](const std::string& reason) {  // NOLINT
+    BOOST_THROW_EXCEPTION(CorruptedMessageException(
+      "Unable to read columnar batch from " + full_filename + ": " + reason));
+  };
+
+  if (file_size < static_cast<int64_t>(sizeof(ColumnarBatchHeader)) ||
+      memcmp(data, kColumnarBatchMagic, sizeof(kColumnarBatchMagic)) != 0) {
+    corrupted("wrong file signature");
+  }
+
+  header_ = reinterpret_cast<const ColumnarBatchHeader*>(data);
+  if (header_->version != kColumnarBatchVersion) {
+    corrupted("unsupported version " + boost::lexical_cast<std::string>(header_->version));
+  }
+
+  if (header_->file_size != file_size || header_->item_size < 0 || header_->token_size < 0 || header_->nnz < 0) {
+    corrupted("inconsistent header");
+  }
+
+  const int64_t num_strings = 2 + 2 * static_cast<int64_t>(header_->token_size) + header_->item_size;
+  auto check_section = [&](int64_t offset, int64_t size) {  // NOLINT
+    if (offset < static_cast<int64_t>(sizeof(ColumnarBatchHeader)) || offset % kSectionAlignment != 0 ||
+        size < 0 || offset + size > file_size) {
+      corrupted("section is out of file bounds");
+    }
+  };
+
+  check_section(header_->string_index_offset, sizeof(int64_t) * (num_strings + 1));
+  check_section(header_->item_id_offset, sizeof(int32_t) * header_->item_size);
+  check_section(header_->row_ptr_offset, sizeof(int32_t) * (header_->item_size + 1));
+  check_section(header_->token_id_offset, sizeof(int32_t) * header_->nnz);
+  check_section(header_->token_weight_offset, sizeof(float) * header_->nnz);
+
+  string_index_ = reinterpret_cast<const int64_t*>(data + header_->string_index_offset);
+  check_section(header_->string_offset, string_index_[num_strings]);
+  for (int64_t i = 0; i < num_strings; ++i) {
+    if (string_index_[i] < 0 || string_index_[i] > string_index_[i + 1]) {
+      corrupted("invalid string index");
+    }
+  }
+
+  strings_ = data + header_->string_offset;
+  item_id_ = reinterpret_cast<const int*>(data + header_->item_id_offset);
+  row_ptr_ = reinterpret_cast<const int*>(data + header_->row_ptr_offset);
+  token_id_ = reinterpret_cast<const int*>(data + header_->token_id_offset);
+  token_weight_ = reinterpret_cast<const float*>(data + header_->token_weight_offset);
+
+  if (row_ptr_[0] != 0 || row_ptr_[header_->item_size] != header_->nnz) {
+    corrupted("invalid item offsets");
+  }
+
+  for (int item_index = 0; item_index < header_->item_size; ++item_index) {
+    if (row_ptr_[item_index] > row_ptr_[item_index + 1]) {
+      corrupted("invalid item offsets");
+    }
+  }
+
+  for (int i = 0; i < header_->nnz; ++i) {
+    if (token_id_[i] < 0 || token_id_[i] >= header_->token_size) {
+      corrupted("token id is out of range");
+    }
+  }
+}
+
+std::string ColumnarBatch::string(int string_index) const {
+  return std::string(strings_ + string_index_[string_index],
+                     strings_ + string_index_[string_index + 1]);
+}
+
+bool ColumnarBatch::IsColumnarBatch(const std::string& filename) {
+  return boost::filesystem::path(filename).extension() == kColumnarBatchExtension;
+}
+
+bool ColumnarBatch::CanSave(const Batch& batch) {
+  if (batch.transaction_typename_size() > 1 ||
+      (batch.transaction_typename_size() == 1 && batch.transaction_typename(0) != DefaultTransactionTypeName)) {
+    return false;
+  }
+
+  if (batch.class_id_size() != batch.token_size()) {
+    return false;
+  }
+
+  for (const Item& item : batch.item()) {
+    if (item.token_weight_size() != item.token_id_size()) {
+      return false;
+    }
+
+    if (item.transaction_start_index_size() > 0) {
+      if (item.transaction_start_index_size() != item.token_id_size() + 1) {
+        return false;
+      }
+
+      for (int i = 0; i < item.transaction_start_index_size(); ++i) {
+        if (item.transaction_start_index(i) != i) {
+          return false;
+        }
+      }
+    }
+
+    for (int token_id : item.token_id()) {
+      if (token_id < 0 || token_id >= batch.token_size()) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+boost::uuids::uuid ColumnarBatch::Save(const Batch& batch, const std::string& disk_path, const std::string& name) {
+  if (!batch.has_id()) {
+    BOOST_THROW_EXCEPTION(InvalidOperation("ColumnarBatch::Save: batch expecting id"));
+  }
+
+  boost::uuids::uuid uuid;
+  try {
+    uuid = boost::lexical_cast<boost::uuids::uuid>(batch.id());
+  } catch (...) {
+    BOOST_THROW_EXCEPTION(ArgumentOutOfRangeException("Batch.id", batch.id(), "expecting guid"));
+  }
+
+  if (!CanSave(batch)) {
+    BOOST_THROW_EXCEPTION(InvalidOperation(
+      "ColumnarBatch::Save: batch " + batch.id() + " has transactions that can not be stored in columnar format"));
+  }
+
+  std::vector<int64_t> string_index;
+  std::vector<char> strings;
+  auto add_string = [&string_index, &strings](const std::string& value) {  // NOLINT
+    string_index.push_back(static_cast<int64_t>(strings.size()));
+    strings.insert(strings.end(), value.begin(), value.end());
+  };
+
+  add_string(batch.id());
+  add_string(batch.description());
+  for (const std::string& token : batch.token()) {
+    add_string(token);
+  }
+  for (const std::string& class_id : batch.class_id()) {
+    add_string(class_id);
+  }
+  for (const Item& item : batch.item()) {
+    // Items without title get their id as title, the same way as in FixMessage(Batch*)
+    add_string((item.has_title() || !item.has_id()) ? item.title() : boost::lexical_cast<std::string>(item.id()));
+  }
+  string_index.push_back(static_cast<int64_t>(strings.size()));
+
+  std::vector<int32_t> item_id, row_ptr, token_id;
+  std::vector<float> token_weight;
+  row_ptr.push_back(0);
+  for (const Item& item : batch.item()) {
+    item_id.push_back(item.id());
+    token_id.insert(token_id.end(), item.token_id().begin(), item.token_id().end());
+    token_weight.insert(token_weight.end(), item.token_weight().begin(), item.token_weight().end());
+    row_ptr.push_back(static_cast<int32_t>(token_id.size()));
+  }
+
+  ColumnarBatchHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kColumnarBatchMagic, sizeof(kColumnarBatchMagic));
+  header.version = kColumnarBatchVersion;
+  header.item_size = batch.item_size();
+  header.token_size = batch.token_size();
+  header.nnz = static_cast<int32_t>(token_id.size());
+  header.string_index_offset = AlignOffset(sizeof(header));
+  header.string_offset = AlignOffset(header.string_index_offset + sizeof(int64_t) * string_index.size());
+  header.item_id_offset = AlignOffset(header.string_offset + strings.size());
+  header.row_ptr_offset = AlignOffset(header.item_id_offset + sizeof(int32_t) * item_id.size());
+  header.token_id_offset = AlignOffset(header.row_ptr_offset + sizeof(int32_t) * row_ptr.size());
+  header.token_weight_offset = AlignOffset(header.token_id_offset + sizeof(int32_t) * token_id.size());
+  header.file_size = header.token_weight_offset + sizeof(float) * token_weight.size();
+
+  Helpers::CreateFolderIfNotExists(disk_path);
+  boost::filesystem::path full_filename =
+    boost::filesystem::path(disk_path) / boost::filesystem::path(name + kColumnarBatchExtension);
+  if (boost::filesystem::exists(full_filename)) {
+    LOG(WARNING) << "File already exists: " << full_filename.string();
+  }
+
+  std::ofstream fout(full_filename.string().c_str(), std::ofstream::binary);
+  if (!fout.is_open()) {
+    BOOST_THROW_EXCEPTION(DiskWriteException("Unable to create file " + full_filename.string()));
+  }
+
+  // Zero-fill the file first, so that alignment gaps between sections are deterministic
+  std::vector<char> zeros(static_cast<size_t>(header.file_size), 0);
+  fout.write(&zeros[0], zeros.size());
+  fout.seekp(0);
+  fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  WriteSection(&fout, header.string_index_offset, string_index);
+  WriteSection(&fout, header.string_offset, strings);
+  WriteSection(&fout, header.item_id_offset, item_id);
+  WriteSection(&fout, header.row_ptr_offset, row_ptr);
+  WriteSection(&fout, header.token_id_offset, token_id);
+  WriteSection(&fout, header.token_weight_offset, token_weight);
+
+  fout.close();
+  if (fout.fail()) {
+    BOOST_THROW_EXCEPTION(DiskWriteException("Batch has not been serialized to disk."));
+  }
+
+  return uuid;
+}
+
+void ColumnarBatch::ToBatch(Batch* batch, bool include_item_tokens) const {
+  batch->Clear();
+  batch->set_id(id());
+
+  std::string batch_description = description();
+  if (!batch_description.empty()) {
+    batch->set_description(batch_description);
+  }
+
+  for (int token_index = 0; token_index < token_size(); ++token_index) {
+    batch->add_token(token(token_index));
+    batch->add_class_id(class_id(token_index));
+  }
+
+  batch->add_transaction_typename(DefaultTransactionTypeName);
+  for (int item_index = 0; item_index < item_size(); ++item_index) {
+    Item* item = batch->add_item();
+    item->set_id(item_id(item_index));
+
+    std::string title = item_title(item_index);
+    if (!title.empty()) {
+      item->set_title(title);
+    }
+  }
+
+  if (include_item_tokens) {
+    AddItemTokens(batch);
+  }
+}
+
+void ColumnarBatch::AddItemTokens(Batch* batch) const {
+  assert(batch->item_size() == item_size());
+  for (int item_index = 0; item_index < item_size(); ++item_index) {
+    Item* item = batch->mutable_item(item_index);
+    if (item->token_id_size() > 0) {
+      continue;  // tokens had been already added
+    }
+
+    const int begin = row_ptr_[item_index];
+    const int end = row_ptr_[item_index + 1];
+    item->mutable_token_id()->Reserve(end - begin);
+    item->mutable_token_weight()->Reserve(end - begin);
+    for (int i = begin; i < end; ++i) {
+      item->add_token_id(token_id_[i]);
+      item->add_token_weight(token_weight_[i]);
+      item->add_transaction_start_index(i - begin);
+      item->add_transaction_typename_id(0);
+    }
+    item->add_transaction_start_index(end - begin);
+  }
+}
+
+}  // namespace core
+}  // namespace artm
@@ -0,0 +1,87 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+
+#include "boost/iostreams/device/mapped_file.hpp"
+#include "boost/utility.hpp"
+#include "boost/uuid/uuid.hpp"
+
+#include "artm/core/common.h"
+
+namespace artm {
+namespace core {
+
+// Header of the columnar batch file. All offsets are in bytes from the beginning of the file,
+// and each section starts at a multiple of 8 bytes. Integers and floats use native byte order.
+struct ColumnarBatchHeader {
+  char magic[8];
+  int32_t version;
+  int32_t item_size;
+  int32_t token_size;
+  int32_t nnz;
+  int64_t string_index_offset;  // int64_t[kNumStrings + 1], offsets of the strings in the string section
+  int64_t string_offset;        // char[], concatenated strings
+  int64_t item_id_offset;       // int32_t[item_size]
+  int64_t row_ptr_offset;       // int32_t[item_size + 1], CSR offsets of the items
+  int64_t token_id_offset;      // int32_t[nnz]
+  int64_t token_weight_offset;  // float[nnz]
+  int64_t file_size;
+};
+
+// ColumnarBatch class provides read-only access to a batch stored in columnar format.
+// The file is memory-mapped, and the CSR arrays of token ids and token weights
+// are accessed in place, without parsing or copying.
+// Strings are stored in the following order: batch id, batch description, keywords of all tokens,
+// class ids of all tokens, titles of all items.
+// Only batches where each transaction is a single token of the default transaction type
+// can be stored in this format (see CanSave).
+class ColumnarBatch : boost::noncopyable {
+ public:
+  // Maps the file into memory and validates its structure.
+  explicit ColumnarBatch(const std::string& full_filename);
+
+  static bool IsColumnarBatch(const std::string& filename);
+  static bool CanSave(const Batch& batch);
+  static boost::uuids::uuid Save(const Batch& batch, const std::string& disk_path, const std::string& name);
+
+  std::string id() const { return string(0); }
+  std::string description() const { return string(1); }
+  std::string token(int token_index) const { return string(2 + token_index); }
+  std::string class_id(int token_index) const { return string(2 + token_size() + token_index); }
+  std::string item_title(int item_index) const { return string(2 + 2 * token_size() + item_index); }
+  int item_id(int item_index) const { return item_id_[item_index]; }
+
+  int item_size() const { return header_->item_size; }
+  int token_size() const { return header_->token_size; }
+  int nnz() const { return header_->nnz; }
+  int64_t byte_size() const { return header_->file_size; }
+
+  const int* row_ptr() const { return row_ptr_; }
+  const int* token_id() const { return token_id_; }
+  const float* token_weight() const { return token_weight_; }
+
+  // Converts the batch into protobuf message.
+  // With include_item_tokens = false only the tokens, the ids and the titles of the items are filled in,
+  // and AddItemTokens can be used later to complete the same message.
+  void ToBatch(Batch* batch, bool include_item_tokens = true) const;
+  void AddItemTokens(Batch* batch) const;
+
+ private:
+  std::string string(int string_index) const;
+
+  boost::iostreams::mapped_file_source file_;
+  const ColumnarBatchHeader* header_;
+  const int64_t* string_index_;
+  const char* strings_;
+  const int* item_id_;
+  const int* row_ptr_;
+  const int* token_id_;
+  const float* token_weight_;
+};
+
+}  // namespace core
+}  // namespace artm
@@ -36,8 +36,7 @@ typedef std::string TopicName;
 const int UnknownId = -1;
 
 const std::string kBatchExtension = ".batch";
-
-const int kIdleLoopFrequency = 1;  // 1 ms
+const std::string kColumnarBatchExtension = ".cbatch";
 
 const int kBatchNameLength = 6;
 
@@ -0,0 +1,138 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#include "artm/core/contiguous_phi_matrix.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "artm/core/helpers.h"
+#include "artm/utility/memory_usage.h"
+
+namespace artm {
+namespace core {
+
+namespace {
+
+float* AlignPointer(float* ptr, int alignment_in_floats) {
+  const uintptr_t alignment = sizeof(float) * alignment_in_floats;
+  const uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+  return reinterpret_cast<float*>((address + alignment - 1) / alignment * alignment);
+}
+
+}  // namespace
+
+ContiguousPhiMatrix::ContiguousPhiMatrix(const ModelName& model_name,
+                                         const google::protobuf::RepeatedPtrField<std::string>& topic_name,
+                                         float min_sparsity_rate)
+    : PhiMatrixFrame(model_name, topic_name, min_sparsity_rate)
+    , row_stride_((topic_size() + kAlignmentInFloats - 1) / kAlignmentInFloats * kAlignmentInFloats)
+    , capacity_(0)
+    , slab_()
+    , data_(nullptr) { }
+
+ContiguousPhiMatrix::ContiguousPhiMatrix(const ContiguousPhiMatrix& rhs)
+    : PhiMatrixFrame(rhs)
+    , row_stride_(rhs.row_stride_)
+    , capacity_(0)
+    , slab_()
+    , data_(nullptr) {
+  Reserve(rhs.token_size());
+  if (rhs.token_size() > 0) {
+    memcpy(data_, rhs.data_, sizeof(float) * row_stride_ * rhs.token_size());
+  }
+}
+
+std::shared_ptr<PhiMatrix> ContiguousPhiMatrix::Duplicate() const {
+  return std::shared_ptr<PhiMatrix>(new ContiguousPhiMatrix(*this));
+}
+
+void ContiguousPhiMatrix::get(int token_id, std::vector<float>* buffer) const {
+  assert(topic_size() > 0 && buffer->size() == topic_size());
+  memcpy(&(*buffer)[0], row(token_id), sizeof(float) * topic_size());
+}
+
+void ContiguousPhiMatrix::set(int token_id, const std::vector<float>& values) {
+  assert(values.size() == topic_size());
+  memcpy(row(token_id), &values[0], sizeof(float) * topic_size());
+}
+
+void ContiguousPhiMatrix::increase(int token_id, const std::vector<float>& increment) {
+  const int topic_size = this->topic_size();
+  assert(increment.size() == topic_size);
+  float* values = row(token_id);
+
+  this->Lock(token_id);
+  for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
+    values[topic_index] += increment[topic_index];
+  }
+  this->Unlock(token_id);
+}
+
+void ContiguousPhiMatrix::get_sparse(int token_id, std::vector<float>* value_buffer,
+                                     std::vector<int>* index_buffer) const {
+  get(token_id, value_buffer);
+}
+
+void ContiguousPhiMatrix::Clear() {
+  std::vector<float>().swap(slab_);
+  data_ = nullptr;
+  capacity_ = 0;
+  PhiMatrixFrame::Clear();
+}
+
+int64_t ContiguousPhiMatrix::ByteSize() const {
+  return PhiMatrixFrame::ByteSize() + ::artm::utility::getMemoryUsage(slab_);
+}
+
+void ContiguousPhiMatrix::Reserve(int token_size) {
+  if (token_size <= capacity_) {
+    return;
+  }
+
+  std::vector<float> slab(row_stride_ * token_size + kAlignmentInFloats, 0.0f);
+  float* data = AlignPointer(&slab[0], kAlignmentInFloats);
+  if (this->token_size() > 0) {
+    memcpy(data, data_, sizeof(float) * row_stride_ * this->token_size());
+  }
+
+  slab_.swap(slab);
+  data_ = data;
+  capacity_ = token_size;
+}
+
+int ContiguousPhiMatrix::AddToken(const Token& token) {
+  int token_id = token_index(token);
+  if (token_id != -1) {
+    return token_id;
+  }
+
+  if (this->token_size() == capacity_) {
+    // Grow geometrically to keep AddToken amortized O(1)
+    Reserve(std::max<int64_t>(2 * capacity_, kAlignmentInFloats));
+  }
+
+  int retval = PhiMatrixFrame::AddToken(token);
+  memset(row(retval), 0, sizeof(float) * row_stride_);
+  return retval;
+}
+
+void ContiguousPhiMatrix::Reset() {
+  if (token_size() > 0) {
+    memset(data_, 0, sizeof(float) * row_stride_ * token_size());
+  }
+}
+
+void ContiguousPhiMatrix::Reshape(const PhiMatrix& phi_matrix) {
+  Clear();
+  Reserve(phi_matrix.token_size());
+  for (int token_id = 0; token_id < phi_matrix.token_size(); ++token_id) {
+    this->AddToken(phi_matrix.token(token_id));
+  }
+
+  set_shape_version(phi_matrix.shape_version());
+}
+
+}  // namespace core
+}  // namespace artm
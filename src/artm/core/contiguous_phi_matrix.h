@@ -0,0 +1,65 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "artm/core/common.h"
+#include "artm/core/dense_phi_matrix.h"
+
+namespace artm {
+namespace core {
+
+// ContiguousPhiMatrix class implements PhiMatrix interface as a dense row-major matrix,
+// stored in a single memory slab. Each row starts at a cache-aligned offset (token_id * row_stride),
+// so there is no per-token heap allocation and the whole matrix can be copied with one memcpy.
+// Unlike DensePhiMatrix the rows are never packed, therefore get/set/increase are O(1) per element.
+// Concurrent increase(token_id, vector) calls are synchronized by striped locks from PhiMatrixFrame.
+class ContiguousPhiMatrix : public PhiMatrixFrame {
+ public:
+  explicit ContiguousPhiMatrix(const ModelName& model_name,
+                               const google::protobuf::RepeatedPtrField<std::string>& topic_name,
+                               float min_sparsity_rate);
+
+  virtual ~ContiguousPhiMatrix() { Clear(); }
+  virtual int64_t ByteSize() const;
+
+  virtual std::shared_ptr<PhiMatrix> Duplicate() const;
+
+  virtual float get(int token_id, int topic_id) const { return row(token_id)[topic_id]; }
+  virtual void get(int token_id, std::vector<float>* buffer) const;
+  virtual void set(int token_id, int topic_id, float value) { row(token_id)[topic_id] = value; }
+  virtual void set(int token_id, const std::vector<float>& values);
+  virtual void increase(int token_id, int topic_id, float increment) { row(token_id)[topic_id] += increment; }
+  virtual void increase(int token_id, const std::vector<float>& increment);  // must be thread-safe
+
+  virtual int get_non_zero_topic_size(int token_id) const { return topic_size(); }
+  virtual void get_sparse(int token_id, std::vector<float>* value_buffer, std::vector<int>* index_buffer) const;
+
+  virtual void Clear();
+  virtual int AddToken(const Token& token);
+
+  // Direct access to the row of the matrix (topic_size() consecutive floats).
+  float* row(int token_id) { return data_ + static_cast<int64_t>(token_id) * row_stride_; }
+  const float* row(int token_id) const { return data_ + static_cast<int64_t>(token_id) * row_stride_; }
+
+  void Reserve(int token_size);
+  void Reset();
+  void Reshape(const PhiMatrix& phi_matrix);
+
+ private:
+  static const int kAlignmentInFloats = 16;  // 64 bytes, the size of a cache line
+
+  ContiguousPhiMatrix(const ContiguousPhiMatrix& rhs);
+  ContiguousPhiMatrix& operator=(const ContiguousPhiMatrix&);
+
+  int64_t row_stride_;
+  int64_t capacity_;         // number of rows that fit into the slab
+  std::vector<float> slab_;  // over-allocated by kAlignmentInFloats to align data_
+  float* data_;
+};
+
+}  // namespace core
+}  // namespace artm
@@ -0,0 +1,294 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#include "artm/core/cooc_matrix.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include "boost/lexical_cast.hpp"
+
+#include "artm/core/exceptions.h"
+
+namespace artm {
+namespace core {
+
+namespace {
+
+const char kCoocMatrixMagic[8] = { 'A', 'R', 'T', 'M', 'C', 'O', 'O', 'C' };
+const int kCoocMatrixVersion = 1;
+const int64_t kSectionAlignment = 8;
+
+int64_t AlignOffset(int64_t offset) {
+  return (offset + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+}
+
+// Pads the file with zeros up to the offset of the section (sections are written in order), then writes the section.
+template <typename T>
+void WriteSection(std::ofstream* fout, int64_t offset, const T* values, int64_t size, const std::string& file_name) {
+  const char padding[kSectionAlignment] = { 0 };
+  const int64_t gap = offset - static_cast<int64_t>(fout->tellp());
+  if (gap < 0 || gap >= kSectionAlignment) {
+    BOOST_THROW_EXCEPTION(DiskWriteException("Unexpected section offset in " + file_name));
+  }
+
+  fout->write(padding, gap);
+  if (size > 0) {
+    fout->write(reinterpret_cast<const char*>(values), sizeof(T) * size);
+  }
+
+  if (fout->fail()) {
+    BOOST_THROW_EXCEPTION(DiskWriteException("Co-occurrence matrix has not been written to disk: " + file_name));
+  }
+}
+
+}  // namespace
+
+CoocRow::const_iterator CoocRow::find(int column) const {
+  const int* iter = std::lower_bound(column_, column_ + size_, column);
+  if (iter == column_ + size_ || *iter != column) {
+    return end();
+  }
+
+  const int64_t offset = iter - column_;
+  return const_iterator(column_ + offset, value_ + offset);
+}
+
+CoocMatrix::CoocMatrix()
+    : row_ptr_(1, 0), column_(), value_(), file_(), row_ptr_data_(nullptr), column_data_(nullptr),
+      value_data_(nullptr), row_size_(0), non_empty_row_size_(0), nnz_(0), pending_() {
+  AssignOwnedArrays();
+}
+
+CoocMatrix::CoocMatrix(const CoocMatrix& rhs)
+    : row_ptr_(rhs.row_ptr_), column_(rhs.column_), value_(rhs.value_), file_(rhs.file_),
+      row_ptr_data_(nullptr), column_data_(nullptr), value_data_(nullptr),
+      row_size_(0), non_empty_row_size_(0), nnz_(0), pending_(rhs.pending_) {
+  if (file_.is_open()) {
+    // mapped_file_source shares the mapping between copies
+    SetArrays(rhs.row_ptr_data_, rhs.column_data_, rhs.value_data_, rhs.row_size_, rhs.nnz_);
+  } else {
+    AssignOwnedArrays();
+  }
+}
+
+CoocMatrix& CoocMatrix::operator=(const CoocMatrix& rhs) {
+  if (this != &rhs) {
+    CoocMatrix copy(rhs);
+    row_ptr_.swap(copy.row_ptr_);
+    column_.swap(copy.column_);
+    value_.swap(copy.value_);
+    pending_.swap(copy.pending_);
+    file_ = copy.file_;
+    if (file_.is_open()) {
+      SetArrays(copy.row_ptr_data_, copy.column_data_, copy.value_data_, copy.row_size_, copy.nnz_);
+    } else {
+      AssignOwnedArrays();
+    }
+  }
+
+  return *this;
+}
+
+void CoocMatrix::SetArrays(const int64_t* row_ptr, const int* column, const float* value,
+                           int row_size, int64_t nnz) {
+  row_ptr_data_ = row_ptr;
+  column_data_ = column;
+  value_data_ = value;
+  row_size_ = row_size;
+  nnz_ = nnz;
+
+  non_empty_row_size_ = 0;
+  for (int row = 0; row < row_size; ++row) {
+    if (row_ptr[row + 1] > row_ptr[row]) {
+      non_empty_row_size_++;
+    }
+  }
+}
+
+void CoocMatrix::AssignOwnedArrays() {
+  SetArrays(&row_ptr_[0], column_.empty() ? nullptr : &column_[0], value_.empty() ? nullptr : &value_[0],
+            static_cast<int>(row_ptr_.size()) - 1, static_cast<int64_t>(column_.size()));
+}
+
+void CoocMatrix::Add(int row, int column, float value) {
+  Entry entry = { row, column, value };
+  pending_.push_back(entry);
+}
+
+void CoocMatrix::Finalize() {
+  if (pending_.empty()) {
+    return;
+  }
+
+  // Finalized entries go first, so that they win over the pending duplicates
+  std::vector<Entry> entries;
+  entries.reserve(nnz_ + pending_.size());
+  for (int row = 0; row < row_size_; ++row) {
+    for (int64_t i = row_ptr_data_[row]; i < row_ptr_data_[row + 1]; ++i) {
+      Entry entry = { row, column_data_[i], value_data_[i] };
+      entries.push_back(entry);
+    }
+  }
+
+  entries.insert(entries.end(), pending_.begin(), pending_.end());
+  std::vector<Entry>().swap(pending_);
+
+  std::stable_sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) {  // NOLINT
+    return (lhs.row < rhs.row) || (lhs.row == rhs.row && lhs.column < rhs.column);
+  });
+
+  // Columns are also counted, so that every column id of the saved matrix is below row_size (see Open)
+  int row_size = 0;
+  for (const Entry& entry : entries) {
+    row_size = std::max(row_size, std::max(entry.row, entry.column) + 1);
+  }
+  std::vector<int64_t> row_ptr(row_size + 1, 0);
+  std::vector<int> column;
+  std::vector<float> value;
+  column.reserve(entries.size());
+  value.reserve(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (i > 0 && entries[i].row == entries[i - 1].row && entries[i].column == entries[i - 1].column) {
+      continue;
+    }
+
+    column.push_back(entries[i].column);
+    value.push_back(entries[i].value);
+    row_ptr[entries[i].row + 1]++;
+  }
+
+  for (int row = 0; row < row_size; ++row) {
+    row_ptr[row + 1] += row_ptr[row];
+  }
+
+  row_ptr_.swap(row_ptr);
+  column_.swap(column);
+  value_.swap(value);
+  file_ = boost::iostreams::mapped_file_source();
+  AssignOwnedArrays();
+}
+
+void CoocMatrix::Clear() {
+  std::vector<int64_t>(1, 0).swap(row_ptr_);
+  std::vector<int>().swap(column_);
+  std::vector<float>().swap(value_);
+  std::vector<Entry>().swap(pending_);
+  file_ = boost::iostreams::mapped_file_source();
+  AssignOwnedArrays();
+}
+
+CoocRow CoocMatrix::row(int row) const {
+  if (row < 0 || row >= row_size_) {
+    return CoocRow();
+  }
+
+  const int64_t begin = row_ptr_data_[row];
+  return CoocRow(column_data_ + begin, value_data_ + begin, static_cast<int>(row_ptr_data_[row + 1] - begin));
+}
+
+int64_t CoocMatrix::ByteSize() const {
+  // memory-mapped arrays are not counted, as they are backed by the file
+  return sizeof(int64_t) * row_ptr_.capacity() + sizeof(int) * column_.capacity() +
+         sizeof(float) * value_.capacity() + sizeof(Entry) * pending_.capacity();
+}
+
+void CoocMatrix::Save(const std::string& file_name) const {
+  CoocMatrixHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kCoocMatrixMagic, sizeof(kCoocMatrixMagic));
+  header.version = kCoocMatrixVersion;
+  header.row_size = row_size_;
+  header.nnz = nnz_;
+  header.row_ptr_offset = AlignOffset(sizeof(header));
+  header.column_offset = AlignOffset(header.row_ptr_offset + sizeof(int64_t) * (row_size_ + 1));
+  header.value_offset = AlignOffset(header.column_offset + sizeof(int32_t) * nnz_);
+  header.file_size = header.value_offset + sizeof(float) * nnz_;
+
+  std::ofstream fout(file_name.c_str(), std::ofstream::binary);
+  if (!fout.is_open()) {
+    BOOST_THROW_EXCEPTION(DiskWriteException("Unable to create file " + file_name));
+  }
+
+  WriteSection(&fout, 0, &header, 1, file_name);
+  WriteSection(&fout, header.row_ptr_offset, row_ptr_data_, row_size_ + 1, file_name);
+  WriteSection(&fout, header.column_offset, column_data_, nnz_, file_name);
+  WriteSection(&fout, header.value_offset, value_data_, nnz_, file_name);
+
+  fout.close();
+  if (fout.fail()) {
+    BOOST_THROW_EXCEPTION(DiskWriteException("Co-occurrence matrix has not been written to disk: " + file_name));
+  }
+}
+
+void CoocMatrix::Open(const std::string& file_name) {
+  boost::iostreams::mapped_file_source file;
+  try {
+    file.open(file_name);
+  } catch (std::exception& ex) {
+    BOOST_THROW_EXCEPTION(DiskReadException("Unable to open file " + file_name + ", " + ex.what()));
+  }
+
+  const int64_t file_size = static_cast<int64_t>(file.size());
+  const char* data = file.data();
+  auto corrupted = [&file_name](const std::string& reason) {  // NOLINT
+    BOOST_THROW_EXCEPTION(CorruptedMessageException(
+      "Unable to read co-occurrence matrix from " + file_name + ": " + reason));
+  };
+
+  if (file_size < static_cast<int64_t>(sizeof(CoocMatrixHeader)) ||
+      memcmp(data, kCoocMatrixMagic, sizeof(kCoocMatrixMagic)) != 0) {
+    corrupted("wrong file signature");
+  }
+
+  const CoocMatrixHeader* header = reinterpret_cast<const CoocMatrixHeader*>(data);
+  if (header->version != kCoocMatrixVersion) {
+    corrupted("unsupported version " + boost::lexical_cast<std::string>(header->version));
+  }
+
+  if (header->file_size != file_size || header->row_size < 0 || header->nnz < 0) {
+    corrupted("inconsistent header");
+  }
+
+  auto check_section = [&](int64_t offset, int64_t size) {  // NOLINT
+    if (offset < static_cast<int64_t>(sizeof(CoocMatrixHeader)) || offset % kSectionAlignment != 0 ||
+        size < 0 || offset + size > file_size) {
+      corrupted("section is out of file bounds");
+    }
+  };
+
+  check_section(header->row_ptr_offset, sizeof(int64_t) * (static_cast<int64_t>(header->row_size) + 1));
+  check_section(header->column_offset, sizeof(int32_t) * header->nnz);
+  check_section(header->value_offset, sizeof(float) * header->nnz);
+
+  const int64_t* row_ptr = reinterpret_cast<const int64_t*>(data + header->row_ptr_offset);
+  const int* column = reinterpret_cast<const int*>(data + header->column_offset);
+  if (row_ptr[0] != 0 || row_ptr[header->row_size] != header->nnz) {
+    corrupted("invalid row offsets");
+  }
+
+  for (int row = 0; row < header->row_size; ++row) {
+    if (row_ptr[row] > row_ptr[row + 1]) {
+      corrupted("invalid row offsets");
+    }
+
+    for (int64_t i = row_ptr[row]; i < row_ptr[row + 1]; ++i) {
+      if (column[i] < 0 || column[i] >= header->row_size) {
+        corrupted("column id is out of range");
+      }
+
+      if (i > row_ptr[row] && column[i - 1] >= column[i]) {
+        corrupted("column ids are not sorted");
+      }
+    }
+  }
+
+  Clear();
+  file_ = file;
+  SetArrays(row_ptr, column, reinterpret_cast<const float*>(data + header->value_offset),
+            header->row_size, header->nnz);
+}
+
+}  // namespace core
+}  // namespace artm
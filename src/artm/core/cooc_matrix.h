@@ -0,0 +1,145 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/iostreams/device/mapped_file.hpp"
+
+#include "artm/core/common.h"
+
+namespace artm {
+namespace core {
+
+// CoocRow is a read-only view of one row of CoocMatrix: the column ids in increasing order and their values.
+// Iteration yields std::pair<int, float> (column id, value), so the code that was written
+// for std::unordered_map<int, float> (range-based for, iter->first, iter->second, find) keeps working.
+class CoocRow {
+ public:
+  typedef std::pair<int, float> value_type;
+
+  class const_iterator {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef CoocRow::value_type value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const value_type* pointer;
+    typedef value_type reference;  // pairs are created on the fly, as columns and values are separate arrays
+
+    const_iterator() : column_(nullptr), value_(nullptr), current_() { }
+    const_iterator(const int* column, const float* value) : column_(column), value_(value), current_() { }
+
+    value_type operator*() const { return value_type(*column_, *value_); }
+    const value_type* operator->() const { current_ = value_type(*column_, *value_); return &current_; }
+
+    const_iterator& operator++() { ++column_; ++value_; return *this; }
+    const_iterator operator++(int) { const_iterator retval(*this); ++(*this); return retval; }
+    bool operator==(const const_iterator& rhs) const { return column_ == rhs.column_; }
+    bool operator!=(const const_iterator& rhs) const { return column_ != rhs.column_; }
+
+   private:
+    const int* column_;
+    const float* value_;
+    mutable value_type current_;
+  };
+
+  CoocRow() : column_(nullptr), value_(nullptr), size_(0) { }
+  CoocRow(const int* column, const float* value, int size) : column_(column), value_(value), size_(size) { }
+
+  int size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  int column(int index) const { return column_[index]; }
+  float value(int index) const { return value_[index]; }
+  const int* column() const { return column_; }
+  const float* value() const { return value_; }
+
+  const_iterator begin() const { return const_iterator(column_, value_); }
+  const_iterator end() const { return const_iterator(column_ + size_, value_ + size_); }
+
+  // Binary search of the column; returns end() if the row has no such column.
+  const_iterator find(int column) const;
+
+ private:
+  const int* column_;
+  const float* value_;
+  int size_;
+};
+
+// Header of the co-occurrence matrix file. All offsets are in bytes from the beginning of the file,
+// and each section starts at a multiple of 8 bytes. Integers and floats use native byte order.
+struct CoocMatrixHeader {
+  char magic[8];
+  int32_t version;
+  int32_t row_size;
+  int64_t nnz;
+  int64_t row_ptr_offset;  // int64_t[row_size + 1]
+  int64_t column_offset;   // int32_t[nnz]
+  int64_t value_offset;    // float[nnz]
+  int64_t file_size;
+};
+
+// CoocMatrix class stores a sparse co-occurrence matrix in frozen CSR format:
+// row offsets, int32 column ids (sorted within each row) and float values.
+// Rows and columns are the indices of the dictionary entries.
+// The matrix is filled in two steps: Add collects (row, column, value) triples,
+// and Finalize sorts them into CSR arrays. Only the finalized entries are visible to row().
+// The CSR arrays are either owned by the matrix or memory-mapped from a file written by Save (see Open).
+class CoocMatrix {
+ public:
+  CoocMatrix();
+  CoocMatrix(const CoocMatrix& rhs);
+  CoocMatrix& operator=(const CoocMatrix& rhs);
+
+  // Adds the value unless the matrix already has a value for this pair of indices
+  // (the same way as std::unordered_map::insert ignores duplicate keys).
+  void Add(int row, int column, float value);
+  void Finalize();
+  void Clear();
+
+  CoocRow row(int row) const;  // returns an empty row for out of range indices
+  int row_size() const { return row_size_; }
+  int non_empty_row_size() const { return non_empty_row_size_; }
+  int64_t nnz() const { return nnz_; }
+  bool empty() const { return nnz_ == 0 && pending_.empty(); }
+  int64_t ByteSize() const;
+
+  // Saves the finalized entries into a file, that can be memory-mapped with Open.
+  void Save(const std::string& file_name) const;
+
+  // Maps the file into memory and validates its structure; the matrix becomes read-only view of the file
+  // (a subsequent Add + Finalize copies the entries into memory).
+  void Open(const std::string& file_name);
+
+ private:
+  struct Entry {
+    int row;
+    int column;
+    float value;
+  };
+
+  void SetArrays(const int64_t* row_ptr, const int* column, const float* value, int row_size, int64_t nnz);
+  void AssignOwnedArrays();
+
+  std::vector<int64_t> row_ptr_;
+  std::vector<int> column_;
+  std::vector<float> value_;
+  boost::iostreams::mapped_file_source file_;
+
+  // point either to the vectors above or into file_
+  const int64_t* row_ptr_data_;
+  const int* column_data_;
+  const float* value_data_;
+  int row_size_;
+  int non_empty_row_size_;
+  int64_t nnz_;
+
+  std::vector<Entry> pending_;
+};
+
+}  // namespace core
+}  // namespace artm
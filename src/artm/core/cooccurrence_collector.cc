@@ -7,7 +7,9 @@
 #include <iomanip>
 #include <iostream>
 #include <fstream>
+#include <functional>
 #include <future>  // NOLINT
+#include <limits>
 #include <map>
 #include <memory>
 #include <mutex>  // NOLINT
@@ -48,10 +50,114 @@ namespace core {
 
 // ToDo (MichaelSolotky): search for all bad-written parts of code with CLion
 
+namespace {
+
+// Number of ranges of first token ids per thread in the second stage of merging;
+// more ranges than threads help to balance the load
+const int kNumOfRangesPerThread = 4;
+
+// A new entry is added into the index of a cooccurrence batch after this number of bytes
+const int64_t kCoocBatchIndexStep = 4096;
+
+// Encoded cells are written into the file of a cooccurrence batch by chunks of this size
+const size_t kCoocBatchWriteBufferSize = 1024 * 1024;
+
+const uint64_t kEmptyKey = ~0ULL;
+
+uint64_t MakeKey(int first_token_id, int second_token_id) {
+  return (static_cast<uint64_t>(first_token_id) << 32) | static_cast<uint32_t>(second_token_id);
+}
+
+int FirstTokenId(uint64_t key) { return static_cast<int>(key >> 32); }
+int SecondTokenId(uint64_t key) { return static_cast<int>(key & 0xFFFFFFFFULL); }
+
+size_t HashKey(uint64_t key) {
+  key *= 0x9E3779B97F4A7C15ULL;
+  return static_cast<size_t>(key ^ (key >> 32));
+}
+
+void AppendVarint(uint64_t value, std::string* buffer) {
+  while (value >= 0x80) {
+    buffer->push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  buffer->push_back(static_cast<char>(value));
+}
+
+// Merges two vectors of records sorted by second token id: if two records have the same second token id,
+// their cooc_tf and cooc_df are added. The result is stored in records, merged_records is a buffer.
+void MergeRecords(const std::vector<CoocInfo>& other_records, std::vector<CoocInfo>* records,
+                  std::vector<CoocInfo>* merged_records) {
+  merged_records->clear();
+  merged_records->reserve(records->size() + other_records.size());
+  auto fi_iter = records->begin();
+  auto se_iter = other_records.begin();
+  while (fi_iter != records->end() && se_iter != other_records.end()) {
+    if (fi_iter->second_token_id == se_iter->second_token_id) {
+      CoocInfo info = { fi_iter->second_token_id, fi_iter->cooc_tf + se_iter->cooc_tf,
+                        fi_iter->cooc_df + se_iter->cooc_df };
+      merged_records->push_back(info);
+      ++fi_iter;
+      ++se_iter;
+    } else if (fi_iter->second_token_id < se_iter->second_token_id) {
+      merged_records->push_back(*fi_iter++);
+    } else {
+      merged_records->push_back(*se_iter++);
+    }
+  }
+  merged_records->insert(merged_records->end(), fi_iter, records->end());
+  merged_records->insert(merged_records->end(), se_iter, other_records.end());
+  records->swap(*merged_records);
+}
+
+// Runs func(index) for all indices in [0, num_tasks) on num_threads threads.
+// An exception thrown by func is re-thrown on the calling thread.
+void ParallelFor(int num_tasks, int num_threads, const std::function<void(int)>& func) {
+  std::atomic<int> next_task(0);
+  auto worker = [&next_task, num_tasks, &func]() {  // NOLINT
+    for (int task = next_task++; task < num_tasks; task = next_task++) {
+      func(task);
+    }
+  };
+
+  std::vector<std::future<void>> tasks;
+  for (int i = 0; i < std::min(num_threads, num_tasks); ++i) {
+    tasks.push_back(std::async(std::launch::async, worker));
+  }
+  for (auto& task : tasks) {
+    task.get();
+  }
+}
+
+// Writes the content of the files one after another into the output file, and removes the files
+void ConcatenateFiles(const std::vector<std::string>& filenames, const std::string& output_filename) {
+  std::ofstream output(output_filename, std::ios::out | std::ios::binary);
+  if (!output.good()) {
+    BOOST_THROW_EXCEPTION(InvalidOperation("Failed to open or create output file " + output_filename));
+  }
+  for (const auto& filename : filenames) {
+    {
+      std::ifstream input(filename, std::ios::in | std::ios::binary);
+      if (input.peek() != std::ifstream::traits_type::eof()) {
+        output << input.rdbuf();
+      }
+    }
+    boost::system::error_code error;
+    fs::remove(filename, error);
+  }
+  output.close();
+  if (output.fail()) {
+    BOOST_THROW_EXCEPTION(InvalidOperation("Failed to write output file " + output_filename));
+  }
+}
+
+}  // namespace
+
 // ************************************ Methods of class CooccurrenceCollector ************************************
 
 CooccurrenceCollector::CooccurrenceCollector(
-      const CollectionParserConfig& collection_parser_config) : open_files_counter_(0) {
+      const CollectionParserConfig& collection_parser_config)
+        : bytes_spilled_(0), memory_usage_(0), peak_memory_(0) {
   config_.set_gather_cooc(collection_parser_config.gather_cooc());
   if (config_.gather_cooc()) {
     config_.set_gather_cooc_tf(collection_parser_config.gather_cooc_tf());
@@ -63,21 +169,20 @@ CooccurrenceCollector::CooccurrenceCollector(
       config_.set_vocab_file_path(collection_parser_config.vocab_file_path());
       vocab_ = Vocab(config_.vocab_file_path());
       num_of_documents_token_occurred_in_.resize(vocab_.token_map_.size());
+      num_of_pairs_token_occurred_in_.resize(vocab_.token_map_.size());
     } else {
       BOOST_THROW_EXCEPTION(InvalidOperation("No vocab file specified. Can't gather co-occurrences"));
     }
     config_.set_target_folder(collection_parser_config.target_folder());
 
+    // Ppmi is calculated directly from the merged co-occurrences,
+    // so co-occurrences are written into a file only if it's specified
     if (collection_parser_config.has_cooc_tf_file_path()) {
       config_.set_cooc_tf_file_path(collection_parser_config.cooc_tf_file_path());
-    } else if (config_.gather_cooc_tf()) {
-      config_.set_cooc_tf_file_path(CreateFileInBatchDir());
     }
 
     if (collection_parser_config.has_cooc_df_file_path()) {
       config_.set_cooc_df_file_path(collection_parser_config.cooc_df_file_path());
-    } else if (config_.gather_cooc_df()) {
-      config_.set_cooc_df_file_path(CreateFileInBatchDir());
     }
 
     if (collection_parser_config.has_ppmi_tf_file_path()) {
@@ -188,56 +293,61 @@ std::vector<std::string> CooccurrenceCollector::ReadPortionOfDocuments(
   return portion;
 }
 
-void CooccurrenceCollector::UploadOnDisk(const CooccurrenceStatisticsHolder& cooc_stat_holder) {
+void CooccurrenceCollector::UploadOnDisk(CooccurrenceStatisticsHolder* cooc_stat_holder) {
   // Uploading is implemented as folowing:
-  // 1. Create a batch which is associated with a specific file on a disk
-  // 2. For every first token id create an object Cell and for every second token
-  // that co-occurred with first write it's id, cooc_tf, cooc_df
-  // 3. Write the cell in output file and continue the cicle while there are
-  // first token ids in cooccurrence statistics holder
-  // Note that there can't be two cells stored in ram simultaniously
+  // 1. Sort the pairs of tokens of the holder by (first token id, second token id)
+  // 2. Create a batch which is associated with a specific file on a disk
+  // 3. For every first token id form a cell with all second tokens that co-occurred with first
+  // (their ids, cooc_tf, cooc_df) and write the cell into the batch
   // 4. Save batch in vector of objects
-  std::shared_ptr<CooccurrenceBatch> batch(CreateNewCooccurrenceBatch());
-  OpenBatchOutputFile(batch);
-  for (auto iter = cooc_stat_holder.storage_.begin(); iter != cooc_stat_holder.storage_.end(); ++iter) {
-    batch->FormNewCell(iter);
-    batch->WriteCell();
+  cooc_stat_holder->SortRecords();
+  std::shared_ptr<CooccurrenceBatch> batch = CreateNewCooccurrenceBatch();
+  Cell cell;
+  const auto& records = cooc_stat_holder->records_;
+  for (size_t index = 0; index < cooc_stat_holder->size_;) {
+    cell.first_token_id = FirstTokenId(records[index].key);
+    cell.records.clear();
+    for (; index < cooc_stat_holder->size_ && FirstTokenId(records[index].key) == cell.first_token_id; ++index) {
+      CoocInfo info = { SecondTokenId(records[index].key), records[index].cooc_tf, records[index].cooc_df };
+      cell.records.push_back(info);
+    }
+    batch->WriteCell(cell);
+    if (config_.calculate_ppmi_tf()) {
+      CalculateTFStatistics(cell);
+    }
   }
-  CloseBatchOutputFile(batch);
+
+  batch->FinishWriting();
+  bytes_spilled_ += batch->byte_size();
   {
     std::unique_lock<std::mutex> vector_of_batches_access_lock(vector_of_batches_access_mutex_);
     vector_of_batches_.push_back(std::move(batch));
   }
 }
 
-CooccurrenceBatch* CooccurrenceCollector::CreateNewCooccurrenceBatch() {
+std::shared_ptr<CooccurrenceBatch> CooccurrenceCollector::CreateNewCooccurrenceBatch() {
   std::unique_lock<std::mutex> target_dir_access_lock(target_dir_access_mutex_);
-  return new CooccurrenceBatch(config_.target_folder());
+  return std::shared_ptr<CooccurrenceBatch>(new CooccurrenceBatch(config_.target_folder()));
 }
 
-void CooccurrenceCollector::OpenBatchOutputFile(std::shared_ptr<CooccurrenceBatch> batch) {
-  if (!batch->out_batch_.is_open()) {
-    std::unique_lock<std::mutex> open_close_file_lock(open_close_file_mutex_);
-    assert(open_files_counter_ < config_.max_num_of_open_files_in_a_process());
-    batch->out_batch_.open(batch->filename_, std::ios::out);
-    if (!batch->out_batch_.is_open()) {
-      BOOST_THROW_EXCEPTION(InvalidOperation(
-        "Failed to open co-occurrence batch file for writing, path = " + batch->filename_));
-    }
-    ++open_files_counter_;
+void CooccurrenceCollector::CalculateTFStatistics(const Cell& cell) {
+  // Calculate statistics of occurrence (of first token which is associated with the cell)
+  // The sums don't depend on the way the pairs are split into batches, so they are known before the merge
+  int64_t n_u = 0;
+  std::unique_lock<std::mutex> token_statistics_access_lock(token_statistics_access_mutex_);
+  for (unsigned i = 0; i < cell.records.size(); ++i) {
+    if (config_.store_symmetric_cooc_values() && cell.first_token_id != cell.records[i].second_token_id) {
+      num_of_pairs_token_occurred_in_[cell.records[i].second_token_id] += cell.records[i].cooc_tf;
+    }  // pairs <u u> have double weight so in symmetric case they should be taken once
+    n_u += cell.records[i].cooc_tf;
   }
+  num_of_pairs_token_occurred_in_[cell.first_token_id] += n_u;
 }
 
-void CooccurrenceCollector::CloseBatchOutputFile(std::shared_ptr<CooccurrenceBatch> batch) {
-  if (batch->out_batch_.is_open()) {
-    std::unique_lock<std::mutex> open_close_file_lock(open_close_file_mutex_);
-    batch->out_batch_.close();
-    if (batch->out_batch_.is_open()) {
-      BOOST_THROW_EXCEPTION(InvalidOperation(
-        "Failed to close co-occurrence batch file, path = " + batch->filename_));
-    }
-    --open_files_counter_;
-  }
+void CooccurrenceCollector::ReportMemoryUsage(int64_t delta) {
+  const int64_t memory_usage = (memory_usage_ += delta);
+  int64_t peak_memory = peak_memory_;
+  while (memory_usage > peak_memory && !peak_memory_.compare_exchange_weak(peak_memory, memory_usage)) { }
 }
 
 unsigned CooccurrenceCollector::NumOfCooccurrenceBatches() const {
@@ -247,275 +357,181 @@ unsigned CooccurrenceCollector::NumOfCooccurrenceBatches() const {
 void CooccurrenceCollector::ReadAndMergeCooccurrenceBatches() {
   // After that all the statistics has been gathered and saved in form of cooc batches on disk, it
   // needs to be read and merged from cooc batches into one storage
-  // If number of cooc batches <= number of files than can be open simultaniously, then
-  // all the cooc batches are divided equally into n groups where n = number of cores.
-  // Else maximal number of open files is taken and divided into n groups.
-  // After that 1 thread has eliberated that can handle another portion of batches than aren't merged yet
   // There are two stages of merging:
-  // 1. merging of files of one group (is done asynchroniously, without dropping of rare pairs of tokens)
-  // n files are written back in the same form (of cooccurrence batches)
-  // If n is too large to merge all the batches into some small number of batches
-  // this operation can be in cicle launched many times.
-  // 2. then that n files need to be read and merged again (with dropping of rare pairs of tokens)
+  // 1. If there are more cooc batches than files that can be open simultaniously by one thread,
+  // groups of batches are merged in parallel into larger batches (without dropping of rare pairs of tokens).
+  // This operation is repeated until the number of batches is small enough.
+  // 2. Then the range of first token ids is split into parts with approximately the same amount of data,
+  // and each part is merged from all the batches by its own thread (with dropping of rare pairs of tokens).
   // Merging of k files is implemented in KWayMerge function
   // After the second stage the data is written in format of output file (not in format of cooc batches)
   // If there would be a need to calculate ppmi or other values which depend on co-occurrences
   // this data can be read back from output file.
 
-  std::cerr << "\nMerging co-occurrence batches. Stage 1: parallel agglomerative merge" << std::endl;
-  // This magic constant isn't the best and can be set to another value found in experiments
-  // This value should be lower than maximal number of open files in a process to avoid frequent
-  // openning-closing of the files
-  const unsigned min_num_of_batches_to_be_merged_in_parallel = 32;
-  while (NumOfCooccurrenceBatches() > min_num_of_batches_to_be_merged_in_parallel) {
+  // Each thread of the second stage needs two files for output
+  const int max_num_of_batches_to_be_merged = std::max(2, config_.max_num_of_open_files_in_a_thread() - 2);
+  if (NumOfCooccurrenceBatches() > static_cast<unsigned>(max_num_of_batches_to_be_merged)) {
+    std::cerr << "\nMerging co-occurrence batches. Stage 1: parallel agglomerative merge" << std::endl;
+  }
+  while (NumOfCooccurrenceBatches() > static_cast<unsigned>(max_num_of_batches_to_be_merged)) {
     FirstStageOfMerging();  // number of files is decreasing here
   }
-  std::cerr << "Merging co-occurrence batches. Stage 2: sequential merge" << std::endl;
-  // vocab will be coppyied here into buffer_for_output_files
-  BufferOfCooccurrences buffer_for_output_files(OUTPUT_FILE, vocab_, num_of_documents_token_occurred_in_, config_);
-  open_files_counter_ += buffer_for_output_files.open_files_counter_;
-  SecondStageOfMerging(&buffer_for_output_files, &vector_of_batches_);
-  buffer_for_output_files.CalculatePpmi();
-  open_files_counter_ -= buffer_for_output_files.open_files_counter_;
+  std::cerr << "Merging co-occurrence batches. Stage 2: parallel merge by ranges of token ids and pPMI calculation"
+            << std::endl;
+  SecondStageOfMerging();
+  vector_of_batches_.clear();
+
+  LOG(INFO) << "Co-occurrence statistics: " << bytes_spilled() << " bytes spilled on disk, "
+            << "peak memory of in-memory statistics is " << peak_memory() << " bytes";
 }
 
-// ToDo (MichaelSolotky): remove batches after merging
 void CooccurrenceCollector::FirstStageOfMerging() {
   // Stage 1: merging portions of batches into intermediate batches
-  // The strategy is the folowing: divide the vector of batches into as much buckets as it's possible
-  // and gives advantages (the best case is 2 batches into each bucket, and all these batches are open
-  // simultaneously), then create several threads which will take a portion of batches, merge them,
-  // then a free thread will take another not-merged portion of batches and so on until
-  // there are no portions left. This procedure produces new batches, but their number is much lower
-  // then but their number is much smaller than those which were sent at the input,
-  // so it could be needed to run it again in order to make that number small enough
+  // The vector of batches is divided into groups of consecutive batches (at least 2 batches in each group,
+  // and not more than can be opened by one thread), then threads take the groups one by one
+  // and merge each group into a new batch. The number of batches decreases at least twice.
   const int num_of_batches = static_cast<int>(vector_of_batches_.size());
-  // Let k be number of buckets in which all the batches will be divided
-  // Let n be total number of batches
-  // k ≤ upper bound of n / 2
-  const int upper_constraint_due_to_num_of_batches = num_of_batches / 2 + num_of_batches % 2;
-  // The procedure would be uneffective if there had been some buckets with at least 1 closed file,
-  // so there should be at least 3 open files in each bucket: 1 for writing and at least 2 merging files
-  const int upper_constraint_due_to_num_of_open_files = config_.max_num_of_open_files_in_a_thread() / 3;
-  const int optimal_num_of_threads = std::min(upper_constraint_due_to_num_of_batches,
-                                              upper_constraint_due_to_num_of_open_files);
-  int num_of_threads = optimal_num_of_threads;
-  // The real number of threads shouldn't be higher the than value set by the user of number of cores in computer
-  if (config_.has_num_threads() && config_.num_threads() > 0) {
-    num_of_threads = std::min(optimal_num_of_threads, config_.num_threads());
-  }
+  const int num_of_threads = std::max(1, config_.num_threads());
   // 1 is subtracted here because 1 file will be needed for writing in it
-  const int optimal_portion_size = std::min(static_cast<int>(vector_of_batches_.size() / num_of_threads),
-                                            config_.max_num_of_open_files_in_a_thread() - 1);
-  // Portion size < 2 would lead to cycling or an error,
-  // if it would be > 10, much RAM space would be needed and i/o operations would be to frequent that
-  // the merging would slow due to pauses for reading and writing
-  const int portion_size = std::min(std::max(optimal_portion_size, 2), 10);
-  std::shared_ptr<std::mutex> open_close_file_mutex_ptr(new std::mutex);
-
-  auto func = [&open_close_file_mutex_ptr, portion_size, this](int portion_index) {  // Wrapper around KWayMerge
-    const int total_num_of_batches = vector_of_batches_.size();
-    std::shared_ptr<CooccurrenceBatch> batch(CreateNewCooccurrenceBatch());
-    OpenBatchOutputFile(batch);
-    // vocab will be coppied here into buffer_for_a_batch
-    BufferOfCooccurrences buffer_for_a_batch(BATCH, vocab_,
-                                             num_of_documents_token_occurred_in_,
-                                             config_);
-    std::vector<std::shared_ptr<CooccurrenceBatch>> portion_of_batches;
-    // Stage 1: take i-th portion from pull of batches
-    {
-      std::unique_lock<std::mutex> vector_of_batches_access_lock(vector_of_batches_access_mutex_);
-      for (int batch_index = portion_index * portion_size;
-           batch_index < (portion_index + 1) * portion_size && batch_index < total_num_of_batches;
-           ++batch_index) {
-        portion_of_batches.push_back(std::move(vector_of_batches_[batch_index]));
-      }
-    }
-    KWayMerge(&buffer_for_a_batch, BATCH, &portion_of_batches, batch, open_close_file_mutex_ptr);
-    CloseBatchOutputFile(batch);
-    return batch;
+  const int max_group_size = std::max(2, config_.max_num_of_open_files_in_a_thread() - 1);
+  const int group_size = std::min(max_group_size, std::max(2, (num_of_batches + num_of_threads - 1) / num_of_threads));
+  const int num_of_groups = (num_of_batches + group_size - 1) / group_size;
+
+  std::vector<std::shared_ptr<CooccurrenceBatch>> intermediate_batches(num_of_groups);
+  ParallelFor(num_of_groups, num_of_threads, [&](int group_index) {  // NOLINT
+    std::vector<std::shared_ptr<CooccurrenceBatch>> group_of_batches(
+      vector_of_batches_.begin() + group_index * group_size,
+      vector_of_batches_.begin() + std::min((group_index + 1) * group_size, num_of_batches));
+
+    std::shared_ptr<CooccurrenceBatch> batch = CreateNewCooccurrenceBatch();
+    KWayMerge(group_of_batches, 0, std::numeric_limits<int>::max(),
+              [&batch](const Cell& cell) { batch->WriteCell(cell); });  // NOLINT
+    batch->FinishWriting();
+    bytes_spilled_ += batch->byte_size();
+    intermediate_batches[group_index] = batch;
+  });
+
+  // Merged batches are destroyed here, and their files are removed
+  vector_of_batches_.swap(intermediate_batches);
+}
+
+void CooccurrenceCollector::SecondStageOfMerging() {
+  // Stage 2: merging of final batches by ranges of first token id
+  // Each range is written into its own temporary files, which are concatenated into the output files
+  // in the order of ranges (so the output files are sorted by first token id as well).
+  // Ppmi is calculated in the same pass, as statistics of occurrence of all tokens is already known
+  const int num_of_threads = std::max(1, config_.num_threads());
+  const std::vector<int> bounds = SplitFirstTokenRange(num_of_threads * kNumOfRangesPerThread);
+  const int num_of_ranges = static_cast<int>(bounds.size()) - 1;
+
+  // Output files of cooc tf, cooc df, ppmi tf and ppmi df (empty if the file isn't written)
+  const std::vector<std::string> output_paths = {
+    config_.gather_cooc_tf() ? config_.cooc_tf_file_path() : std::string(),
+    config_.gather_cooc_df() ? config_.cooc_df_file_path() : std::string(),
+    config_.calculate_ppmi_tf() ? config_.ppmi_tf_file_path() : std::string(),
+    config_.calculate_ppmi_df() ? config_.ppmi_df_file_path() : std::string()
   };
+  std::vector<std::vector<std::string>> parts(output_paths.size(), std::vector<std::string>(num_of_ranges));
 
-  std::vector<std::shared_ptr<CooccurrenceBatch>> intermediate_batches;
-  std::mutex intermediate_batches_access_mutex;
-  std::queue<unsigned> queue_of_indices;
-  std::mutex queue_access_mutex;
-
-  auto worker = [&intermediate_batches, &intermediate_batches_access_mutex,
-                 &queue_of_indices, &queue_access_mutex, &func]() {
-    while (true) {
-      unsigned index;
-      {  // take one task from queue of tasks
-        std::unique_lock<std::mutex> queue_access_lock(queue_access_mutex);
-        if (queue_of_indices.empty()) {
-          break;
-        } else {
-          index = queue_of_indices.front();
-          queue_of_indices.pop();
-        }
-      }
-      std::shared_ptr<CooccurrenceBatch> batch = func(index);
-      {
-        std::unique_lock<std::mutex> intermediate_batches_access_lock(intermediate_batches_access_mutex);
-        intermediate_batches.push_back(std::move(batch));
+  ParallelFor(num_of_ranges, num_of_threads, [&](int range_index) {  // NOLINT
+    for (size_t i = 0; i < output_paths.size(); ++i) {
+      if (!output_paths[i].empty()) {
+        parts[i][range_index] = CreateFileInBatchDir();
       }
     }
-  };
-  // Prepare indices for threads (each thread will take index and send in func)
-  for (int i = 0; i * portion_size < static_cast<int>(vector_of_batches_.size()); ++i) {
-    queue_of_indices.push(i);
-  }
-  // Launch workers
-  std::vector<std::thread> workers;
-  for (int i = 0; i < num_of_threads; ++i) {
-    workers.emplace_back(worker);
-  }
-  for (int i = 0; i < num_of_threads; ++i) {
-    workers[i].join();
-  }
-  vector_of_batches_ = std::move(intermediate_batches);
-}
-
-void CooccurrenceCollector::SecondStageOfMerging(BufferOfCooccurrences* buffer_for_output_files,
-                               std::vector<std::shared_ptr<CooccurrenceBatch>>* intermediate_batches) {
-  // Stage 2: merging of final batches (in single thread)
-  std::shared_ptr<std::mutex> open_close_file_mutex_ptr(new std::mutex);
-  // Note: the 4th arg is fake, it's not used later if mode == OUTPUT_FILE
-  KWayMerge(buffer_for_output_files, OUTPUT_FILE, intermediate_batches,
-            (*intermediate_batches)[0], open_close_file_mutex_ptr);
-  // Files are explicitly closed here, because it's necesery to push the data in files on this step
-  if (config_.gather_cooc_tf()) {
-    buffer_for_output_files->cooc_tf_dict_out_.close();
-  }
-  if (config_.gather_cooc_df()) {
-    buffer_for_output_files->cooc_df_dict_out_.close();
-  }
-  buffer_for_output_files->open_files_counter_ -= 2;
-  open_files_counter_ -= 2;
-}
-
-void CooccurrenceCollector::KWayMerge(BufferOfCooccurrences* buffer, const int mode,
-                                      std::vector<std::shared_ptr<CooccurrenceBatch>>* vector_of_input_batches_ptr,
-                                      std::shared_ptr<CooccurrenceBatch> out_batch,
-                                      std::shared_ptr<std::mutex> open_close_file_mutex_ptr) {
-  // All cooc batches has it's local buffer in RAM (look the CooccurrenceBatch class implementation)
-  // Information in batches is stored in cells.
-  // There are 2 different output formats, which are set via mode parameter:
-  // 1. Batches
-  // 2. Output file
+
+    BufferOfCooccurrences buffer(vocab_, num_of_documents_token_occurred_in_, num_of_pairs_token_occurred_in_,
+                                 config_, parts[0][range_index], parts[1][range_index],
+                                 parts[2][range_index], parts[3][range_index]);
+    KWayMerge(vector_of_batches_, bounds[range_index], bounds[range_index + 1],
+              [&buffer](const Cell& cell) { buffer.WriteCell(cell); });  // NOLINT
+    // Files are explicitly closed here, because it's necesery to push the data in files on this step
+    buffer.Close();
+  });
+
+  for (size_t i = 0; i < output_paths.size(); ++i) {
+    if (!output_paths[i].empty()) {
+      ConcatenateFiles(parts[i], output_paths[i]);
+    }
+  }
+}
+
+std::vector<int> CooccurrenceCollector::SplitFirstTokenRange(int num_ranges) const {
+  // Returns the bounds of ranges of first token ids, so that each range holds approximately
+  // the same amount of data in the batches (the size is estimated by the sparse indices of the batches)
+  std::vector<std::pair<int, int64_t>> sizes;  // (first token id, size of the data that starts from it)
+  int64_t total_size = 0;
+  for (const auto& batch : vector_of_batches_) {
+    for (size_t i = 0; i < batch->index_.size(); ++i) {
+      const int64_t end = (i + 1 < batch->index_.size()) ? batch->index_[i + 1].second : batch->byte_size();
+      sizes.push_back(std::make_pair(batch->index_[i].first, end - batch->index_[i].second));
+      total_size += end - batch->index_[i].second;
+    }
+  }
+  std::sort(sizes.begin(), sizes.end());
+
+  std::vector<int> bounds(1, 0);
+  int64_t accumulated_size = 0;
+  for (const auto& size : sizes) {
+    if (static_cast<int>(bounds.size()) < num_ranges &&
+        accumulated_size * num_ranges >= total_size * static_cast<int64_t>(bounds.size()) &&
+        size.first > bounds.back()) {
+      bounds.push_back(size.first);
+    }
+    accumulated_size += size.second;
+  }
+  bounds.push_back(std::numeric_limits<int>::max());
+  return bounds;
+}
+
+void CooccurrenceCollector::KWayMerge(const std::vector<std::shared_ptr<CooccurrenceBatch>>& batches,
+                                      int first_token_begin, int first_token_end,
+                                      const std::function<void(const Cell&)>& write_cell) const {
+  // Every reader of a batch holds one cell in RAM (look the CooccurrenceBatchReader class implementation)
   // Here's the k-way merge algorithm for external sorting:
-  // 1. Initially first cells of all the batches are read in their buffers
-  // 2. Then batches are sorted (std::make_heap) by first_token_id of the cell
-  // 3. Then a cell with the lowest first_token_id is extaracted and put in
-  // buffer and the next cell is read from corresponding batch
-  // 4. If the lowest first token id equals first token id of cell of this buffer, they are merged
-  // else the current cell is written in file and the new one is loaded.
+  // 1. Initially first cells (in the range of first token ids) of all the batches are read
+  // 2. Then readers are sorted (std::make_heap) by first_token_id of the cell
+  // 3. Then a cell with the lowest first_token_id is extaracted and merged into the current cell
+  // and the next cell is read from corresponding batch
+  // 4. If the lowest first token id doesn't equal first token id of the current cell,
+  // the current cell is passed to write_cell and the new one takes its place
   // Writing and empting is done in order to keep low memory consumption
-  // During execution of this function (if mode is OUTPUT_FILE) n_u is calculated and saved,
-  // so after merge all the information needed to calculate ppmi will be gathered and
-  // available from class BufferOfCooccurrences
-  // Note: here's only 1 way to communicate between threads - through open_files_counter
 
   // Step 1:
-  std::vector<std::shared_ptr<CooccurrenceBatch>>& vector_of_input_batches = *vector_of_input_batches_ptr;
-  auto iter = vector_of_input_batches.begin();
-  {  // Open all files and read the first cell
-    std::unique_lock<std::mutex> open_close_file_lock(*open_close_file_mutex_ptr);
-    for (; iter != vector_of_input_batches.end(); ++iter) {
-      OpenBatchInputFile(*iter);
-      (*iter)->ReadCell();
+  std::vector<std::shared_ptr<CooccurrenceBatchReader>> readers;
+  for (const auto& batch : batches) {
+    auto reader = std::make_shared<CooccurrenceBatchReader>(batch, first_token_begin, first_token_end);
+    if (reader->ReadCell()) {
+      readers.push_back(reader);
     }
   }
   // Step 2:
-  std::make_heap(vector_of_input_batches.begin(), vector_of_input_batches.end(),
-                 CooccurrenceBatch::CoocBatchComparator());
-  if (!vector_of_input_batches.empty()) {
-    buffer->cell_ = Cell();
-    buffer->cell_.first_token_id = (*vector_of_input_batches[0]).cell_.first_token_id;
-  }
-  while (!vector_of_input_batches.empty()) {
+  std::make_heap(readers.begin(), readers.end(), CooccurrenceBatchReader::CoocBatchReaderComparator());
+  Cell current_cell;
+  std::vector<CoocInfo> merged_records;
+  while (!readers.empty()) {
+    // Step 3:
+    std::pop_heap(readers.begin(), readers.end(), CooccurrenceBatchReader::CoocBatchReaderComparator());
+    const Cell& cell = readers.back()->cell();
     // Step 4:
-    if (buffer->cell_.first_token_id == (*vector_of_input_batches[0]).cell_.first_token_id) {
-      buffer->MergeWithExistingCell(*vector_of_input_batches[0]);
+    if (current_cell.first_token_id == cell.first_token_id) {
+      MergeRecords(cell.records, &current_cell.records, &merged_records);
     } else {
-      if (mode == BATCH) {
-        out_batch->cell_ = buffer->cell_;
-        out_batch->WriteCell();
-      } else if (mode == OUTPUT_FILE) {
-        if (config_.calculate_ppmi_tf()) {
-          buffer->CalculateTFStatistics();
-        }
-        if (config_.gather_cooc_tf()) {
-          buffer->WriteCoocFromCell(TokenCoocFrequency, config_.cooc_min_tf());
-        }
-        if (config_.gather_cooc_df()) {
-          buffer->WriteCoocFromCell(DocumentCoocFrequency, config_.cooc_min_df());
-        }
-        // It's importants to set size = 0 after popping, because this value will be checked later
-        buffer->cell_.records.resize(0);
+      if (!current_cell.records.empty()) {
+        write_cell(current_cell);
       }
-      buffer->cell_ = (*vector_of_input_batches[0]).cell_;
+      current_cell.first_token_id = cell.first_token_id;
+      current_cell.records = cell.records;
     }
-    // Step 3:
-    std::pop_heap(vector_of_input_batches.begin(), vector_of_input_batches.end(),
-                  CooccurrenceBatch::CoocBatchComparator());
     // if there are some data to read ReadCell reads it and returns true, else returns false
-    if (vector_of_input_batches.back()->ReadCell()) {
-      std::push_heap(vector_of_input_batches.begin(), vector_of_input_batches.end(),
-                     CooccurrenceBatch::CoocBatchComparator());
+    if (readers.back()->ReadCell()) {
+      std::push_heap(readers.begin(), readers.end(), CooccurrenceBatchReader::CoocBatchReaderComparator());
     } else {
-      std::unique_lock<std::mutex> open_close_file_lock(*open_close_file_mutex_ptr);
-      CloseBatchInputFile(vector_of_input_batches.back());
-      vector_of_input_batches.pop_back();
-    }
-  }
-  if (!buffer->cell_.records.empty()) {
-    if (mode == BATCH) {
-      out_batch->cell_ = buffer->cell_;
-      out_batch->WriteCell();
-    } else if (mode == OUTPUT_FILE) {
-      if (config_.calculate_ppmi_tf()) {
-        buffer->CalculateTFStatistics();
-      }
-      if (config_.gather_cooc_tf()) {
-        buffer->WriteCoocFromCell(TokenCoocFrequency, config_.cooc_min_tf());
-      }
-      if (config_.gather_cooc_df()) {
-        buffer->WriteCoocFromCell(DocumentCoocFrequency, config_.cooc_min_df());
-      }
-    }
-  }
-}
-
-void CooccurrenceCollector::OpenBatchInputFile(std::shared_ptr<CooccurrenceBatch> batch) {
-  if (!batch->in_batch_.is_open()) {
-    std::unique_lock<std::mutex> open_close_file_lock(open_close_file_mutex_);
-    assert(open_files_counter_ < config_.max_num_of_open_files_in_a_process());
-    batch->in_batch_.open(batch->filename_, std::ios::in);
-    if (!batch->in_batch_.is_open()) {
-      BOOST_THROW_EXCEPTION(InvalidOperation(
-        "Failed to open co-occurrence batch file for reading, path = " + batch->filename_));
+      readers.pop_back();
     }
-    // ToDo (MichaelSolotky): find the way to check correctness of the seekg procedure
-    batch->in_batch_.seekg(batch->in_batch_offset_);
-    ++open_files_counter_;
   }
-}
-
-bool CooccurrenceCollector::IsOpenBatchInputFile(const CooccurrenceBatch& batch) const {
-  return batch.in_batch_.is_open();
-}
-
-void CooccurrenceCollector::CloseBatchInputFile(std::shared_ptr<CooccurrenceBatch> batch) {
-  if (batch->in_batch_.is_open()) {
-    std::unique_lock<std::mutex> open_close_file_lock(open_close_file_mutex_);
-    batch->in_batch_offset_ = batch->in_batch_.tellg();
-    batch->in_batch_.close();
-    if (batch->in_batch_.is_open()) {
-      BOOST_THROW_EXCEPTION(InvalidOperation(
-        "Failed to close co-occurrence batch file, path = " + batch->filename_));
-    }
-    --open_files_counter_;
+  if (!current_cell.records.empty()) {
+    write_cell(current_cell);
   }
 }
 
@@ -585,346 +601,378 @@ unsigned Vocab::VocabSize() const {
 
 // This class stores temporarily added statistics about pairs of tokens (how often these pairs
 // occurred in documents in a window and in how many documents they occurred together in a window).
-// The data is stored in rb tree (std::map)
+// The data is stored in a flat hash table with linear probing, which has much lower memory overhead
+// and better locality than node-based containers
+CooccurrenceStatisticsHolder::CooccurrenceStatisticsHolder(CooccurrenceCollector* collector)
+    : collector_(collector), records_(), size_(0), sorted_(false) {
+  const size_t initial_capacity = 1024;
+  Rehash(initial_capacity);
+}
+
+CooccurrenceStatisticsHolder::~CooccurrenceStatisticsHolder() {
+  if (collector_ != nullptr) {
+    collector_->ReportMemoryUsage(-ByteSize());
+  }
+}
+
+int64_t CooccurrenceStatisticsHolder::ByteSize() const {
+  return sizeof(Record) * records_.capacity();
+}
+
+void CooccurrenceStatisticsHolder::Rehash(size_t capacity) {
+  const int64_t old_byte_size = ByteSize();
+  Record empty_record = { kEmptyKey, 0, 0, 0 };
+  std::vector<Record> records(capacity, empty_record);
+  const size_t mask = capacity - 1;
+  for (const Record& record : records_) {
+    if (record.key != kEmptyKey) {
+      size_t index = HashKey(record.key) & mask;
+      while (records[index].key != kEmptyKey) {
+        index = (index + 1) & mask;
+      }
+      records[index] = record;
+    }
+  }
+  records_.swap(records);
+
+  if (collector_ != nullptr) {
+    collector_->ReportMemoryUsage(ByteSize() - old_byte_size);
+  }
+}
+
 void CooccurrenceStatisticsHolder::SavePairOfTokens(const int first_token_id, const int second_token_id,
                                                     const unsigned doc_id, const double weight) {
-  // There are 2 levels of indexing
-  // The first level keeps information about first token and the second level
-  // about co-occurrence between the first and the second tokens
-  // If first token id is known (exists in the structure), corresponding node should be modified
-  // else it should be added to the structure
-  auto it1 = storage_.find(first_token_id);
-  if (it1 == storage_.end()) {
-    FirstToken first_token;
-    first_token.second_token_reference = std::map<int, SecondTokenAndCooccurrence> {
-      {second_token_id, SecondTokenAndCooccurrence(doc_id, weight)}
-    };
-    storage_.insert(std::pair<int, FirstToken>(first_token_id, first_token));
-  } else {
-    std::map<int, SecondTokenAndCooccurrence>& second_tokens = it1->second.second_token_reference;
-    auto it2 = second_tokens.find(second_token_id);
-    if (it2 == second_tokens.end()) {
-      SecondTokenAndCooccurrence second_token(doc_id, weight);
-      second_tokens.insert(std::pair<int, SecondTokenAndCooccurrence>(second_token_id, second_token));
-    } else {
-      if (it2->second.last_doc_id != doc_id) {
-        it2->second.last_doc_id = doc_id;
-        ++(it2->second.cooc_df);
+  // If the pair is known (exists in the table), corresponding record should be modified
+  // else it should be added to the first empty slot after its hash
+  if (sorted_) {
+    BOOST_THROW_EXCEPTION(InvalidOperation("Co-occurrence statistics can't be modified after sorting"));
+  }
+
+  // The load factor is kept below 1/2, so that probe sequences stay short
+  if (2 * (size_ + 1) > records_.size()) {
+    Rehash(2 * records_.size());
+  }
+
+  const uint64_t key = MakeKey(first_token_id, second_token_id);
+  const size_t mask = records_.size() - 1;
+  for (size_t index = HashKey(key) & mask; ; index = (index + 1) & mask) {
+    Record& record = records_[index];
+    if (record.key == key) {
+      if (record.last_doc_id != doc_id) {
+        record.last_doc_id = doc_id;
+        ++record.cooc_df;
       }
-      it2->second.cooc_tf += weight;
+      record.cooc_tf += weight;
+      return;
+    }
+
+    if (record.key == kEmptyKey) {
+      record.key = key;
+      record.last_doc_id = doc_id;
+      record.cooc_df = 1;
+      record.cooc_tf = weight;
+      ++size_;
+      return;
     }
   }
 }
 
-bool CooccurrenceStatisticsHolder::Empty() {
-  return storage_.empty();
+void CooccurrenceStatisticsHolder::SortRecords() {
+  if (sorted_) {
+    return;
+  }
+
+  size_t size = 0;
+  for (size_t index = 0; index < records_.size(); ++index) {
+    if (records_[index].key != kEmptyKey) {
+      records_[size++] = records_[index];
+    }
+  }
+  std::sort(records_.begin(), records_.begin() + size_, [](const Record& left, const Record& right) {  // NOLINT
+    return left.key < right.key;
+  });
+  sorted_ = true;
 }
 
 // ******************************** Methods of class CooccurrenceBatch ********************************
 
-CooccurrenceBatch::CooccurrenceBatch(const std::string& path_to_batches) : in_batch_offset_(0) {
+CooccurrenceBatch::CooccurrenceBatch(const std::string& path_to_batches) : byte_size_(0) {
   boost::uuids::uuid uuid = boost::uuids::random_generator()();
   fs::path batch(boost::lexical_cast<std::string>(uuid));
   fs::path full_filename = fs::path(path_to_batches) / batch;
   filename_ = full_filename.string();
 }
 
-void CooccurrenceBatch::FormNewCell(const std::map<int, CooccurrenceStatisticsHolder::FirstToken>
-                                             ::const_iterator& cooc_stat_node) {
-  // Here is initialization of a new cell
-  // A cell consists on first_token_id, number of records it includes
-  // Then records go, every reord consists on second_token_id, cooc_tf, cooc_df
-  cell_.first_token_id = cooc_stat_node->first;
-  // while reading from file it's necessery to know how many records to read
-  auto second_token_reference = cooc_stat_node->second.second_token_reference;
-  cell_.num_of_records = second_token_reference.size();
-  cell_.records.resize(cell_.num_of_records);
-  unsigned i = 0;
-  for (auto iter = second_token_reference.begin(); iter != second_token_reference.end(); ++iter, ++i) {
-    cell_.records[i].second_token_id = iter->first;
-    cell_.records[i].cooc_tf = iter->second.cooc_tf;
-    cell_.records[i].cooc_df = iter->second.cooc_df;
-  }
-}
-
-void CooccurrenceBatch::WriteCell() {
-  // Cells are written in following form: first line consists of first token id and num of triples
-  // the second line consists of numbers triples, which are separeted with a
-  // space and numbers in these triples are separeted the same
-  // stringstream is used for fast bufferized i/o operations
-  // Initially data is written into stringstreams and then one large stringstream is written in file
-  std::stringstream ss;
-  ss << cell_.first_token_id << ' ';
-  // The value of the variable cell_.num_of_records is invalid (wasn't updated from first read from batch)
-  ss << cell_.records.size() << std::endl;
-  for (unsigned i = 0; i < cell_.records.size(); ++i) {
-    ss << cell_.records[i].second_token_id << ' ';
-    ss << cell_.records[i].cooc_tf << ' ';
-    ss << cell_.records[i].cooc_df << ' ';
+CooccurrenceBatch::~CooccurrenceBatch() {
+  boost::system::error_code error;
+  fs::remove(filename_, error);
+}
+
+void CooccurrenceBatch::WriteCell(const Cell& cell) {
+  // Cells are encoded into a buffer, which is written into the file by large chunks
+  if (!out_batch_.is_open()) {
+    out_batch_.open(filename_, std::ios::out | std::ios::binary);
+    if (!out_batch_.is_open()) {
+      BOOST_THROW_EXCEPTION(InvalidOperation(
+        "Failed to open co-occurrence batch file for writing, path = " + filename_));
+    }
+  }
+
+  const int64_t offset = byte_size_ + buffer_.size();
+  if (index_.empty() || offset - index_.back().second >= kCoocBatchIndexStep) {
+    index_.push_back(std::make_pair(cell.first_token_id, offset));
+  }
+
+  AppendVarint(cell.first_token_id, &buffer_);
+  AppendVarint(cell.records.size(), &buffer_);
+  int prev_second_token_id = 0;
+  for (const CoocInfo& record : cell.records) {
+    AppendVarint(record.second_token_id - prev_second_token_id, &buffer_);
+    AppendVarint(record.cooc_tf, &buffer_);
+    AppendVarint(record.cooc_df, &buffer_);
+    prev_second_token_id = record.second_token_id;
+  }
+
+  if (buffer_.size() >= kCoocBatchWriteBufferSize) {
+    out_batch_.write(buffer_.data(), buffer_.size());
+    byte_size_ += buffer_.size();
+    buffer_.clear();
   }
-  ss << std::endl;
-  out_batch_ << ss.str();
 }
 
-bool CooccurrenceBatch::ReadCell() {
-  if (ReadCellHeader()) {
-    ReadRecords();
-    return true;
+void CooccurrenceBatch::FinishWriting() {
+  if (!out_batch_.is_open()) {
+    return;
+  }
+
+  out_batch_.write(buffer_.data(), buffer_.size());
+  byte_size_ += buffer_.size();
+  std::string().swap(buffer_);
+  out_batch_.close();
+  if (out_batch_.fail()) {
+    BOOST_THROW_EXCEPTION(InvalidOperation(
+      "Failed to write co-occurrence batch file, path = " + filename_));
   }
-  return false;
 }
 
-bool CooccurrenceBatch::ReadCellHeader() {
-  // stringstream is used for fast bufferized i/o operations
-  std::string str;
-  getline(in_batch_, str);
-  std::stringstream ss(str);
-  ss >> cell_.first_token_id;
-  ss >> cell_.num_of_records;
-  if (!in_batch_.eof()) {
-    return true;
-  } else {
-    return false;
+// ******************************** Methods of class CooccurrenceBatchReader ********************************
+
+CooccurrenceBatchReader::CooccurrenceBatchReader(std::shared_ptr<CooccurrenceBatch> batch,
+                                                 int first_token_begin, int first_token_end)
+    : batch_(batch), file_(), ptr_(nullptr), end_(nullptr),
+      first_token_begin_(first_token_begin), first_token_end_(first_token_end) {
+  if (batch_->byte_size() == 0) {
+    return;
+  }
+
+  // Start from the last indexed cell before first_token_begin
+  auto iter = std::upper_bound(batch_->index_.begin(), batch_->index_.end(),
+                               std::make_pair(first_token_begin, std::numeric_limits<int64_t>::max()));
+  if (iter != batch_->index_.begin()) {
+    --iter;
+  }
+
+  try {
+    file_.open(batch_->filename_);
+  } catch (std::exception& ex) {
+    BOOST_THROW_EXCEPTION(InvalidOperation(
+      "Failed to open co-occurrence batch file for reading, path = " + batch_->filename_ + ", " + ex.what()));
   }
+
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(file_.data());
+  ptr_ = data + iter->second;
+  end_ = data + file_.size();
 }
 
-void CooccurrenceBatch::ReadRecords() {
-  // It's not good if there are no records in batch after header
-  if (in_batch_.eof()) {
-    BOOST_THROW_EXCEPTION(InvalidOperation("Error while reading from batch. File is corrupted"));
+bool CooccurrenceBatchReader::ReadVarint(uint64_t* value) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && ptr_ < end_; shift += 7) {
+    const uint64_t byte = *ptr_++;
+    result |= (byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return true;
+    }
   }
-  std::string str;
-  getline(in_batch_, str);
-  // stringstream is used for fast bufferized i/o operations
-  std::stringstream ss(str);
-  cell_.records.resize(cell_.num_of_records);
-  for (unsigned i = 0; i < cell_.num_of_records; ++i) {
-    ss >> cell_.records[i].second_token_id;
-    ss >> cell_.records[i].cooc_tf;
-    ss >> cell_.records[i].cooc_df;
+  return false;
+}
+
+bool CooccurrenceBatchReader::ReadCell() {
+  // Cells before first_token_begin are skipped (reading starts from the indexed cell, which may be earlier)
+  while (ptr_ < end_) {
+    uint64_t first_token_id = 0;
+    uint64_t num_of_records = 0;
+    if (!ReadVarint(&first_token_id) || !ReadVarint(&num_of_records) ||
+        num_of_records > static_cast<uint64_t>(end_ - ptr_)) {
+      BOOST_THROW_EXCEPTION(InvalidOperation("Error while reading from batch. File is corrupted"));
+    }
+
+    cell_.first_token_id = static_cast<int>(first_token_id);
+    if (cell_.first_token_id >= first_token_end_) {
+      ptr_ = end_;
+      return false;
+    }
+
+    cell_.records.resize(num_of_records);
+    uint64_t second_token_id = 0;
+    for (CoocInfo& record : cell_.records) {
+      uint64_t delta = 0;
+      uint64_t cooc_tf = 0;
+      uint64_t cooc_df = 0;
+      if (!ReadVarint(&delta) || !ReadVarint(&cooc_tf) || !ReadVarint(&cooc_df)) {
+        BOOST_THROW_EXCEPTION(InvalidOperation("Error while reading from batch. File is corrupted"));
+      }
+      second_token_id += delta;
+      record.second_token_id = static_cast<int>(second_token_id);
+      record.cooc_tf = static_cast<int64_t>(cooc_tf);
+      record.cooc_df = static_cast<unsigned>(cooc_df);
+    }
+
+    if (cell_.first_token_id >= first_token_begin_) {
+      return true;
+    }
   }
+  return false;
 }
 
 // ********************************* Methods of class BufferOfCooccurrences *********************************
 
-// ToDo (MichaeSolotky): logic of this class isn't obvious, it would be cool to express thoughts clearer
-// ToDo (MichaeSolotky): don't copy vocab if there's no need (like in CooccurrenceCollector)
-
-// The main purpose of this class is to store statistics of co-occurrences and some
-// variables calculated on base of them, perform that calculations, write that in
-// target file and read from it.
-// This class stores data in cells (special structure) before they are written in resulting files
-// A cell can from a batch can come in this buffer and be merged with current stored
-// (in case first_token_ids of cells are equal) or the current cell can be pushed from buffer in file
-// (in case first_token_ids aren't equal) and new cell takes place of the old one
-// This buffer can be used for writing in a batch or in a target file (like file of co-occurrences
-// or file of pPMI), the target_ parameter is responsible for this, it can be either
-// OUTPUT_FILE or BATCH
+// The main purpose of this class is to write merged statistics of co-occurrences into
+// target files and calculate variables based on them (like ppmi).
+// Merged cells come into this buffer in increasing order of first token id (see CooccurrenceCollector::KWayMerge)
 BufferOfCooccurrences::BufferOfCooccurrences(
-    const int target, const Vocab& vocab,
+    const Vocab& vocab,
     const std::vector<unsigned>& num_of_documents_token_occurred_in,
-    const CooccurrenceCollectorConfig& config) : target_(target), vocab_(vocab),
+    const std::vector<int64_t>& num_of_pairs_token_occurred_in,
+    const CooccurrenceCollectorConfig& config,
+    const std::string& cooc_tf_file_path,
+    const std::string& cooc_df_file_path,
+    const std::string& ppmi_tf_file_path,
+    const std::string& ppmi_df_file_path) : vocab_(vocab),
                       num_of_documents_token_occurred_in_(num_of_documents_token_occurred_in),
-                      open_files_counter_(0), config_(config) {
-  num_of_pairs_token_occurred_in_.resize(vocab_.token_map_.size());
-  if (target_ == OUTPUT_FILE) {  // Open that files only if planning to write in them
-    if (config_.gather_cooc_tf()) {  // It's important firstly to create file (open output file)
-      cooc_tf_dict_out_.open(config_.cooc_tf_file_path(), std::ios::out);
-      CheckOutputFile(cooc_tf_dict_out_, config_.cooc_tf_file_path());
-      cooc_tf_dict_in_.open(config_.cooc_tf_file_path(), std::ios::in);
-      CheckInputFile(cooc_tf_dict_in_, config_.cooc_tf_file_path());
-      open_files_counter_ += 2;
-    }
-    if (config_.gather_cooc_df()) {
-      cooc_df_dict_out_.open(config_.cooc_df_file_path(), std::ios::out);
-      CheckOutputFile(cooc_df_dict_out_, config_.cooc_df_file_path());
-      cooc_df_dict_in_.open(config_.cooc_df_file_path(), std::ios::in);
-      CheckInputFile(cooc_df_dict_in_, config_.cooc_df_file_path());
-      open_files_counter_ += 2;
-    }
-    if (config_.calculate_ppmi_tf()) {
-      ppmi_tf_dict_.open(config_.ppmi_tf_file_path(), std::ios::out);
-      CheckOutputFile(ppmi_tf_dict_, config_.ppmi_tf_file_path());
-      ++open_files_counter_;
-    }
-    if (config_.calculate_ppmi_df()) {
-      ppmi_df_dict_.open(config_.ppmi_df_file_path(), std::ios::out);
-      CheckOutputFile(ppmi_df_dict_, config_.ppmi_df_file_path());
-      ++open_files_counter_;
-    }
-  }
+                      num_of_pairs_token_occurred_in_(num_of_pairs_token_occurred_in),
+                      config_(config) {
+  // Open that files only if planning to write in them
+  OpenOutputFile(cooc_tf_file_path, &cooc_tf_dict_out_);
+  OpenOutputFile(cooc_df_file_path, &cooc_df_dict_out_);
+  OpenOutputFile(ppmi_tf_file_path, &ppmi_tf_dict_out_);
+  OpenOutputFile(ppmi_df_file_path, &ppmi_df_dict_out_);
 }
 
-void BufferOfCooccurrences::CheckInputFile(const std::ifstream& file, const std::string& filename) {
-  if (!file.good()) {
-    BOOST_THROW_EXCEPTION(InvalidOperation("Failed to open input file " +
-                                            filename + " in working directory"));
+void BufferOfCooccurrences::OpenOutputFile(const std::string& filename, std::ofstream* file) {
+  if (filename.empty()) {
+    return;
   }
-}
 
-void BufferOfCooccurrences::CheckOutputFile(const std::ofstream& file, const std::string& filename) {
-  if (!file.good()) {
+  file->open(filename, std::ios::out);
+  if (!file->good()) {
     BOOST_THROW_EXCEPTION(InvalidOperation("Failed to open or create output file " +
                                             filename + " in working directory"));
   }
 }
 
-// ToDo (MichaelSolotky): may be this can be implemented in more optimal way
-void BufferOfCooccurrences::MergeWithExistingCell(const CooccurrenceBatch& batch) {
-  // All the data in buffer are stored in a cell, so here are rules of updating each cell
-  // This function takes two vectors (one of the current cell and one which is stored in batch),
-  // merges them in folowing way:
-  // 1. If two elements of vector are different (different second token id),
-  // stacks them one to another in ascending order
-  // 2. It these two elemnts are equal, adds their cooc_tf and cooc_df and
-  // stores fianl cell with this parameters
-  // After merging final vector is sorted in ascending order
-  std::vector<CoocInfo> old_vector = cell_.records;
-  cell_.records.resize(old_vector.size() + batch.cell_.records.size());
-  auto fi_iter = old_vector.begin();
-  auto se_iter = batch.cell_.records.begin();
-  auto th_iter = cell_.records.begin();
-  while (fi_iter != old_vector.end() && se_iter != batch.cell_.records.end()) {
-    if (fi_iter->second_token_id == se_iter->second_token_id) {
-      th_iter->second_token_id = fi_iter->second_token_id;
-      th_iter->cooc_tf = fi_iter->cooc_tf + se_iter->cooc_tf;
-      th_iter->cooc_df = fi_iter->cooc_df + se_iter->cooc_df;
-      ++fi_iter;
-      ++se_iter;
-    } else if (fi_iter->second_token_id < se_iter->second_token_id) {
-      *th_iter = *fi_iter;
-      ++fi_iter;
-    } else {
-      *th_iter = *se_iter;
-      ++se_iter;
+void BufferOfCooccurrences::CloseOutputFile(std::ofstream* file) {
+  if (file->is_open()) {
+    file->close();
+    if (file->fail()) {
+      BOOST_THROW_EXCEPTION(InvalidOperation("Failed to write output file of co-occurrences"));
     }
-    ++th_iter;
   }
-  cell_.records.resize(th_iter - cell_.records.begin());
-  std::copy(fi_iter, old_vector.end(), std::back_inserter(cell_.records));
-  std::copy(se_iter, batch.cell_.records.end(), std::back_inserter(cell_.records));
 }
 
-void BufferOfCooccurrences::CalculateTFStatistics() {
-  // Calculate statistics of occurrence (of first token which is associated with current cell)
-  int64_t n_u = 0;
-  for (unsigned i = 0; i < cell_.records.size(); ++i) {
-    if (config_.store_symmetric_cooc_values() && cell_.first_token_id != cell_.records[i].second_token_id) {
-      num_of_pairs_token_occurred_in_[cell_.records[i].second_token_id] += cell_.records[i].cooc_tf;
-    }  // pairs <u u> have double weight so in symmetric case they should be taken once
-    n_u += cell_.records[i].cooc_tf;
+void BufferOfCooccurrences::Close() {
+  CloseOutputFile(&cooc_tf_dict_out_);
+  CloseOutputFile(&cooc_df_dict_out_);
+  CloseOutputFile(&ppmi_tf_dict_out_);
+  CloseOutputFile(&ppmi_df_dict_out_);
+}
+
+void BufferOfCooccurrences::WriteCell(const Cell& cell) {
+  if (cooc_tf_dict_out_.is_open()) {
+    WriteCoocFromCell(cell, TokenCoocFrequency, config_.cooc_min_tf(), &cooc_tf_dict_out_);
+  }
+  if (cooc_df_dict_out_.is_open()) {
+    WriteCoocFromCell(cell, DocumentCoocFrequency, config_.cooc_min_df(), &cooc_df_dict_out_);
+  }
+  if (ppmi_tf_dict_out_.is_open()) {
+    WritePpmiFromCell(cell, TokenCoocFrequency, config_.cooc_min_tf(), config_.total_num_of_pairs(),
+                      &ppmi_tf_dict_out_);
+  }
+  if (ppmi_df_dict_out_.is_open()) {
+    WritePpmiFromCell(cell, DocumentCoocFrequency, config_.cooc_min_df(), config_.total_num_of_documents(),
+                      &ppmi_df_dict_out_);
   }
-  num_of_pairs_token_occurred_in_[cell_.first_token_id] += n_u;
 }
 
-void BufferOfCooccurrences::WriteCoocFromCell(const std::string mode, const unsigned cooc_min) {
-  // This function takes a cell from buffer and writes data from cell in file
+void BufferOfCooccurrences::WriteCoocFromCell(const Cell& cell, const std::string mode, const unsigned cooc_min,
+                                              std::ofstream* out) {
+  // This function takes a cell and writes data from cell in file
   // Output file format(s) are defined here
   // stringstream is used for fast bufferized i/o operations
-  // Note: before writing in file all the information is stored in ram
   std::stringstream output_buf;
   bool no_cooc_found = true;
   std::string prev_modality = DefaultClass;
-  Vocab::TokenModality first_token = vocab_.FindTokenStr(cell_.first_token_id);
+  Vocab::TokenModality first_token = vocab_.FindTokenStr(cell.first_token_id);
   if (first_token.modality != DefaultClass) {
     output_buf << '|' << first_token.modality << ' ';
     prev_modality = first_token.modality;
   }
   output_buf << first_token.token_str << ' ';
-  for (unsigned i = 0; i < cell_.records.size(); ++i) {
-    if (cell_.GetCoocFromCell(mode, i) >= cooc_min && cell_.first_token_id != cell_.records[i].second_token_id) {
+  for (unsigned i = 0; i < cell.records.size(); ++i) {
+    if (cell.GetCoocFromCell(mode, i) >= cooc_min && cell.first_token_id != cell.records[i].second_token_id) {
       no_cooc_found = false;
-      Vocab::TokenModality second_token = vocab_.FindTokenStr(cell_.records[i].second_token_id);
+      Vocab::TokenModality second_token = vocab_.FindTokenStr(cell.records[i].second_token_id);
       if (second_token.modality != prev_modality) {
         output_buf << " |" << second_token.modality << ' ';
         prev_modality = second_token.modality;
       }
-      output_buf << second_token.token_str << ':' << cell_.GetCoocFromCell(mode, i) << ' ';
+      output_buf << second_token.token_str << ':' << cell.GetCoocFromCell(mode, i) << ' ';
     }
   }
   if (!no_cooc_found) {
     output_buf << '\n';
-    if (mode == TokenCoocFrequency) {
-      cooc_tf_dict_out_ << output_buf.str();
-    } else {
-      cooc_df_dict_out_ << output_buf.str();
-    }
-  }
-}
-
-void BufferOfCooccurrences::CalculatePpmi() {  // Wrapper around CalculateAndWritePpmi
-  std::cerr << "Calculating pPMI" << std::endl;
-  if (config_.calculate_ppmi_tf()) {
-    CalculateAndWritePpmi(TokenCoocFrequency, config_.total_num_of_pairs());
-  }
-  if (config_.calculate_ppmi_df()) {
-    CalculateAndWritePpmi(DocumentCoocFrequency, config_.total_num_of_documents());
+    *out << output_buf.str();
   }
 }
 
-void BufferOfCooccurrences::CalculateAndWritePpmi(const std::string mode, const long double n) {
-  // This function reads cooc file line by line, calculates ppmi and saves them in external file of ppmi
-  // stringstream is used for fast bufferized i/o operations
-  // Note: before writing in file all the information is stored in ram
+void BufferOfCooccurrences::WritePpmiFromCell(const Cell& cell, const std::string mode, const unsigned cooc_min,
+                                              const long double n, std::ofstream* out) {
+  // This function calculates ppmi of the pairs of the cell, that are written into co-occurrence file
+  // (e.g. pairs of different tokens with co-occurrence not lower than cooc_min), and writes it in file
+  // Note that modalities are written without '|' in ppmi files
   std::stringstream output_buf;
-  std::string str;
-  while (getline(mode == TokenCoocFrequency ? cooc_tf_dict_in_ : cooc_df_dict_in_, str)) {
-    boost::algorithm::trim(str);
-    std::string first_token_modality = DefaultClass;  // Here's how modality is indicated in output file
-    bool new_first_token = true;
-    std::vector<std::string> strs;
-    boost::split(strs, str, boost::is_any_of(" :\t\r"));
-    unsigned index_of_first_token = 0;
-    // Find modality
-    for (; index_of_first_token < strs.size() && (strs[index_of_first_token].empty() ||
-                                                  strs[index_of_first_token][0] == '|'); ++index_of_first_token) {
-      if (!strs[index_of_first_token].empty()) {
-        first_token_modality = strs[index_of_first_token].substr(1);
-      }
+  bool new_first_token = true;
+  Vocab::TokenModality first_token = vocab_.FindTokenStr(cell.first_token_id);
+  std::string prev_modality = first_token.modality;
+  const long double n_u = GetTokenFreq(mode, cell.first_token_id);
+  for (unsigned i = 0; i < cell.records.size(); ++i) {
+    const int64_t cooc = cell.GetCoocFromCell(mode, i);
+    if (cooc < cooc_min || cell.first_token_id == cell.records[i].second_token_id) {
+      continue;
     }
-    std::string first_token_str = strs[index_of_first_token];
-    unsigned not_a_word_counter = 0;
-    std::string prev_modality = first_token_modality;
-    for (unsigned i = index_of_first_token + 1; i + not_a_word_counter < strs.size(); i += 2) {
-      std::string second_token_modality = first_token_modality;
-      for (; i + not_a_word_counter < strs.size() && (strs[i + not_a_word_counter].empty() ||
-                                                      strs[i + not_a_word_counter][0] == '|'); ++not_a_word_counter) {
-        if (!strs[i + not_a_word_counter].empty()) {
-          second_token_modality = strs[i + not_a_word_counter].substr(1);
+
+    long double n_v = GetTokenFreq(mode, cell.records[i].second_token_id);
+    long double n_uv = static_cast<long double>(cooc);
+    double value_inside_logarithm = (n / n_u) / (n_v / n_uv);
+    if (value_inside_logarithm > 1.0) {
+      if (new_first_token) {
+        if (first_token.modality != DefaultClass) {
+          output_buf << first_token.modality << ' ';
         }
+        output_buf << first_token.token_str;
+        new_first_token = false;
       }
-      if (i + not_a_word_counter + 1 >= strs.size()) {
-        break;
-      }
-      std::string second_token_str = strs[i + not_a_word_counter];
-      int64_t cooc = std::stoull(strs[i + not_a_word_counter + 1]);
-      long double n_u = GetTokenFreq(mode, vocab_.FindTokenId(first_token_str, first_token_modality));
-      long double n_v = GetTokenFreq(mode, vocab_.FindTokenId(second_token_str, second_token_modality));
-      long double n_uv = static_cast<long double>(cooc);
-      double value_inside_logarithm = (n / n_u) / (n_v / n_uv);
-      if (value_inside_logarithm > 1.0) {
-        if (new_first_token) {
-          if (first_token_modality != DefaultClass) {
-            output_buf << first_token_modality << ' ';
-          }
-          output_buf << first_token_str;
-          new_first_token = false;
-        }
-        if (second_token_modality != prev_modality) {
-          output_buf << ' ' << second_token_modality;
-          prev_modality = second_token_modality;
-        }
-        output_buf << ' ' << second_token_str << ':' << log(value_inside_logarithm);
+      Vocab::TokenModality second_token = vocab_.FindTokenStr(cell.records[i].second_token_id);
+      if (second_token.modality != prev_modality) {
+        output_buf << ' ' << second_token.modality;
+        prev_modality = second_token.modality;
       }
-    }
-    if (!new_first_token) {
-      output_buf << '\n';
+      output_buf << ' ' << second_token.token_str << ':' << log(value_inside_logarithm);
     }
   }
-  if (mode == TokenCoocFrequency) {
-    ppmi_tf_dict_ << output_buf.str();
-  } else {
-    ppmi_df_dict_ << output_buf.str();
+  if (!new_first_token) {
+    output_buf << '\n';
+    *out << output_buf.str();
   }
 }
 
@@ -2,6 +2,10 @@
 
 #pragma once
 
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <fstream>
@@ -11,10 +15,12 @@
 #include <sstream>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
 #include "boost/filesystem.hpp"
+#include "boost/iostreams/device/mapped_file.hpp"
 #include "boost/utility.hpp"
 
 #include "artm/core/collection_parser.h"
@@ -24,9 +30,7 @@ namespace artm {
 namespace core {
 
 enum {
-  TOKEN_NOT_FOUND = -1,
-  BATCH = 0,
-  OUTPUT_FILE = 1
+  TOKEN_NOT_FOUND = -1
 };
 
 struct CoocInfo {
@@ -37,11 +41,10 @@ struct CoocInfo {
 
 // Data in Cooccurrence batches are stored in cells
 // Every cell refers to its first token id and holds info about tokens that co-occur with it
-// You need firstly to read cell header then records
+// (records are sorted by second_token_id)
 
 struct Cell {
-  explicit Cell(int first_token_id = -1, unsigned num_of_records = 0) :
-       first_token_id(first_token_id), num_of_records(num_of_records) { }
+  explicit Cell(int first_token_id = -1) : first_token_id(first_token_id) { }
 
   int64_t GetCoocFromCell(const std::string& mode, const unsigned record_pos) const {
     if (mode == TokenCoocFrequency) {
@@ -51,7 +54,6 @@ struct Cell {
     }
   }
   int first_token_id;
-  unsigned num_of_records;  // when cell is read, it's necessary to know how many triples to read
   std::vector<CoocInfo> records;
 };
 
@@ -59,6 +61,7 @@ class CooccurrenceCollector;
 class Vocab;
 class CooccurrenceStatisticsHolder;
 class CooccurrenceBatch;
+class CooccurrenceBatchReader;
 class BufferOfCooccurrences;
 
 class Vocab {
@@ -88,6 +91,7 @@ class Vocab {
 
 class CooccurrenceCollector {
   friend class CollectionParser;
+  friend class CooccurrenceStatisticsHolder;
  public:
   explicit CooccurrenceCollector(const CollectionParserConfig& config);
 
@@ -96,6 +100,9 @@ class CooccurrenceCollector {
   unsigned NumOfCooccurrenceBatches() const;
   void ReadAndMergeCooccurrenceBatches();
 
+  int64_t bytes_spilled() const { return bytes_spilled_; }  // total size of all co-occurrence batches written
+  int64_t peak_memory() const { return peak_memory_; }  // peak size of CooccurrenceStatisticsHolders in memory
+
  private:
   std::string MakeKeyForVocab(const std::string& token_str, const std::string& modality) const;
   int FindTokenIdInVocab(const std::string& token_str, const std::string& modality);
@@ -103,123 +110,161 @@ class CooccurrenceCollector {
   unsigned VocabSize();
   void CreateAndSetTargetFolder();
   std::string CreateFileInBatchDir() const;
-  void UploadOnDisk(const CooccurrenceStatisticsHolder& cooc_stat_holder);
+  void UploadOnDisk(CooccurrenceStatisticsHolder* cooc_stat_holder);
   void FirstStageOfMerging();
-  void SecondStageOfMerging(BufferOfCooccurrences* res,
-                            std::vector<std::shared_ptr<CooccurrenceBatch>>* intermediate_batches);
-  void KWayMerge(BufferOfCooccurrences* res, const int mode,
-                 std::vector<std::shared_ptr<CooccurrenceBatch>>* vector_of_batches_ptr,
-                 std::shared_ptr<CooccurrenceBatch> out_batch,
-                 std::shared_ptr<std::mutex> open_close_file_mutex_ptr);
-  CooccurrenceBatch* CreateNewCooccurrenceBatch();
-  void OpenBatchInputFile(std::shared_ptr<CooccurrenceBatch> batch);
-  void OpenBatchOutputFile(std::shared_ptr<CooccurrenceBatch> batch);
-  bool IsOpenBatchInputFile(const CooccurrenceBatch& batch) const;
-  void CloseBatchInputFile(std::shared_ptr<CooccurrenceBatch> batch);
-  void CloseBatchOutputFile(std::shared_ptr<CooccurrenceBatch> batch);
+  void SecondStageOfMerging();
+  void KWayMerge(const std::vector<std::shared_ptr<CooccurrenceBatch>>& batches,
+                 int first_token_begin, int first_token_end,
+                 const std::function<void(const Cell&)>& write_cell) const;
+  std::vector<int> SplitFirstTokenRange(int num_ranges) const;
+  std::shared_ptr<CooccurrenceBatch> CreateNewCooccurrenceBatch();
+  void CalculateTFStatistics(const Cell& cell);
+  void ReportMemoryUsage(int64_t delta);
 
   Vocab vocab_;  // Holds mapping tokens to their indices
   std::vector<unsigned> num_of_documents_token_occurred_in_;  // the index here is token_id
+  std::vector<int64_t> num_of_pairs_token_occurred_in_;  // the index here is token_id, needed for ppmi tf
   std::vector<std::shared_ptr<CooccurrenceBatch>> vector_of_batches_;
-  int open_files_counter_;
-  std::mutex open_close_file_mutex_;
   std::mutex vocab_access_mutex_;
   std::mutex vector_of_batches_access_mutex_;
   std::mutex target_dir_access_mutex_;
+  std::mutex token_statistics_access_mutex_;
+  std::atomic<int64_t> bytes_spilled_;
+  std::atomic<int64_t> memory_usage_;
+  std::atomic<int64_t> peak_memory_;
   CooccurrenceCollectorConfig config_;
 };
 
-class CooccurrenceStatisticsHolder {
+// CooccurrenceStatisticsHolder accumulates tf and df of pairs of tokens of one portion of documents.
+// Pairs are kept in a flat open-addressing hash table keyed by (first_token_id, second_token_id),
+// and are sorted by the key in place before they are written into a co-occurrence batch.
+class CooccurrenceStatisticsHolder : private boost::noncopyable {
   friend class CooccurrenceCollector;
  public:
-  struct FirstToken;
-  struct SecondTokenAndCooccurrence;
+  // The collector (optional) is notified about the memory taken by the holder.
+  explicit CooccurrenceStatisticsHolder(CooccurrenceCollector* collector = nullptr);
+  ~CooccurrenceStatisticsHolder();
+
   void SavePairOfTokens(const int first_token_id, const int second_token_id,
                         const unsigned doc_id, const double weight = 1);
-  bool Empty();
+  bool Empty() const { return size_ == 0; }
+  int64_t ByteSize() const;
 
  private:
-  // Here's two-level structure storage_
-  // Vector was chosen because it has a very low memory overhead
-  std::map<int, FirstToken> storage_;
-};
+  struct Record {
+    uint64_t key;  // first_token_id in the high 32 bits, second_token_id in the low 32 bits
+    // When a new pair comes, this field is checked and if current doc_id isn't
+    // equal to previous cooc_df should be incremented
+    unsigned last_doc_id;  // id of the last document where the pair occurred
+    unsigned cooc_df;
+    int64_t cooc_tf;
+  };
 
-struct CooccurrenceStatisticsHolder::FirstToken {
-  std::map<int, SecondTokenAndCooccurrence> second_token_reference;
-};
+  void Rehash(size_t capacity);
 
-struct CooccurrenceStatisticsHolder::SecondTokenAndCooccurrence {
-  explicit SecondTokenAndCooccurrence(const unsigned doc_id, const int64_t cooc_tf = 1) :
-                                      last_doc_id(doc_id), cooc_tf(cooc_tf), cooc_df(1) { }
-  // When a new pair comes, this field is checked and if current doc_id isn't
-  // equal to previous cooc_df should be incremented
-  unsigned last_doc_id;  // id of the last document where the pair occurred
-  int64_t cooc_tf;
-  unsigned cooc_df;
+  // Moves all pairs to the beginning of records_ and sorts them by the key.
+  // The holder can't be modified after this call.
+  void SortRecords();
+
+  CooccurrenceCollector* collector_;
+  std::vector<Record> records_;  // the capacity is a power of two; empty slots have key == kEmptyKey
+  size_t size_;
+  bool sorted_;
 };
 
-// Cooccurrence Batch is an intermidiate buffer between other data in RAM and
-// a spesific file stored on disc. This buffer holds only one cell at a time.
-// Also it's a wrapper around a ifstream and ofstream of an external file
+// CooccurrenceBatch is a file with a sorted portion of co-occurrence statistics.
+// The file is a sequence of cells in increasing order of first_token_id. All numbers are varint-encoded:
+// first_token_id, number of records, and then (second_token_id delta, cooc_tf, cooc_df) for every record,
+// where the delta is taken from the second_token_id of the previous record of the cell.
+// The batch keeps a sparse index of cell offsets, so that it can be read starting from any first token id
+// (see CooccurrenceBatchReader). The file is removed when the batch is destroyed.
 // Co-occurrence batch can be created only by a special method of class CooccurrenceCollector
-class CooccurrenceBatch: private boost::noncopyable {
+class CooccurrenceBatch : private boost::noncopyable {
   friend class CooccurrenceCollector;
-  friend class BufferOfCooccurrences;
+  friend class CooccurrenceBatchReader;
  public:
-  struct CoocBatchComparator;
-  void FormNewCell(const std::map<int, CooccurrenceStatisticsHolder::FirstToken>::const_iterator& cooc_stat_node);
-  void WriteCell();
-  bool ReadCellHeader();
-  void ReadRecords();
-  bool ReadCell();  // Initiates reading of a cell from a file (e.g. call of ReadCellHeader() and ReadRecords())
+  ~CooccurrenceBatch();
+
+  void WriteCell(const Cell& cell);
+  void FinishWriting();
+  int64_t byte_size() const { return byte_size_; }
 
  private:
   explicit CooccurrenceBatch(const std::string& path_to_batches);
 
-  Cell cell_;
-  std::ifstream in_batch_;
-  std::ofstream out_batch_;
   std::string filename_;
-  int64_t in_batch_offset_;
+  std::ofstream out_batch_;
+  std::string buffer_;  // encoded cells that are not written into out_batch_ yet
+  int64_t byte_size_;
+  std::vector<std::pair<int, int64_t>> index_;  // (first_token_id, offset of the cell)
+};
+
+// CooccurrenceBatchReader reads the cells of a memory-mapped co-occurrence batch
+// which first_token_id belongs to [first_token_begin, first_token_end).
+// This reader holds only one cell at a time.
+class CooccurrenceBatchReader : private boost::noncopyable {
+ public:
+  struct CoocBatchReaderComparator;
+
+  CooccurrenceBatchReader(std::shared_ptr<CooccurrenceBatch> batch, int first_token_begin, int first_token_end);
+
+  bool ReadCell();  // returns false if there are no more cells in the range
+  const Cell& cell() const { return cell_; }
+
+ private:
+  bool ReadVarint(uint64_t* value);
+
+  std::shared_ptr<CooccurrenceBatch> batch_;
+  boost::iostreams::mapped_file_source file_;
+  const unsigned char* ptr_;
+  const unsigned char* end_;
+  int first_token_begin_;
+  int first_token_end_;
+  Cell cell_;
 };
 
-struct CooccurrenceBatch::CoocBatchComparator {
-  bool operator()(const std::shared_ptr<CooccurrenceBatch>& left,
-                  const std::shared_ptr<CooccurrenceBatch>& right) const {
+struct CooccurrenceBatchReader::CoocBatchReaderComparator {
+  bool operator()(const std::shared_ptr<CooccurrenceBatchReader>& left,
+                  const std::shared_ptr<CooccurrenceBatchReader>& right) const {
     return left->cell_.first_token_id > right->cell_.first_token_id;
   }
 };
 
+// BufferOfCooccurrences writes merged cells of co-occurrences into the output files,
+// and calculates ppmi of the pairs of the same cells.
+// Ppmi needs the statistics of occurrence of all tokens (n_u), so it's gathered before the merge.
+// Each range of first token ids is written by its own buffer into separate files,
+// and then these files are concatenated (see CooccurrenceCollector::SecondStageOfMerging)
 class BufferOfCooccurrences {
   friend class CooccurrenceCollector;
- public:
-  void CalculatePpmi();
 
  private:
-  BufferOfCooccurrences(const int target, const Vocab& vocab,
-                        const std::vector<unsigned>& num_of_documents_token_occurred_in_,
-                        const CooccurrenceCollectorConfig& config);
-  void CheckInputFile(const std::ifstream& file, const std::string& filename);
-  void CheckOutputFile(const std::ofstream& file, const std::string& filename);
-  void MergeWithExistingCell(const CooccurrenceBatch& batch);
-  void CalculateTFStatistics();
-  void WriteCoocFromCell(const std::string mode, const unsigned cooc_min);  // Output file formats are defined here
-  int64_t GetCoocFromCell(const std::string& mode, const unsigned record_pos) const;
-  void CalculateAndWritePpmi(const std::string mode, const long double n);
+  // Empty file paths mean that the corresponding values are not written
+  BufferOfCooccurrences(const Vocab& vocab,
+                        const std::vector<unsigned>& num_of_documents_token_occurred_in,
+                        const std::vector<int64_t>& num_of_pairs_token_occurred_in,
+                        const CooccurrenceCollectorConfig& config,
+                        const std::string& cooc_tf_file_path,
+                        const std::string& cooc_df_file_path,
+                        const std::string& ppmi_tf_file_path,
+                        const std::string& ppmi_df_file_path);
+  void OpenOutputFile(const std::string& filename, std::ofstream* file);
+  void CloseOutputFile(std::ofstream* file);
+  void WriteCell(const Cell& cell);
+  void Close();
+  // Output file formats are defined here
+  void WriteCoocFromCell(const Cell& cell, const std::string mode, const unsigned cooc_min, std::ofstream* out);
+  void WritePpmiFromCell(const Cell& cell, const std::string mode, const unsigned cooc_min,
+                         const long double n, std::ofstream* out);
   double GetTokenFreq(const std::string& mode, const int token_id) const;
 
-  const int target_;  // can be either OUTPUT_FILE or BATCH
   const Vocab& vocab_;  // Holds mapping tokens to their indices
   const std::vector<unsigned>& num_of_documents_token_occurred_in_;
-  std::vector<int64_t> num_of_pairs_token_occurred_in_;
-  std::ifstream cooc_tf_dict_in_;
+  const std::vector<int64_t>& num_of_pairs_token_occurred_in_;
   std::ofstream cooc_tf_dict_out_;
-  std::ifstream cooc_df_dict_in_;
   std::ofstream cooc_df_dict_out_;
-  std::ofstream ppmi_tf_dict_;
-  std::ofstream ppmi_df_dict_;
-  int open_files_counter_;
-  Cell cell_;
+  std::ofstream ppmi_tf_dict_out_;
+  std::ofstream ppmi_df_dict_out_;
   CooccurrenceCollectorConfig config_;
 };
 
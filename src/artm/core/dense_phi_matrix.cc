@@ -3,6 +3,7 @@
 #include "artm/core/dense_phi_matrix.h"
 
 #include <algorithm>
+#include <chrono>  // NOLINT
 
 #include "artm/core/helpers.h"
 #include "artm/utility/memory_usage.h"
@@ -14,31 +15,52 @@ namespace core {
 // TokenCollection methods
 // =======================================================
 
+TokenCollection::TokenCollection()
+    : token_to_token_id_(), token_id_to_token_(), token_class_index_(), version_(NextVersion()) { }
+
+int64_t TokenCollection::NextVersion() {
+  static std::atomic<int64_t> last_version(0);
+  return ++last_version;
+}
+
 int TokenCollection::AddToken(const Token& token) {
-  int token_id = this->token_id(token);
-  if (token_id != -1) {
-    return token_id;
+  const int existing_token_id = token_id(token);
+  if (existing_token_id != TokenIdTable::kUndefIndex) {
+    return existing_token_id;
   }
 
-  token_id = token_size();
-  token_to_token_id_.insert(
-    std::make_pair(token, token_id));
+  // Tokens of the same class usually go one after another
+  const bool same_class = !token_id_to_token_.empty() && token_id_to_token_.back().class_id == token.class_id;
+  token_class_index_.push_back(same_class ? token_class_index_.back()
+                                          : ClassIdRegistry::singleton().Register(token.class_id));
+  token_to_token_id_.Insert(token.hash());
   token_id_to_token_.push_back(token);
-  return token_id;
+  version_ = NextVersion();
+  return token_size() - 1;
 }
 
 void TokenCollection::Swap(TokenCollection* rhs) {
-  token_to_token_id_.swap(rhs->token_to_token_id_);
+  token_to_token_id_.Swap(&rhs->token_to_token_id_);
   token_id_to_token_.swap(rhs->token_id_to_token_);
+  token_class_index_.swap(rhs->token_class_index_);
+  std::swap(version_, rhs->version_);
 }
 
 bool TokenCollection::has_token(const Token& token) const {
-  return token_to_token_id_.count(token) > 0;
+  return token_id(token) != TokenIdTable::kUndefIndex;
 }
 
 int TokenCollection::token_id(const Token& token) const {
-  auto iter = token_to_token_id_.find(token);
-  return (iter != token_to_token_id_.end()) ? iter->second : -1;
+  return token_to_token_id_.Find(token.hash(), [this, &token](int id) {  // NOLINT
+    return token_id_to_token_[id] == token;
+  });
+}
+
+int TokenCollection::token_id(boost::string_ref class_id, boost::string_ref keyword) const {
+  return token_to_token_id_.Find(Token::Hash(class_id, keyword), [this, class_id, keyword](int id) {  // NOLINT
+    const Token& token = token_id_to_token_[id];
+    return keyword == token.keyword && class_id == token.class_id;
+  });
 }
 
 const Token& TokenCollection::token(int index) const {
@@ -46,20 +68,23 @@ const Token& TokenCollection::token(int index) const {
 }
 
 void TokenCollection::Clear() {
-  token_to_token_id_.clear();
+  token_to_token_id_.Clear();
   token_id_to_token_.clear();
+  token_class_index_.clear();
+  version_ = NextVersion();
 }
 
 int TokenCollection::token_size() const {
-  return static_cast<int>(token_to_token_id_.size());
+  return static_cast<int>(token_id_to_token_.size());
 }
 
 int64_t TokenCollection::ByteSize() const {
   int64_t retval = 0;
   retval += artm::utility::getMemoryUsage(token_id_to_token_);
-  retval += artm::utility::getMemoryUsage(token_to_token_id_);
+  retval += token_to_token_id_.ByteSize();
+  retval += artm::utility::getMemoryUsage(token_class_index_);
   for (const auto& token : token_id_to_token_) {
-    retval += 2 * (token.keyword.size() + token.class_id.size());
+    retval += token.keyword.size() + token.class_id.size();
   }
   return retval;
 }
@@ -74,10 +99,22 @@ void SpinLock::Lock() {
   }
 }
 
+bool SpinLock::TryLock() {
+  return state_.exchange(kLocked, std::memory_order_acquire) == kUnlocked;
+}
+
 void SpinLock::Unlock() {
   state_.store(kUnlocked, std::memory_order_release);
 }
 
+void StripedSpinLock::LockContended(SpinLock* lock) {
+  auto start = std::chrono::steady_clock::now();
+  lock->Lock();
+  auto delta = std::chrono::steady_clock::now() - start;
+  contention_count_++;
+  contention_time_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(delta).count();
+}
+
 // =======================================================
 // PhiMatrixFrame methods
 // =======================================================
@@ -104,12 +141,7 @@ PhiMatrixFrame::PhiMatrixFrame(const PhiMatrixFrame& rhs)
     , topic_name_(rhs.topic_name_)
     , token_collection_(rhs.token_collection_)
     , spin_locks_()
-    , min_sparsity_rate_(rhs.min_sparsity_rate_) {
-  spin_locks_.reserve(rhs.spin_locks_.size());
-  for (unsigned i = 0; i < rhs.spin_locks_.size(); ++i) {
-    spin_locks_.push_back(std::make_shared<SpinLock>());
-  }
-}
+    , min_sparsity_rate_(rhs.min_sparsity_rate_) { }
 
 const Token& PhiMatrixFrame::token(int index) const {
   return token_collection_.token(index);
@@ -146,16 +178,9 @@ int PhiMatrixFrame::token_index(const Token& token) const {
 
 void PhiMatrixFrame::Clear() {
   token_collection_.Clear();
-  spin_locks_.clear();
 }
 
 int PhiMatrixFrame::AddToken(const Token& token) {
-  int token_id = token_collection_.token_id(token);
-  if (token_id != -1) {
-    return token_id;
-  }
-
-  spin_locks_.push_back(std::make_shared<SpinLock>());
   return token_collection_.AddToken(token);
 }
 
@@ -163,11 +188,10 @@ void PhiMatrixFrame::Swap(PhiMatrixFrame* rhs) {
   model_name_.swap(rhs->model_name_);
   topic_name_.swap(rhs->topic_name_);
   token_collection_.Swap(&rhs->token_collection_);
-  spin_locks_.swap(rhs->spin_locks_);
 }
 
 int64_t PhiMatrixFrame::ByteSize() const {
-  return token_collection_.ByteSize();
+  return token_collection_.ByteSize() + spin_locks_.ByteSize();
 }
 
 // =======================================================
@@ -359,6 +383,12 @@ void DensePhiMatrix::set(int token_id, int topic_id, float value) {
   }
 }
 
+void DensePhiMatrix::set(int token_id, const std::vector<float>& values) {
+  assert(values.size() == topic_size());
+  memcpy(values_[token_id].unpack(), &values[0], sizeof(float) * topic_size());
+  values_[token_id].pack();
+}
+
 void DensePhiMatrix::increase(int token_id, int topic_id, float increment) {
   values_[token_id].unpack()[topic_id] += increment;
   if ((topic_id + 1) == topic_size()) {
@@ -424,6 +454,8 @@ void DensePhiMatrix::Reshape(const PhiMatrix& phi_matrix) {
   for (int token_id = 0; token_id < phi_matrix.token_size(); ++token_id) {
     this->AddToken(phi_matrix.token(token_id));
   }
+
+  set_shape_version(phi_matrix.shape_version());
 }
 
 // =======================================================
@@ -464,6 +496,11 @@ void AttachedPhiMatrix::get(int token_id, std::vector<float>* buffer) const {
   memcpy(&buffer->at(0), values_[token_id], sizeof(float) * topic_size());
 }
 
+void AttachedPhiMatrix::set(int token_id, const std::vector<float>& values) {
+  assert(values.size() == topic_size());
+  memcpy(values_[token_id], &values[0], sizeof(float) * topic_size());
+}
+
 void AttachedPhiMatrix::increase(int token_id, const std::vector<float>& increment) {
   const int topic_size = this->topic_size();
   assert(increment.size() == topic_size);
@@ -11,17 +11,25 @@
 
 #include "boost/utility.hpp"
 
+#include "artm/core/class_id_registry.h"
 #include "artm/core/common.h"
 #include "artm/core/phi_matrix.h"
+#include "artm/core/token_index.h"
 
 namespace artm {
 namespace core {
 
 // TokenCollection class represents a sequential vector of tokens.
-// It also contains a mapping from Token to its index for efficient lookup.
+// Each modification of the collection assigns it a new process-wide unique version,
+// while copies of the collection keep the version of the original.
+// It also contains a TokenIdTable for efficient lookup of the tokens, also by (class_id, keyword) strings,
+// and the index of the class_id of each token in ClassIdRegistry.
+// The table stores only token ids, so each token is kept once, in token_id_to_token_.
 // For tokens that are not present in the collection loop up method will return 'UnknownId' constant.
 class TokenCollection {
  public:
+  TokenCollection();
+
   void Clear();
   int  AddToken(const Token& token);
   void Swap(TokenCollection* rhs);
@@ -30,11 +38,21 @@ class TokenCollection {
   int token_size() const;
   bool has_token(const Token& token) const;
   int token_id(const Token& token) const;
+  int token_id(boost::string_ref class_id, boost::string_ref keyword) const;
   const Token& token(int index) const;
+  int class_index(int index) const { return token_class_index_[index]; }
+
+  int64_t version() const { return version_; }
+  void set_version(int64_t version) { version_ = version; }
+
+  // Returns a new process-wide unique version, also used by matrices that do not store TokenCollection.
+  static int64_t NextVersion();
 
  private:
-  std::unordered_map<Token, int, TokenHasher> token_to_token_id_;
+  TokenIdTable token_to_token_id_;
   std::vector<Token> token_id_to_token_;
+  std::vector<int> token_class_index_;
+  int64_t version_;
 };
 
 // A simple spin lock class, used for synchronization.
@@ -42,6 +60,7 @@ class SpinLock : boost::noncopyable {
  public:
   SpinLock() : state_(kUnlocked) { }
   void Lock();
+  bool TryLock();
   void Unlock();
 
  private:
@@ -50,11 +69,47 @@ class SpinLock : boost::noncopyable {
   std::atomic<bool> state_;
 };
 
+// A fixed-size array of spin locks, used to synchronize updates of phi matrix rows.
+// Each row is protected by the lock at (token_id % kNumStripes), which avoids allocating
+// a separate lock for every token. Stripes are padded to the cache line size
+// to prevent false sharing between threads that update different rows.
+// The class also counts how many times a lock was contended and how long the threads had to spin.
+class StripedSpinLock : boost::noncopyable {
+ public:
+  static const int kNumStripes = 1024;  // must be a power of two
+
+  StripedSpinLock() : stripes_(new Stripe[kNumStripes]), contention_count_(0), contention_time_ns_(0) { }
+  void Lock(int index) {
+    SpinLock* lock = &stripes_[stripe(index)].lock;
+    if (!lock->TryLock()) {
+      LockContended(lock);
+    }
+  }
+  void Unlock(int index) { stripes_[stripe(index)].lock.Unlock(); }
+  int64_t ByteSize() const { return sizeof(Stripe) * kNumStripes; }
+
+  static int stripe(int index) { return index & (kNumStripes - 1); }
+  int64_t contention_count() const { return contention_count_; }
+  int64_t contention_time_ns() const { return contention_time_ns_; }
+
+ private:
+  struct Stripe {
+    SpinLock lock;
+    char padding[64 - sizeof(SpinLock)];
+  };
+
+  void LockContended(SpinLock* lock);
+
+  std::unique_ptr<Stripe[]> stripes_;
+  std::atomic<int64_t> contention_count_;
+  std::atomic<int64_t> contention_time_ns_;
+};
+
 // PhiMatrixFrame is a abstract class that partially implements PhiMatrix interface.
 // It implements most methods that manage the structure of the PhiMatrix
 // (e.g. the set of tokens, and the set of topic names).
 // It does not implement the actual storate for the 2D matrix (e.g. n_wt or p(w|t) values).
-// This storate is implemented in derived classes DensePhiMatrix and AttachedPhiMatrix.
+// This storate is implemented in derived classes DensePhiMatrix, ContiguousPhiMatrix and AttachedPhiMatrix.
 class PhiMatrixFrame : public PhiMatrix {
  public:
   explicit PhiMatrixFrame(const ModelName& model_name,
@@ -69,6 +124,8 @@ class PhiMatrixFrame : public PhiMatrix {
   virtual const Token& token(int index) const;
   virtual bool has_token(const Token& token) const;
   virtual int token_index(const Token& token) const;
+  virtual int class_index(int token_id) const { return token_collection_.class_index(token_id); }
+  virtual int64_t shape_version() const { return token_collection_.version(); }
   virtual google::protobuf::RepeatedPtrField<std::string> topic_name() const;
   virtual const std::string& topic_name(int topic_id) const;
   virtual void set_topic_name(int topic_id, const std::string& topic_name);
@@ -80,20 +137,25 @@ class PhiMatrixFrame : public PhiMatrix {
   void Clear();
   virtual int AddToken(const Token& token);
 
-  void Lock(int token_id) { spin_locks_[token_id]->Lock(); }
-  void Unlock(int token_id) { spin_locks_[token_id]->Unlock(); }
+  void Lock(int token_id) { spin_locks_.Lock(token_id); }
+  void Unlock(int token_id) { spin_locks_.Unlock(token_id); }
+  const StripedSpinLock& spin_locks() const { return spin_locks_; }
 
   void Swap(PhiMatrixFrame* rhs);
 
   PhiMatrixFrame(const PhiMatrixFrame& rhs);
   PhiMatrixFrame& operator=(const PhiMatrixFrame&);
 
+ protected:
+  // Must only be called when the tokens are exactly the same as in a matrix of given shape version (see Reshape).
+  void set_shape_version(int64_t shape_version) { token_collection_.set_version(shape_version); }
+
  private:
   ModelName model_name_;
   std::vector<std::string> topic_name_;
 
   TokenCollection token_collection_;
-  std::vector<std::shared_ptr<SpinLock> > spin_locks_;
+  StripedSpinLock spin_locks_;
   float min_sparsity_rate_;
 };
 
@@ -143,6 +205,7 @@ class DensePhiMatrix : public PhiMatrixFrame {
   virtual float get(int token_id, int topic_id) const;
   virtual void get(int token_id, std::vector<float>* buffer) const;
   virtual void set(int token_id, int topic_id, float value);
+  virtual void set(int token_id, const std::vector<float>& values);
   virtual void increase(int token_id, int topic_id, float increment);
   virtual void increase(int token_id, const std::vector<float>& increment);  // must be thread-safe
 
@@ -179,6 +242,7 @@ class AttachedPhiMatrix : boost::noncopyable, public PhiMatrixFrame {
   virtual float get(int token_id, int topic_id) const { return values_[token_id][topic_id]; }
   virtual void get(int token_id, std::vector<float>* buffer) const;
   virtual void set(int token_id, int topic_id, float value) { values_[token_id][topic_id] = value; }
+  virtual void set(int token_id, const std::vector<float>& values);
   virtual void increase(int token_id, int topic_id, float increment) { values_[token_id][topic_id] += increment; }
   virtual void increase(int token_id, const std::vector<float>& increment);  // must be thread-safe
 
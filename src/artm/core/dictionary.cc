@@ -7,44 +7,31 @@ namespace artm {
 namespace core {
 
 void Dictionary::AddEntry(const DictionaryEntry& entry) {
-  if (token_index_.find(entry.token()) != token_index_.end()) {
+  if (token_index_.Add(entry.token()) != static_cast<int>(entries_.size())) {
     LOG(WARNING) << "Token " << entry.token().keyword << " (" << entry.token().class_id
       << ") is already in dictionary";
     return;
   }
 
   entries_.push_back(entry);
-  token_index_.insert(std::make_pair(entry.token(), entries_.size() - 1));
 }
 
-void Dictionary::AddCoocImpl(const Token& token_1, const Token& token_2, float value, CoocMap* cooc_map) {
+void Dictionary::AddCoocImpl(const Token& token_1, const Token& token_2, float value, CoocMatrix* cooc_matrix) {
   // check tokens are in the dictionary, e.g. exist in token_index_
-  auto token_1_index = token_index_.find(token_1);
-  if (token_1_index == token_index_.end()) {
+  const int token_1_index = token_index_.Find(token_1);
+  if (token_1_index == TokenIndex::kUndefIndex) {
     LOG(WARNING) << "No token " << token_1.keyword
                  << " (" << token_1.class_id << ") in dictionary";
     return;
   }
 
-  auto token_2_index = token_index_.find(token_2);
-  if (token_2_index == token_index_.end()) {
+  const int token_2_index = token_index_.Find(token_2);
+  if (token_2_index == TokenIndex::kUndefIndex) {
     LOG(WARNING) << "No token " << token_2.keyword << " (" << token_2.class_id << ") in dictionary";
     return;
   }
 
-  AddCoocImpl(token_1_index->second, token_2_index->second, value, cooc_map);
-}
-
-void Dictionary::AddCoocImpl(int index_1, int index_2, float value, CoocMap* cooc_map) {
-  // try to find token_1 in the first level of cooc_map, if no one was found, add token_1
-  auto iter_1 = cooc_map->find(index_1);
-  if (iter_1 == cooc_map->end()) {
-    cooc_map->insert(std::make_pair(index_1, std::unordered_map<int, float>()));
-    iter_1 = cooc_map->find(index_1);
-  }
-
-  // std::map::insert() ignores attempts to write several pairs with same key
-  iter_1->second.insert(std::make_pair(index_2, value));
+  cooc_matrix->Add(token_1_index, token_2_index, value);
 }
 
 void Dictionary::AddCoocValue(const Token& token_1, const Token& token_2, float value) {
@@ -60,78 +47,96 @@ void Dictionary::AddCoocDf(const Token& token_1, const Token& token_2, float df)
 }
 
 void Dictionary::AddCoocValue(int index_1, int index_2, float value) {
-  AddCoocImpl(index_1, index_2, value, &cooc_values_);
+  cooc_values_.Add(index_1, index_2, value);
 }
 void Dictionary::AddCoocTf(int index_1, int index_2, float value) {
-  AddCoocImpl(index_1, index_2, value, &cooc_tfs_);
+  cooc_tfs_.Add(index_1, index_2, value);
 }
 void Dictionary::AddCoocDf(int index_1, int index_2, float value) {
-  AddCoocImpl(index_1, index_2, value, &cooc_dfs_);
+  cooc_dfs_.Add(index_1, index_2, value);
+}
+
+void Dictionary::FinalizeCooc() {
+  cooc_values_.Finalize();
+  cooc_tfs_.Finalize();
+  cooc_dfs_.Finalize();
+}
+
+std::vector<std::string> Dictionary::CoocFileNames(const std::string& file_name) {
+  return { file_name + ".cooc_values", file_name + ".cooc_tfs", file_name + ".cooc_dfs" };
+}
+
+void Dictionary::SaveCooc(const std::string& file_name) const {
+  std::vector<std::string> file_names = CoocFileNames(file_name);
+  cooc_values_.Save(file_names[0]);
+  cooc_tfs_.Save(file_names[1]);
+  cooc_dfs_.Save(file_names[2]);
+}
+
+void Dictionary::OpenCooc(const std::string& file_name) {
+  std::vector<std::string> file_names = CoocFileNames(file_name);
+  cooc_values_.Open(file_names[0]);
+  cooc_tfs_.Open(file_names[1]);
+  cooc_dfs_.Open(file_names[2]);
+
+  // Ids of the rows and columns are used as indices of the entries
+  for (const CoocMatrix* cooc_matrix : { &cooc_values_, &cooc_tfs_, &cooc_dfs_ }) {
+    if (cooc_matrix->row_size() > size()) {
+      clear_cooc();
+      BOOST_THROW_EXCEPTION(CorruptedMessageException(
+        "Co-occurrences in " + file_name + " refer to tokens outside of dictionary " + name_));
+    }
+  }
 }
 
 bool Dictionary::has_valid_cooc_state() const {
-  if (cooc_tfs_.size() == 0 && cooc_dfs_.size() == 0) {
+  if (cooc_tfs_.non_empty_row_size() == 0 && cooc_dfs_.non_empty_row_size() == 0) {
     return true;
   }
 
-  return (cooc_dfs_.size() == cooc_tfs_.size()) && (cooc_dfs_.size() == cooc_values_.size());
+  return (cooc_dfs_.non_empty_row_size() == cooc_tfs_.non_empty_row_size()) &&
+         (cooc_dfs_.non_empty_row_size() == cooc_values_.non_empty_row_size());
 }
 
 int64_t Dictionary::ByteSize() const {
   int64_t retval = 0;
   retval += ::artm::utility::getMemoryUsage(entries_);
-  retval += ::artm::utility::getMemoryUsage(token_index_);
-  retval += ::artm::utility::getMemoryUsage(cooc_values_);
-  retval += ::artm::utility::getMemoryUsage(cooc_tfs_);
-  retval += ::artm::utility::getMemoryUsage(cooc_dfs_);
-  for (const auto& entry : cooc_values_) {
-    retval += ::artm::utility::getMemoryUsage(entry.second);
-  }
-
-  for (const auto& entry : cooc_tfs_) {
-    retval += ::artm::utility::getMemoryUsage(entry.second);
-  }
-
-  for (const auto& entry : cooc_dfs_) {
-    retval += ::artm::utility::getMemoryUsage(entry.second);
-  }
+  retval += token_index_.ByteSize();
+  retval += cooc_values_.ByteSize();
+  retval += cooc_tfs_.ByteSize();
+  retval += cooc_dfs_.ByteSize();
 
   for (const auto& entry : entries_) {
-    retval += 2 * (entry.token().keyword.size() + entry.token().class_id.size());
+    retval += entry.token().keyword.size() + entry.token().class_id.size();
   }
   return retval;
 }
 
-const std::unordered_map<int, float>* Dictionary::cooc_info_impl(const Token& token, const CoocMap& cooc_map) const {
-  auto index_iter = token_index_.find(token);
-  if (index_iter == token_index_.end()) {
-    return nullptr;
-  }
-
-  auto cooc_map_iter = cooc_map.find(index_iter->second);
-  if (cooc_map_iter == cooc_map.end()) {
-    return nullptr;
+CoocRow Dictionary::cooc_info_impl(const Token& token, const CoocMatrix& cooc_matrix) const {
+  const int index = token_index_.Find(token);
+  if (index == TokenIndex::kUndefIndex) {
+    return CoocRow();
   }
 
-  return &(cooc_map_iter->second);
+  return cooc_matrix.row(index);
 }
 
-const std::unordered_map<int, float>*  Dictionary::token_cooc_values(const Token& token) const {
+CoocRow Dictionary::token_cooc_values(const Token& token) const {
   return cooc_info_impl(token, cooc_values_);
 }
 
-const std::unordered_map<int, float>*  Dictionary::token_cooc_tfs(const Token& token) const {
+CoocRow Dictionary::token_cooc_tfs(const Token& token) const {
   return cooc_info_impl(token, cooc_tfs_);
 }
 
-const std::unordered_map<int, float>*  Dictionary::token_cooc_dfs(const Token& token) const {
+CoocRow Dictionary::token_cooc_dfs(const Token& token) const {
   return cooc_info_impl(token, cooc_dfs_);
 }
 
 const DictionaryEntry* Dictionary::entry(const Token& token) const {
-  auto find_iter = token_index_.find(token);
-  if (find_iter != token_index_.end()) {
-    return &entries_[find_iter->second];
+  const int index = token_index_.Find(token);
+  if (index != TokenIndex::kUndefIndex) {
+    return &entries_[index];
   } else {
     return nullptr;
   }
@@ -151,14 +156,10 @@ float Dictionary::CountTopicCoherence(const std::vector<core::Token>& tokens_to_
     return 0.0f;
   }
 
-  // -1 means that find() result == end()
+  // -1 means that the token is not in the dictionary
   auto indices = std::vector<int>(k, -1);
   for (int i = 0; i < k; ++i) {
-    auto token_index_iter = token_index_.find(tokens_to_score[i]);
-    if (token_index_iter == token_index_.end()) {
-      continue;
-    }
-    indices[i] = token_index_iter->second;
+    indices[i] = token_index_.Find(tokens_to_score[i]);
   }
 
   for (int i = 0; i < k - 1; ++i) {
@@ -166,8 +167,8 @@ float Dictionary::CountTopicCoherence(const std::vector<core::Token>& tokens_to_
       continue;
     }
 
-    auto cooc_map_iter = cooc_values_.find(indices[i]);
-    if (cooc_map_iter == cooc_values_.end()) {
+    CoocRow cooc_row = cooc_values_.row(indices[i]);
+    if (cooc_row.empty()) {
       continue;
     }
 
@@ -180,8 +181,8 @@ float Dictionary::CountTopicCoherence(const std::vector<core::Token>& tokens_to_
         continue;
       }
 
-      auto value_iter = cooc_map_iter->second.find(indices[j]);
-      if (value_iter == cooc_map_iter->second.end()) {
+      auto value_iter = cooc_row.find(indices[j]);
+      if (value_iter == cooc_row.end()) {
         continue;
       }
       coherence_value += static_cast<float>(value_iter->second);
@@ -194,14 +195,14 @@ float Dictionary::CountTopicCoherence(const std::vector<core::Token>& tokens_to_
 void Dictionary::clear() {
   name_.clear();
   entries_.clear();
-  token_index_.clear();
+  token_index_.Clear();
   clear_cooc();
 }
 
 void Dictionary::clear_cooc() {
-  cooc_values_.clear();
-  cooc_tfs_.clear();
-  cooc_dfs_.clear();
+  cooc_values_.Clear();
+  cooc_tfs_.Clear();
+  cooc_dfs_.Clear();
 }
 
 }  // namespace core
@@ -10,8 +10,10 @@
 #include <utility>
 
 #include "artm/core/common.h"
+#include "artm/core/cooc_matrix.h"
 #include "artm/core/thread_safe_holder.h"
 #include "artm/core/token.h"
+#include "artm/core/token_index.h"
 
 namespace artm {
 namespace core {
@@ -24,8 +26,6 @@ class Dictionary;
 // The key (std::string) corresponds to the name of the dictionary.
 typedef ThreadSafeCollectionHolder<std::string, Dictionary> ThreadSafeDictionaryCollection;
 
-typedef std::unordered_map<int, std::unordered_map<int, float> > CoocMap;
-
 // DictionaryEntry represents one entry in the dictionary, associated with a specific token.
 class DictionaryEntry {
  public:
@@ -50,6 +50,9 @@ class DictionaryEntry {
 // entries will define the order of tokens in the PhiMatrix.
 // Dictionary also supports an efficient lookup of the entries by its token.
 // Dictionary also stores a co-occurence data, used by Coherence score and regularizer.
+// Co-occurrences are kept in frozen CSR matrices (see CoocMatrix); the values added by AddCooc* methods
+// become visible only after FinalizeCooc(), which is called once the dictionary is fully constructed
+// (see MasterComponent::AddDictionary).
 class Dictionary {
  public:
   explicit Dictionary(const std::string& name) : name_(name) { }
@@ -64,16 +67,26 @@ class Dictionary {
   void AddCoocValue(int index_1, int index_2, float value);
   void AddCoocTf(int index_1, int index_2, float value);
   void AddCoocDf(int index_1, int index_2, float value);
+  void FinalizeCooc();
+
+  // Writes the co-occurrence matrices next to the file, into file_name + ".cooc_values" (".cooc_tfs", ".cooc_dfs").
+  void SaveCooc(const std::string& file_name) const;
+
+  // Memory-maps the matrices written by SaveCooc instead of reading them (see CoocMatrix::Open).
+  void OpenCooc(const std::string& file_name);
+  static std::vector<std::string> CoocFileNames(const std::string& file_name);
 
   void SetNumItems(int num_items) { num_items_in_collection_ = num_items; }
 
   // SECTION OF GETTERS
-  bool HasToken(const Token& token) const { return token_index_.find(token) != token_index_.end(); }
+  bool HasToken(const Token& token) const { return token_index_.Contains(token); }
 
   // general method to return all cooc tokens with their values for given token
-  const std::unordered_map<int, float>* token_cooc_values(const Token& token) const;
-  const std::unordered_map<int, float>* token_cooc_tfs(const Token& token) const;
-  const std::unordered_map<int, float>* token_cooc_dfs(const Token& token) const;
+  // (an empty row if the token has no co-occurrences or is not in the dictionary)
+  CoocRow token_cooc_values(const Token& token) const;
+  CoocRow token_cooc_tfs(const Token& token) const;
+  CoocRow token_cooc_dfs(const Token& token) const;
+  CoocRow token_cooc_values(int index) const { return cooc_values_.row(index); }
 
   const DictionaryEntry* entry(const Token& token) const;
   const DictionaryEntry* entry(int index) const;
@@ -85,11 +98,11 @@ class Dictionary {
   int64_t ByteSize() const;
 
   const std::vector<DictionaryEntry>& entries() const { return entries_; }
-  const std::unordered_map<Token, int, TokenHasher>& token_index() const { return token_index_; }
+  const TokenIndex& token_index() const { return token_index_; }
 
-  const std::unordered_map<int, std::unordered_map<int, float> >& cooc_values() const { return cooc_values_; }
-  const std::unordered_map<int, std::unordered_map<int, float> >& cooc_tfs() const { return cooc_tfs_; }
-  const std::unordered_map<int, std::unordered_map<int, float> >& cooc_dfs() const { return cooc_dfs_; }
+  const CoocMatrix& cooc_values() const { return cooc_values_; }
+  const CoocMatrix& cooc_tfs() const { return cooc_tfs_; }
+  const CoocMatrix& cooc_dfs() const { return cooc_dfs_; }
 
   // SECTION OF OPERATIONS
   float CountTopicCoherence(const std::vector<core::Token>& tokens_to_score);
@@ -102,15 +115,14 @@ class Dictionary {
  private:
   std::string name_;
   std::vector<DictionaryEntry> entries_;
-  std::unordered_map<Token, int, TokenHasher> token_index_;
-  CoocMap cooc_values_;
-  CoocMap cooc_tfs_;
-  CoocMap cooc_dfs_;
+  TokenIndex token_index_;  // ids of the tokens are the indices of their entries
+  CoocMatrix cooc_values_;
+  CoocMatrix cooc_tfs_;
+  CoocMatrix cooc_dfs_;
   size_t num_items_in_collection_;
 
-  void AddCoocImpl(const Token& token_1, const Token& token_2, float value, CoocMap* cooc_map);
-  void AddCoocImpl(int index_1, int index_2, float value, CoocMap* cooc_map);
-  const std::unordered_map<int, float>* cooc_info_impl(const Token& token, const CoocMap& cooc_map) const;
+  void AddCoocImpl(const Token& token_1, const Token& token_2, float value, CoocMatrix* cooc_matrix);
+  CoocRow cooc_info_impl(const Token& token, const CoocMatrix& cooc_matrix) const;
 };
 
 }  // namespace core
@@ -57,8 +57,18 @@ void DictionaryOperations::Export(const ExportDictionaryArgs& args, const Dictio
     file_name += ".dict";
   }
 
-  if (boost::filesystem::exists(file_name)) {
-    BOOST_THROW_EXCEPTION(DiskWriteException("File already exists: " + file_name));
+  const bool binary_cooc = (args.format() == ExportDictionaryArgs_Format_Binary);
+  std::vector<std::string> file_names = { file_name };
+  if (binary_cooc) {
+    for (const std::string& cooc_file_name : Dictionary::CoocFileNames(file_name)) {
+      file_names.push_back(cooc_file_name);
+    }
+  }
+
+  for (const std::string& name : file_names) {
+    if (boost::filesystem::exists(name)) {
+      BOOST_THROW_EXCEPTION(DiskWriteException("File already exists: " + name));
+    }
   }
 
   std::ofstream fout(file_name, std::ofstream::binary);
@@ -69,9 +79,9 @@ void DictionaryOperations::Export(const ExportDictionaryArgs& args, const Dictio
   if (!dict.has_valid_cooc_state()) {
     BOOST_THROW_EXCEPTION(InvalidOperation("Dictionary " +
       args.dictionary_name() + " has invalid cooc state (num values: " +
-      std::to_string(dict.cooc_values().size()) +
-      ", num tfs: " + std::to_string(dict.cooc_tfs().size()) +
-      ", num dfs: " + std::to_string(dict.cooc_dfs().size()) + ")"));
+      std::to_string(dict.cooc_values().non_empty_row_size()) +
+      ", num tfs: " + std::to_string(dict.cooc_tfs().non_empty_row_size()) +
+      ", num dfs: " + std::to_string(dict.cooc_dfs().non_empty_row_size()) + ")"));
   }
 
   LOG(INFO) << "Exporting dictionary " << args.dictionary_name() << " to " << file_name;
@@ -82,7 +92,8 @@ void DictionaryOperations::Export(const ExportDictionaryArgs& args, const Dictio
   // Add ability to save and load several token_dict_data
   // int tokens_per_chunk = std::min<int>(token_size, 3e+7);
 
-  const char version = 0;
+  // Version 1 keeps the co-occurrences in CSR files instead of DictionaryData messages
+  const char version = binary_cooc ? 1 : 0;
   fout << version;
 
   DictionaryData token_dict_data;
@@ -110,23 +121,24 @@ void DictionaryOperations::Export(const ExportDictionaryArgs& args, const Dictio
   DictionaryData cooc_dict_data;
   int current_cooc_length = 0;
   const int max_cooc_length = 10 * 1000 * 1000;
-  if (dict.cooc_values().size()) {
+  if (binary_cooc) {
+    dict.SaveCooc(file_name);
+  } else if (dict.cooc_values().non_empty_row_size()) {
     for (int token_id = 0; token_id < token_size; ++token_id) {
-      auto entry = dict.entry(token_id);
-      auto cooc_values_info = dict.token_cooc_values(entry->token());
-      auto cooc_tfs_info = dict.token_cooc_tfs(entry->token());
-      auto cooc_dfs_info = dict.token_cooc_dfs(entry->token());
+      CoocRow cooc_values_info = dict.cooc_values().row(token_id);
+      CoocRow cooc_tfs_info = dict.cooc_tfs().row(token_id);
+      CoocRow cooc_dfs_info = dict.cooc_dfs().row(token_id);
 
-      if (cooc_values_info != nullptr) {
-        for (auto iter = cooc_values_info->begin(); iter != cooc_values_info->end(); ++iter) {
+      if (!cooc_values_info.empty()) {
+        for (auto iter = cooc_values_info.begin(); iter != cooc_values_info.end(); ++iter) {
           cooc_dict_data.add_cooc_first_index(token_id);
           cooc_dict_data.add_cooc_second_index(iter->first);
           cooc_dict_data.add_cooc_value(iter->second);
-          if (cooc_tfs_info != nullptr) {
-            auto tf_iter = cooc_tfs_info->find(iter->first);
-            auto df_iter = cooc_dfs_info->find(iter->first);
+          if (!cooc_tfs_info.empty()) {
+            auto tf_iter = cooc_tfs_info.find(iter->first);
+            auto df_iter = cooc_dfs_info.find(iter->first);
 
-            if (tf_iter == cooc_tfs_info->end() || df_iter == cooc_dfs_info->end()) {
+            if (tf_iter == cooc_tfs_info.end() || df_iter == cooc_dfs_info.end()) {
               BOOST_THROW_EXCEPTION(InvalidOperation("Dictionary " +
                   args.dictionary_name() + " has internal cooc tf/df inconsistence"));
             }
@@ -180,7 +192,7 @@ std::shared_ptr<Dictionary> DictionaryOperations::Import(const ImportDictionaryA
 
   char version;
   fin >> version;
-  if (version != 0) {
+  if (version != 0 && version != 1) {
     std::stringstream ss;
     ss << "Unsupported format version: " << static_cast<int>(version);
     BOOST_THROW_EXCEPTION(DiskReadException(ss.str()));
@@ -235,6 +247,10 @@ std::shared_ptr<Dictionary> DictionaryOperations::Import(const ImportDictionaryA
   }
   fin.close();
 
+  if (version == 1) {
+    dictionary->OpenCooc(args.file_name());
+  }
+
   return dictionary;
 }
 
@@ -276,7 +292,7 @@ std::shared_ptr<Dictionary> DictionaryOperations::Gather(const GatherDictionaryA
     try {
       if (batch_ptr == nullptr) {
         batch_ptr = std::make_shared<Batch>();
-        ::artm::core::Helpers::LoadMessage(batch_file, batch_ptr.get());
+        ::artm::core::Helpers::LoadBatch(batch_file, batch_ptr.get());
       }
     }
     catch (std::exception& ex) {
@@ -557,19 +573,20 @@ std::shared_ptr<Dictionary> DictionaryOperations::Filter(const FilterDictionaryA
       dictionary->AddEntry(entry);
     }
 
-    old_index_new_index.insert(std::pair<int, int>(dictionary_token_index.find(entry.token())->second,
+    old_index_new_index.insert(std::pair<int, int>(dictionary_token_index.Find(entry.token()),
       accepted_tokens_count - 1));
   }
 
   auto& cooc_values = dict.cooc_values();
 
-  for (auto iter = cooc_values.begin(); iter != cooc_values.end(); ++iter) {
-    auto first_index_iter = old_index_new_index.find(iter->first);
+  for (int index = 0; index < cooc_values.row_size(); ++index) {
+    auto first_index_iter = old_index_new_index.find(index);
     if (first_index_iter == old_index_new_index.end()) {
       continue;
     }
 
-    for (auto cooc_iter = iter->second.begin(); cooc_iter != iter->second.end(); ++cooc_iter) {
+    CoocRow cooc_row = cooc_values.row(index);
+    for (auto cooc_iter = cooc_row.begin(); cooc_iter != cooc_row.end(); ++cooc_iter) {
       auto second_index_iter = old_index_new_index.find(cooc_iter->first);
       if (second_index_iter == old_index_new_index.end()) {
         continue;
@@ -0,0 +1,118 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <sstream>
+
+#include "artm/core/exceptions.h"
+
+namespace artm {
+namespace core {
+
+// ExternalMatrixWriter writes theta or phi values straight into a caller-provided buffer
+// (see ArtmRequestThetaMatrixToBuffer and ArtmRequestTopicModelToBuffer), in the same layout
+// as ArtmRequestThetaMatrixExternal and ArtmRequestTopicModelExternal return them:
+// - dense layout is a row-major matrix of floats, one row per item (or token), one column per topic;
+// - sparse layout is three arrays of num_values elements each --- int32 row indices, int32 topic indices,
+//   and float values. Rows without values are skipped, so row indices only count the non-empty rows.
+// A writer without a buffer only counts the values, so that the caller can find the size of the buffer.
+class ExternalMatrixWriter {
+ public:
+  ExternalMatrixWriter(bool sparse, int64_t num_values, char* address)
+      : sparse_(sparse), capacity_(num_values), address_(address), num_values_(0), num_rows_(0), row_begin_(0) { }
+
+  static int64_t ByteSize(bool sparse, int64_t num_values) {
+    return static_cast<int64_t>(sparse ? (2 * sizeof(int32_t) + sizeof(float)) : sizeof(float)) * num_values;
+  }
+
+  bool sparse() const { return sparse_; }
+  bool counting() const { return address_ == nullptr; }
+
+  // Returns false when the values are not needed, e.g. when only counting the values of a dense matrix.
+  bool needs_values() const { return sparse_ || address_ != nullptr; }
+
+  int64_t num_values() const { return num_values_; }
+  int num_rows() const { return num_rows_; }
+
+  // Appends the next value of the current row (dense layout).
+  void AddValue(float value) {
+    if (address_ != nullptr) {
+      CheckCapacity();
+      reinterpret_cast<float*>(address_)[num_values_] = value;
+    }
+    num_values_++;
+  }
+
+  // Appends a value of the current row (sparse layout).
+  void AddValue(int topic_index, float value) {
+    if (address_ != nullptr) {
+      CheckCapacity();
+      int32_t* indices = reinterpret_cast<int32_t*>(address_);
+      indices[num_values_] = num_rows_;
+      indices[capacity_ + num_values_] = topic_index;
+      reinterpret_cast<float*>(indices + 2 * capacity_)[num_values_] = value;
+    }
+    num_values_++;
+  }
+
+  // Counts the values of the current row without providing them (dense layout, when !needs_values()).
+  void SkipValues(int count) { num_values_ += count; }
+
+  // Finishes the current row. Returns false if the row is skipped (sparse layout, no values).
+  bool EndRow() {
+    if (sparse_ && num_values_ == row_begin_) {
+      return false;
+    }
+
+    num_rows_++;
+    row_begin_ = num_values_;
+    return true;
+  }
+
+  // Runs 'write_rows(&writer)' to count the values (and to collect the metadata of the rows),
+  // and then once again to write them into the buffer. Zero 'address_length' means that the caller
+  // only queries the size of the matrix. Returns the number of values.
+  template<typename WriteRows>
+  static int64_t Write(bool sparse, int64_t address_length, char* address, WriteRows write_rows) {
+    ExternalMatrixWriter counter(sparse, 0, nullptr);
+    write_rows(&counter);
+    const int64_t num_values = counter.num_values();
+    if (address_length == 0) {
+      return num_values;
+    }
+
+    const int64_t byte_size = ByteSize(sparse, num_values);
+    if (address == nullptr || address_length != byte_size) {
+      std::stringstream ss;
+      ss << "Invalid 'address_length' parameter (" << byte_size << " expected, found " << address_length << ")";
+      BOOST_THROW_EXCEPTION(InvalidOperation(ss.str()));
+    }
+
+    ExternalMatrixWriter writer(sparse, num_values, address);
+    write_rows(&writer);
+    if (writer.num_values() != num_values) {
+      BOOST_THROW_EXCEPTION(InvalidOperation("The matrix has changed while it was written to the buffer"));
+    }
+
+    return num_values;
+  }
+
+ private:
+  void CheckCapacity() const {
+    if (num_values_ >= capacity_) {
+      BOOST_THROW_EXCEPTION(InvalidOperation("The matrix has changed while it was written to the buffer"));
+    }
+  }
+
+  bool sparse_;
+  int64_t capacity_;
+  char* address_;
+  int64_t num_values_;
+  int num_rows_;
+  int64_t row_begin_;
+};
+
+}  // namespace core
+}  // namespace artm
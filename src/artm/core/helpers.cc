@@ -14,6 +14,7 @@
 #include "boost/uuid/uuid_generators.hpp"
 
 #include "artm/core/check_messages.h"
+#include "artm/core/columnar_batch.h"
 #include "artm/core/common.h"
 #include "artm/core/helpers.h"
 #include "artm/core/exceptions.h"
@@ -140,7 +141,8 @@ std::vector<boost::filesystem::path> Helpers::ListAllBatches(const boost::filesy
     boost::filesystem::recursive_directory_iterator it(root);
     boost::filesystem::recursive_directory_iterator endit;
     while (it != endit) {
-      if (boost::filesystem::is_regular_file(*it) && it->path().extension() == kBatchExtension) {
+      if (boost::filesystem::is_regular_file(*it) &&
+          (it->path().extension() == kBatchExtension || it->path().extension() == kColumnarBatchExtension)) {
         batches.push_back(it->path());
       }
       ++it;
@@ -167,6 +169,14 @@ boost::uuids::uuid Helpers::SaveBatch(const Batch& batch,
   return uuid;
 }
 
+void Helpers::LoadBatch(const std::string& full_filename, Batch* batch) {
+  if (ColumnarBatch::IsColumnarBatch(full_filename)) {
+    ColumnarBatch(full_filename).ToBatch(batch);
+  } else {
+    LoadMessage(full_filename, batch);
+  }
+}
+
 void Helpers::LoadMessage(const std::string& filename, const std::string& disk_path,
                           ::google::protobuf::Message* message) {
   boost::filesystem::path full_path =
@@ -44,6 +44,9 @@ class Helpers {
                                       const std::string& disk_path,
                                       const std::string& name);
 
+  // Loads batch from disk, either in protobuf or in columnar format (see ColumnarBatch).
+  static void LoadBatch(const std::string& full_filename, Batch* batch);
+
   // Loads protobuf message from disk.
   static void LoadMessage(const std::string& full_filename,
                           ::google::protobuf::Message* message);
@@ -14,6 +14,7 @@
 #include "artm/core/helpers.h"
 #include "artm/core/cache_manager.h"
 #include "artm/core/score_manager.h"
+#include "artm/core/dense_phi_matrix.h"
 #include "artm/core/dictionary.h"
 #include "artm/core/exceptions.h"
 #include "artm/core/processor.h"
@@ -76,6 +77,8 @@ Instance::Instance(const MasterModelConfig& config)
       cache_manager_(),
       score_manager_(),
       score_tracker_(),
+      batch_token_id_cache_(),
+      batch_prefetcher_(),
       processors_() {
   Reconfigure(config);
 }
@@ -91,6 +94,8 @@ Instance::Instance(const Instance& rhs)
       cache_manager_(),
       score_manager_(),
       score_tracker_(),
+      batch_token_id_cache_(),
+      batch_prefetcher_(),
       processors_() {
   Reconfigure(*rhs.config());
 
@@ -184,11 +189,18 @@ void Instance::RequestMasterComponentInfo(MasterComponentInfo* master_info) cons
       info->set_num_topics(p_wt->topic_size());
       info->set_type(typeid(*p_wt).name());
       info->set_byte_size(p_wt->ByteSize());
+
+      auto frame = std::dynamic_pointer_cast<const PhiMatrixFrame>(p_wt);
+      if (frame != nullptr) {
+        info->set_lock_contention_count(frame->spin_locks().contention_count());
+        info->set_lock_contention_time_ns(frame->spin_locks().contention_time_ns());
+      }
     }
   }
 
   master_info->set_processor_queue_size(static_cast<int>(processor_queue_.size()));
   master_info->set_num_processors(static_cast<int>(processors_.size()));
+  batch_prefetcher_.RequestPipelineInfo(master_info->mutable_pipeline());
 }
 
 CacheManager* Instance::cache_manager() {
@@ -421,14 +433,18 @@ void Instance::Reconfigure(const MasterModelConfig& master_config) {
     is_configured_  = true;
   }
 
+  batch_prefetcher_.Reconfigure(master_config.num_prefetch_batches(), master_config.prefetch_memory_budget());
+
   {
     // Adjust size of processors_; cast size to int to avoid compiler warning.
     while (static_cast<int>(processors_.size()) > target_processors_count) {
       processors_.pop_back();
     }
 
+    processor_queue_.set_num_workers(target_processors_count);
     while (static_cast<int>(processors_.size()) < target_processors_count) {
-      processors_.push_back(std::shared_ptr<Processor>(new Processor(this)));
+      int processor_index = static_cast<int>(processors_.size());
+      processors_.push_back(std::shared_ptr<Processor>(new Processor(this, processor_index)));
     }
   }
 
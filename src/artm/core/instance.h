@@ -10,6 +10,8 @@
 #include "boost/thread/mutex.hpp"
 #include "boost/utility.hpp"
 
+#include "artm/core/batch_prefetcher.h"
+#include "artm/core/batch_token_id_cache.h"
 #include "artm/core/common.h"
 #include "artm/core/processor_input.h"
 #include "artm/core/thread_safe_holder.h"
@@ -31,7 +33,7 @@ typedef ThreadSafeCollectionHolder<std::string, Batch> ThreadSafeBatchCollection
 typedef ThreadSafeCollectionHolder<std::string, PhiMatrix> ThreadSafeModelCollection;
 typedef ThreadSafeCollectionHolder<std::string, RegularizerInterface> ThreadSafeRegularizerCollection;
 typedef ThreadSafeCollectionHolder<std::string, ScoreCalculatorInterface> ThreadSafeScoreCollection;
-typedef ThreadSafeQueue<std::shared_ptr<ProcessorInput>> ProcessorQueue;
+typedef WorkStealingQueue<std::shared_ptr<ProcessorInput>> ProcessorQueue;
 
 // Class Instance is respondible for hosting of other components and data structures.
 // Essentially it implements Pimpl idiom for MasterComponent class,
@@ -48,6 +50,8 @@ class Instance {
   ThreadSafeRegularizerCollection* regularizers() { return &regularizers_; }
   ThreadSafeScoreCollection* scores_calculators() { return &score_calculators_; }
   ProcessorQueue* processor_queue() { return &processor_queue_; }
+  BatchPrefetcher* batch_prefetcher() { return &batch_prefetcher_; }
+  BatchTokenIdCache* batch_token_id_cache() { return &batch_token_id_cache_; }
   ThreadSafeDictionaryCollection* dictionaries() const { return &ThreadSafeDictionaryCollection::singleton(); }
   ThreadSafeBatchCollection* batches() { return &batches_; }
   ThreadSafeModelCollection* models() { return &models_; }
@@ -95,7 +99,13 @@ class Instance {
   std::shared_ptr<ScoreManager> score_manager_;
   std::shared_ptr<ScoreTracker> score_tracker_;
 
-  // Depends on schema_, processor_queue_, and merger_
+  // Depends on [none]
+  BatchTokenIdCache batch_token_id_cache_;
+
+  // Depends on [none]; has an associated thread
+  BatchPrefetcher batch_prefetcher_;
+
+  // Depends on schema_, processor_queue_, batch_prefetcher_, and merger_
   std::vector<std::shared_ptr<Processor> > processors_;
 
   Instance(const Instance& rhs);
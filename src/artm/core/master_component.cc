@@ -29,9 +29,12 @@
 #include "artm/core/cache_manager.h"
 #include "artm/core/call_on_destruction.h"
 #include "artm/core/check_messages.h"
+#include "artm/core/cuckoo_watch.h"
 #include "artm/core/instance.h"
+#include "artm/core/nwt_shards.h"
 #include "artm/core/processor.h"
 #include "artm/core/protobuf_helpers.h"
+#include "artm/core/phi_matrix_file.h"
 #include "artm/core/phi_matrix_operations.h"
 #include "artm/core/score_manager.h"
 #include "artm/core/dense_phi_matrix.h"
@@ -275,6 +278,7 @@ void MasterComponent::DisposeRegularizer(const std::string& name) {
 }
 
 void MasterComponent::AddDictionary(std::shared_ptr<Dictionary> dictionary) {
+  dictionary->FinalizeCooc();
   DisposeDictionary(dictionary->name());
   instance_->dictionaries()->set(dictionary->name(), dictionary);
   DictionaryOperations::WriteDictionarySummaryToLog(*dictionary);
@@ -378,11 +382,6 @@ void MasterComponent::ExportModel(const ExportModelArgs& args) {
     BOOST_THROW_EXCEPTION(DiskWriteException("File already exists: " + args.file_name()));
   }
 
-  std::ofstream fout(args.file_name(), std::ofstream::binary);
-  if (!fout.is_open()) {
-    BOOST_THROW_EXCEPTION(DiskWriteException("Unable to create file " + args.file_name()));
-  }
-
   std::shared_ptr<const PhiMatrix> phi_matrix = instance_->GetPhiMatrixSafe(args.model_name());
   const PhiMatrix& n_wt = *phi_matrix;
 
@@ -393,6 +392,19 @@ void MasterComponent::ExportModel(const ExportModelArgs& args) {
     BOOST_THROW_EXCEPTION(InvalidOperation("Model " + args.model_name() + " has no tokens, export failed"));
   }
 
+  if (args.format() != ExportModelArgs_Format_Protobuf) {
+    PhiMatrixFile::Save(n_wt, args.file_name(), args.format() == ExportModelArgs_Format_BinaryDense,
+                        static_cast<int>(instance_->processor_size()));
+    LOG(INFO) << "Export of model completed, token_size = " << n_wt.token_size()
+              << ", topic_size = " << n_wt.topic_size();
+    return;
+  }
+
+  std::ofstream fout(args.file_name(), std::ofstream::binary);
+  if (!fout.is_open()) {
+    BOOST_THROW_EXCEPTION(DiskWriteException("Unable to create file " + args.file_name()));
+  }
+
   int tokens_per_chunk = std::min<int>(token_size, 100 * 1024 * 1024 / n_wt.topic_size());
 
   ::artm::GetTopicModelArgs get_topic_model_args;
@@ -436,6 +448,16 @@ void MasterComponent::ImportModel(const ImportModelArgs& args) {
     }
   }
 
+  if (PhiMatrixFile::IsPhiMatrixFile(args.file_name())) {
+    ImportBinaryModel(args);
+    return;
+  }
+
+  if (args.attach() || args.read_only()) {
+    BOOST_THROW_EXCEPTION(InvalidOperation(
+      "ImportModelArgs.attach and read_only require a model exported with ExportModelArgs.format = BinaryDense"));
+  }
+
   std::ifstream fin(args.file_name(), std::ifstream::binary);
   if (!fin.is_open()) {
     BOOST_THROW_EXCEPTION(DiskReadException("Unable to open file " + args.file_name()));
@@ -451,7 +473,7 @@ void MasterComponent::ImportModel(const ImportModelArgs& args) {
     BOOST_THROW_EXCEPTION(DiskReadException(ss.str()));
   }
 
-  std::shared_ptr<DensePhiMatrix> target = nullptr;
+  std::shared_ptr<PhiMatrix> target = nullptr;
   while (!fin.eof()) {
     int length;
     fin >> length;
@@ -473,9 +495,8 @@ void MasterComponent::ImportModel(const ImportModelArgs& args) {
     }
 
     topic_model.set_name(args.model_name());
-    target = std::make_shared<DensePhiMatrix>(args.model_name(),
-                                              topic_model.topic_name(),
-                                              instance_->config()->min_sparsity_rate());
+    target = PhiMatrixOperations::CreatePhiMatrix(*instance_->config(), args.model_name(),
+                                                  topic_model.topic_name());
 
     PhiMatrixOperations::ApplyTopicModelOperation(topic_model, 1.0f, /* add_missing_tokens = */ true, target.get());
   }
@@ -491,6 +512,44 @@ void MasterComponent::ImportModel(const ImportModelArgs& args) {
             << ", topic_size = " << target->topic_size();
 }
 
+void MasterComponent::ImportBinaryModel(const ImportModelArgs& args) {
+  LOG(INFO) << "Importing model " << args.model_name() << " from " << args.file_name()
+            << (args.read_only() ? " (read-only)" : (args.attach() ? " (attach)" : ""));
+
+  const int num_threads = static_cast<int>(instance_->processor_size());
+  const bool is_mapped = args.attach() || args.read_only();
+  auto file = std::make_shared<PhiMatrixFile>(args.file_name(), /* writable =*/ is_mapped && !args.read_only());
+
+  std::shared_ptr<PhiMatrix> target;
+  if (is_mapped) {
+    // Read-only import must not touch the pages of the values, unless the caller asks for the verification
+    const bool verify_values = args.read_only() ? (args.has_verify_checksum() && args.verify_checksum())
+                                                : args.verify_checksum();
+    if (verify_values) {
+      file->VerifyValues(num_threads);
+    }
+
+    if (args.read_only()) {
+      target = std::make_shared<SharedPhiMatrix>(args.model_name(), file);
+    } else {
+      target = std::make_shared<MappedPhiMatrix>(args.model_name(), file, instance_->config()->min_sparsity_rate());
+    }
+  } else {
+    google::protobuf::RepeatedPtrField<std::string> topic_name;
+    for (int topic_index = 0; topic_index < file->topic_size(); ++topic_index) {
+      topic_name.Add()->assign(file->topic_name(topic_index));
+    }
+
+    // CopyTo always verifies the chunks, as it reads all values anyway
+    target = PhiMatrixOperations::CreatePhiMatrix(*instance_->config(), args.model_name(), topic_name);
+    file->CopyTo(target.get(), num_threads);
+  }
+
+  instance_->SetPhiMatrix(args.model_name(), target);
+  LOG(INFO) << "Import of model completed, token_size = " << target->token_size()
+            << ", topic_size = " << target->topic_size();
+}
+
 void MasterComponent::ExportScoreTracker(const ExportScoreTrackerArgs& args) {
   if (boost::filesystem::exists(args.file_name())) {
     BOOST_THROW_EXCEPTION(DiskWriteException("File already exists: " + args.file_name()));
@@ -617,9 +676,7 @@ void MasterComponent::InitializeModel(const InitializeModelArgs& args) {
       BOOST_THROW_EXCEPTION(InvalidOperation(ss.str()));
     }
 
-    new_ttm = std::make_shared< ::artm::core::DensePhiMatrix>(args.model_name(),
-                                                              args.topic_name(),
-                                                              instance_->config()->min_sparsity_rate());
+    new_ttm = PhiMatrixOperations::CreatePhiMatrix(*instance_->config(), args.model_name(), args.topic_name());
     for (int index = 0; index < (int64_t) dict->size(); ++index) {
       ::artm::core::Token token = dict->entry(index)->token();
 
@@ -740,6 +797,19 @@ void MasterComponent::Request(const GetTopicModelArgs& args, ::artm::TopicModel*
   PhiMatrixOperations::RetrieveExternalTopicModel(*phi_matrix, args, result);
 }
 
+void MasterComponent::Request(const GetTopicModelArgs& args, ::artm::TopicModel* result,
+                              int64_t address_length, char* address) {
+  std::shared_ptr<MasterModelConfig> config = instance_->config();
+  if (config != nullptr) {
+    if (!args.has_model_name()) {
+      const_cast<GetTopicModelArgs*>(&args)->set_model_name(config->pwt_name());
+    }
+  }
+
+  auto phi_matrix = instance_->GetPhiMatrixSafe(args.model_name());
+  PhiMatrixOperations::RetrieveExternalTopicModel(*phi_matrix, args, result, address_length, address);
+}
+
 void MasterComponent::Request(const GetTopicModelArgs& args, ::artm::TopicModel* result, std::string* external) {
   Request(args, result);
   if (args.matrix_layout() == artm::MatrixLayout_Sparse) {
@@ -819,10 +889,8 @@ void MasterComponent::RequestProcessBatchesImpl(const ProcessBatchesArgs& proces
         PhiMatrixOperations::AssignValue(0.0f, const_cast<::artm::core::PhiMatrix*>(current_nwt_target.get()));
       }
     } else {
-      auto nwt_target(std::make_shared<DensePhiMatrix>(args.nwt_target_name(),
-                                                       p_wt.topic_name(),
-                                                       instance_->config()->min_sparsity_rate()));
-      nwt_target->Reshape(p_wt);
+      auto nwt_target = PhiMatrixOperations::CreatePhiMatrix(*instance_->config(), args.nwt_target_name(),
+                                                             p_wt.topic_name(), &p_wt);
       instance_->SetPhiMatrix(args.nwt_target_name(), nwt_target);
     }
   }
@@ -866,6 +934,14 @@ void MasterComponent::RequestProcessBatchesImpl(const ProcessBatchesArgs& proces
                          << "), which may cause suboptimal performance.";
   }
 
+  // Thread-local n_wt shards are only used in synchronous mode,
+  // because the shards must be reduced into n_wt before returning from RequestProcessBatchesImpl.
+  std::shared_ptr<NwtShardCollection> nwt_shards;
+  if (!asynchronous && args.has_nwt_target_name() && instance_->config()->use_thread_local_nwt()) {
+    auto nwt_target = instance_->GetPhiMatrixSafe(args.nwt_target_name());
+    nwt_shards = std::make_shared<NwtShardCollection>(const_cast<PhiMatrix*>(nwt_target.get()));
+  }
+
   auto createProcessorInput = [&](){  // NOLINT
     boost::uuids::uuid task_id = boost::uuids::random_generator()();
     batch_manager->Add(task_id);
@@ -885,6 +961,7 @@ void MasterComponent::RequestProcessBatchesImpl(const ProcessBatchesArgs& proces
 
     if (args.has_nwt_target_name()) {
       pi->set_nwt_target_name(args.nwt_target_name());
+      pi->set_nwt_shards(nwt_shards.get());
     }
 
     return pi;
@@ -895,6 +972,10 @@ void MasterComponent::RequestProcessBatchesImpl(const ProcessBatchesArgs& proces
     auto pi = createProcessorInput();
     pi->set_batch_filename(args.batch_filename(batch_index));
     pi->set_batch_weight(args.batch_weight(batch_index));
+    if (!instance_->batches()->has_key(pi->batch_filename())) {
+      instance_->batch_prefetcher()->Add(pi);
+    }
+
     instance_->processor_queue()->push(pi);
   }
 
@@ -910,8 +991,12 @@ void MasterComponent::RequestProcessBatchesImpl(const ProcessBatchesArgs& proces
     return;
   }
 
-  while (!batch_manager->IsEverythingProcessed()) {
-    boost::this_thread::sleep(boost::posix_time::milliseconds(kIdleLoopFrequency));
+  batch_manager->Wait();
+
+  if (nwt_shards != nullptr) {
+    CuckooWatch cuckoo("ReduceNwtShards(" + std::to_string(nwt_shards->shard_size()) + " shards, " +
+                       std::to_string(nwt_shards->ByteSize()) + " bytes)");
+    nwt_shards->Reduce(instance_->processor_size());
   }
 
   GetThetaMatrixArgs get_theta_matrix_args;
@@ -962,8 +1047,8 @@ void MasterComponent::MergeModel(const MergeModelArgs& merge_model_args) {
     }
   }
 
-  std::shared_ptr<DensePhiMatrix> nwt_target = std::make_shared<DensePhiMatrix>(
-    merge_model_args.nwt_target_name(), merge_model_args.topic_name(), instance_->config()->min_sparsity_rate());
+  std::shared_ptr<PhiMatrix> nwt_target = PhiMatrixOperations::CreatePhiMatrix(
+    *instance_->config(), merge_model_args.nwt_target_name(), merge_model_args.topic_name());
 
   std::shared_ptr<Dictionary> dictionary = nullptr;
   if (merge_model_args.has_dictionary_name()) {
@@ -1031,12 +1116,10 @@ void MasterComponent::RegularizeModel(const RegularizeModelArgs& regularize_mode
   std::shared_ptr<const PhiMatrix> pwt_phi_matrix = instance_->GetPhiMatrixSafe(pwt_source_name);
   const PhiMatrix& p_wt = *pwt_phi_matrix;
 
-  auto rwt_target(std::make_shared<DensePhiMatrix>(rwt_target_name,
-                                                   nwt_phi_matrix->topic_name(),
-                                                   instance_->config()->min_sparsity_rate()));
-  rwt_target->Reshape(*nwt_phi_matrix);
+  auto rwt_target = PhiMatrixOperations::CreatePhiMatrix(*instance_->config(), rwt_target_name,
+                                                         nwt_phi_matrix->topic_name(), nwt_phi_matrix.get());
   PhiMatrixOperations::InvokePhiRegularizers(instance_.get(), regularize_model_args.regularizer_settings(),
-                                             p_wt, n_wt, rwt_target.get());
+                                             p_wt, n_wt, rwt_target.get(), instance_->processor_size());
   instance_->SetPhiMatrix(rwt_target_name, rwt_target);
   VLOG(0) << "MasterComponent: complete regularizing model " << regularize_model_args.pwt_source_name();
 }
@@ -1062,20 +1145,26 @@ void MasterComponent::NormalizeModel(const NormalizeModelArgs& normalize_model_a
     rwt_phi_matrix = instance_->GetPhiMatrixSafe(rwt_source_name);
   }
 
-  auto pwt_target = std::dynamic_pointer_cast<DensePhiMatrix>(instance_->models()->get(pwt_target_name));
+  // Existing p_wt is updated in place, unless it is attached to an external memory or is read-only
+  std::shared_ptr<PhiMatrix> pwt_target = instance_->models()->get(pwt_target_name);
+  if (std::dynamic_pointer_cast<AttachedPhiMatrix>(pwt_target) != nullptr ||
+      std::dynamic_pointer_cast<SharedPhiMatrix>(pwt_target) != nullptr) {
+    pwt_target = nullptr;
+  }
 
   bool use_newly_created_pwt = (pwt_target == nullptr) || !PhiMatrixOperations::HasEqualShape(*pwt_target, n_wt);
 
   if (use_newly_created_pwt) {
-    pwt_target = std::make_shared<DensePhiMatrix>(pwt_target_name, n_wt.topic_name(),
-                                                  instance_->config()->min_sparsity_rate());
-    pwt_target.get()->Reshape(n_wt);
+    pwt_target = PhiMatrixOperations::CreatePhiMatrix(*instance_->config(), pwt_target_name,
+                                                      n_wt.topic_name(), &n_wt);
   }
 
+  // Processors are idle during normalization, so the M-step uses as many threads
+  const int num_threads = static_cast<int>(instance_->processor_size());
   if (rwt_phi_matrix == nullptr) {
-    PhiMatrixOperations::FindPwt(n_wt, pwt_target.get());
+    PhiMatrixOperations::FindPwt(n_wt, pwt_target.get(), num_threads);
   } else {
-    PhiMatrixOperations::FindPwt(n_wt, *rwt_phi_matrix, pwt_target.get());
+    PhiMatrixOperations::FindPwt(n_wt, *rwt_phi_matrix, pwt_target.get(), num_threads);
   }
 
   if (use_newly_created_pwt) {
@@ -1090,9 +1179,7 @@ void MasterComponent::OverwriteTopicModel(const ::artm::TopicModel& args) {
     const_cast< ::artm::TopicModel*>(&args)->set_name(config->pwt_name());
   }
 
-  auto target = std::make_shared<DensePhiMatrix>(args.name(),
-                                                 args.topic_name(),
-                                                 instance_->config()->min_sparsity_rate());
+  auto target = PhiMatrixOperations::CreatePhiMatrix(*instance_->config(), args.name(), args.topic_name());
 
   PhiMatrixOperations::ApplyTopicModelOperation(args, 1.0f, /* add_missing_tokens = */ true, target.get());
   instance_->SetPhiMatrix(args.name(), target);
@@ -1102,6 +1189,11 @@ void MasterComponent::Request(const GetThetaMatrixArgs& args, ::artm::ThetaMatri
   instance_->cache_manager()->RequestThetaMatrix(args, result);
 }
 
+void MasterComponent::Request(const GetThetaMatrixArgs& args, ::artm::ThetaMatrix* result,
+                              int64_t address_length, char* address) {
+  instance_->cache_manager()->RequestThetaMatrix(args, result, address_length, address);
+}
+
 static void ValidateProcessedItems(std::string method_description, MasterComponent* master) {
   ::artm::GetScoreValueArgs get_items_processed;
   ::artm::ScoreData items_processed_data;
@@ -1483,9 +1575,7 @@ class ArtmExecutor {
   }
 
   void Await(int operation_id) {
-    while (!asynchronous_[operation_id]->IsEverythingProcessed()) {
-      boost::this_thread::sleep(boost::posix_time::milliseconds(kIdleLoopFrequency));
-    }
+    asynchronous_[operation_id]->Wait();
   }
 
   void Regularize(std::string pwt, std::string nwt, std::string rwt) {
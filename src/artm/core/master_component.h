@@ -47,8 +47,10 @@ class MasterComponent : boost::noncopyable {
   void Request(::artm::MasterModelConfig* result);
   void Request(const GetTopicModelArgs& args, ::artm::TopicModel* result);
   void Request(const GetTopicModelArgs& args, ::artm::TopicModel* result, std::string* external);
+  void Request(const GetTopicModelArgs& args, ::artm::TopicModel* result, int64_t address_length, char* address);
   void Request(const GetThetaMatrixArgs& args, ThetaMatrix* result);
   void Request(const GetThetaMatrixArgs& args, ThetaMatrix* result, std::string* external);
+  void Request(const GetThetaMatrixArgs& args, ThetaMatrix* result, int64_t address_length, char* address);
   void Request(const TransformMasterModelArgs& args, ThetaMatrix* result);
   void Request(const TransformMasterModelArgs& args, ThetaMatrix* result, std::string* external);
   void Request(const GetScoreValueArgs& args, ScoreData* result);
@@ -116,6 +118,8 @@ class MasterComponent : boost::noncopyable {
 
   void AddDictionary(std::shared_ptr<Dictionary> dictionary);
 
+  void ImportBinaryModel(const ImportModelArgs& args);
+
   std::shared_ptr<Instance> instance_;
 };
 
@@ -0,0 +1,127 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#include "artm/core/nwt_shards.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "boost/thread/locks.hpp"
+
+#include "artm/core/dense_phi_matrix.h"
+#include "artm/core/helpers.h"
+
+namespace artm {
+namespace core {
+
+NwtShard::NwtShard(int token_size, int topic_size)
+    : topic_size_(topic_size), non_zero_rows_(0), rows_(token_size) { }
+
+void NwtShard::increase(int token_id, const std::vector<float>& increment) {
+  assert(increment.size() == topic_size_);
+  std::unique_ptr<float[]>& values = rows_[token_id];
+  if (values == nullptr) {
+    values.reset(new float[topic_size_]);
+    memcpy(values.get(), &increment[0], sizeof(float) * topic_size_);
+    non_zero_rows_++;
+    return;
+  }
+
+  for (int topic_index = 0; topic_index < topic_size_; ++topic_index) {
+    values[topic_index] += increment[topic_index];
+  }
+}
+
+int64_t NwtShard::ByteSize() const {
+  return sizeof(std::unique_ptr<float[]>) * rows_.size() +
+         sizeof(float) * static_cast<int64_t>(topic_size_) * non_zero_rows_;
+}
+
+NwtShardCollection::NwtShardCollection(PhiMatrix* n_wt) : lock_(), n_wt_(n_wt), shards_() { }
+
+NwtShard* NwtShardCollection::shard() {
+  boost::lock_guard<boost::mutex> guard(lock_);
+  std::shared_ptr<NwtShard>& retval = shards_[boost::this_thread::get_id()];
+  if (retval == nullptr) {
+    retval = std::make_shared<NwtShard>(n_wt_->token_size(), n_wt_->topic_size());
+  }
+
+  return retval.get();
+}
+
+int NwtShardCollection::shard_size() const {
+  boost::lock_guard<boost::mutex> guard(lock_);
+  return static_cast<int>(shards_.size());
+}
+
+int64_t NwtShardCollection::ByteSize() const {
+  boost::lock_guard<boost::mutex> guard(lock_);
+  int64_t retval = 0;
+  for (const auto& shard : shards_) {
+    retval += shard.second->ByteSize();
+  }
+
+  return retval;
+}
+
+void NwtShardCollection::ReduceRange(int stripe_begin, int stripe_end) {
+  const int token_size = n_wt_->token_size();
+  const int topic_size = n_wt_->topic_size();
+  std::vector<float> values(topic_size, 0.0f);
+
+  for (int base = 0; base < token_size; base += StripedSpinLock::kNumStripes) {
+    const int token_end = std::min(base + stripe_end, token_size);
+    for (int token_id = base + stripe_begin; token_id < token_end; ++token_id) {
+      bool has_values = false;
+      for (const auto& shard : shards_) {
+        const float* row = shard.second->row(token_id);
+        if (row == nullptr) {
+          continue;
+        }
+
+        if (!has_values) {
+          memcpy(&values[0], row, sizeof(float) * topic_size);
+          has_values = true;
+          continue;
+        }
+
+        for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
+          values[topic_index] += row[topic_index];
+        }
+      }
+
+      if (has_values) {
+        n_wt_->increase(token_id, values);
+      }
+    }
+  }
+}
+
+void NwtShardCollection::Reduce(int num_threads) {
+  boost::lock_guard<boost::mutex> guard(lock_);
+  if (shards_.empty() || n_wt_->topic_size() == 0) {
+    return;
+  }
+
+  num_threads = std::max(1, std::min(num_threads, StripedSpinLock::kNumStripes));
+  if (num_threads == 1) {
+    ReduceRange(0, StripedSpinLock::kNumStripes);
+  } else {
+    boost::thread_group threads;
+    for (int thread_index = 0; thread_index < num_threads; ++thread_index) {
+      const int stripe_begin = StripedSpinLock::kNumStripes * thread_index / num_threads;
+      const int stripe_end = StripedSpinLock::kNumStripes * (thread_index + 1) / num_threads;
+      threads.create_thread([this, stripe_begin, stripe_end]() {  // NOLINT
+        Helpers::SetThreadName(-1, "NwtShards reduce");
+        ReduceRange(stripe_begin, stripe_end);
+      });
+    }
+
+    threads.join_all();
+  }
+
+  shards_.clear();
+}
+
+}  // namespace core
+}  // namespace artm
@@ -0,0 +1,64 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/thread.hpp"
+#include "boost/utility.hpp"
+
+#include "artm/core/common.h"
+#include "artm/core/phi_matrix.h"
+
+namespace artm {
+namespace core {
+
+// NwtShard class accumulates n_wt increments produced by a single processor thread.
+// Rows are allocated on first write, so the shard only holds the tokens touched by its batches.
+// NwtShard is not thread-safe; each processor thread must use its own shard.
+class NwtShard : boost::noncopyable {
+ public:
+  NwtShard(int token_size, int topic_size);
+
+  void increase(int token_id, const std::vector<float>& increment);
+
+  // Returns nullptr if the shard has no values for the token.
+  const float* row(int token_id) const { return rows_[token_id].get(); }
+  int topic_size() const { return topic_size_; }
+  int64_t ByteSize() const;
+
+ private:
+  int topic_size_;
+  int non_zero_rows_;
+  std::vector<std::unique_ptr<float[]>> rows_;
+};
+
+// NwtShardCollection class holds per-thread n_wt shards for one ProcessBatches call.
+// Processors write into their private shards without any synchronization,
+// and once all batches are processed the shards are reduced into the target n_wt matrix.
+// The reduction runs in parallel, with each thread owning a disjoint range of lock stripes of n_wt
+// (see StripedSpinLock), so reducing threads never contend for the same lock.
+class NwtShardCollection : boost::noncopyable {
+ public:
+  explicit NwtShardCollection(PhiMatrix* n_wt);
+
+  // Returns the shard of the calling thread, creating it on the first call.
+  NwtShard* shard();
+  void Reduce(int num_threads);
+
+  int shard_size() const;
+  int64_t ByteSize() const;
+
+ private:
+  void ReduceRange(int stripe_begin, int stripe_end);
+
+  mutable boost::mutex lock_;
+  PhiMatrix* n_wt_;
+  std::map<boost::thread::id, std::shared_ptr<NwtShard>> shards_;
+};
+
+}  // namespace core
+}  // namespace artm
@@ -31,9 +31,17 @@ class PhiMatrix {
   virtual bool has_token(const Token& token) const = 0;
   virtual int token_index(const Token& token) const = 0;
 
+  // Index of the class_id of the token in ClassIdRegistry.
+  virtual int class_index(int token_id) const = 0;
+
+  // Identifies the sequence of tokens in the matrix. Two matrices with equal shape versions
+  // have the same tokens at the same indices; any change to the tokens gives a new shape version.
+  virtual int64_t shape_version() const = 0;
+
   virtual float get(int token_id, int topic_id) const = 0;
   virtual void get(int token_id, std::vector<float>* buffer) const = 0;
   virtual void set(int token_id, int topic_id, float value) = 0;
+  virtual void set(int token_id, const std::vector<float>& values) = 0;  // writes the whole row
   virtual void increase(int token_id, int topic_id, float increment) = 0;
   virtual void increase(int token_id, const std::vector<float>& increment) = 0;  // must be thread-safe
 
@@ -0,0 +1,640 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#include "artm/core/phi_matrix_file.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+
+#include "boost/crc.hpp"
+#include "boost/lexical_cast.hpp"
+#include "boost/thread/thread.hpp"
+
+#include "artm/core/exceptions.h"
+#include "artm/core/helpers.h"
+
+namespace artm {
+namespace core {
+
+namespace {
+
+const char kPhiMatrixFileMagic[8] = { 'A', 'R', 'T', 'M', 'P', 'H', 'I', 'M' };
+const int kPhiMatrixFileVersion = 2;
+const int64_t kSectionAlignment = 8;
+
+// Chunks of about 1M values are large enough to amortize thread scheduling,
+// and small enough to balance the load on a few threads.
+const int64_t kValuesPerChunk = 1024 * 1024;
+
+int64_t AlignOffset(int64_t offset) {
+  return (offset + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+}
+
+int ChunkSize(int topic_size) {
+  return static_cast<int>(std::max<int64_t>(1, kValuesPerChunk / std::max(1, topic_size)));
+}
+
+// Runs func(chunk_index) for all chunks, distributing the chunks among num_threads threads.
+template<typename Function>
+void ParallelForChunks(int num_chunks, int num_threads, Function func) {
+  num_threads = std::max(1, std::min(num_threads, num_chunks));
+  if (num_threads == 1) {
+    for (int chunk_index = 0; chunk_index < num_chunks; ++chunk_index) {
+      func(chunk_index);
+    }
+    return;
+  }
+
+  std::atomic<int> next_chunk(0);
+  boost::thread_group threads;
+  for (int thread_index = 0; thread_index < num_threads; ++thread_index) {
+    threads.create_thread([&next_chunk, num_chunks, &func]() {  // NOLINT
+      Helpers::SetThreadName(-1, "PhiMatrixFile");
+      for (int chunk_index = next_chunk++; chunk_index < num_chunks; chunk_index = next_chunk++) {
+        func(chunk_index);
+      }
+    });
+  }
+
+  threads.join_all();
+}
+
+// The checksum of a chunk covers its topic indices (sparse layout only) and its values.
+uint32_t ChunkChecksum(const int* topic_index, const float* values, int64_t size) {
+  boost::crc_32_type crc;
+  if (topic_index != nullptr) {
+    crc.process_bytes(topic_index, sizeof(int32_t) * size);
+  }
+  crc.process_bytes(values, sizeof(float) * size);
+  return crc.checksum();
+}
+
+uint32_t HeaderChecksum(const PhiMatrixFileHeader& header, const int64_t* string_index, const char* strings,
+                        const int64_t* row_ptr, const PhiMatrixFileHashSlot* hash_index) {
+  const int64_t num_strings = header.topic_size + 2 * static_cast<int64_t>(header.token_size);
+  boost::crc_32_type crc;
+  crc.process_bytes(&header, sizeof(header));
+  crc.process_bytes(string_index, sizeof(int64_t) * (num_strings + 1));
+  crc.process_bytes(strings, string_index[num_strings]);
+  if (row_ptr != nullptr) {
+    crc.process_bytes(row_ptr, sizeof(int64_t) * (header.token_size + 1));
+  }
+  crc.process_bytes(hash_index, sizeof(PhiMatrixFileHashSlot) * header.hash_index_size);
+  return crc.checksum();
+}
+
+google::protobuf::RepeatedPtrField<std::string> TopicNames(const PhiMatrixFile& file) {
+  google::protobuf::RepeatedPtrField<std::string> topic_name;
+  for (int topic_index = 0; topic_index < file.topic_size(); ++topic_index) {
+    topic_name.Add()->assign(file.topic_name(topic_index));
+  }
+
+  return topic_name;
+}
+
+template<typename T>
+void WriteSection(std::ofstream* fout, int64_t offset, const T* values, int64_t size) {
+  if (size > 0) {
+    fout->seekp(offset);
+    fout->write(reinterpret_cast<const char*>(values), sizeof(T) * size);
+  }
+}
+
+}  // namespace
+
+PhiMatrixFile::PhiMatrixFile(const std::string& file_name, bool writable)
+    : file_name_(file_name), file_(), header_(nullptr), string_index_(nullptr), strings_(nullptr),
+      row_ptr_(nullptr), topic_index_(nullptr), values_(nullptr), checksum_(nullptr), hash_index_(nullptr) {
+  try {
+    boost::iostreams::mapped_file_params params(file_name);
+    params.flags = writable ? boost::iostreams::mapped_file::priv : boost::iostreams::mapped_file::readonly;
+    file_.open(params);
+  } catch (std::exception& ex) {
+    BOOST_THROW_EXCEPTION(DiskReadException("Unable to open file " + file_name + ", " + ex.what()));
+  }
+
+  const int64_t file_size = static_cast<int64_t>(file_.size());
+  const char* data = file_.const_data();
+  if (file_size < static_cast<int64_t>(sizeof(PhiMatrixFileHeader)) ||
+      memcmp(data, kPhiMatrixFileMagic, sizeof(kPhiMatrixFileMagic)) != 0) {
+    ThrowCorrupted("wrong file signature");
+  }
+
+  header_ = reinterpret_cast<const PhiMatrixFileHeader*>(data);
+  if (header_->version != kPhiMatrixFileVersion) {
+    ThrowCorrupted("unsupported version " + boost::lexical_cast<std::string>(header_->version));
+  }
+
+  const int64_t max_nnz = static_cast<int64_t>(header_->token_size) * header_->topic_size;
+  if (header_->file_size != file_size || header_->token_size < 0 || header_->topic_size <= 0 ||
+      (header_->layout != Dense && header_->layout != Sparse) || header_->chunk_size <= 0 ||
+      header_->chunk_count != (header_->token_size + header_->chunk_size - 1) / header_->chunk_size ||
+      header_->nnz < 0 || header_->nnz > max_nnz || (header_->layout == Dense && header_->nnz != max_nnz) ||
+      header_->hash_index_size <= header_->token_size ||
+      (header_->hash_index_size & (header_->hash_index_size - 1)) != 0) {
+    ThrowCorrupted("inconsistent header");
+  }
+
+  auto check_section = [&](int64_t offset, int64_t size) {  // NOLINT
+    if (offset < static_cast<int64_t>(sizeof(PhiMatrixFileHeader)) || offset % kSectionAlignment != 0 ||
+        size < 0 || offset + size > file_size) {
+      ThrowCorrupted("section is out of file bounds");
+    }
+  };
+
+  const int64_t num_strings = header_->topic_size + 2 * static_cast<int64_t>(header_->token_size);
+  check_section(header_->string_index_offset, sizeof(int64_t) * (num_strings + 1));
+  check_section(header_->value_offset, sizeof(float) * header_->nnz);
+  check_section(header_->checksum_offset, sizeof(uint32_t) * (header_->chunk_count + 1));
+  check_section(header_->hash_index_offset, sizeof(PhiMatrixFileHashSlot) * header_->hash_index_size);
+  if (header_->layout == Sparse) {
+    check_section(header_->row_ptr_offset, sizeof(int64_t) * (header_->token_size + 1));
+    check_section(header_->topic_index_offset, sizeof(int32_t) * header_->nnz);
+    row_ptr_ = reinterpret_cast<const int64_t*>(data + header_->row_ptr_offset);
+    topic_index_ = reinterpret_cast<const int*>(data + header_->topic_index_offset);
+  }
+
+  string_index_ = reinterpret_cast<const int64_t*>(data + header_->string_index_offset);
+  check_section(header_->string_offset, string_index_[num_strings]);
+  strings_ = data + header_->string_offset;
+  values_ = reinterpret_cast<const float*>(data + header_->value_offset);
+  checksum_ = reinterpret_cast<const uint32_t*>(data + header_->checksum_offset);
+  hash_index_ = reinterpret_cast<const PhiMatrixFileHashSlot*>(data + header_->hash_index_offset);
+
+  if (HeaderChecksum(*header_, string_index_, strings_, row_ptr_, hash_index_) != checksum_[header_->chunk_count]) {
+    ThrowCorrupted("checksum mismatch in the header or in the tokens");
+  }
+
+  for (int64_t i = 0; i < num_strings; ++i) {
+    if (string_index_[i] < 0 || string_index_[i] > string_index_[i + 1]) {
+      ThrowCorrupted("invalid string index");
+    }
+  }
+
+  // The index has more slots than tokens, so the probing always stops at an empty slot
+  for (int slot = 0; slot < header_->hash_index_size; ++slot) {
+    if (hash_index_[slot].token_index < -1 || hash_index_[slot].token_index >= header_->token_size) {
+      ThrowCorrupted("invalid token hash index");
+    }
+  }
+
+  if (row_ptr_ != nullptr) {
+    if (row_ptr_[0] != 0 || row_ptr_[header_->token_size] != header_->nnz) {
+      ThrowCorrupted("invalid row offsets");
+    }
+
+    for (int token_index = 0; token_index < header_->token_size; ++token_index) {
+      if (row_ptr_[token_index] > row_ptr_[token_index + 1]) {
+        ThrowCorrupted("invalid row offsets");
+      }
+    }
+  }
+}
+
+void PhiMatrixFile::ThrowCorrupted(const std::string& reason) const {
+  BOOST_THROW_EXCEPTION(CorruptedMessageException("Unable to read model from " + file_name_ + ": " + reason));
+}
+
+bool PhiMatrixFile::IsPhiMatrixFile(const std::string& file_name) {
+  std::ifstream fin(file_name.c_str(), std::ifstream::binary);
+  char magic[sizeof(kPhiMatrixFileMagic)];
+  if (!fin.is_open() || !fin.read(magic, sizeof(magic))) {
+    return false;
+  }
+
+  return memcmp(magic, kPhiMatrixFileMagic, sizeof(kPhiMatrixFileMagic)) == 0;
+}
+
+std::string PhiMatrixFile::string(int string_index) const {
+  return std::string(strings_ + string_index_[string_index],
+                     strings_ + string_index_[string_index + 1]);
+}
+
+bool PhiMatrixFile::string_equals(int string_index, const std::string& value) const {
+  const int64_t begin = string_index_[string_index];
+  return (string_index_[string_index + 1] - begin == static_cast<int64_t>(value.size())) &&
+         memcmp(strings_ + begin, value.data(), value.size()) == 0;
+}
+
+uint64_t PhiMatrixFile::TokenHash(const ClassId& class_id, const std::string& keyword) {
+  // 64-bit FNV-1a; the separator keeps ("ab", "c") and ("a", "bc") apart
+  uint64_t hash = 14695981039346656037ULL;
+  auto process = [&hash](const std::string& value) {  // NOLINT
+    for (char c : value) {
+      hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+  };
+
+  process(class_id);
+  hash = (hash ^ 0xFF) * 1099511628211ULL;
+  process(keyword);
+  return hash;
+}
+
+int PhiMatrixFile::FindToken(const ClassId& class_id, const std::string& keyword) const {
+  const uint64_t hash = TokenHash(class_id, keyword);
+  const int mask = header_->hash_index_size - 1;
+  for (int slot = static_cast<int>(hash & mask); ; slot = (slot + 1) & mask) {
+    const PhiMatrixFileHashSlot& entry = hash_index_[slot];
+    if (entry.token_index == PhiMatrix::kUndefIndex) {
+      return PhiMatrix::kUndefIndex;
+    }
+
+    if (entry.hash == static_cast<uint32_t>(hash) &&
+        string_equals(topic_size() + entry.token_index, keyword) &&
+        string_equals(topic_size() + token_size() + entry.token_index, class_id)) {
+      return entry.token_index;
+    }
+  }
+}
+
+bool PhiMatrixFile::IsValidChunk(int chunk_index) const {
+  const int token_begin = chunk_index * header_->chunk_size;
+  const int token_end = std::min(token_begin + header_->chunk_size, header_->token_size);
+  int64_t begin = static_cast<int64_t>(token_begin) * header_->topic_size;
+  int64_t end = static_cast<int64_t>(token_end) * header_->topic_size;
+  if (row_ptr_ != nullptr) {
+    begin = row_ptr_[token_begin];
+    end = row_ptr_[token_end];
+    for (int64_t i = begin; i < end; ++i) {
+      if (topic_index_[i] < 0 || topic_index_[i] >= header_->topic_size) {
+        return false;
+      }
+    }
+  }
+
+  const int* topic_index = (topic_index_ != nullptr) ? topic_index_ + begin : nullptr;
+  return ChunkChecksum(topic_index, values_ + begin, end - begin) == checksum_[chunk_index];
+}
+
+void PhiMatrixFile::VerifyValues(int num_threads) const {
+  std::atomic<bool> is_valid(true);
+  ParallelForChunks(header_->chunk_count, num_threads, [this, &is_valid](int chunk_index) {  // NOLINT
+    if (is_valid && !IsValidChunk(chunk_index)) {
+      is_valid = false;
+    }
+  });
+
+  if (!is_valid) {
+    ThrowCorrupted("checksum mismatch in the values");
+  }
+}
+
+void PhiMatrixFile::CopyTo(PhiMatrix* target, int num_threads) const {
+  if (target->token_size() != 0 || target->topic_size() != topic_size()) {
+    BOOST_THROW_EXCEPTION(InternalError("PhiMatrixFile::CopyTo expects an empty matrix with the same topics"));
+  }
+
+  // Tokens are added on one thread, as the token index of the matrix is not thread-safe
+  for (int token_index = 0; token_index < token_size(); ++token_index) {
+    target->AddToken(Token(class_id(token_index), keyword(token_index)));
+  }
+
+  // Each chunk is verified and decoded by one thread; different threads never write the same row
+  std::atomic<bool> is_valid(true);
+  ParallelForChunks(header_->chunk_count, num_threads, [this, target, &is_valid](int chunk_index) {  // NOLINT
+    if (!is_valid || !IsValidChunk(chunk_index)) {
+      is_valid = false;
+      return;
+    }
+
+    const int topic_size = header_->topic_size;
+    const int token_begin = chunk_index * header_->chunk_size;
+    const int token_end = std::min(token_begin + header_->chunk_size, header_->token_size);
+    std::vector<float> buffer(topic_size, 0.0f);
+    for (int token_index = token_begin; token_index < token_end; ++token_index) {
+      if (row_ptr_ == nullptr) {
+        const float* row = values_ + static_cast<int64_t>(token_index) * topic_size;
+        std::copy(row, row + topic_size, buffer.begin());
+      } else {
+        std::fill(buffer.begin(), buffer.end(), 0.0f);
+        for (int64_t i = row_ptr_[token_index]; i < row_ptr_[token_index + 1]; ++i) {
+          buffer[topic_index_[i]] = values_[i];
+        }
+      }
+
+      target->set(token_index, buffer);
+    }
+  });
+
+  if (!is_valid) {
+    ThrowCorrupted("checksum mismatch in the values");
+  }
+}
+
+float* PhiMatrixFile::mutable_values() {
+  if (file_.flags() == boost::iostreams::mapped_file::readonly) {
+    return nullptr;
+  }
+
+  return reinterpret_cast<float*>(file_.data() + header_->value_offset);
+}
+
+void PhiMatrixFile::Save(const PhiMatrix& phi_matrix, const std::string& file_name,
+                         bool force_dense, int num_threads) {
+  const int token_size = phi_matrix.token_size();
+  const int topic_size = phi_matrix.topic_size();
+  if (topic_size == 0) {
+    BOOST_THROW_EXCEPTION(InvalidOperation("Model " + phi_matrix.model_name() + " has no topics"));
+  }
+
+  const int chunk_size = ChunkSize(topic_size);
+  const int chunk_count = (token_size + chunk_size - 1) / chunk_size;
+
+  // Count non-zero values of each token to choose the layout
+  std::vector<int64_t> row_ptr(token_size + 1, 0);
+  ParallelForChunks(chunk_count, num_threads, [&](int chunk_index) {  // NOLINT
+    std::vector<float> buffer(topic_size, 0.0f);
+    const int token_end = std::min(chunk_index * chunk_size + chunk_size, token_size);
+    for (int token_index = chunk_index * chunk_size; token_index < token_end; ++token_index) {
+      phi_matrix.get(token_index, &buffer);
+      row_ptr[token_index + 1] = topic_size - std::count(buffer.begin(), buffer.end(), 0.0f);
+    }
+  });
+
+  for (int token_index = 0; token_index < token_size; ++token_index) {
+    row_ptr[token_index + 1] += row_ptr[token_index];
+  }
+
+  const int64_t dense_nnz = static_cast<int64_t>(token_size) * topic_size;
+  const bool is_sparse = !force_dense && 2 * row_ptr[token_size] < dense_nnz;
+
+  std::vector<int64_t> string_index;
+  std::vector<char> strings;
+  auto add_string = [&string_index, &strings](const std::string& value) {  // NOLINT
+    string_index.push_back(static_cast<int64_t>(strings.size()));
+    strings.insert(strings.end(), value.begin(), value.end());
+  };
+
+  for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
+    add_string(phi_matrix.topic_name(topic_index));
+  }
+  for (int token_index = 0; token_index < token_size; ++token_index) {
+    add_string(phi_matrix.token(token_index).keyword);
+  }
+  for (int token_index = 0; token_index < token_size; ++token_index) {
+    add_string(phi_matrix.token(token_index).class_id);
+  }
+  string_index.push_back(static_cast<int64_t>(strings.size()));
+
+  int hash_index_size = 1;
+  while (hash_index_size < 2 * static_cast<int64_t>(token_size)) {
+    hash_index_size *= 2;
+  }
+
+  PhiMatrixFileHashSlot empty_slot = { PhiMatrix::kUndefIndex, 0 };
+  std::vector<PhiMatrixFileHashSlot> hash_index(hash_index_size, empty_slot);
+  for (int token_index = 0; token_index < token_size; ++token_index) {
+    const Token& token = phi_matrix.token(token_index);
+    const uint64_t hash = TokenHash(token.class_id, token.keyword);
+    int slot = static_cast<int>(hash & (hash_index_size - 1));
+    while (hash_index[slot].token_index != PhiMatrix::kUndefIndex) {
+      slot = (slot + 1) & (hash_index_size - 1);
+    }
+
+    hash_index[slot].token_index = token_index;
+    hash_index[slot].hash = static_cast<uint32_t>(hash);
+  }
+
+  PhiMatrixFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kPhiMatrixFileMagic, sizeof(kPhiMatrixFileMagic));
+  header.version = kPhiMatrixFileVersion;
+  header.layout = is_sparse ? Sparse : Dense;
+  header.token_size = token_size;
+  header.topic_size = topic_size;
+  header.chunk_size = chunk_size;
+  header.chunk_count = chunk_count;
+  header.nnz = is_sparse ? row_ptr[token_size] : dense_nnz;
+  header.string_index_offset = AlignOffset(sizeof(header));
+  header.string_offset = AlignOffset(header.string_index_offset + sizeof(int64_t) * string_index.size());
+  int64_t offset = AlignOffset(header.string_offset + strings.size());
+  if (is_sparse) {
+    header.row_ptr_offset = offset;
+    header.topic_index_offset = AlignOffset(header.row_ptr_offset + sizeof(int64_t) * row_ptr.size());
+    offset = AlignOffset(header.topic_index_offset + sizeof(int32_t) * header.nnz);
+  }
+  header.value_offset = offset;
+  header.checksum_offset = AlignOffset(header.value_offset + sizeof(float) * header.nnz);
+  header.hash_index_offset = AlignOffset(header.checksum_offset + sizeof(uint32_t) * (chunk_count + 1));
+  header.hash_index_size = hash_index_size;
+  header.file_size = header.hash_index_offset + sizeof(PhiMatrixFileHashSlot) * hash_index_size;
+
+  std::ofstream fout(file_name.c_str(), std::ofstream::binary);
+  if (!fout.is_open()) {
+    BOOST_THROW_EXCEPTION(DiskWriteException("Unable to create file " + file_name));
+  }
+
+  // Seeking past the end of the file fills the alignment gaps between sections with zeros
+  WriteSection(&fout, 0, &header, 1);
+  WriteSection(&fout, header.string_index_offset, &string_index[0], string_index.size());
+  WriteSection(&fout, header.string_offset, strings.empty() ? nullptr : &strings[0], strings.size());
+  if (is_sparse) {
+    WriteSection(&fout, header.row_ptr_offset, &row_ptr[0], row_ptr.size());
+  }
+  WriteSection(&fout, header.hash_index_offset, &hash_index[0], hash_index.size());
+
+  std::vector<uint32_t> checksum(chunk_count + 1, 0);
+  std::vector<float> buffer(topic_size, 0.0f);
+  std::vector<int> chunk_topic_index;
+  std::vector<float> chunk_values;
+  for (int chunk_index = 0; chunk_index < chunk_count; ++chunk_index) {
+    const int token_begin = chunk_index * chunk_size;
+    const int token_end = std::min(token_begin + chunk_size, token_size);
+    chunk_topic_index.clear();
+    chunk_values.clear();
+    for (int token_index = token_begin; token_index < token_end; ++token_index) {
+      phi_matrix.get(token_index, &buffer);
+      if (!is_sparse) {
+        chunk_values.insert(chunk_values.end(), buffer.begin(), buffer.end());
+        continue;
+      }
+
+      for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
+        if (buffer[topic_index] != 0.0f) {
+          chunk_topic_index.push_back(topic_index);
+          chunk_values.push_back(buffer[topic_index]);
+        }
+      }
+    }
+
+    const int64_t begin = is_sparse ? row_ptr[token_begin] : static_cast<int64_t>(token_begin) * topic_size;
+    const int64_t size = static_cast<int64_t>(chunk_values.size());
+    const int* topic_index = is_sparse ? (chunk_topic_index.empty() ? nullptr : &chunk_topic_index[0]) : nullptr;
+    const float* values = chunk_values.empty() ? nullptr : &chunk_values[0];
+    checksum[chunk_index] = ChunkChecksum(topic_index, values, size);
+    if (is_sparse) {
+      WriteSection(&fout, header.topic_index_offset + sizeof(int32_t) * begin, topic_index, size);
+    }
+    WriteSection(&fout, header.value_offset + sizeof(float) * begin, values, size);
+  }
+
+  checksum[chunk_count] = HeaderChecksum(header, &string_index[0], strings.empty() ? nullptr : &strings[0],
+                                         is_sparse ? &row_ptr[0] : nullptr, &hash_index[0]);
+  WriteSection(&fout, header.checksum_offset, &checksum[0], checksum.size());
+
+  fout.close();
+  if (fout.fail()) {
+    BOOST_THROW_EXCEPTION(DiskWriteException("Model has not been serialized to disk: " + file_name));
+  }
+}
+
+MappedPhiMatrix::MappedPhiMatrix(const ModelName& model_name, const std::shared_ptr<PhiMatrixFile>& file,
+                                 float min_sparsity_rate)
+    : PhiMatrixFrame(model_name, TopicNames(*file), min_sparsity_rate), file_(file), values_(file->mutable_values()) {
+  if (file->layout() != PhiMatrixFile::Dense || values_ == nullptr) {
+    BOOST_THROW_EXCEPTION(InvalidOperation(
+      "Only models exported with ExportModelArgs.format = BinaryDense can be attached, model " + model_name));
+  }
+
+  for (int token_index = 0; token_index < file->token_size(); ++token_index) {
+    PhiMatrixFrame::AddToken(Token(file->class_id(token_index), file->keyword(token_index)));
+  }
+}
+
+std::shared_ptr<PhiMatrix> MappedPhiMatrix::Duplicate() const {
+  auto retval = std::make_shared<DensePhiMatrix>(model_name(), topic_name(), min_sparsity_rate());
+  std::vector<float> buffer(topic_size(), 0.0f);
+  for (int token_index = 0; token_index < token_size(); ++token_index) {
+    retval->AddToken(token(token_index));
+    get(token_index, &buffer);
+    retval->set(token_index, buffer);
+  }
+
+  return retval;
+}
+
+void MappedPhiMatrix::get(int token_id, std::vector<float>* buffer) const {
+  assert(topic_size() > 0 && buffer->size() == topic_size());
+  memcpy(&buffer->at(0), row(token_id), sizeof(float) * topic_size());
+}
+
+void MappedPhiMatrix::set(int token_id, const std::vector<float>& values) {
+  assert(values.size() == topic_size());
+  memcpy(row(token_id), &values[0], sizeof(float) * topic_size());
+}
+
+void MappedPhiMatrix::increase(int token_id, const std::vector<float>& increment) {
+  const int topic_size = this->topic_size();
+  assert(increment.size() == topic_size);
+  float* values = row(token_id);
+
+  this->Lock(token_id);
+  for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
+    values[topic_index] += increment[topic_index];
+  }
+  this->Unlock(token_id);
+}
+
+void MappedPhiMatrix::Clear() {
+  values_ = nullptr;
+  file_.reset();
+  PhiMatrixFrame::Clear();
+}
+
+void MappedPhiMatrix::get_sparse(int token_id, std::vector<float>* value_buffer,
+                                 std::vector<int>* index_buffer) const {
+  get(token_id, value_buffer);
+}
+
+int MappedPhiMatrix::AddToken(const Token& token) {
+  BOOST_THROW_EXCEPTION(InternalError("Tokens addition is not allowed for mapped model."));
+}
+
+SharedPhiMatrix::SharedPhiMatrix(const ModelName& model_name, const std::shared_ptr<PhiMatrixFile>& file)
+    : model_name_(model_name), topic_name_(), file_(file), values_(file->values()),
+      shape_version_(TokenCollection::NextVersion()), tokens_created_(), tokens_(), class_index_() {
+  if (file->layout() != PhiMatrixFile::Dense) {
+    BOOST_THROW_EXCEPTION(InvalidOperation(
+      "Only models exported with ExportModelArgs.format = BinaryDense can be attached, model " + model_name));
+  }
+
+  for (int topic_index = 0; topic_index < file->topic_size(); ++topic_index) {
+    topic_name_.push_back(file->topic_name(topic_index));
+  }
+}
+
+google::protobuf::RepeatedPtrField<std::string> SharedPhiMatrix::topic_name() const {
+  google::protobuf::RepeatedPtrField<std::string> retval;
+  for (const std::string& topic_name : topic_name_) {
+    retval.Add()->assign(topic_name);
+  }
+
+  return retval;
+}
+
+int64_t SharedPhiMatrix::ByteSize() const {
+  // the values and the token index are backed by the file
+  int64_t retval = sizeof(Token) * tokens_.capacity() + sizeof(int) * class_index_.capacity();
+  for (const Token& token : tokens_) {
+    retval += token.keyword.size() + token.class_id.size();
+  }
+  return retval;
+}
+
+void SharedPhiMatrix::CreateTokens() const {
+  std::call_once(tokens_created_, [this]() {  // NOLINT
+    tokens_.reserve(file_->token_size());
+    class_index_.reserve(file_->token_size());
+    for (int token_index = 0; token_index < file_->token_size(); ++token_index) {
+      tokens_.push_back(Token(file_->class_id(token_index), file_->keyword(token_index)));
+
+      const bool same_class = token_index > 0 && tokens_[token_index - 1].class_id == tokens_.back().class_id;
+      class_index_.push_back(same_class ? class_index_.back()
+                                        : ClassIdRegistry::singleton().Register(tokens_.back().class_id));
+    }
+  });
+}
+
+const Token& SharedPhiMatrix::token(int index) const {
+  CreateTokens();
+  return tokens_[index];
+}
+
+int SharedPhiMatrix::class_index(int token_id) const {
+  CreateTokens();
+  return class_index_[token_id];
+}
+
+void SharedPhiMatrix::get(int token_id, std::vector<float>* buffer) const {
+  assert(topic_size() > 0 && buffer->size() == topic_size());
+  memcpy(&buffer->at(0), row(token_id), sizeof(float) * topic_size());
+}
+
+void SharedPhiMatrix::get_sparse(int token_id, std::vector<float>* value_buffer,
+                                 std::vector<int>* index_buffer) const {
+  get(token_id, value_buffer);
+}
+
+std::shared_ptr<PhiMatrix> SharedPhiMatrix::Duplicate() const {
+  auto retval = std::make_shared<DensePhiMatrix>(model_name(), topic_name(), 0.0f);
+  std::vector<float> buffer(topic_size(), 0.0f);
+  for (int token_index = 0; token_index < token_size(); ++token_index) {
+    retval->AddToken(token(token_index));
+    get(token_index, &buffer);
+    retval->set(token_index, buffer);
+  }
+
+  return retval;
+}
+
+void SharedPhiMatrix::ThrowReadOnly() const {
+  BOOST_THROW_EXCEPTION(InvalidOperation("Model " + model_name_ + " is imported as read-only"));
+}
+
+void SharedPhiMatrix::set_topic_name(int topic_id, const std::string& topic_name) { ThrowReadOnly(); }
+void SharedPhiMatrix::set(int token_id, int topic_id, float value) { ThrowReadOnly(); }
+void SharedPhiMatrix::set(int token_id, const std::vector<float>& values) { ThrowReadOnly(); }
+void SharedPhiMatrix::increase(int token_id, int topic_id, float increment) { ThrowReadOnly(); }
+void SharedPhiMatrix::increase(int token_id, const std::vector<float>& increment) { ThrowReadOnly(); }
+void SharedPhiMatrix::Clear() { ThrowReadOnly(); }
+
+int SharedPhiMatrix::AddToken(const Token& token) {
+  ThrowReadOnly();
+  return PhiMatrix::kUndefIndex;
+}
+
+}  // namespace core
+}  // namespace artm
@@ -0,0 +1,215 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <vector>
+
+#include "boost/iostreams/device/mapped_file.hpp"
+#include "boost/utility.hpp"
+
+#include "artm/core/common.h"
+#include "artm/core/dense_phi_matrix.h"
+
+namespace artm {
+namespace core {
+
+// Header of the binary model file. All offsets are in bytes from the beginning of the file,
+// and each section starts at a multiple of 8 bytes. Integers and floats use native byte order.
+// The values are split into chunks of chunk_size consecutive tokens, and each chunk has its own CRC32,
+// so that the chunks can be verified and decoded independently.
+// The last checksum covers the header, the strings, the row offsets and the token hash index.
+struct PhiMatrixFileHeader {
+  char magic[8];
+  int32_t version;
+  int32_t layout;       // PhiMatrixFile::Layout
+  int32_t token_size;
+  int32_t topic_size;
+  int32_t chunk_size;   // number of tokens per chunk
+  int32_t chunk_count;
+  int64_t nnz;          // number of stored values
+  int64_t string_index_offset;  // int64_t[topic_size + 2 * token_size + 1], offsets of the strings
+  int64_t string_offset;        // char[], topic names, then keywords of all tokens, then class ids of all tokens
+  int64_t row_ptr_offset;       // int64_t[token_size + 1], sparse layout only
+  int64_t topic_index_offset;   // int32_t[nnz], sparse layout only
+  int64_t value_offset;         // float[nnz], row-major token_size x topic_size matrix for dense layout
+  int64_t checksum_offset;      // uint32_t[chunk_count + 1]
+  int64_t hash_index_offset;    // PhiMatrixFileHashSlot[hash_index_size]
+  int32_t hash_index_size;      // power of two, at least twice the number of tokens
+  int32_t reserved;
+  int64_t file_size;
+};
+
+// Slot of the token hash index with open addressing and linear probing.
+// The slot of a token is found by PhiMatrixFile::TokenHash, that does not depend on the platform;
+// empty slots have token_index = -1.
+struct PhiMatrixFileHashSlot {
+  int32_t token_index;
+  uint32_t hash;  // lower 32 bits of the hash, to skip the string comparison for most collisions
+};
+
+// PhiMatrixFile class reads and writes phi matrices in a versioned binary format,
+// which is much faster to load than the chunks of TopicModel messages written by ExportModel.
+// The file is memory-mapped, the tokens are read in place,
+// and the chunks of values are decoded on several threads (see CopyTo).
+// Dense files can also be attached without copying the values (see MappedPhiMatrix).
+class PhiMatrixFile : boost::noncopyable {
+ public:
+  enum Layout {
+    Dense = 0,   // all values of each token
+    Sparse = 1,  // non-zero values of each token with their topic indices
+  };
+
+  // Maps the file into memory and validates its structure and the checksum of the tokens.
+  // With writable = true the mapping is private: modifications are visible to this process only
+  // and are never written back to the file.
+  PhiMatrixFile(const std::string& file_name, bool writable);
+
+  // Returns true if the file starts with the signature of the binary model format.
+  static bool IsPhiMatrixFile(const std::string& file_name);
+
+  // Writes the matrix in sparse layout when less than half of its values are non-zero,
+  // otherwise (or with force_dense = true) in dense layout.
+  static void Save(const PhiMatrix& phi_matrix, const std::string& file_name, bool force_dense, int num_threads);
+
+  int token_size() const { return header_->token_size; }
+  int topic_size() const { return header_->topic_size; }
+  Layout layout() const { return static_cast<Layout>(header_->layout); }
+  int64_t nnz() const { return header_->nnz; }
+  int64_t byte_size() const { return header_->file_size; }
+
+  std::string topic_name(int topic_index) const { return string(topic_index); }
+  std::string keyword(int token_index) const { return string(topic_size() + token_index); }
+  std::string class_id(int token_index) const { return string(topic_size() + token_size() + token_index); }
+
+  // Looks the token up in the hash index of the file, without reading the strings of other tokens.
+  // Returns PhiMatrix::kUndefIndex if there is no such token.
+  int FindToken(const ClassId& class_id, const std::string& keyword) const;
+  static uint64_t TokenHash(const ClassId& class_id, const std::string& keyword);
+
+  // Adds all tokens to the empty target and fills in their values, decoding the chunks on num_threads threads.
+  // Throws CorruptedMessageException if a chunk fails verification.
+  void CopyTo(PhiMatrix* target, int num_threads) const;
+
+  // Verifies the checksums of all chunks of values on num_threads threads.
+  void VerifyValues(int num_threads) const;
+
+  // Row-major values of dense layout; mutable_values() returns nullptr for read-only mappings.
+  const float* values() const { return values_; }
+  float* mutable_values();
+
+ private:
+  std::string string(int string_index) const;
+  bool string_equals(int string_index, const std::string& value) const;
+  bool IsValidChunk(int chunk_index) const;
+  void ThrowCorrupted(const std::string& reason) const;
+
+  std::string file_name_;
+  boost::iostreams::mapped_file file_;
+  const PhiMatrixFileHeader* header_;
+  const int64_t* string_index_;
+  const char* strings_;
+  const int64_t* row_ptr_;
+  const int* topic_index_;
+  const float* values_;
+  const uint32_t* checksum_;
+  const PhiMatrixFileHashSlot* hash_index_;
+};
+
+// MappedPhiMatrix class implements PhiMatrix interface over the values of a dense binary model file,
+// the same way as AttachedPhiMatrix works over the memory provided by external code.
+// The file is mapped privately, so that the values can be modified (e.g. by NormalizeModel)
+// without changing the file; the pages that were not modified stay shared with the page cache.
+class MappedPhiMatrix : boost::noncopyable, public PhiMatrixFrame {
+ public:
+  MappedPhiMatrix(const ModelName& model_name, const std::shared_ptr<PhiMatrixFile>& file, float min_sparsity_rate);
+  virtual ~MappedPhiMatrix() { }
+  virtual int64_t ByteSize() const { return 0; }  // the values are backed by the file
+
+  virtual std::shared_ptr<PhiMatrix> Duplicate() const;
+
+  virtual float get(int token_id, int topic_id) const { return row(token_id)[topic_id]; }
+  virtual void get(int token_id, std::vector<float>* buffer) const;
+  virtual void set(int token_id, int topic_id, float value) { row(token_id)[topic_id] = value; }
+  virtual void set(int token_id, const std::vector<float>& values);
+  virtual void increase(int token_id, int topic_id, float increment) { row(token_id)[topic_id] += increment; }
+  virtual void increase(int token_id, const std::vector<float>& increment);  // must be thread-safe
+
+  virtual int get_non_zero_topic_size(int token_id) const { return topic_size(); }
+  virtual void get_sparse(int token_id, std::vector<float>* value_buffer, std::vector<int>* index_buffer) const;
+
+  virtual void Clear();
+  virtual int AddToken(const Token& token);
+
+ private:
+  float* row(int token_id) { return values_ + static_cast<int64_t>(token_id) * topic_size(); }
+  const float* row(int token_id) const { return values_ + static_cast<int64_t>(token_id) * topic_size(); }
+
+  std::shared_ptr<PhiMatrixFile> file_;
+  float* values_;
+};
+
+// SharedPhiMatrix class implements read-only PhiMatrix interface over a dense binary model file.
+// Unlike MappedPhiMatrix it does not build the token index in memory: tokens are looked up
+// in the hash index of the file, and the file is mapped read-only, so that the processes
+// that load the same model share its pages in the page cache.
+// This makes ImportModel almost instant, and is intended for inference (e.g. TransformMasterModel).
+// All methods that modify the matrix throw InvalidOperation.
+class SharedPhiMatrix : boost::noncopyable, public PhiMatrix {
+ public:
+  SharedPhiMatrix(const ModelName& model_name, const std::shared_ptr<PhiMatrixFile>& file);
+
+  virtual int token_size() const { return file_->token_size(); }
+  virtual int topic_size() const { return file_->topic_size(); }
+  virtual google::protobuf::RepeatedPtrField<std::string> topic_name() const;
+  virtual const std::string& topic_name(int topic_id) const { return topic_name_[topic_id]; }
+  virtual void set_topic_name(int topic_id, const std::string& topic_name);
+  virtual ModelName model_name() const { return model_name_; }
+  virtual int64_t ByteSize() const;
+  virtual bool is_packable() const { return false; }
+
+  // Tokens are only created when token() or class_index() is called for the first time
+  // (e.g. to retrieve the model), as inference only needs token_index().
+  virtual const Token& token(int index) const;
+  virtual int class_index(int token_id) const;
+  virtual bool has_token(const Token& token) const { return token_index(token) != kUndefIndex; }
+  virtual int token_index(const Token& token) const { return file_->FindToken(token.class_id, token.keyword); }
+  virtual int64_t shape_version() const { return shape_version_; }
+
+  virtual float get(int token_id, int topic_id) const { return row(token_id)[topic_id]; }
+  virtual void get(int token_id, std::vector<float>* buffer) const;
+  virtual void set(int token_id, int topic_id, float value);
+  virtual void set(int token_id, const std::vector<float>& values);
+  virtual void increase(int token_id, int topic_id, float increment);
+  virtual void increase(int token_id, const std::vector<float>& increment);
+
+  virtual int get_non_zero_topic_size(int token_id) const { return topic_size(); }
+  virtual void get_sparse(int token_id, std::vector<float>* value_buffer, std::vector<int>* index_buffer) const;
+
+  virtual void Clear();
+  virtual int AddToken(const Token& token);
+
+  virtual std::shared_ptr<PhiMatrix> Duplicate() const;
+
+ private:
+  const float* row(int token_id) const { return values_ + static_cast<int64_t>(token_id) * topic_size(); }
+  void ThrowReadOnly() const;
+  void CreateTokens() const;
+
+  ModelName model_name_;
+  std::vector<std::string> topic_name_;
+  std::shared_ptr<PhiMatrixFile> file_;
+  const float* values_;
+  int64_t shape_version_;
+
+  mutable std::once_flag tokens_created_;
+  mutable std::vector<Token> tokens_;
+  mutable std::vector<int> class_index_;
+};
+
+}  // namespace core
+}  // namespace artm
@@ -3,18 +3,24 @@
 #include "artm/core/phi_matrix_operations.h"
 
 #include <assert.h>
+#include <string.h>
 
 #include <algorithm>
+#include <atomic>
 #include <utility>
 #include <string>
 #include <set>
 
 #include "boost/range/adaptor/map.hpp"
+#include "boost/thread/thread.hpp"
 
 #include "artm/core/check_messages.h"
+#include "artm/core/class_id_registry.h"
 #include "artm/core/protobuf_helpers.h"
 #include "artm/core/helpers.h"
+#include "artm/core/contiguous_phi_matrix.h"
 #include "artm/core/dense_phi_matrix.h"
+#include "artm/core/external_matrix_writer.h"
 #include "artm/core/instance.h"
 #include "artm/regularizer_interface.h"
 
@@ -22,78 +28,197 @@ namespace artm {
 namespace core {
 
 namespace {
-  std::unordered_map<ClassId, std::vector<float>> FindRelativeRegularizationCoefficients(
-          const std::shared_ptr<artm::RegularizerInterface>& regularizer,
-          const PhiMatrix& n_wt,
-          const DensePhiMatrix& local_r_wt,
-          const Normalizers& n_t_all,
-          const std::vector<bool>& topics_to_regularize,
-          int topic_size,
-          int token_size,
-          float gamma) {
-    std::unordered_map<ClassId, std::vector<float>> relative_coefficients;
-
-    std::vector<core::ClassId> class_ids;
-    if (!regularizer->class_ids_to_regularize().empty()) {
-      for (const auto& class_id : regularizer->class_ids_to_regularize()) {
-        class_ids.push_back(class_id);
-      }
-    } else {
-      for (const auto& n_t : n_t_all) {
-        class_ids.push_back(n_t.first);
+
+// The M-step kernels process the tokens in blocks of fixed size and reduce the partial sums of the blocks
+// in block order, so that the result does not depend on the number of threads.
+const int kNormalizeBlockSize = 4096;
+
+// Runs func(block_index) for all blocks, distributing the blocks among num_threads threads.
+template<typename Function>
+void ParallelForBlocks(int num_blocks, int num_threads, const char* thread_name, Function func) {
+  num_threads = std::max(1, std::min(num_threads, num_blocks));
+  if (num_threads == 1) {
+    for (int block_index = 0; block_index < num_blocks; ++block_index) {
+      func(block_index);
+    }
+    return;
+  }
+
+  std::atomic<int> next_block(0);
+  boost::thread_group threads;
+  for (int thread_index = 0; thread_index < num_threads; ++thread_index) {
+    threads.create_thread([&next_block, num_blocks, thread_name, &func]() {  // NOLINT
+      Helpers::SetThreadName(-1, thread_name);
+      for (int block_index = next_block++; block_index < num_blocks; block_index = next_block++) {
+        func(block_index);
       }
+    });
+  }
+
+  threads.join_all();
+}
+
+int NumTokenBlocks(int token_size) {
+  return (token_size + kNormalizeBlockSize - 1) / kNormalizeBlockSize;
+}
+
+// Runs the regularizer on num_threads threads if it provides RegularizePhiAgent,
+// otherwise falls back to single-threaded RegularizerInterface::RegularizePhi.
+bool RunPhiRegularizer(RegularizerInterface* regularizer, const PhiMatrix& p_wt, const PhiMatrix& n_wt,
+                       PhiMatrix* r_wt, const float* tau, int num_threads) {
+  std::shared_ptr<RegularizePhiAgent> agent = regularizer->CreateRegularizePhiAgent(p_wt, n_wt, tau);
+  if (agent == nullptr) {
+    return regularizer->RegularizePhi(p_wt, n_wt, r_wt, tau);
+  }
+
+  // Each block of tokens is processed by exactly one thread, so agents never write the same row of r_wt
+  const int token_size = n_wt.token_size();
+  ParallelForBlocks(NumTokenBlocks(token_size), num_threads, "RegularizePhi", [&](int block_index) {  // NOLINT
+    const int token_begin = block_index * kNormalizeBlockSize;
+    agent->Apply(token_begin, std::min(token_begin + kNormalizeBlockSize, token_size), r_wt);
+  });
+
+  return true;
+}
+
+// Classes of n_wt tokens, resolved once for all relative regularizers.
+struct TokenClasses {
+  std::vector<ClassId> class_id;
+  std::vector<int> token_class;  // index in class_id for each token of n_wt
+};
+
+TokenClasses FindTokenClasses(const PhiMatrix& n_wt) {
+  TokenClasses retval;
+  retval.token_class.resize(n_wt.token_size());
+  std::vector<int> local_class;  // index in retval.class_id for each class index of ClassIdRegistry
+  for (int token_id = 0; token_id < n_wt.token_size(); ++token_id) {
+    const int class_index = n_wt.class_index(token_id);
+    if (class_index >= static_cast<int>(local_class.size())) {
+      local_class.resize(class_index + 1, -1);
     }
 
-    std::vector<float> r_it = std::vector<float>(topic_size, 0.0f);
-    std::vector<float> coefficients = std::vector<float>(topic_size, 0.0f);
-    for (const auto& class_id : class_ids) {
-      auto iter = n_t_all.find(class_id);
-      if (iter != n_t_all.end()) {
-        double n = 0.0;
-        double r_i = 0.0;
-        std::vector<float> n_t = iter->second;
+    if (local_class[class_index] == -1) {
+      local_class[class_index] = static_cast<int>(retval.class_id.size());
+      retval.class_id.push_back(n_wt.token(token_id).class_id);
+    }
 
-        for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
-          if (!topics_to_regularize[topic_id]) {
-            continue;
-          }
-          n += n_t[topic_id];
+    retval.token_class[token_id] = local_class[class_index];
+  }
 
-          float r_it_current = 0.0f;
-          for (int token_id = 0; token_id < token_size; ++token_id) {
-            if (n_wt.token(token_id).class_id != iter->first) {
-              continue;
-            }
+  return retval;
+}
 
-            r_it_current += fabs(local_r_wt.get(token_id, topic_id));
-          }
+// Finds relative regularization coefficients for each class of token_classes (empty vectors for the classes
+// that are not regularized). Sums of |r_wt| are collected in one parallel pass over the tokens,
+// and reduced in block order, so that the result does not depend on the number of threads.
+std::vector<std::vector<float>> FindRelativeRegularizationCoefficients(
+        const std::shared_ptr<artm::RegularizerInterface>& regularizer,
+        const TokenClasses& token_classes,
+        const ContiguousPhiMatrix& local_r_wt,
+        const Normalizers& n_t_all,
+        const std::vector<bool>& topics_to_regularize,
+        float gamma,
+        int num_threads) {
+  const int topic_size = local_r_wt.topic_size();
+  const int token_size = local_r_wt.token_size();
+  const int class_size = static_cast<int>(token_classes.class_id.size());
+  const int num_blocks = NumTokenBlocks(token_size);
+
+  std::vector<std::vector<double>> block_r_it(num_blocks);
+  ParallelForBlocks(num_blocks, num_threads, "RegularizePhi", [&](int block_index) {  // NOLINT
+    std::vector<double>& r_it = block_r_it[block_index];
+    r_it.assign(static_cast<size_t>(class_size) * topic_size, 0.0);
+    const int token_begin = block_index * kNormalizeBlockSize;
+    const int token_end = std::min(token_begin + kNormalizeBlockSize, token_size);
+    for (int token_id = token_begin; token_id < token_end; ++token_id) {
+      const float* values = local_r_wt.row(token_id);
+      double* class_r_it = &r_it[static_cast<size_t>(token_classes.token_class[token_id]) * topic_size];
+      for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+        class_r_it[topic_id] += fabs(values[topic_id]);
+      }
+    }
+  });
 
-          r_it[topic_id] = r_it_current;
-          r_i += r_it_current;
-        }
+  std::vector<double> r_it(static_cast<size_t>(class_size) * topic_size, 0.0);
+  for (const auto& block : block_r_it) {
+    for (size_t i = 0; i < r_it.size(); ++i) {
+      r_it[i] += block[i];
+    }
+  }
 
-        for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
-          if (!topics_to_regularize[topic_id]) {
-            continue;
-          }
+  std::vector<core::ClassId> class_ids;
+  if (!regularizer->class_ids_to_regularize().empty()) {
+    for (const auto& class_id : regularizer->class_ids_to_regularize()) {
+      class_ids.push_back(class_id);
+    }
+  } else {
+    for (const auto& n_t : n_t_all) {
+      class_ids.push_back(n_t.first);
+    }
+  }
 
-          coefficients[topic_id] = gamma * (n_t[topic_id] / r_it[topic_id]) +
-                                   (1 - gamma) * static_cast<float>(n / r_i);
-        }
+  std::vector<std::vector<float>> relative_coefficients(class_size);
+  for (const auto& class_id : class_ids) {
+    auto iter = n_t_all.find(class_id);
+    if (iter == n_t_all.end()) {
+      LOG(WARNING) << "No class_id " << class_id << " in model";
+      continue;
+    }
 
-        relative_coefficients.insert(std::make_pair(iter->first, coefficients));
-      } else {
-        LOG(WARNING) << "No class_id " << class_id << " in model";
+    auto class_iter = std::find(token_classes.class_id.begin(), token_classes.class_id.end(), class_id);
+    if (class_iter == token_classes.class_id.end()) {
+      continue;
+    }
+
+    const int class_index = static_cast<int>(class_iter - token_classes.class_id.begin());
+    const std::vector<float>& n_t = iter->second;
+    const double* class_r_it = &r_it[static_cast<size_t>(class_index) * topic_size];
+
+    double n = 0.0;
+    double r_i = 0.0;
+    for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+      if (topics_to_regularize[topic_id]) {
+        n += n_t[topic_id];
+        r_i += class_r_it[topic_id];
+      }
+    }
+
+    std::vector<float>& coefficients = relative_coefficients[class_index];
+    coefficients.assign(topic_size, 0.0f);
+    for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+      if (topics_to_regularize[topic_id]) {
+        coefficients[topic_id] = gamma * static_cast<float>(n_t[topic_id] / class_r_it[topic_id]) +
+                                 (1 - gamma) * static_cast<float>(n / r_i);
       }
     }
-    return relative_coefficients;
   }
+
+  return relative_coefficients;
+}
+
 }  // namespace
 
-void PhiMatrixOperations::RetrieveExternalTopicModel(const PhiMatrix& phi_matrix,
-                                                     const ::artm::GetTopicModelArgs& get_model_args,
-                                                     ::artm::TopicModel* topic_model) {
-  const bool has_sparse_format = (get_model_args.matrix_layout() == MatrixLayout_Sparse);
+std::shared_ptr<PhiMatrix> PhiMatrixOperations::CreatePhiMatrix(
+    const MasterModelConfig& config, const ModelName& model_name,
+    const google::protobuf::RepeatedPtrField<std::string>& topic_name,
+    const PhiMatrix* shape) {
+  if (config.phi_matrix_type() == PhiMatrixType_Contiguous) {
+    auto retval = std::make_shared<ContiguousPhiMatrix>(model_name, topic_name, config.min_sparsity_rate());
+    if (shape != nullptr) {
+      retval->Reshape(*shape);
+    }
+    return retval;
+  }
+
+  auto retval = std::make_shared<DensePhiMatrix>(model_name, topic_name, config.min_sparsity_rate());
+  if (shape != nullptr) {
+    retval->Reshape(*shape);
+  }
+  return retval;
+}
+
+// Returns ids of tokens, requested by GetTopicModelArgs.token and GetTopicModelArgs.class_id
+static std::vector<int> FindTokensToUse(const PhiMatrix& phi_matrix, const ::artm::GetTopicModelArgs& get_model_args) {
   const bool use_default_class = (get_model_args.class_id_size() == 0);
 
   std::vector<int> tokens_to_use;
@@ -126,6 +251,11 @@ void PhiMatrixOperations::RetrieveExternalTopicModel(const PhiMatrix& phi_matrix
     }
   }
 
+  return tokens_to_use;
+}
+
+// Returns indices of topics, requested by GetTopicModelArgs.topic_name (all topics by default)
+static std::vector<int> FindTopicsToUse(const PhiMatrix& phi_matrix, const ::artm::GetTopicModelArgs& get_model_args) {
   std::vector<int> topics_to_use;
   if (get_model_args.topic_name_size() != 0) {
     auto this_topic_name = phi_matrix.topic_name();
@@ -147,6 +277,16 @@ void PhiMatrixOperations::RetrieveExternalTopicModel(const PhiMatrix& phi_matrix
     }
   }
 
+  return topics_to_use;
+}
+
+void PhiMatrixOperations::RetrieveExternalTopicModel(const PhiMatrix& phi_matrix,
+                                                     const ::artm::GetTopicModelArgs& get_model_args,
+                                                     ::artm::TopicModel* topic_model) {
+  const bool has_sparse_format = (get_model_args.matrix_layout() == MatrixLayout_Sparse);
+  std::vector<int> tokens_to_use = FindTokensToUse(phi_matrix, get_model_args);
+  std::vector<int> topics_to_use = FindTopicsToUse(phi_matrix, get_model_args);
+
   LOG(INFO) << "RetrieveExternalTopicModel() with "
             << topics_to_use.size() << " topics, "
             << tokens_to_use.size() << " tokens";
@@ -189,6 +329,56 @@ void PhiMatrixOperations::RetrieveExternalTopicModel(const PhiMatrix& phi_matrix
   }
 }
 
+void PhiMatrixOperations::RetrieveExternalTopicModel(const PhiMatrix& phi_matrix,
+                                                     const ::artm::GetTopicModelArgs& get_model_args,
+                                                     ::artm::TopicModel* topic_model,
+                                                     int64_t address_length, char* address) {
+  const bool has_sparse_format = (get_model_args.matrix_layout() == MatrixLayout_Sparse);
+  std::vector<int> tokens_to_use = FindTokensToUse(phi_matrix, get_model_args);
+  std::vector<int> topics_to_use = FindTopicsToUse(phi_matrix, get_model_args);
+
+  LOG(INFO) << "RetrieveExternalTopicModel() with "
+            << topics_to_use.size() << " topics, "
+            << tokens_to_use.size() << " tokens into external buffer";
+
+  for (int topic_index : topics_to_use) {
+    topic_model->add_topic_name(phi_matrix.topic_name(topic_index));
+  }
+  topic_model->set_num_topics(static_cast<int>(topics_to_use.size()));
+  topic_model->set_name(phi_matrix.model_name());
+
+  std::vector<float> values(phi_matrix.topic_size());
+  auto write_rows = [&](ExternalMatrixWriter* writer) {
+    for (int token_index : tokens_to_use) {
+      if (!writer->needs_values()) {
+        writer->SkipValues(static_cast<int>(topics_to_use.size()));
+      } else {
+        phi_matrix.get(token_index, &values);
+        if (!has_sparse_format) {
+          for (int topic_index : topics_to_use) {
+            writer->AddValue(values[topic_index]);
+          }
+        } else {
+          for (unsigned topics_to_use_index = 0; topics_to_use_index < topics_to_use.size(); topics_to_use_index++) {
+            float value = values[topics_to_use[topics_to_use_index]];
+            if (fabs(value) > get_model_args.eps()) {
+              writer->AddValue(topics_to_use_index, value);
+            }
+          }
+        }
+      }
+
+      if (writer->EndRow() && writer->counting()) {
+        const Token& current_token = phi_matrix.token(token_index);
+        topic_model->add_token(current_token.keyword);
+        topic_model->add_class_id(current_token.class_id);
+      }
+    }
+  };
+
+  topic_model->set_num_values(ExternalMatrixWriter::Write(has_sparse_format, address_length, address, write_rows));
+}
+
 void PhiMatrixOperations::ApplyTopicModelOperation(const ::artm::TopicModel& topic_model,
                                                    float apply_weight, bool add_missing_tokens,
                                                    PhiMatrix* phi_matrix) {
@@ -273,13 +463,11 @@ void PhiMatrixOperations::ApplyTopicModelOperation(const ::artm::TopicModel& top
 void PhiMatrixOperations::InvokePhiRegularizers(
     Instance* instance,
     const ::google::protobuf::RepeatedPtrField<RegularizerSettings>& regularizer_settings,
-    const PhiMatrix& p_wt, const PhiMatrix& n_wt, PhiMatrix* r_wt) {
+    const PhiMatrix& p_wt, const PhiMatrix& n_wt, PhiMatrix* r_wt, int num_threads) {
 
   int topic_size = n_wt.topic_size();
   int token_size = n_wt.token_size();
 
-  auto n_t_all = PhiMatrixOperations::FindNormalizers(n_wt);
-
   bool use_any_relative_regularization = false;
   for (const auto &reg_it : regularizer_settings) {
     if (reg_it.has_gamma()) {
@@ -289,7 +477,11 @@ void PhiMatrixOperations::InvokePhiRegularizers(
   }
 
   if (use_any_relative_regularization) {
-    DensePhiMatrix local_r_wt(ModelName(), n_wt.topic_name(), instance->config()->min_sparsity_rate());
+    auto n_t_all = PhiMatrixOperations::FindNormalizers(n_wt, num_threads);
+    TokenClasses token_classes = FindTokenClasses(n_wt);
+
+    // The scratch matrix is shared by all regularizers; its rows are cleared as soon as they are added to r_wt
+    ContiguousPhiMatrix local_r_wt(ModelName(), n_wt.topic_name(), instance->config()->min_sparsity_rate());
     local_r_wt.Reshape(n_wt);
 
     for (const auto &reg_it : regularizer_settings) {
@@ -314,7 +506,7 @@ void PhiMatrixOperations::InvokePhiRegularizers(
         continue;
       }
 
-      bool retval = regularizer->RegularizePhi(p_wt, n_wt, &local_r_wt);
+      bool retval = RunPhiRegularizer(regularizer.get(), p_wt, n_wt, &local_r_wt, nullptr, num_threads);
       if (!retval) {
         continue;
       }
@@ -326,34 +518,48 @@ void PhiMatrixOperations::InvokePhiRegularizers(
         topics_to_regularize.assign(topic_size, true);
       }
 
-      std::unordered_map<ClassId, std::vector<float>> relative_coefficients;
+      std::vector<std::vector<float>> relative_coefficients;
       if (use_relative_reg) {
-        relative_coefficients = FindRelativeRegularizationCoefficients(regularizer, n_wt, local_r_wt, n_t_all,
-                                                                       topics_to_regularize, topic_size,
-                                                                       token_size, reg_it.gamma());
+        relative_coefficients = FindRelativeRegularizationCoefficients(regularizer, token_classes, local_r_wt,
+                                                                       n_t_all, topics_to_regularize,
+                                                                       reg_it.gamma(), num_threads);
+        for (size_t class_index = 0; class_index < relative_coefficients.size(); ++class_index) {
+          if (relative_coefficients[class_index].empty()) {
+            LOG(WARNING) << "No relative coefficients were provided for class_id "
+                         << token_classes.class_id[class_index];
+          }
+        }
       }
 
-      for (int token_id = 0; token_id < token_size; ++token_id) {
-        const auto& class_id = n_wt.token(token_id).class_id;
-        auto iter = relative_coefficients.find(class_id);
+      // update global r_wt using coefficient and tau, and clear the scratch matrix for the next regularizer
+      ParallelForBlocks(NumTokenBlocks(token_size), num_threads, "RegularizePhi", [&](int block_index) {  // NOLINT
+        std::vector<float> increment(topic_size, 0.0f);
+        const int token_begin = block_index * kNormalizeBlockSize;
+        const int token_end = std::min(token_begin + kNormalizeBlockSize, token_size);
+        for (int token_id = token_begin; token_id < token_end; ++token_id) {
+          float* values = local_r_wt.row(token_id);
+          const std::vector<float>* coefficients = nullptr;
+          if (use_relative_reg) {
+            coefficients = &relative_coefficients[token_classes.token_class[token_id]];
+          }
 
-        if (use_relative_reg && iter == relative_coefficients.end()) {
-          LOG(WARNING) << "No relative coefficients were provided for class_id " << class_id;
-          continue;
-        }
+          if (coefficients == nullptr || !coefficients->empty()) {
+            for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+              if (coefficients != nullptr && !topics_to_regularize[topic_id]) {
+                increment[topic_id] = 0.0f;
+                continue;
+              }
 
-        for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
-          if (use_relative_reg && !topics_to_regularize[topic_id]) {
-            continue;
+              float coefficient = (coefficients != nullptr) ? (*coefficients)[topic_id] : 1.0f;
+              increment[topic_id] = coefficient * tau * values[topic_id];
+            }
+
+            r_wt->increase(token_id, increment);
           }
 
-          // update global r_wt using coefficient and tau
-          float coefficient = use_relative_reg ? iter->second[topic_id] : 1.0f;
-          float increment = coefficient * tau * local_r_wt.get(token_id, topic_id);
-          r_wt->increase(token_id, topic_id, increment);
+          memset(values, 0, sizeof(float) * topic_size);
         }
-      }
-      local_r_wt.Reset();
+      });
     }
   } else {
     for (const auto& reg_it : regularizer_settings) {
@@ -375,90 +581,182 @@ void PhiMatrixOperations::InvokePhiRegularizers(
         continue;
       }
 
-      regularizer->RegularizePhi(p_wt, n_wt, r_wt, &tau);
+      RunPhiRegularizer(regularizer.get(), p_wt, n_wt, r_wt, &tau, num_threads);
     }
   }
 }
 
-static Normalizers FindNormalizersImpl(const PhiMatrix& n_wt, const PhiMatrix* r_wt) {
-  Normalizers retval;
-  assert((r_wt == nullptr) || (r_wt->token_size() == n_wt.token_size() && r_wt->topic_size() == n_wt.topic_size()));
+namespace {
 
-  for (int token_id = 0; token_id < n_wt.token_size(); ++token_id) {
-    const Token& token = n_wt.token(token_id);
-    auto normalizer_key = token.class_id;
+// Partial normalizers of one block of tokens.
+// Classes are numbered locally in the order of their first appearance within the block.
+struct NormalizersBlock {
+  std::vector<int> class_index;  // index in ClassIdRegistry of each local class
+  std::vector<float> n_t;        // class_size x topic_size
+};
+
+class FusedNormalizer {
+ public:
+  FusedNormalizer(const PhiMatrix& n_wt, const PhiMatrix* r_wt, int num_threads)
+      : n_wt_(n_wt), r_wt_(r_wt), num_threads_(num_threads),
+        blocks_((n_wt.token_size() + kNormalizeBlockSize - 1) / kNormalizeBlockSize), class_n_t_(),
+        normalizers_() {
+    assert((r_wt == nullptr) || (r_wt->token_size() == n_wt.token_size() && r_wt->topic_size() == n_wt.topic_size()));
+  }
+
+  // Sums positive n_wt + r_wt values over the tokens of each class
+  const Normalizers& FindNormalizers() {
+    ParallelForBlocks(static_cast<int>(blocks_.size()), num_threads_, "Normalize", [this](int block_index) {  // NOLINT
+      FindBlockNormalizers(block_index);
+    });
+
+    // Blocks are reduced in their order, so the result does not depend on the number of threads
+    const int topic_size = n_wt_.topic_size();
+    for (const NormalizersBlock& block : blocks_) {
+      for (int local_class = 0; local_class < static_cast<int>(block.class_index.size()); ++local_class) {
+        const int class_index = block.class_index[local_class];
+        if (class_index >= static_cast<int>(class_n_t_.size())) {
+          class_n_t_.resize(class_index + 1);
+        }
+
+        std::vector<float>& n_t = class_n_t_[class_index];
+        if (n_t.empty()) {
+          n_t.assign(topic_size, 0.0f);
+        }
 
-    assert(r_wt == nullptr || r_wt->token(token_id) == token);
-    auto iter = retval.find(normalizer_key);
-    if (iter == retval.end()) {
-      retval.insert(std::make_pair(normalizer_key, std::vector<float>(n_wt.topic_size(), 0)));
-      iter = retval.find(normalizer_key);
+        const float* block_n_t = &block.n_t[static_cast<size_t>(local_class) * topic_size];
+        for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+          n_t[topic_id] += block_n_t[topic_id];
+        }
+      }
     }
 
-    for (int topic_id = 0; topic_id < n_wt.topic_size(); ++topic_id) {
-      const float sum = n_wt.get(token_id, topic_id) + ((r_wt == nullptr) ? 0.0f : r_wt->get(token_id, topic_id));
-      if (sum > 0) {
-        iter->second[topic_id] += sum;
+    for (int class_index = 0; class_index < static_cast<int>(class_n_t_.size()); ++class_index) {
+      if (!class_n_t_[class_index].empty()) {
+        normalizers_[ClassIdRegistry::singleton().class_id(class_index)] = class_n_t_[class_index];
       }
     }
+
+    return normalizers_;
   }
 
-  return retval;
-}
+  // Must be called after FindNormalizers; p_wt may be the same matrix as n_wt.
+  void FindPwt(PhiMatrix* p_wt) {
+    ParallelForBlocks(static_cast<int>(blocks_.size()), num_threads_, "Normalize", [this, p_wt](int block_index) {  // NOLINT
+      FindBlockPwt(block_index, p_wt);
+    });
+  }
 
-static void FindPwtImpl(const PhiMatrix& n_wt, const PhiMatrix* r_wt, PhiMatrix* p_wt) {
-  const int topic_size = n_wt.topic_size();
-  const int token_size = n_wt.token_size();
+ private:
+  void FindBlockNormalizers(int block_index) {
+    NormalizersBlock& block = blocks_[block_index];
+    const int topic_size = n_wt_.topic_size();
+    const int token_begin = block_index * kNormalizeBlockSize;
+    const int token_end = std::min(token_begin + kNormalizeBlockSize, n_wt_.token_size());
+
+    std::vector<int> local_class;  // local index for each class index of ClassIdRegistry
+    std::vector<float> n_wt_row(topic_size, 0.0f), r_wt_row(topic_size, 0.0f);
+    for (int token_id = token_begin; token_id < token_end; ++token_id) {
+      assert(r_wt_ == nullptr || r_wt_->token(token_id) == n_wt_.token(token_id));
+      const int class_index = n_wt_.class_index(token_id);
+      if (class_index >= static_cast<int>(local_class.size())) {
+        local_class.resize(class_index + 1, -1);
+      }
 
-  if (topic_size == 0 || token_size == 0) {
-    LOG(WARNING) << "Attempt to calculate p_wt for empty matrix";
-    return;
-  }
+      if (local_class[class_index] == -1) {
+        local_class[class_index] = static_cast<int>(block.class_index.size());
+        block.class_index.push_back(class_index);
+        block.n_t.resize(block.n_t.size() + topic_size, 0.0f);
+      }
 
-  assert((r_wt == nullptr) || (r_wt->token_size() == n_wt.token_size() && r_wt->topic_size() == n_wt.topic_size()));
-  assert(p_wt->token_size() == n_wt.token_size() && p_wt->topic_size() == n_wt.topic_size());
+      n_wt_.get(token_id, &n_wt_row);
+      if (r_wt_ != nullptr) {
+        r_wt_->get(token_id, &r_wt_row);
+      }
 
-  Normalizers n_t = FindNormalizersImpl(n_wt, r_wt);
-  for (int token_id = 0; token_id < token_size; ++token_id) {
-    const Token& token = n_wt.token(token_id);
-    assert(r_wt == nullptr || r_wt->token(token_id) == token);
-    assert(p_wt->token(token_id) == token);
-    const std::vector<float>& nt = n_t[token.class_id];
-    for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
-      if (nt[topic_index] <= 0) {
-        p_wt->set(token_id, topic_index, 0.0f);
-        continue;
+      float* n_t = &block.n_t[static_cast<size_t>(local_class[class_index]) * topic_size];
+      for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+        const float sum = n_wt_row[topic_id] + r_wt_row[topic_id];
+        if (sum > 0) {
+          n_t[topic_id] += sum;
+        }
+      }
+    }
+  }
+
+  void FindBlockPwt(int block_index, PhiMatrix* p_wt) {
+    const int topic_size = n_wt_.topic_size();
+    const int token_begin = block_index * kNormalizeBlockSize;
+    const int token_end = std::min(token_begin + kNormalizeBlockSize, n_wt_.token_size());
+
+    std::vector<float> n_wt_row(topic_size, 0.0f), r_wt_row(topic_size, 0.0f), p_wt_row(topic_size, 0.0f);
+    for (int token_id = token_begin; token_id < token_end; ++token_id) {
+      assert(p_wt->token(token_id) == n_wt_.token(token_id));
+      const std::vector<float>& nt = class_n_t_[n_wt_.class_index(token_id)];
+      n_wt_.get(token_id, &n_wt_row);
+      if (r_wt_ != nullptr) {
+        r_wt_->get(token_id, &r_wt_row);
       }
 
-      float nwt_value = n_wt.get(token_id, topic_index);
-      float rwt_value = (r_wt == nullptr) ? 0.0f : r_wt->get(token_id, topic_index);
-      float value = std::max<float>(nwt_value + rwt_value, 0.0f) / nt[topic_index];
-      if (isZero(value)) {
-        // Reset small values to 0.0 to avoid performance hit.
-        // http://en.wikipedia.org/wiki/Denormal_number#Performance_issues
-        // http://stackoverflow.com/questions/13964606/inconsistent-multiplication-performance-with-floats
-        value = 0.0f;
+      for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
+        if (nt[topic_index] <= 0) {
+          p_wt_row[topic_index] = 0.0f;
+          continue;
+        }
+
+        float value = std::max<float>(n_wt_row[topic_index] + r_wt_row[topic_index], 0.0f) / nt[topic_index];
+        if (isZero(value)) {
+          // Reset small values to 0.0 to avoid performance hit.
+          // http://en.wikipedia.org/wiki/Denormal_number#Performance_issues
+          // http://stackoverflow.com/questions/13964606/inconsistent-multiplication-performance-with-floats
+          value = 0.0f;
+        }
+
+        p_wt_row[topic_index] = value;
       }
 
-      p_wt->set(token_id, topic_index, value);
+      p_wt->set(token_id, p_wt_row);
     }
   }
+
+  const PhiMatrix& n_wt_;
+  const PhiMatrix* r_wt_;
+  int num_threads_;
+  std::vector<NormalizersBlock> blocks_;
+  std::vector<std::vector<float>> class_n_t_;  // normalizers for each class index of ClassIdRegistry
+  Normalizers normalizers_;
+};
+
+void FindPwtImpl(const PhiMatrix& n_wt, const PhiMatrix* r_wt, PhiMatrix* p_wt, int num_threads) {
+  if (n_wt.topic_size() == 0 || n_wt.token_size() == 0) {
+    LOG(WARNING) << "Attempt to calculate p_wt for empty matrix";
+    return;
+  }
+
+  assert(p_wt->token_size() == n_wt.token_size() && p_wt->topic_size() == n_wt.topic_size());
+
+  // Normalizers and p_wt share the per-token class indices and the thread pool of one kernel
+  FusedNormalizer normalizer(n_wt, r_wt, num_threads);
+  normalizer.FindNormalizers();
+  normalizer.FindPwt(p_wt);
 }
 
-Normalizers PhiMatrixOperations::FindNormalizers(const PhiMatrix& n_wt) {
-  return FindNormalizersImpl(n_wt, nullptr);
+}  // namespace
+
+Normalizers PhiMatrixOperations::FindNormalizers(const PhiMatrix& n_wt, int num_threads) {
+  return FusedNormalizer(n_wt, nullptr, num_threads).FindNormalizers();
 }
 
-Normalizers PhiMatrixOperations::FindNormalizers(const PhiMatrix& n_wt, const PhiMatrix& r_wt) {
-  return FindNormalizersImpl(n_wt, &r_wt);
+Normalizers PhiMatrixOperations::FindNormalizers(const PhiMatrix& n_wt, const PhiMatrix& r_wt, int num_threads) {
+  return FusedNormalizer(n_wt, &r_wt, num_threads).FindNormalizers();
 }
 
-void PhiMatrixOperations::FindPwt(const PhiMatrix& n_wt, PhiMatrix* p_wt) {
-  FindPwtImpl(n_wt, nullptr, p_wt);
+void PhiMatrixOperations::FindPwt(const PhiMatrix& n_wt, PhiMatrix* p_wt, int num_threads) {
+  FindPwtImpl(n_wt, nullptr, p_wt, num_threads);
 }
 
-void PhiMatrixOperations::FindPwt(const PhiMatrix& n_wt, const PhiMatrix& r_wt, PhiMatrix* p_wt) {
-  FindPwtImpl(n_wt, &r_wt, p_wt);
+void PhiMatrixOperations::FindPwt(const PhiMatrix& n_wt, const PhiMatrix& r_wt, PhiMatrix* p_wt, int num_threads) {
+  FindPwtImpl(n_wt, &r_wt, p_wt, num_threads);
 }
 
 bool PhiMatrixOperations::HasEqualShape(const PhiMatrix& first, const PhiMatrix& second) {
@@ -476,6 +774,11 @@ bool PhiMatrixOperations::HasEqualShape(const PhiMatrix& first, const PhiMatrix&
     return false;
   }
 
+  // equal shape versions guarantee equal tokens
+  if (first.shape_version() == second.shape_version()) {
+    return true;
+  }
+
   for (int i = 0; i < first.token_size(); ++i) {
     if (first.token(i) != second.token(i)) {
       return false;
@@ -20,28 +20,47 @@ typedef std::unordered_map<ClassId, std::vector<float>> Normalizers;
 // PhiMatrixOperations contains helper methods to operate on PhiMatrix class.
 class PhiMatrixOperations {
  public:
+  // Create an empty phi matrix with storage, selected by MasterModelConfig.phi_matrix_type.
+  // If 'shape' is provided the new matrix will have the same set of tokens as 'shape' (all values are zeros).
+  static std::shared_ptr<PhiMatrix> CreatePhiMatrix(
+    const MasterModelConfig& config, const ModelName& model_name,
+    const google::protobuf::RepeatedPtrField<std::string>& topic_name,
+    const PhiMatrix* shape = nullptr);
+
   // Extract protobuf message 'topic_model' from phi matrix
   static void RetrieveExternalTopicModel(
     const PhiMatrix& phi_matrix, const ::artm::GetTopicModelArgs& get_model_args,
     ::artm::TopicModel* topic_model);
 
+  // Write the values of phi matrix straight into a caller-provided buffer (see ExternalMatrixWriter);
+  // 'topic_model' gets everything except token_weights. Zero address_length only requests the size (num_values).
+  static void RetrieveExternalTopicModel(
+    const PhiMatrix& phi_matrix, const ::artm::GetTopicModelArgs& get_model_args,
+    ::artm::TopicModel* topic_model, int64_t address_length, char* address);
+
   // Apply protobuf message 'topic_model' to phi_matrix
   static void ApplyTopicModelOperation(
     const ::artm::TopicModel& topic_model, float apply_weight, bool add_missing_tokens, PhiMatrix* phi_matrix);
 
-  // Calculate phi matrix regularizers (r_wt)
+  // Calculate phi matrix regularizers (r_wt).
+  // Regularizers run one after another; each regularizer that provides RegularizePhiAgent
+  // is applied to blocks of tokens on num_threads threads.
   static void InvokePhiRegularizers(
     Instance* instance,
     const ::google::protobuf::RepeatedPtrField<RegularizerSettings>& regularizer_settings,
-    const PhiMatrix& p_wt, const PhiMatrix& n_wt, PhiMatrix* r_wt);
+    const PhiMatrix& p_wt, const PhiMatrix& n_wt, PhiMatrix* r_wt, int num_threads = 1);
 
-  // For each ClassId finds a sum of all n_wt values for each topic with (optionally) regularizers r_wt
-  static Normalizers FindNormalizers(const PhiMatrix& n_wt);
-  static Normalizers FindNormalizers(const PhiMatrix& n_wt, const PhiMatrix& r_wt);
+  // For each ClassId finds a sum of all n_wt values for each topic with (optionally) regularizers r_wt.
+  // The tokens are split into fixed-size blocks, processed by num_threads threads;
+  // the result does not depend on num_threads.
+  static Normalizers FindNormalizers(const PhiMatrix& n_wt, int num_threads = 1);
+  static Normalizers FindNormalizers(const PhiMatrix& n_wt, const PhiMatrix& r_wt, int num_threads = 1);
 
-  // Produce normalized p_wt matrix from counters n_wt and (optionaly) regularizers r_wt
-  static void FindPwt(const PhiMatrix& n_wt, PhiMatrix* p_wt);
-  static void FindPwt(const PhiMatrix& n_wt, const PhiMatrix& r_wt, PhiMatrix* p_wt);
+  // Produce normalized p_wt matrix from counters n_wt and (optionaly) regularizers r_wt.
+  // Normalizers and p_wt are found by one fused parallel kernel that writes whole rows of p_wt.
+  // p_wt may be the same matrix as n_wt.
+  static void FindPwt(const PhiMatrix& n_wt, PhiMatrix* p_wt, int num_threads = 1);
+  static void FindPwt(const PhiMatrix& n_wt, const PhiMatrix& r_wt, PhiMatrix* p_wt, int num_threads = 1);
 
   // Checks whether two PhiMatrix instances has same set of tokens and topic names.
   // The order of the tokens and topics must also match.
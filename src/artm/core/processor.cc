@@ -5,6 +5,7 @@
 #include <stdlib.h>
 
 #include <algorithm>
+#include <chrono>  // NOLINT
 #include <map>
 #include <memory>
 #include <string>
@@ -19,6 +20,8 @@
 #include "artm/core/call_on_destruction.h"
 #include "artm/core/cuckoo_watch.h"
 #include "artm/core/batch_manager.h"
+#include "artm/core/batch_prefetcher.h"
+#include "artm/core/columnar_batch.h"
 #include "artm/core/cache_manager.h"
 #include "artm/utility/blas.h"
 
@@ -30,8 +33,9 @@ namespace fs = boost::filesystem;
 namespace artm {
 namespace core {
 
-Processor::Processor(Instance* instance)
+Processor::Processor(Instance* instance, int processor_index)
     : instance_(instance),
+      processor_index_(processor_index),
       is_stopping(false),
       thread_() {
   // Keep this at the last action in constructor.
@@ -42,6 +46,7 @@ Processor::Processor(Instance* instance)
 
 Processor::~Processor() {
   is_stopping = true;
+  instance_->processor_queue()->notify_all();
   if (thread_.joinable()) {
     thread_.join();
   }
@@ -54,33 +59,21 @@ void Processor::ThreadFunction() {
     // Do not log performance measurements below kTimeLoggingThreshold milliseconds
     const int kTimeLoggingThreshold = 0;
 
+    // BLAS library is resolved on the first batch and again only when master config names another library
+    util::Blas* blas = nullptr;
+    std::string blas_library;
+
     Helpers::SetThreadName(-1, "Processor thread");
     LOG(INFO) << "Processor thread started";
-    int pop_retries = 0;
-    const int pop_retries_max = 20;
-
-    util::Blas* blas = util::Blas::builtin();
 
     for (;;) {
-      if (is_stopping) {
+      std::shared_ptr<ProcessorInput> part;
+      if (!instance_->processor_queue()->pop(processor_index_, is_stopping, &part)) {
         LOG(INFO) << "Processor thread stopped";
         LOG(INFO) << "Total number of processed batches: " << total_processed_batches;
         break;
       }
 
-      std::shared_ptr<ProcessorInput> part;
-      if (!instance_->processor_queue()->try_pop(&part)) {
-        pop_retries++;
-        LOG_IF(INFO, pop_retries == pop_retries_max) << "No data in processing queue, waiting...";
-
-        boost::this_thread::sleep(boost::posix_time::milliseconds(kIdleLoopFrequency));
-
-        continue;
-      }
-
-      LOG_IF(INFO, pop_retries >= pop_retries_max) << "Processing queue has data, processing started";
-      pop_retries = 0;
-
       // CuckooWatch logs time from now to destruction
       const std::string batch_name = part->has_batch_filename() ? part->batch_filename() : part->batch().id();
       CuckooWatch cuckoo(std::string("ProcessBatch(") + batch_name + std::string(")"));
@@ -92,27 +85,60 @@ void Processor::ThreadFunction() {
         }
       });
 
-      Batch batch;
+      // In-memory batches are used without copying; columnar batches are memory-mapped,
+      // and only the tokens, the ids and the titles of their items are converted to protobuf message.
+      // Batches from disk are normally prefetched by BatchPrefetcher, otherwise they are loaded here.
+      std::shared_ptr<const Batch> batch_ptr;
+      std::shared_ptr<Batch> loaded_message;
+      std::shared_ptr<ColumnarBatch> columnar_batch;
+      auto load_start = std::chrono::steady_clock::now();
       {
         CuckooWatch cuckoo2("LoadMessage", &cuckoo, kTimeLoggingThreshold);
         if (part->has_batch_filename()) {
-          auto mem_batch = instance_->batches()->get(part->batch_filename());
-          if (mem_batch != nullptr) {
-            batch.CopyFrom(*mem_batch);
-          } else {
-            try {
-              ::artm::core::Helpers::LoadMessage(part->batch_filename(), &batch);
-            } catch (std::exception& ex) {
-              LOG(ERROR) << ex.what() << ", the batch will be skipped.";
-              continue;
+          std::shared_ptr<LoadedBatch> loaded_batch = instance_->batch_prefetcher()->Take(*part);
+          batch_ptr = instance_->batches()->get(part->batch_filename());
+          if (batch_ptr == nullptr) {
+            if (loaded_batch == nullptr) {
+              try {
+                loaded_batch = LoadedBatch::Load(part->batch_filename());
+              } catch (std::exception& ex) {
+                LOG(ERROR) << ex.what() << ", the batch will be skipped.";
+                continue;
+              }
             }
+
+            batch_ptr = loaded_message = loaded_batch->message;
+            columnar_batch = loaded_batch->columnar_batch;
           }
         } else {  // part->has_batch_filename()
-          batch.CopyFrom(part->batch());
+          batch_ptr = std::shared_ptr<const Batch>(part, &part->batch());
         }
       }
 
+      auto compute_start = std::chrono::steady_clock::now();
+      call_on_destruction record_time([&]() {  // NOLINT
+        auto compute_end = std::chrono::steady_clock::now();
+        instance_->batch_prefetcher()->RecordProcessorTime(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(compute_start - load_start).count(),
+          std::chrono::duration_cast<std::chrono::nanoseconds>(compute_end - compute_start).count());
+      });
+
+      const Batch& batch = *batch_ptr;
+
+      // Columnar batches do not convert the tokens of their items until some consumer requires them
+      auto add_item_tokens = [&columnar_batch, &loaded_message, &cuckoo]() {  // NOLINT
+        if (columnar_batch != nullptr) {
+          CuckooWatch cuckoo2("AddItemTokens", &cuckoo, kTimeLoggingThreshold);
+          columnar_batch->AddItemTokens(loaded_message.get());
+          columnar_batch.reset();
+        }
+      };
+
       std::shared_ptr<MasterModelConfig> master_config = instance_->config();
+      if (blas == nullptr || blas_library != master_config->blas_library()) {
+        blas_library = master_config->blas_library();
+        blas = util::Blas::load(blas_library);
+      }
 
       const ModelName& model_name = part->model_name();
       const ProcessBatchesArgs& args = part->args();
@@ -157,7 +183,7 @@ void Processor::ThreadFunction() {
         }
         VLOG(0) << "Processor: start processing batch " << batch.id() << " into model " << model_description.str();
 
-        std::shared_ptr<ThetaMatrix> cache;
+        std::shared_ptr<const ThetaCacheEntry> cache;
         if (part->has_reuse_theta_cache_manager()) {
           CuckooWatch cuckoo2("FindReuseThetaCacheEntry", &cuckoo, kTimeLoggingThreshold);
           cache = part->reuse_theta_cache_manager()->FindCacheEntry(batch);
@@ -176,25 +202,25 @@ void Processor::ThreadFunction() {
 
         std::shared_ptr<NwtWriteAdapter> nwt_writer;
         if (nwt_target != nullptr) {
-          nwt_writer = std::make_shared<NwtWriteAdapter>(const_cast<PhiMatrix*>(nwt_target.get()));
+          PhiMatrix* n_wt = const_cast<PhiMatrix*>(nwt_target.get());
+          if (part->has_nwt_shards()) {
+            nwt_writer = std::make_shared<NwtWriteAdapter>(n_wt, part->nwt_shards()->shard());
+          } else {
+            nwt_writer = std::make_shared<NwtWriteAdapter>(n_wt);
+          }
         }
 
-        std::shared_ptr<ThetaMatrix> new_cache_entry_ptr(nullptr);
+        // Theta cache entries with predict_class_id keep no topics
+        std::shared_ptr<ThetaCacheEntry> new_cache_entry_ptr(nullptr);
         if (part->has_cache_manager()) {
-          new_cache_entry_ptr.reset(new ThetaMatrix());
+          new_cache_entry_ptr = std::make_shared<ThetaCacheEntry>(
+            args.has_predict_class_id() ? google::protobuf::RepeatedPtrField<std::string>() : p_wt.topic_name(),
+            /* sparse = */ false);
         }
 
-        std::shared_ptr<ThetaMatrix> new_ptdw_cache_entry_ptr(nullptr);
+        std::shared_ptr<ThetaCacheEntry> new_ptdw_cache_entry_ptr(nullptr);
         if (part->has_ptdw_cache_manager()) {
-          new_ptdw_cache_entry_ptr.reset(new ThetaMatrix());
-        }
-
-        if (new_cache_entry_ptr != nullptr) {
-          new_cache_entry_ptr->mutable_topic_name()->CopyFrom(p_wt.topic_name());
-        }
-
-        if (new_ptdw_cache_entry_ptr != nullptr) {
-          new_ptdw_cache_entry_ptr->mutable_topic_name()->CopyFrom(p_wt.topic_name());
+          new_ptdw_cache_entry_ptr = std::make_shared<ThetaCacheEntry>(p_wt.topic_name(), /* sparse = */ true);
         }
 
         {
@@ -205,6 +231,10 @@ void Processor::ThreadFunction() {
             ProcessorHelpers::CreateRegularizerAgents(batch, args, instance_, &theta_agents, &ptdw_agents);
           }
 
+          if (!ptdw_agents.empty() || part->has_ptdw_cache_manager()) {
+            add_item_tokens();
+          }
+
           // We assum here that batch is correct, e.g. it's transaction_type field
           // in case of regular model contains ALL class_ids from batch, not their subset.
           // Both parser and checker generates such batches.
@@ -236,7 +266,8 @@ void Processor::ThreadFunction() {
             std::shared_ptr<CsrMatrix<float>> sparse_ndw;
             {
               CuckooWatch cuckoo2("InitializeSparseNdw", &cuckoo, kTimeLoggingThreshold);
-              sparse_ndw = ProcessorHelpers::InitializeSparseNdw(batch, args);
+              sparse_ndw = (columnar_batch != nullptr) ? ProcessorHelpers::InitializeSparseNdw(*columnar_batch, args)
+                                                       : ProcessorHelpers::InitializeSparseNdw(batch, args);
             }
 
             if (ptdw_agents.empty() && !part->has_ptdw_cache_manager()) {
@@ -244,27 +275,29 @@ void Processor::ThreadFunction() {
               ProcessorHelpers::InferThetaAndUpdateNwtSparse(args, batch, part->batch_weight(), *sparse_ndw, p_wt,
                                                              theta_agents, theta_matrix.get(), nwt_writer.get(),
                                                              blas, instance_->config()->use_sparse_computation(),
+                                                             instance_->batch_token_id_cache(),
                                                              new_cache_entry_ptr.get());
             } else {
               CuckooWatch cuckoo2("InferPtdwAndUpdateNwtSparse", &cuckoo, kTimeLoggingThreshold);
               ProcessorHelpers::InferPtdwAndUpdateNwtSparse(args, batch, part->batch_weight(), *sparse_ndw,
                                                             p_wt, theta_agents, ptdw_agents, theta_matrix.get(),
-                                                            nwt_writer.get(), blas, new_cache_entry_ptr.get(),
-                                                            new_ptdw_cache_entry_ptr.get());
+                                                            nwt_writer.get(), blas, instance_->batch_token_id_cache(),
+                                                            new_cache_entry_ptr.get(), new_ptdw_cache_entry_ptr.get());
             }
           }
         }
 
         if (new_cache_entry_ptr != nullptr) {
           CuckooWatch cuckoo2("UpdateCacheEntry", &cuckoo, kTimeLoggingThreshold);
-          part->cache_manager()->UpdateCacheEntry(batch.id(), *new_cache_entry_ptr);
+          part->cache_manager()->UpdateCacheEntry(batch.id(), new_cache_entry_ptr);
         }
 
         if (new_ptdw_cache_entry_ptr != nullptr) {
           CuckooWatch cuckoo2("UpdatePtdwCacheEntry", &cuckoo, kTimeLoggingThreshold);
-          part->ptdw_cache_manager()->UpdateCacheEntry(batch.id(), *new_ptdw_cache_entry_ptr);
+          part->ptdw_cache_manager()->UpdateCacheEntry(batch.id(), new_ptdw_cache_entry_ptr);
         }
 
+        std::vector<Token> batch_token_dict;
         for (int score_index = 0; score_index < master_config->score_config_size(); ++score_index) {
           const ScoreName& score_name = master_config->score_config(score_index).name();
 
@@ -279,13 +312,20 @@ void Processor::ThreadFunction() {
             continue;
           }
 
+          add_item_tokens();
           CuckooWatch cuckoo2("CalculateScore(" + score_name + ")", &cuckoo, kTimeLoggingThreshold);
 
-          auto score_value = ProcessorHelpers::CalcScores(score_calc.get(), batch, p_wt, args, *theta_matrix);
+          // all scores of the batch share one token dictionary
+          if (batch_token_dict.empty() && batch.token_size() > 0) {
+            batch_token_dict = ProcessorHelpers::CreateBatchTokenDict(batch);
+          }
+
+          auto score_value = ProcessorHelpers::CalcScores(score_calc.get(), batch, batch_token_dict,
+                                                          p_wt, args, *theta_matrix);
           if (score_value != nullptr) {
-            instance_->score_manager()->Append(score_name, score_value->SerializeAsString());
+            instance_->score_manager()->Append(score_name, *score_value);
             if (part->score_manager() != nullptr) {
-              part->score_manager()->Append(score_name, score_value->SerializeAsString());
+              part->score_manager()->Append(score_name, *score_value);
             }
           }
         }
@@ -17,16 +17,18 @@ class Instance;
 // A class that implements ProcessBatch routine from
 // 'Parallel Non-blocking Deterministic Algorithm for Online Topic Modeling'.
 // Each processor instantiates its own thread that pulls tasks from processor queue, hosted by the Instance.
+// The processor_index identifies the deque of the processor in the queue (see WorkStealingQueue).
 // Each master components owns its own processors.
 // The implementation of the processor class is, perhaps, the most complicated code in BigARTM core.
 // If you are looking into Processor then you should consider reading other articles on ARTM theory.
 class Processor : boost::noncopyable {
  public:
-  explicit Processor(Instance* instance);
+  Processor(Instance* instance, int processor_index);
   ~Processor();
 
  private:
   Instance* instance_;
+  int processor_index_;
 
   mutable std::atomic<bool> is_stopping;
   boost::thread thread_;
@@ -7,17 +7,22 @@
 #include <vector>
 #include <string>
 
+#include "artm/core/batch_token_id_cache.h"
+#include "artm/core/columnar_batch.h"
+#include "artm/core/nwt_shards.h"
 #include "artm/core/phi_matrix.h"
 #include "artm/core/phi_matrix_operations.h"
 #include "artm/core/instance.h"
 #include "artm/core/helpers.h"
 #include "artm/core/protobuf_helpers.h"
 #include "artm/core/score_manager.h"
+#include "artm/core/theta_cache_entry.h"
 
 #include "artm/regularizer_interface.h"
 #include "artm/score_calculator_interface.h"
 
 #include "artm/utility/blas.h"
+#include "artm/utility/simd_kernels.h"
 
 namespace util = artm::utility;
 using ::util::CsrMatrix;
@@ -99,14 +104,22 @@ class NormalizeThetaAgent : public RegularizeThetaAgent {
   }
 };
 
+// NwtWriteAdapter class stores the increments of n_wt, calculated by the processor.
+// If a shard is provided the increments go to the thread-private shard
+// (to be reduced into n_wt later), otherwise they are written directly into n_wt.
 class NwtWriteAdapter {
  public:
-  explicit NwtWriteAdapter(PhiMatrix* n_wt) : n_wt_(n_wt) { }
+  explicit NwtWriteAdapter(PhiMatrix* n_wt) : n_wt_(n_wt), shard_(nullptr) { }
+  NwtWriteAdapter(PhiMatrix* n_wt, NwtShard* shard) : n_wt_(n_wt), shard_(shard) { }
 
   void Store(int nwt_token_id, const std::vector<float>& nwt_vector) {
     assert(nwt_vector.size() == n_wt_->topic_size());
     assert((nwt_token_id >= 0) && (nwt_token_id < n_wt_->token_size()));
-    n_wt_->increase(nwt_token_id, nwt_vector);
+    if (shard_ != nullptr) {
+      shard_->increase(nwt_token_id, nwt_vector);
+    } else {
+      n_wt_->increase(nwt_token_id, nwt_vector);
+    }
   }
 
   PhiMatrix* n_wt() {
@@ -115,17 +128,18 @@ class NwtWriteAdapter {
 
  private:
   PhiMatrix* n_wt_;
+  NwtShard* shard_;
 };
 
 class ProcessorHelpers {
  public:
-  static void CreateThetaCacheEntry(ThetaMatrix* new_cache_entry_ptr,
+  static void CreateThetaCacheEntry(ThetaCacheEntry* new_cache_entry_ptr,
                                     LocalThetaMatrix<float>* theta_matrix,
                                     const Batch& batch,
                                     const PhiMatrix& p_wt,
                                     const ProcessBatchesArgs& args);
 
-  static void CreatePtdwCacheEntry(ThetaMatrix* new_cache_entry_ptr,
+  static void CreatePtdwCacheEntry(ThetaCacheEntry* new_cache_entry_ptr,
                                    LocalPhiMatrix<float>* ptdw_matrix,
                                    const Batch& batch,
                                    int item_index,
@@ -134,7 +148,7 @@ class ProcessorHelpers {
   static std::shared_ptr<LocalThetaMatrix<float>> InitializeTheta(int topic_size,
                                                                   const Batch& batch,
                                                                   const ProcessBatchesArgs& args,
-                                                                  const ThetaMatrix* cache);
+                                                                  const ThetaCacheEntry* cache);
 
   static std::shared_ptr<LocalPhiMatrix<float>> InitializePhi(const Batch& batch,
                                                               const ::artm::core::PhiMatrix& p_wt);
@@ -148,12 +162,23 @@ class ProcessorHelpers {
   static std::shared_ptr<CsrMatrix<float>> InitializeSparseNdw(const Batch& batch,
                                                                const ProcessBatchesArgs& args);
 
-  static void FindBatchTokenIds(const Batch& batch,
-                                const PhiMatrix& phi_matrix,
-                                std::vector<int>* token_id);
+  // Builds n_dw directly from the arrays of a columnar batch.
+  // When all class and transaction weights are equal to 1 the result is a view of the memory-mapped arrays,
+  // so it must not outlive the columnar batch.
+  static std::shared_ptr<CsrMatrix<float>> InitializeSparseNdw(const ColumnarBatch& batch,
+                                                               const ProcessBatchesArgs& args);
+
+  // Returns the index of each batch token in phi_matrix; token_id_cache may be nullptr.
+  static std::shared_ptr<const std::vector<int>> FindBatchTokenIds(const Batch& batch,
+                                                                   const PhiMatrix& phi_matrix,
+                                                                   BatchTokenIdCache* token_id_cache);
+
+  // Builds the tokens of the batch, to be shared by all scores of the batch (see CalcScores)
+  static std::vector<Token> CreateBatchTokenDict(const Batch& batch);
 
   static std::shared_ptr<Score> CalcScores(ScoreCalculatorInterface* score_calc,
                                            const Batch& batch,
+                                           const std::vector<Token>& batch_token_dict,
                                            const PhiMatrix& p_wt,
                                            const ProcessBatchesArgs& args,
                                            const LocalThetaMatrix<float>& theta_matrix);
@@ -167,8 +192,9 @@ class ProcessorHelpers {
                                           const RegularizePtdwAgentCollection& ptdw_agents,
                                           LocalThetaMatrix<float>* theta_matrix,
                                           NwtWriteAdapter* nwt_writer, util::Blas* blas,
-                                          ThetaMatrix* new_cache_entry_ptr = nullptr,
-                                          ThetaMatrix* new_ptdw_cache_entry_ptr = nullptr);
+                                          BatchTokenIdCache* token_id_cache,
+                                          ThetaCacheEntry* new_cache_entry_ptr = nullptr,
+                                          ThetaCacheEntry* new_ptdw_cache_entry_ptr = nullptr);
 
   static void InferThetaAndUpdateNwtSparse(const ProcessBatchesArgs& args,
                                            const Batch& batch,
@@ -180,7 +206,8 @@ class ProcessorHelpers {
                                            NwtWriteAdapter* nwt_writer,
                                            util::Blas* blas,
                                            bool use_sparse_computation,
-                                           ThetaMatrix* new_cache_entry_ptr = nullptr);
+                                           BatchTokenIdCache* token_id_cache,
+                                           ThetaCacheEntry* new_cache_entry_ptr = nullptr);
 
   ProcessorHelpers() = delete;
 };
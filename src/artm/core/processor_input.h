@@ -14,6 +14,7 @@ namespace core {
 class BatchManager;
 class ScoreManager;
 class CacheManager;
+class NwtShardCollection;
 
 // This class describes one task for the processor component.
 // It has all the input data needed to execute ProcessBatch routine.
@@ -24,7 +25,7 @@ class ProcessorInput {
                      batch_filename_(), batch_weight_(1.0f), task_id_(), batch_manager_(nullptr),
                      score_manager_(nullptr), cache_manager_(nullptr),
                      ptdw_cache_manager_(nullptr),
-                     reuse_theta_cache_manager_(nullptr) { }
+                     reuse_theta_cache_manager_(nullptr), nwt_shards_(nullptr) { }
 
   Batch* mutable_batch() { return &batch_; }
   const Batch& batch() const { return batch_; }
@@ -50,6 +51,10 @@ class ProcessorInput {
   void set_reuse_theta_cache_manager(CacheManager* cache_manager) { reuse_theta_cache_manager_ = cache_manager; }
   bool has_reuse_theta_cache_manager() const { return reuse_theta_cache_manager_ != nullptr; }
 
+  NwtShardCollection* nwt_shards() const { return nwt_shards_; }
+  void set_nwt_shards(NwtShardCollection* nwt_shards) { nwt_shards_ = nwt_shards; }
+  bool has_nwt_shards() const { return nwt_shards_ != nullptr; }
+
   const ModelName& model_name() const { return model_name_; }
   void set_model_name(const ModelName& model_name) { model_name_ = model_name; }
 
@@ -80,6 +85,7 @@ class ProcessorInput {
   CacheManager* cache_manager_;
   CacheManager* ptdw_cache_manager_;
   CacheManager* reuse_theta_cache_manager_;
+  NwtShardCollection* nwt_shards_;
 };
 
 }  // namespace core
@@ -2,6 +2,8 @@
 
 #include "artm/core/processor_transaction_helpers.h"
 
+#include "artm/core/class_id_registry.h"
+
 namespace artm {
 namespace core {
 
@@ -31,14 +33,7 @@ std::shared_ptr<BatchTransactionInfo> ProcessorTransactionHelpers::PrepareBatchI
   TokenIdsToInfo token_ids_to_info;
   TransactionIdToInfo transaction_id_to_info;
 
-  bool use_class_weight = false;
-  std::unordered_map<ClassId, float> class_id_to_weight;
-  if (args.class_id_size() > 0) {
-    use_class_weight = true;
-    for (int i = 0; i < args.class_id_size(); ++i) {
-      class_id_to_weight.emplace(args.class_id(i), args.class_weight(i));
-    }
-  }
+  const std::vector<float> class_weight = ClassWeights(args).token_weights(batch);
 
   bool use_transaction_weight = false;
   std::unordered_map<TransactionTypeName, float> tt_name_to_weight;
@@ -71,16 +66,7 @@ std::shared_ptr<BatchTransactionInfo> ProcessorTransactionHelpers::PrepareBatchI
       for (int idx = start_index; idx < end_index; ++idx) {
         const int token_id = item.token_id(idx);
         const float token_weight = item.token_weight(idx);
-
-        ClassId class_id = batch.class_id(token_id);
-
-        float class_weight = 1.0f;
-        if (use_class_weight) {
-          auto iter = class_id_to_weight.find(class_id);
-          class_weight = (iter == class_id_to_weight.end()) ? 0.0f : iter->second;
-        }
-
-        transaction_weight += (token_weight * class_weight);
+        transaction_weight += (token_weight * class_weight[token_id]);
       }
 
       n_dw_val.push_back(transaction_weight * tt_weight);
@@ -137,7 +123,7 @@ void ProcessorTransactionHelpers::TransactionInferThetaAndUpdateNwtSparse(
                                      const RegularizeThetaAgentCollection& theta_agents,
                                      LocalThetaMatrix<float>* theta_matrix,
                                      NwtWriteAdapter* nwt_writer, util::Blas* blas,
-                                     ThetaMatrix* new_cache_entry_ptr) {
+                                     ThetaCacheEntry* new_cache_entry_ptr) {
   if (!args.opt_for_avx()) {
     LOG(WARNING) << "Current version of BigARTM doesn't support 'opt_for_avx' == false"
       << " with complex transactions, option 'opt_for_avx' will be ignored";
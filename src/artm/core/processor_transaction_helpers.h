@@ -63,7 +63,7 @@ class ProcessorTransactionHelpers {
                                      const RegularizeThetaAgentCollection& theta_agents,
                                      LocalThetaMatrix<float>* theta_matrix,
                                      NwtWriteAdapter* nwt_writer, util::Blas* blas,
-                                     ThetaMatrix* new_cache_entry_ptr);
+                                     ThetaCacheEntry* new_cache_entry_ptr);
 
   ProcessorTransactionHelpers() = delete;
 };
@@ -27,16 +27,28 @@ void ScoreManager::Append(const ScoreName& score_name,
     return;
   }
 
+  Append(score_name, *score_inc);
+}
+
+void ScoreManager::Append(const ScoreName& score_name, const Score& score) {
+  auto score_calculator = instance_->scores_calculators()->get(score_name);
+  if (score_calculator == nullptr) {
+    LOG(ERROR) << "Unable to find score calculator: " << score_name;
+    return;
+  }
+
   // Note that the following operation must be atomic
   // (e.g. finding score / append score / setting score).
   // This is the reason to use explicit lock around score_map_ instead of ThreadSafeCollectionHolder.
+  // Stored scores are only exposed as copies (see RequestScore), so they are merged in place.
   boost::lock_guard<boost::mutex> guard(lock_);
   auto iter = score_map_.find(score_name);
   if (iter != score_map_.end()) {
-    score_calculator->AppendScore(*iter->second, score_inc.get());
-    iter->second = score_inc;
+    score_calculator->AppendScore(score, iter->second.get());
   } else {
-    score_map_.insert(std::pair<ScoreName, std::shared_ptr<Score>>(score_name, score_inc));
+    std::shared_ptr<Score> score_copy = score_calculator->CreateScore();
+    score_copy->CopyFrom(score);
+    score_map_.insert(std::pair<ScoreName, std::shared_ptr<Score>>(score_name, score_copy));
   }
 }
 
@@ -95,7 +107,14 @@ void ScoreManager::RequestAllScores(::google::protobuf::RepeatedPtrField< ::artm
 void ScoreManager::CopyFrom(const ScoreManager& score_manager) {
   boost::lock_guard<boost::mutex> guard(lock_);
   boost::lock_guard<boost::mutex> guard2(score_manager.lock_);
-  score_map_ = score_manager.score_map_;
+
+  // Scores are merged in place, so each score manager must own its scores
+  score_map_.clear();
+  for (const auto& elem : score_manager.score_map_) {
+    std::shared_ptr<Score> score_copy(elem.second->New());
+    score_copy->CopyFrom(*elem.second);
+    score_map_.insert(std::make_pair(elem.first, score_copy));
+  }
 }
 
 void ScoreTracker::Clear() {
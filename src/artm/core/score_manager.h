@@ -28,6 +28,9 @@ class ScoreManager : boost::noncopyable {
   explicit ScoreManager(Instance* instance) : instance_(instance), lock_(), score_map_() { }
 
   void Append(const ScoreName& score_name, const std::string& score_blob);
+
+  // Merges the score without serialization; the score is copied only for the first append of the score_name.
+  void Append(const ScoreName& score_name, const Score& score);
   void Clear();
   bool RequestScore(const ScoreName& score_name, ScoreData *score_data) const;
   void RequestAllScores(::google::protobuf::RepeatedPtrField< ::artm::ScoreData>* score_data) const;
@@ -0,0 +1,284 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#include "artm/core/theta_cache_entry.h"
+
+#include <string.h>
+
+#include <fstream>
+
+#include "boost/filesystem.hpp"
+#include "boost/lexical_cast.hpp"
+
+#include "artm/core/exceptions.h"
+#include "artm/utility/memory_usage.h"
+
+namespace fs = boost::filesystem;
+
+namespace artm {
+namespace core {
+
+namespace {
+
+const char kThetaCacheFileMagic[8] = { 'A', 'R', 'T', 'M', 'T', 'H', 'E', 'T' };
+const int kThetaCacheFileVersion = 1;
+const int64_t kSectionAlignment = 8;
+
+int64_t AlignOffset(int64_t offset) {
+  return (offset + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+}
+
+template<typename T>
+void WriteSection(std::ofstream* fout, int64_t offset, const T* values, int64_t size) {
+  if (size > 0) {
+    fout->seekp(offset);
+    fout->write(reinterpret_cast<const char*>(values), sizeof(T) * size);
+  }
+}
+
+}  // namespace
+
+ThetaCacheEntry::ThetaCacheEntry()
+    : topic_name_(), sparse_(false), item_size_(0), num_values_(0),
+      item_id_(nullptr), title_index_(nullptr), titles_(nullptr), row_ptr_(nullptr), topic_index_(nullptr),
+      values_(nullptr), file_name_(), remove_file_(false), file_() { }
+
+ThetaCacheEntry::ThetaCacheEntry(const google::protobuf::RepeatedPtrField<std::string>& topic_name, bool sparse)
+    : ThetaCacheEntry() {
+  topic_name_.CopyFrom(topic_name);
+  sparse_ = sparse;
+  title_index_storage_.push_back(0);
+  if (sparse_) {
+    row_ptr_storage_.push_back(0);
+  }
+  UpdateSections();
+}
+
+ThetaCacheEntry::~ThetaCacheEntry() {
+  if (file_.is_open()) {
+    file_.close();
+  }
+
+  if (remove_file_) {
+    try { fs::remove(fs::path(file_name_)); }
+    catch (...) { }
+  }
+}
+
+void ThetaCacheEntry::UpdateSections() {
+  item_id_ = item_id_storage_.empty() ? nullptr : &item_id_storage_[0];
+  title_index_ = &title_index_storage_[0];
+  titles_ = titles_storage_.empty() ? nullptr : &titles_storage_[0];
+  row_ptr_ = row_ptr_storage_.empty() ? nullptr : &row_ptr_storage_[0];
+  topic_index_ = topic_index_storage_.empty() ? nullptr : &topic_index_storage_[0];
+  values_ = values_storage_.empty() ? nullptr : &values_storage_[0];
+}
+
+void ThetaCacheEntry::Reserve(int item_size) {
+  item_id_storage_.reserve(item_size);
+  title_index_storage_.reserve(item_size + 1);
+  if (sparse_) {
+    row_ptr_storage_.reserve(item_size + 1);
+  } else {
+    values_storage_.reserve(static_cast<int64_t>(item_size) * topic_size());
+  }
+}
+
+void ThetaCacheEntry::AddItem(int item_id, boost::string_ref title, const float* values) {
+  if (sparse_ || file_.is_open()) {
+    BOOST_THROW_EXCEPTION(InternalError("ThetaCacheEntry::AddItem() is called for sparse or mapped entry"));
+  }
+
+  item_id_storage_.push_back(item_id);
+  titles_storage_.insert(titles_storage_.end(), title.begin(), title.end());
+  title_index_storage_.push_back(static_cast<int64_t>(titles_storage_.size()));
+  values_storage_.insert(values_storage_.end(), values, values + topic_size());
+  item_size_++;
+  num_values_ += topic_size();
+  UpdateSections();
+}
+
+void ThetaCacheEntry::AddItem(int item_id, boost::string_ref title,
+                              const float* values, const int* topic_index, int size) {
+  if (!sparse_ || file_.is_open()) {
+    BOOST_THROW_EXCEPTION(InternalError("ThetaCacheEntry::AddItem() is called for dense or mapped entry"));
+  }
+
+  item_id_storage_.push_back(item_id);
+  titles_storage_.insert(titles_storage_.end(), title.begin(), title.end());
+  title_index_storage_.push_back(static_cast<int64_t>(titles_storage_.size()));
+  values_storage_.insert(values_storage_.end(), values, values + size);
+  topic_index_storage_.insert(topic_index_storage_.end(), topic_index, topic_index + size);
+  row_ptr_storage_.push_back(static_cast<int64_t>(values_storage_.size()));
+  item_size_++;
+  num_values_ += size;
+  UpdateSections();
+}
+
+int64_t ThetaCacheEntry::ByteSize() const {
+  int64_t retval = sizeof(ThetaCacheEntry);
+  for (const std::string& topic_name : topic_name_) {
+    retval += sizeof(std::string) + topic_name.size();
+  }
+
+  retval += ::artm::utility::getMemoryUsage(item_id_storage_);
+  retval += ::artm::utility::getMemoryUsage(title_index_storage_);
+  retval += ::artm::utility::getMemoryUsage(titles_storage_);
+  retval += ::artm::utility::getMemoryUsage(row_ptr_storage_);
+  retval += ::artm::utility::getMemoryUsage(topic_index_storage_);
+  retval += ::artm::utility::getMemoryUsage(values_storage_);
+  return retval;
+}
+
+void ThetaCacheEntry::Save(const std::string& file_name) const {
+  std::vector<int64_t> topic_name_index(1, 0);
+  std::string topic_names;
+  for (const std::string& topic_name : topic_name_) {
+    topic_names += topic_name;
+    topic_name_index.push_back(static_cast<int64_t>(topic_names.size()));
+  }
+
+  ThetaCacheFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kThetaCacheFileMagic, sizeof(kThetaCacheFileMagic));
+  header.version = kThetaCacheFileVersion;
+  header.sparse = sparse_ ? 1 : 0;
+  header.item_size = item_size_;
+  header.topic_size = topic_size();
+  header.num_values = num_values_;
+  header.topic_name_index_offset = AlignOffset(sizeof(header));
+  header.topic_name_offset = AlignOffset(header.topic_name_index_offset + sizeof(int64_t) * topic_name_index.size());
+  header.item_id_offset = AlignOffset(header.topic_name_offset + topic_names.size());
+  header.title_index_offset = AlignOffset(header.item_id_offset + sizeof(int32_t) * item_size_);
+  header.title_offset = AlignOffset(header.title_index_offset + sizeof(int64_t) * (item_size_ + 1));
+  int64_t offset = AlignOffset(header.title_offset + title_index_[item_size_]);
+  if (sparse_) {
+    header.row_ptr_offset = offset;
+    header.topic_index_offset = AlignOffset(header.row_ptr_offset + sizeof(int64_t) * (item_size_ + 1));
+    offset = AlignOffset(header.topic_index_offset + sizeof(int32_t) * num_values_);
+  }
+  header.value_offset = offset;
+  header.file_size = header.value_offset + sizeof(float) * num_values_;
+
+  std::ofstream fout(file_name.c_str(), std::ofstream::binary);
+  if (!fout.is_open()) {
+    BOOST_THROW_EXCEPTION(DiskWriteException("Unable to create file " + file_name));
+  }
+
+  // Seeking past the end of the file fills the alignment gaps between sections with zeros
+  WriteSection(&fout, 0, &header, 1);
+  WriteSection(&fout, header.topic_name_index_offset, &topic_name_index[0], topic_name_index.size());
+  WriteSection(&fout, header.topic_name_offset, topic_names.c_str(), topic_names.size());
+  WriteSection(&fout, header.item_id_offset, item_id_, item_size_);
+  WriteSection(&fout, header.title_index_offset, title_index_, item_size_ + 1);
+  WriteSection(&fout, header.title_offset, titles_, title_index_[item_size_]);
+  if (sparse_) {
+    WriteSection(&fout, header.row_ptr_offset, row_ptr_, item_size_ + 1);
+    WriteSection(&fout, header.topic_index_offset, topic_index_, num_values_);
+  }
+  if (num_values_ > 0) {
+    WriteSection(&fout, header.value_offset, values_, num_values_);
+  } else {
+    // Pad the file up to the (empty) section of values, so that the file has its declared size
+    const char padding[kSectionAlignment] = { 0 };
+    fout.seekp(0, std::ios::end);
+    fout.write(padding, header.file_size - static_cast<int64_t>(fout.tellp()));
+  }
+
+  fout.close();
+  if (fout.fail()) {
+    BOOST_THROW_EXCEPTION(DiskWriteException("Theta cache entry has not been written to disk: " + file_name));
+  }
+}
+
+void ThetaCacheEntry::ThrowCorrupted(const std::string& reason) const {
+  BOOST_THROW_EXCEPTION(CorruptedMessageException("Unable to read theta cache from " + file_name_ + ": " + reason));
+}
+
+std::shared_ptr<ThetaCacheEntry> ThetaCacheEntry::Load(const std::string& file_name, bool remove_file) {
+  std::shared_ptr<ThetaCacheEntry> entry(new ThetaCacheEntry());
+  entry->file_name_ = file_name;
+  entry->remove_file_ = remove_file;
+
+  try {
+    entry->file_.open(file_name);
+  } catch (std::exception& ex) {
+    BOOST_THROW_EXCEPTION(DiskReadException("Unable to open file " + file_name + ", " + ex.what()));
+  }
+
+  const int64_t file_size = static_cast<int64_t>(entry->file_.size());
+  const char* data = entry->file_.data();
+  if (file_size < static_cast<int64_t>(sizeof(ThetaCacheFileHeader)) ||
+      memcmp(data, kThetaCacheFileMagic, sizeof(kThetaCacheFileMagic)) != 0) {
+    entry->ThrowCorrupted("wrong file signature");
+  }
+
+  const ThetaCacheFileHeader* header = reinterpret_cast<const ThetaCacheFileHeader*>(data);
+  if (header->version != kThetaCacheFileVersion) {
+    entry->ThrowCorrupted("unsupported version " + boost::lexical_cast<std::string>(header->version));
+  }
+
+  if (header->file_size != file_size || header->item_size < 0 || header->topic_size < 0 || header->num_values < 0 ||
+      (!header->sparse && header->num_values != static_cast<int64_t>(header->item_size) * header->topic_size)) {
+    entry->ThrowCorrupted("inconsistent header");
+  }
+
+  auto check_section = [&](int64_t offset, int64_t size) {  // NOLINT
+    if (offset < static_cast<int64_t>(sizeof(ThetaCacheFileHeader)) || offset % kSectionAlignment != 0 ||
+        size < 0 || offset + size > file_size) {
+      entry->ThrowCorrupted("section is out of file bounds");
+    }
+  };
+
+  // Offsets of the strings must be non-decreasing and stay within their section
+  auto check_index = [&](const int64_t* index, int size, int64_t string_offset) {  // NOLINT
+    if (index[0] != 0) {
+      entry->ThrowCorrupted("invalid string offsets");
+    }
+    for (int i = 0; i < size; ++i) {
+      if (index[i] > index[i + 1]) {
+        entry->ThrowCorrupted("invalid string offsets");
+      }
+    }
+    check_section(string_offset, index[size]);
+  };
+
+  check_section(header->topic_name_index_offset, sizeof(int64_t) * (header->topic_size + 1));
+  const int64_t* topic_name_index = reinterpret_cast<const int64_t*>(data + header->topic_name_index_offset);
+  check_index(topic_name_index, header->topic_size, header->topic_name_offset);
+  for (int topic_index = 0; topic_index < header->topic_size; ++topic_index) {
+    entry->topic_name_.Add()->assign(data + header->topic_name_offset + topic_name_index[topic_index],
+                                     topic_name_index[topic_index + 1] - topic_name_index[topic_index]);
+  }
+
+  check_section(header->item_id_offset, sizeof(int32_t) * header->item_size);
+  check_section(header->title_index_offset, sizeof(int64_t) * (header->item_size + 1));
+  entry->title_index_ = reinterpret_cast<const int64_t*>(data + header->title_index_offset);
+  check_index(entry->title_index_, header->item_size, header->title_offset);
+  check_section(header->value_offset, sizeof(float) * header->num_values);
+
+  if (header->sparse) {
+    check_section(header->row_ptr_offset, sizeof(int64_t) * (header->item_size + 1));
+    check_section(header->topic_index_offset, sizeof(int32_t) * header->num_values);
+    entry->row_ptr_ = reinterpret_cast<const int64_t*>(data + header->row_ptr_offset);
+    entry->topic_index_ = reinterpret_cast<const int*>(data + header->topic_index_offset);
+    if (entry->row_ptr_[0] != 0 || entry->row_ptr_[header->item_size] != header->num_values) {
+      entry->ThrowCorrupted("invalid row offsets");
+    }
+    for (int item_index = 0; item_index < header->item_size; ++item_index) {
+      if (entry->row_ptr_[item_index] > entry->row_ptr_[item_index + 1]) {
+        entry->ThrowCorrupted("invalid row offsets");
+      }
+    }
+  }
+
+  entry->sparse_ = (header->sparse != 0);
+  entry->item_size_ = header->item_size;
+  entry->num_values_ = header->num_values;
+  entry->item_id_ = reinterpret_cast<const int*>(data + header->item_id_offset);
+  entry->titles_ = data + header->title_offset;
+  entry->values_ = reinterpret_cast<const float*>(data + header->value_offset);
+  return entry;
+}
+
+}  // namespace core
+}  // namespace artm
@@ -0,0 +1,133 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "boost/iostreams/device/mapped_file.hpp"
+#include "boost/utility.hpp"
+#include "boost/utility/string_ref.hpp"
+
+#include "artm/core/common.h"
+
+namespace artm {
+namespace core {
+
+// Header of the file of a theta cache entry, spilled to disk (see MasterModelConfig.disk_cache_path).
+// All offsets are in bytes from the beginning of the file, and each section starts at a multiple of 8 bytes.
+// Integers and floats use native byte order, as the files are only read by the process that wrote them.
+struct ThetaCacheFileHeader {
+  char magic[8];
+  int32_t version;
+  int32_t sparse;
+  int32_t item_size;
+  int32_t topic_size;
+  int64_t num_values;
+  int64_t topic_name_index_offset;  // int64_t[topic_size + 1], offsets of topic names
+  int64_t topic_name_offset;        // char[]
+  int64_t item_id_offset;           // int32_t[item_size]
+  int64_t title_index_offset;       // int64_t[item_size + 1], offsets of item titles
+  int64_t title_offset;             // char[]
+  int64_t row_ptr_offset;           // int64_t[item_size + 1], sparse entries only
+  int64_t topic_index_offset;       // int32_t[num_values], sparse entries only
+  int64_t value_offset;             // float[num_values], item_size x topic_size matrix for dense entries
+  int64_t file_size;
+};
+
+// ThetaCacheEntry keeps theta matrix of a single batch, as stored by CacheManager:
+// - ids and titles of the items (titles are stored back to back, with their offsets);
+// - values of all items in a single block, where the values of each item are contiguous.
+//   Dense entries keep topic_size() values of each item, and sparse entries (e.g. ptdw matrices)
+//   keep the values of each item with their topic indices.
+// The entry can be written to a file with a fixed layout (see ThetaCacheFileHeader), and then mapped into memory,
+// so that reading it back does not parse or copy anything. The entry is not modified after it is cached;
+// ThetaMatrix messages are only created to respond to API calls (see CacheManager::RequestThetaMatrix).
+class ThetaCacheEntry : boost::noncopyable {
+ public:
+  ThetaCacheEntry(const google::protobuf::RepeatedPtrField<std::string>& topic_name, bool sparse);
+  ~ThetaCacheEntry();
+
+  // Appends an item of a dense entry with topic_size() values.
+  void AddItem(int item_id, boost::string_ref title, const float* values);
+
+  // Appends an item of a sparse entry with 'size' values of topics 'topic_index'.
+  void AddItem(int item_id, boost::string_ref title, const float* values, const int* topic_index, int size);
+
+  void Reserve(int item_size);
+
+  // Writes the entry into a file that can be read back by Load.
+  void Save(const std::string& file_name) const;
+
+  // Maps the file, written by Save. With remove_file = true the file is removed together with the entry.
+  static std::shared_ptr<ThetaCacheEntry> Load(const std::string& file_name, bool remove_file);
+
+  int item_size() const { return item_size_; }
+  int topic_size() const { return topic_name_.size(); }
+  const google::protobuf::RepeatedPtrField<std::string>& topic_name() const { return topic_name_; }
+  bool sparse() const { return sparse_; }
+  int64_t num_values() const { return num_values_; }
+
+  int item_id(int item_index) const { return item_id_[item_index]; }
+  boost::string_ref item_title(int item_index) const {
+    return boost::string_ref(titles_ + title_index_[item_index],
+                             title_index_[item_index + 1] - title_index_[item_index]);
+  }
+
+  // Values of the item: topic_size() values for dense entries, or item_value_size() values
+  // of topics item_topic_index() for sparse entries.
+  const float* item_values(int item_index) const { return values_ + value_begin(item_index); }
+  int item_value_size(int item_index) const {
+    return sparse_ ? static_cast<int>(row_ptr_[item_index + 1] - row_ptr_[item_index]) : topic_size();
+  }
+  const int* item_topic_index(int item_index) const { return topic_index_ + row_ptr_[item_index]; }
+
+  // Memory used by the entry; the values of mapped entries are not counted, as they are backed by the file.
+  int64_t ByteSize() const;
+
+  // Name of the file that backs the entry, or an empty string for entries in memory.
+  const std::string& file_name() const { return file_name_; }
+  int64_t file_size() const { return file_.is_open() ? static_cast<int64_t>(file_.size()) : 0; }
+
+ private:
+  ThetaCacheEntry();
+
+  int64_t value_begin(int item_index) const {
+    return sparse_ ? row_ptr_[item_index] : static_cast<int64_t>(item_index) * topic_size();
+  }
+
+  void ThrowCorrupted(const std::string& reason) const;
+
+  // Points the section pointers into the vectors of an entry in memory.
+  void UpdateSections();
+
+  google::protobuf::RepeatedPtrField<std::string> topic_name_;
+  bool sparse_;
+  int item_size_;
+  int64_t num_values_;
+
+  // Sections of the entry, pointing either into the vectors below or into the mapped file
+  const int* item_id_;
+  const int64_t* title_index_;
+  const char* titles_;
+  const int64_t* row_ptr_;
+  const int* topic_index_;
+  const float* values_;
+
+  std::vector<int> item_id_storage_;
+  std::vector<int64_t> title_index_storage_;
+  std::vector<char> titles_storage_;
+  std::vector<int64_t> row_ptr_storage_;
+  std::vector<int> topic_index_storage_;
+  std::vector<float> values_storage_;
+
+  std::string file_name_;
+  bool remove_file_;
+  boost::iostreams::mapped_file_source file_;
+};
+
+}  // namespace core
+}  // namespace artm
@@ -2,14 +2,19 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <queue>
 #include <map>
 #include <memory>
 #include <vector>
 #include <utility>
 
+#include "boost/thread/condition_variable.hpp"
 #include "boost/thread/locks.hpp"
 #include "boost/thread/mutex.hpp"
+#include "boost/thread/shared_mutex.hpp"
 #include "boost/utility.hpp"
 
 #include "artm/core/common.h"
@@ -192,5 +197,127 @@ class ThreadSafeQueue : boost::noncopyable {
   size_t reserved_;
 };
 
+// WorkStealingQueue class keeps a separate deque of tasks for each worker thread.
+// New tasks are distributed across the deques in round-robin order.
+// A worker pops tasks from the front of its own deque, and once the deque is empty
+// it steals from the front of other deques, so a short task never waits behind a long one
+// while some of the workers are idle, and the tasks still start in the order they were pushed
+// (processors rely on this order to prefetch the batches ahead, see BatchPrefetcher).
+// Each deque has its own lock, so workers only contend when they touch the same deque.
+// pop() blocks on a condition variable instead of polling.
+template<typename T>
+class WorkStealingQueue : boost::noncopyable {
+ public:
+  WorkStealingQueue() : deques_lock_(), deques_(), num_workers_(1), next_deque_(0), size_(0),
+                        wait_lock_(), task_available_() {
+    deques_.emplace_back(new Deque());
+  }
+
+  // Deques are never removed, so tasks pushed before the number of workers was reduced
+  // remain available for stealing.
+  void set_num_workers(int num_workers) {
+    boost::unique_lock<boost::shared_mutex> guard(deques_lock_);
+    num_workers_ = std::max(num_workers, 1);
+    while (deques_.size() < num_workers_) {
+      deques_.emplace_back(new Deque());
+    }
+  }
+
+  void push(const T& elem) {
+    {
+      boost::shared_lock<boost::shared_mutex> guard(deques_lock_);
+      Deque& deque = *deques_[next_deque_++ % num_workers_];
+      boost::lock_guard<boost::mutex> deque_guard(deque.lock);
+      deque.tasks.push_back(elem);
+      size_++;
+    }
+
+    // Taking wait_lock_ guarantees that a worker can't miss the notification
+    // between checking size_ and starting to wait in pop()
+    boost::lock_guard<boost::mutex> guard(wait_lock_);
+    task_available_.notify_one();
+  }
+
+  bool try_pop(int worker_index, T* elem) {
+    if (size_ == 0) {
+      return false;
+    }
+
+    boost::shared_lock<boost::shared_mutex> guard(deques_lock_);
+    const int num_deques = static_cast<int>(deques_.size());
+    if (worker_index >= 0 && worker_index < num_deques && pop_front(deques_[worker_index].get(), elem)) {
+      return true;
+    }
+
+    for (int offset = 1; offset <= num_deques; ++offset) {
+      if (pop_front(deques_[(std::max(worker_index, 0) + offset) % num_deques].get(), elem)) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  // Blocks until there is a task or is_stopping flag is set (see notify_all()).
+  // Returns false if the worker has to stop.
+  bool pop(int worker_index, const std::atomic<bool>& is_stopping, T* elem) {
+    for (;;) {
+      if (is_stopping) {
+        return false;
+      }
+
+      if (try_pop(worker_index, elem)) {
+        return true;
+      }
+
+      // Another worker might have taken the task between the wake-up and try_pop(); wait again then
+      boost::unique_lock<boost::mutex> lock(wait_lock_);
+      task_available_.wait(lock, [this, &is_stopping]() { return size_ > 0 || is_stopping; });  // NOLINT
+    }
+  }
+
+  // Wakes up all workers blocked in pop(), so that they can check their is_stopping flags.
+  void notify_all() {
+    boost::lock_guard<boost::mutex> guard(wait_lock_);
+    task_available_.notify_all();
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+ private:
+  struct Deque {
+    boost::mutex lock;
+    std::deque<T> tasks;
+  };
+
+  bool pop_front(Deque* deque, T* elem) {
+    boost::lock_guard<boost::mutex> guard(deque->lock);
+    if (deque->tasks.empty()) {
+      return false;
+    }
+
+    *elem = deque->tasks.front();
+    deque->tasks.pop_front();
+    size_--;
+    return true;
+  }
+
+  // deques_lock_ only guards the list of deques, and is taken exclusively in set_num_workers()
+  mutable boost::shared_mutex deques_lock_;
+  std::vector<std::unique_ptr<Deque>> deques_;
+  size_t num_workers_;
+  std::atomic<size_t> next_deque_;
+  std::atomic<size_t> size_;
+
+  boost::mutex wait_lock_;
+  boost::condition_variable task_available_;
+};
+
 }  // namespace core
 }  // namespace artm
@@ -8,6 +8,7 @@
 
 #include "boost/algorithm/string.hpp"
 #include "boost/functional/hash.hpp"
+#include "boost/utility/string_ref.hpp"
 
 #include "artm/core/common.h"
 
@@ -29,7 +30,7 @@ struct Token {
   Token(const ClassId& _class_id, const std::string& _keyword)
     : keyword(_keyword)
     , class_id(_class_id)
-    , hash_(calcHash(_class_id, _keyword)) { }
+    , hash_(Hash(_class_id, _keyword)) { }
 
   Token& operator=(const Token &token) {
     if (this != &token) {
@@ -62,18 +63,19 @@ struct Token {
 
   size_t hash() const { return hash_; }
 
+  // Returns the same value as Token(class_id, keyword).hash(), without constructing the token.
+  static size_t Hash(boost::string_ref class_id, boost::string_ref keyword) {
+    size_t hash = 0;
+    boost::hash_combine(hash, boost::hash_range(keyword.begin(), keyword.end()));
+    boost::hash_combine(hash, boost::hash_range(class_id.begin(), class_id.end()));
+    return hash;
+  }
+
   const std::string keyword;
   const ClassId class_id;
 
  private:
   const size_t hash_;
-
-  static size_t calcHash(const ClassId& class_id, const std::string& keyword) {
-    size_t hash = 0;
-    boost::hash_combine<std::string>(hash, keyword);
-    boost::hash_combine<std::string>(hash, class_id);
-    return hash;
-  }
 };
 
 struct TokenHasher {
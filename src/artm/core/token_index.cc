@@ -0,0 +1,206 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#include "artm/core/token_index.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "artm/utility/memory_usage.h"
+
+namespace artm {
+namespace core {
+
+namespace {
+
+// The table grows when it is more than 7/8 full; Robin Hood probing keeps the probe sequences short
+const int kMaxLoadNumerator = 7;
+const int kMaxLoadDenominator = 8;
+const int kMinSlotSize = 16;
+
+}  // namespace
+
+// =======================================================
+// TokenIdTable methods
+// =======================================================
+
+const int TokenIdTable::kUndefIndex;
+
+uint32_t TokenIdTable::SlotHash(size_t token_hash) {
+  // Final mix of MurmurHash3, as Token::Hash does not spread the entropy over the low bits
+  uint64_t hash = static_cast<uint64_t>(token_hash);
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return static_cast<uint32_t>(hash);
+}
+
+void TokenIdTable::Insert(size_t token_hash) {
+  if (static_cast<int64_t>(size_ + 1) * kMaxLoadDenominator >
+      static_cast<int64_t>(slots_.size()) * kMaxLoadNumerator) {
+    Rehash(std::max(kMinSlotSize, static_cast<int>(2 * slots_.size())));
+  }
+
+  Slot slot = { size_++, SlotHash(token_hash) };
+  Insert(slot);
+}
+
+void TokenIdTable::Insert(Slot slot) {
+  const uint32_t mask = static_cast<uint32_t>(slots_.size() - 1);
+  uint32_t distance = 0;
+  for (uint32_t pos = slot.hash & mask; ; pos = (pos + 1) & mask, ++distance) {
+    if (slots_[pos].id == kUndefIndex) {
+      slots_[pos] = slot;
+      return;
+    }
+
+    const uint32_t existing_distance = (pos - slots_[pos].hash) & mask;
+    if (existing_distance < distance) {
+      std::swap(slot, slots_[pos]);
+      distance = existing_distance;
+    }
+  }
+}
+
+void TokenIdTable::Rehash(int slot_size) {
+  std::vector<Slot> old_slots(slot_size, Slot { kUndefIndex, 0 });
+  old_slots.swap(slots_);
+  for (const Slot& slot : old_slots) {
+    if (slot.id != kUndefIndex) {
+      Insert(slot);
+    }
+  }
+}
+
+void TokenIdTable::Reserve(int size) {
+  int slot_size = kMinSlotSize;
+  while (static_cast<int64_t>(size) * kMaxLoadDenominator > static_cast<int64_t>(slot_size) * kMaxLoadNumerator) {
+    slot_size *= 2;
+  }
+
+  if (slot_size > static_cast<int>(slots_.size())) {
+    Rehash(slot_size);
+  }
+}
+
+void TokenIdTable::Clear() {
+  TokenIdTable empty;
+  Swap(&empty);
+}
+
+void TokenIdTable::Swap(TokenIdTable* rhs) {
+  slots_.swap(rhs->slots_);
+  std::swap(size_, rhs->size_);
+}
+
+int64_t TokenIdTable::ByteSize() const {
+  return ::artm::utility::getMemoryUsage(slots_);
+}
+
+// =======================================================
+// TokenIndex methods
+// =======================================================
+
+const int TokenIndex::kUndefIndex;
+
+TokenIndex::TokenIndex() : table_(), keywords_(), keyword_offset_(1, 0), class_index_(), class_ids_(),
+                           class_id_to_index_() { }
+
+boost::string_ref TokenIndex::keyword(int id) const {
+  const int64_t begin = keyword_offset_[id];
+  return boost::string_ref(keywords_.data() + begin, keyword_offset_[id + 1] - begin);
+}
+
+bool TokenIndex::Equals(int id, boost::string_ref class_id, boost::string_ref keyword) const {
+  const int64_t begin = keyword_offset_[id];
+  if (keyword_offset_[id + 1] - begin != static_cast<int64_t>(keyword.size()) ||
+      memcmp(keywords_.data() + begin, keyword.data(), keyword.size()) != 0) {
+    return false;
+  }
+
+  const ClassId& stored_class_id = class_ids_[class_index_[id]];
+  return stored_class_id.size() == class_id.size() &&
+         memcmp(stored_class_id.data(), class_id.data(), class_id.size()) == 0;
+}
+
+int TokenIndex::Find(size_t token_hash, boost::string_ref class_id, boost::string_ref keyword) const {
+  return table_.Find(token_hash, [this, class_id, keyword](int id) {  // NOLINT
+    return Equals(id, class_id, keyword);
+  });
+}
+
+int TokenIndex::Add(size_t token_hash, boost::string_ref class_id, boost::string_ref keyword) {
+  int id = Find(token_hash, class_id, keyword);
+  if (id != kUndefIndex) {
+    return id;
+  }
+
+  id = size();
+  keywords_.insert(keywords_.end(), keyword.begin(), keyword.end());
+  keyword_offset_.push_back(static_cast<int64_t>(keywords_.size()));
+  class_index_.push_back(InternClassId(class_id));
+  table_.Insert(token_hash);
+  return id;
+}
+
+int TokenIndex::InternClassId(boost::string_ref class_id) {
+  // Consecutive tokens usually share the class_id
+  if (!class_index_.empty()) {
+    const ClassId& last_class_id = class_ids_[class_index_.back()];
+    if (last_class_id.size() == class_id.size() &&
+        memcmp(last_class_id.data(), class_id.data(), class_id.size()) == 0) {
+      return class_index_.back();
+    }
+  }
+
+  ClassId class_id_str = class_id.to_string();
+  auto iter = class_id_to_index_.find(class_id_str);
+  if (iter != class_id_to_index_.end()) {
+    return iter->second;
+  }
+
+  const int index = static_cast<int>(class_ids_.size());
+  class_ids_.push_back(class_id_str);
+  class_id_to_index_.insert(std::make_pair(class_id_str, index));
+  return index;
+}
+
+void TokenIndex::Reserve(int size) {
+  table_.Reserve(size);
+  keyword_offset_.reserve(size + 1);
+  class_index_.reserve(size);
+}
+
+void TokenIndex::Clear() {
+  TokenIndex empty;
+  Swap(&empty);
+}
+
+void TokenIndex::Swap(TokenIndex* rhs) {
+  table_.Swap(&rhs->table_);
+  keywords_.swap(rhs->keywords_);
+  keyword_offset_.swap(rhs->keyword_offset_);
+  class_index_.swap(rhs->class_index_);
+  class_ids_.swap(rhs->class_ids_);
+  class_id_to_index_.swap(rhs->class_id_to_index_);
+}
+
+int64_t TokenIndex::ByteSize() const {
+  int64_t retval = 0;
+  retval += table_.ByteSize();
+  retval += ::artm::utility::getMemoryUsage(keywords_);
+  retval += ::artm::utility::getMemoryUsage(keyword_offset_);
+  retval += ::artm::utility::getMemoryUsage(class_index_);
+  retval += ::artm::utility::getMemoryUsage(class_ids_);
+  retval += ::artm::utility::getMemoryUsage(class_id_to_index_);
+  for (const ClassId& class_id : class_ids_) {
+    retval += 2 * class_id.size();
+  }
+  return retval;
+}
+
+}  // namespace core
+}  // namespace artm
@@ -0,0 +1,136 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "boost/utility/string_ref.hpp"
+
+#include "artm/core/common.h"
+#include "artm/core/token.h"
+
+namespace artm {
+namespace core {
+
+// TokenIdTable class is a flat hash table of token ids, with open addressing and Robin Hood linear probing.
+// It stores only (id, hash) slots, so a lookup usually touches one cache line of the table,
+// and the tokens themselves are kept by the owner of the table: the callers of Find
+// provide a function that compares the token with given id against the token being looked up.
+class TokenIdTable {
+ public:
+  static const int kUndefIndex = -1;
+
+  TokenIdTable() : slots_(), size_(0) { }
+
+  // Returns the id of the first token with equal hash for which equals(id) is true, or kUndefIndex.
+  template <typename Equals>
+  int Find(size_t token_hash, const Equals& equals) const;
+
+  // Adds a token with id size(); the caller must check that the token is not in the table yet.
+  void Insert(size_t token_hash);
+
+  void Reserve(int size);
+  void Clear();
+  void Swap(TokenIdTable* rhs);
+
+  int size() const { return size_; }
+  int64_t ByteSize() const;
+
+ private:
+  struct Slot {
+    int id;         // kUndefIndex for empty slots
+    uint32_t hash;  // defines the home slot of the token, and skips most of the string comparisons
+  };
+
+  static uint32_t SlotHash(size_t token_hash);
+
+  void Insert(Slot slot);
+  void Rehash(int slot_size);
+
+  std::vector<Slot> slots_;  // size is zero or a power of two
+  int size_;
+};
+
+template <typename Equals>
+int TokenIdTable::Find(size_t token_hash, const Equals& equals) const {
+  if (slots_.empty()) {
+    return kUndefIndex;
+  }
+
+  const uint32_t hash = SlotHash(token_hash);
+  const uint32_t mask = static_cast<uint32_t>(slots_.size() - 1);
+  uint32_t distance = 0;
+  for (uint32_t pos = hash & mask; ; pos = (pos + 1) & mask, ++distance) {
+    const Slot& slot = slots_[pos];
+
+    // Robin Hood invariant: the token would have displaced any slot that is closer to its home
+    if (slot.id == kUndefIndex || distance > ((pos - slot.hash) & mask)) {
+      return kUndefIndex;
+    }
+
+    if (slot.hash == hash && equals(slot.id)) {
+      return slot.id;
+    }
+  }
+}
+
+// TokenIndex class assigns sequential ids 0, 1, 2, ... to distinct tokens in the order of their addition,
+// and finds the id of a token. It is a compact replacement of std::unordered_map<Token, int, TokenHasher>:
+// - keywords are stored back to back in a single arena, and each class_id is stored only once
+//   (tokens keep the index of their class_id), so there is no allocation per token;
+// - the hash table is a TokenIdTable, so a lookup usually touches one cache line of the table
+//   before comparing the strings;
+// - tokens can be looked up by (class_id, keyword) strings, without constructing a temporary Token.
+// Concurrent lookups are safe as long as no tokens are added.
+class TokenIndex {
+ public:
+  static const int kUndefIndex = TokenIdTable::kUndefIndex;
+
+  TokenIndex();
+
+  // Returns the id of the token, adding the token with id size() if it is not in the index yet.
+  int Add(const Token& token) { return Add(token.hash(), token.class_id, token.keyword); }
+  int Add(boost::string_ref class_id, boost::string_ref keyword) {
+    return Add(Token::Hash(class_id, keyword), class_id, keyword);
+  }
+
+  // Returns the id of the token, or kUndefIndex if there is no such token.
+  int Find(const Token& token) const { return Find(token.hash(), token.class_id, token.keyword); }
+  int Find(boost::string_ref class_id, boost::string_ref keyword) const {
+    return Find(Token::Hash(class_id, keyword), class_id, keyword);
+  }
+
+  bool Contains(const Token& token) const { return Find(token) != kUndefIndex; }
+
+  void Reserve(int size);
+  void Clear();
+  void Swap(TokenIndex* rhs);
+
+  int size() const { return static_cast<int>(class_index_.size()); }
+  bool empty() const { return class_index_.empty(); }
+  boost::string_ref keyword(int id) const;
+  const ClassId& class_id(int id) const { return class_ids_[class_index_[id]]; }
+  Token token(int id) const { return Token(class_id(id), keyword(id).to_string()); }
+
+  int64_t ByteSize() const;
+
+ private:
+  int Add(size_t token_hash, boost::string_ref class_id, boost::string_ref keyword);
+  int Find(size_t token_hash, boost::string_ref class_id, boost::string_ref keyword) const;
+  bool Equals(int id, boost::string_ref class_id, boost::string_ref keyword) const;
+  int InternClassId(boost::string_ref class_id);
+
+  TokenIdTable table_;
+  std::vector<char> keywords_;
+  std::vector<int64_t> keyword_offset_;  // size() + 1 offsets in keywords_
+  std::vector<int> class_index_;         // for each token - index in class_ids_
+  std::vector<ClassId> class_ids_;
+  std::unordered_map<ClassId, int> class_id_to_index_;
+};
+
+}  // namespace core
+}  // namespace artm
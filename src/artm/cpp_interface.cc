@@ -81,6 +81,13 @@ int64_t ArtmExecute(int master_id, const ArgsT& args, FuncT func) {
   return HandleErrorCode(func(master_id, blob.size(), StringAsArray(&blob)));
 }
 
+template<typename ArgsT, typename FuncT>
+int64_t ArtmExecute(int master_id, const ArgsT& args, FuncT func, int64_t address_length, char* address) {
+  std::string blob;
+  SerializeMessageToString(args, &blob);
+  return HandleErrorCode(func(master_id, blob.size(), StringAsArray(&blob), address_length, address));
+}
+
 template<typename ResultT>
 ResultT ArtmCopyResult(int64_t length) {
   std::string result_blob;
@@ -120,6 +127,17 @@ void ArtmRequestMatrix(int no_rows, int no_cols, Matrix* matrix) {
   HandleErrorCode(ArtmCopyRequestedObject(length, reinterpret_cast<char*>(matrix->get_data())));
 }
 
+// Requests the size of a dense matrix, and then writes its values straight into 'matrix'
+template<typename ResultT, typename ArgsT, typename FuncT, typename NumRowsT>
+ResultT ArtmRequestMatrix(int master_id, const ArgsT& args, FuncT func, NumRowsT num_rows, Matrix* matrix) {
+  auto retval = ArtmCopyResult<ResultT>(ArtmExecute(master_id, args, func, 0, nullptr));
+  matrix->resize(num_rows(retval), retval.num_topics());
+
+  int64_t length = sizeof(float) * matrix->no_columns() * matrix->no_rows();
+  ArtmExecute(master_id, args, func, length, reinterpret_cast<char*>(matrix->get_data()));
+  return retval;
+}
+
 CollectionParserInfo ParseCollection(const CollectionParserConfig& config) {
   int64_t length = ArtmExecute(config, ArtmParseCollection);
   return ArtmCopyResult<CollectionParserInfo>(length);
@@ -182,6 +200,11 @@ TopicModel MasterModel::GetTopicModel(Matrix* matrix) {
 }
 
 TopicModel MasterModel::GetTopicModel(const GetTopicModelArgs& args, Matrix* matrix) {
+  if (matrix != nullptr && args.matrix_layout() == MatrixLayout_Dense) {
+    return ArtmRequestMatrix< ::artm::TopicModel>(id_, args, ArtmRequestTopicModelToBuffer,
+                                                  [](const TopicModel& m) { return m.token_size(); }, matrix);
+  }
+
   auto retval = ArtmRequest< ::artm::TopicModel>(id_, args, ArtmRequestTopicModelExternal);
   ArtmRequestMatrix(retval.token_size(), retval.num_topics(), matrix);
   return retval;
@@ -202,6 +225,11 @@ ThetaMatrix MasterModel::GetThetaMatrix(Matrix* matrix) {
 }
 
 ThetaMatrix MasterModel::GetThetaMatrix(const GetThetaMatrixArgs& args, Matrix* matrix) {
+  if (matrix != nullptr && args.matrix_layout() == MatrixLayout_Dense) {
+    return ArtmRequestMatrix< ::artm::ThetaMatrix>(id_, args, ArtmRequestThetaMatrixToBuffer,
+                                                   [](const ThetaMatrix& m) { return m.item_id_size(); }, matrix);
+  }
+
   auto retval = ArtmRequest< ::artm::ThetaMatrix>(id_, args, ArtmRequestThetaMatrixExternal);
   ArtmRequestMatrix(retval.item_id_size(), retval.num_topics(), matrix);
   return retval;
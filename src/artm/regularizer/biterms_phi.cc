@@ -15,118 +15,222 @@ namespace regularizer {
 
 BitermsPhi::BitermsPhi(const BitermsPhiConfig& config) : config_(config) { }
 
-bool BitermsPhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
-                               const ::artm::core::PhiMatrix& n_wt,
-                               ::artm::core::PhiMatrix* r_wt,
-                               const float* tau) {
-  if (!::artm::core::PhiMatrixOperations::HasEqualShape(p_wt, n_wt)) {
-    LOG(ERROR) << "BitermsPhi does not support changes in p_wt and n_wt matrix. Cancel it's launch.";
-    return false;
-  }
-
-  // prepare parameters
-  const int topic_size = n_wt.topic_size();
-  const int token_size = n_wt.token_size();
+namespace {
 
-  std::vector<bool> topics_to_regularize;
-  if (config_.topic_name().size() == 0) {
-    topics_to_regularize.assign(topic_size, true);
-  } else {
-    topics_to_regularize = core::is_member(n_wt.topic_name(), config_.topic_name());
+// Loads the row into the cache ahead of its use.
+inline void PrefetchRow(const float* row, int size) {
+#if defined(__GNUC__)
+  const int kFloatsPerCacheLine = 16;
+  for (int i = 0; i < size; i += kFloatsPerCacheLine) {
+    __builtin_prefetch(row + i);
   }
+#endif
+}
 
-  bool use_all_classes = false;
-  if (config_.class_id_size() == 0) {
-    use_all_classes = true;
-  }
+}  // namespace
 
-  if (!config_.has_dictionary_name()) {
-    LOG(ERROR) << "There's no dictionary for Biterms regularizer. Cancel it's launch.";
-    return false;
+void BitermsPhiAgent::Apply(int token_begin, int token_end, ::artm::core::PhiMatrix* r_wt) const {
+  const int topic_size = n_wt_.topic_size();
+  if (topic_size == 0) {
+    return;
   }
 
-  auto dictionary_ptr = dictionary(config_.dictionary_name());
-  if (dictionary_ptr == nullptr) {
-    LOG(ERROR) << "There's no dictionary for Biterms regularizer. Cancel it's launch.";
-    return false;
-  }
+  // scratch buffers, reused for all tokens of the range
+  std::vector<float> p_wt_row(topic_size, 0.0f);
+  std::vector<float> p_ut_row(topic_size, 0.0f);
+  std::vector<float> n_t_p_wt(topic_size, 0.0f);  // n_t * p_wt
+  std::vector<float> p_tuw(topic_size, 0.0f);
+  std::vector<float> values(topic_size, 0.0f);
+  std::vector<int> sparse_topics;
+  sparse_topics.reserve(topic_size);
 
-  // create the conversion from index if token in Dictionary -> index of token in Phi
-  // -1 means that token from dictionary doesn't present in Phi matrix
-  std::vector<int> dict_to_phi_indices(dictionary_ptr->size(), -1);
-  for (int index = 0; index < dictionary_ptr->size(); ++index) {
-    auto& entry = dictionary_ptr->entries()[index];
-    dict_to_phi_indices[index] = n_wt.token_index(entry.token());
-  }
-
-  // compute n_t
-  std::vector<float> n_t(topic_size, 0.0f);
-  for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
-    for (int token_index = 0; token_index < token_size; ++token_index) {
-      n_t[topic_index] += n_wt.get(token_index, topic_index);
+  auto p_wt_row_ptr = [&](int token_id, std::vector<float>* buffer) {  // NOLINT
+    if (contiguous_p_wt_ != nullptr) {
+      return contiguous_p_wt_->row(token_id);
     }
-  }
 
-  // proceed the regularization
-  for (int token_id = 0; token_id < token_size; ++token_id) {
-    const auto& token = n_wt.token(token_id);
-    if (!use_all_classes && !core::is_member(token.class_id, config_.class_id())) {
+    p_wt_.get(token_id, buffer);
+    return static_cast<const float*>(&(*buffer)[0]);
+  };
+
+  for (int token_id = token_begin; token_id < token_end; ++token_id) {
+    if (!class_ids_.contains(n_wt_.class_index(token_id))) {
       continue;
     }
 
-    auto cooc_tokens_info = dictionary_ptr->token_cooc_values(token);
-    if (cooc_tokens_info == nullptr) {
+    const auto& token = n_wt_.token(token_id);
+
+    core::CoocRow cooc_tokens_info = dictionary_->token_cooc_values(token);
+    if (cooc_tokens_info.empty()) {
       continue;
     }
 
-    std::vector<float> n_t_p_wt(topic_size, 0.0f);  // n_t * p_wt
+    const float* p_w = p_wt_row_ptr(token_id, &p_wt_row);
     for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
-      n_t_p_wt[topic_id] = n_t[topic_id] * p_wt.get(token_id, topic_id);
+      n_t_p_wt[topic_id] = n_t_[topic_id] * p_w[topic_id];
     }
 
-    std::vector<float> values(topic_size, 0.0f);
-    for (const auto& elem : *cooc_tokens_info) {
-      float mult_coef = elem.second;
-      int cooc_token_index = dict_to_phi_indices[elem.first];
+    // the topics where n_t * p_wt is zero do not contribute neither to p_tuw nor to its norm
+    const std::vector<int>* topics = &topics_to_regularize_;
+    if (use_sparse_topics_) {
+      sparse_topics.clear();
+      for (int topic_id : topics_to_regularize_) {
+        if (n_t_p_wt[topic_id] != 0.0f) {
+          sparse_topics.push_back(topic_id);
+        }
+      }
+
+      topics = &sparse_topics;
+      if (sparse_topics.empty()) {
+        continue;
+      }
+    }
+
+    const bool dense_topics = use_all_topics_ && (static_cast<int>(topics->size()) == topic_size);
+    values.assign(topic_size, 0.0f);
+    for (int i = 0; i < cooc_tokens_info.size(); ++i) {
+      int cooc_token_index = dict_to_phi_indices_[cooc_tokens_info.column(i)];
       if (cooc_token_index == -1) {
         continue;
       }
 
-      float p_tuw_norm = 0.0f;
-      std::vector<float> p_tuw(n_t_p_wt);
-      for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
-        if (!topics_to_regularize[topic_id]) {
-          continue;
+      if (contiguous_p_wt_ != nullptr && i + 1 < cooc_tokens_info.size()) {
+        int next_token_index = dict_to_phi_indices_[cooc_tokens_info.column(i + 1)];
+        if (next_token_index != -1) {
+          PrefetchRow(contiguous_p_wt_->row(next_token_index), topic_size);
         }
-
-        p_tuw[topic_id] *= p_wt.get(cooc_token_index, topic_id);
-        p_tuw_norm += p_tuw[topic_id];
       }
 
-      for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
-        if (!topics_to_regularize[topic_id]) {
-          continue;
+      const float mult_coef = cooc_tokens_info.value(i);
+      const float* p_u = p_wt_row_ptr(cooc_token_index, &p_ut_row);
+      float p_tuw_norm = 0.0f;
+      if (dense_topics) {
+        for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+          p_tuw[topic_id] = n_t_p_wt[topic_id] * p_u[topic_id];
+          p_tuw_norm += p_tuw[topic_id];
         }
 
-        float p_t_uw = p_tuw_norm > 0.0f && p_tuw[topic_id] > 0.0f ?
-          p_tuw[topic_id] / p_tuw_norm : 0.0f;
+        if (p_tuw_norm > 0.0f) {
+          for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+            if (p_tuw[topic_id] > 0.0f) {
+              values[topic_id] += p_tuw[topic_id] / p_tuw_norm * mult_coef;
+            }
+          }
+        }
+      } else {
+        for (int topic_id : *topics) {
+          p_tuw[topic_id] = n_t_p_wt[topic_id] * p_u[topic_id];
+          p_tuw_norm += p_tuw[topic_id];
+        }
 
-        values[topic_id] += p_t_uw * mult_coef;
+        if (p_tuw_norm > 0.0f) {
+          for (int topic_id : *topics) {
+            if (p_tuw[topic_id] > 0.0f) {
+              values[topic_id] += p_tuw[topic_id] / p_tuw_norm * mult_coef;
+            }
+          }
+        }
       }
     }
 
-    if (tau != nullptr) {
-      for (auto& v : values) {
-        v *= *tau;
-      }
+    for (auto& v : values) {
+      v *= tau_;
     }
 
     r_wt->increase(token_id, values);
   }
+}
+
+bool BitermsPhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
+                               const ::artm::core::PhiMatrix& n_wt,
+                               ::artm::core::PhiMatrix* r_wt,
+                               const float* tau) {
+  // CreateRegularizePhiAgent does not log, as InvokePhiRegularizers falls back to this method when it fails
+  auto agent = CreateRegularizePhiAgent(p_wt, n_wt, tau);
+  if (agent == nullptr) {
+    LOG(ERROR) << FindLaunchError(p_wt, n_wt) << " Cancel it's launch.";
+    return false;
+  }
 
+  agent->Apply(0, n_wt.token_size(), r_wt);
   return true;
 }
 
+std::string BitermsPhi::FindLaunchError(const ::artm::core::PhiMatrix& p_wt, const ::artm::core::PhiMatrix& n_wt) {
+  if (!::artm::core::PhiMatrixOperations::HasEqualShape(p_wt, n_wt)) {
+    return "BitermsPhi does not support changes in p_wt and n_wt matrix.";
+  }
+
+  if (!config_.has_dictionary_name() || dictionary(config_.dictionary_name()) == nullptr) {
+    return "There's no dictionary for Biterms regularizer.";
+  }
+
+  return std::string();
+}
+
+std::shared_ptr<RegularizePhiAgent>
+BitermsPhi::CreateRegularizePhiAgent(const ::artm::core::PhiMatrix& p_wt,
+                                     const ::artm::core::PhiMatrix& n_wt,
+                                     const float* tau) {
+  if (!FindLaunchError(p_wt, n_wt).empty()) {
+    return nullptr;
+  }
+
+  auto dictionary_ptr = dictionary(config_.dictionary_name());
+  if (dictionary_ptr == nullptr) {
+    return nullptr;
+  }
+
+  BitermsPhiAgent* agent = new BitermsPhiAgent(p_wt, n_wt);
+  std::shared_ptr<BitermsPhiAgent> retval(agent);
+  agent->contiguous_p_wt_ = dynamic_cast<const ::artm::core::ContiguousPhiMatrix*>(&p_wt);
+
+  // prepare parameters
+  const int topic_size = n_wt.topic_size();
+  const int token_size = n_wt.token_size();
+
+  std::vector<bool> topics_to_regularize;
+  if (config_.topic_name().size() == 0) {
+    topics_to_regularize.assign(topic_size, true);
+  } else {
+    topics_to_regularize = core::is_member(n_wt.topic_name(), config_.topic_name());
+  }
+
+  for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+    if (topics_to_regularize[topic_id]) {
+      agent->topics_to_regularize_.push_back(topic_id);
+    }
+  }
+
+  agent->use_all_topics_ = (static_cast<int>(agent->topics_to_regularize_.size()) == topic_size);
+  agent->use_sparse_topics_ = config_.use_sparse_topics();
+
+  // create the conversion from index if token in Dictionary -> index of token in Phi
+  agent->dict_to_phi_indices_.assign(dictionary_ptr->size(), -1);
+  for (int index = 0; index < dictionary_ptr->size(); ++index) {
+    auto& entry = dictionary_ptr->entries()[index];
+    agent->dict_to_phi_indices_[index] = n_wt.token_index(entry.token());
+  }
+
+  // compute n_t in one pass over the rows
+  agent->n_t_.assign(topic_size, 0.0f);
+  std::vector<float> n_wt_row(topic_size, 0.0f);
+  for (int token_index = 0; token_index < token_size && topic_size > 0; ++token_index) {
+    n_wt.get(token_index, &n_wt_row);
+    for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
+      agent->n_t_[topic_index] += n_wt_row[topic_index];
+    }
+  }
+
+  agent->dictionary_ = dictionary_ptr;
+  agent->class_ids_ = core::ClassIdSet(config_.class_id());
+  if (tau != nullptr) {
+    agent->tau_ = *tau;
+  }
+
+  return retval;
+}
+
 google::protobuf::RepeatedPtrField<std::string> BitermsPhi::topics_to_regularize() {
   return config_.topic_name();
 }
@@ -18,6 +18,7 @@
    - class_ids (class ids to regularize, empty == all)
    - transaction_typenames (transaction type names to regularize, empty == all)
    - dictionary_name (strongly required parameter)
+   - use_sparse_topics (skip the topics where p_wt of the regularized token is zero)
 
 */
 
@@ -25,13 +26,46 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "artm/regularizer_interface.h"
+#include "artm/core/class_id_registry.h"
+#include "artm/core/contiguous_phi_matrix.h"
 #include "artm/core/transform_function.h"
 
 namespace artm {
 namespace regularizer {
 
+class BitermsPhiAgent : public RegularizePhiAgent {
+ public:
+  BitermsPhiAgent(const ::artm::core::PhiMatrix& p_wt, const ::artm::core::PhiMatrix& n_wt)
+    : p_wt_(p_wt)
+    , n_wt_(n_wt)
+    , contiguous_p_wt_(nullptr)
+    , use_all_topics_(false)
+    , use_sparse_topics_(false)
+    , tau_(1.0f) { }
+
+  virtual void Apply(int token_begin, int token_end, ::artm::core::PhiMatrix* r_wt) const;
+
+ private:
+  friend class BitermsPhi;
+
+  const ::artm::core::PhiMatrix& p_wt_;
+  const ::artm::core::PhiMatrix& n_wt_;
+  const ::artm::core::ContiguousPhiMatrix* contiguous_p_wt_;  // rows are read in place (nullptr otherwise)
+  std::shared_ptr<artm::core::Dictionary> dictionary_;
+
+  // conversion from index of token in Dictionary -> index of token in Phi (-1 if there's no such token)
+  std::vector<int> dict_to_phi_indices_;
+  std::vector<float> n_t_;
+  std::vector<int> topics_to_regularize_;
+  bool use_all_topics_;
+  bool use_sparse_topics_;
+  core::ClassIdSet class_ids_;  // empty == all
+  float tau_;
+};
+
 class BitermsPhi : public RegularizerInterface {
  public:
   explicit BitermsPhi(const BitermsPhiConfig& config);
@@ -41,12 +75,20 @@ class BitermsPhi : public RegularizerInterface {
                              ::artm::core::PhiMatrix* r_wt,
                              const float* tau);
 
+  virtual std::shared_ptr<RegularizePhiAgent>
+  CreateRegularizePhiAgent(const ::artm::core::PhiMatrix& p_wt,
+                           const ::artm::core::PhiMatrix& n_wt,
+                           const float* tau);
+
   virtual google::protobuf::RepeatedPtrField<std::string> topics_to_regularize();
   virtual google::protobuf::RepeatedPtrField<std::string> class_ids_to_regularize();
 
   virtual bool Reconfigure(const RegularizerConfig& config);
 
  private:
+  // Returns the reason why the regularizer can't be applied, or an empty string
+  std::string FindLaunchError(const ::artm::core::PhiMatrix& p_wt, const ::artm::core::PhiMatrix& n_wt);
+
   BitermsPhiConfig config_;
 };
 
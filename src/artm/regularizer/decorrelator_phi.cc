@@ -14,96 +14,134 @@
 namespace artm {
 namespace regularizer {
 
-bool DecorrelatorPhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
-                                    const ::artm::core::PhiMatrix& n_wt,
-                                    ::artm::core::PhiMatrix* r_wt,
-                                    const float* tau) {
-  // read the parameters from config and control their correctness
-  const bool use_topic_pairs = (topic_pairs_.size() > 0);
+void DecorrelatorPhiAgent::Apply(int token_begin, int token_end, ::artm::core::PhiMatrix* r_wt) const {
+  const int topic_size = p_wt_.topic_size();
+  if (topic_size == 0) {
+    return;
+  }
 
-  std::unordered_map<std::string, int> topics_to_regularize;
-  if (!use_topic_pairs) {
-    for (const auto& s : (config_.topic_name().size() ? config_.topic_name() : p_wt.topic_name())) {
-      bool valid_topic = false;
-      for (int i = 0; i < p_wt.topic_name().size(); ++i) {
-        if (p_wt.topic_name(i) == s) {
-          topics_to_regularize.insert(std::make_pair(s, i));
-          valid_topic = true;
-          break;
-        }
+  std::vector<float> weights(topic_size, 0.0f);
+  std::vector<float> values(topic_size, 0.0f);
+  for (int token_nwt_id = token_begin; token_nwt_id < token_end; ++token_nwt_id) {
+    if (!class_ids_.contains(n_wt_.class_index(token_nwt_id))) {
+      continue;
+    }
+
+    const auto& token = n_wt_.token(token_nwt_id);
+
+    int token_pwt_id = same_tokens_ ? token_nwt_id : p_wt_.token_index(token);
+    if (token_pwt_id == -1) {
+      continue;
+    }
+
+    p_wt_.get(token_pwt_id, &weights);
+    const float* weight = &weights[0];
+    float* value = &values[0];
+
+    if (use_all_topics_) {
+      // the common case, vectorized by the compiler
+      float weights_sum = 0.0f;
+      for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+        weights_sum += weight[topic_id];
       }
-      if (!valid_topic) {
-        LOG(WARNING) << "Topic name " << s << " is not presented into model and will be ignored";
+
+      for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+        value[topic_id] = -weight[topic_id] * (weights_sum - weight[topic_id]) * tau_;
+      }
+    } else if (!use_topic_pairs_) {
+      values.assign(topic_size, 0.0f);
+      float weights_sum = 0.0f;
+      for (int topic_id : topic_index_) {
+        weights_sum += weight[topic_id];
+      }
+
+      for (int topic_id : topic_index_) {
+        value[topic_id] = -weight[topic_id] * (weights_sum - weight[topic_id]) * tau_;
+      }
+    } else {
+      values.assign(topic_size, 0.0f);
+      for (int i = 0; i < static_cast<int>(first_topic_index_.size()); ++i) {
+        float weights_sum = 0.0f;
+        for (int j = pair_begin_[i]; j < pair_begin_[i + 1]; ++j) {
+          weights_sum += weight[second_topic_index_[j]] * pair_value_[j];
+        }
+
+        const int topic_id = first_topic_index_[i];
+        value[topic_id] = -weight[topic_id] * (weights_sum - weight[topic_id]) * tau_;
       }
     }
+
+    r_wt->increase(token_nwt_id, values);
   }
+}
 
+bool DecorrelatorPhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
+                                    const ::artm::core::PhiMatrix& n_wt,
+                                    ::artm::core::PhiMatrix* r_wt,
+                                    const float* tau) {
+  auto agent = CreateRegularizePhiAgent(p_wt, n_wt, tau);
+  agent->Apply(0, n_wt.token_size(), r_wt);
+  return true;
+}
+
+std::shared_ptr<RegularizePhiAgent>
+DecorrelatorPhi::CreateRegularizePhiAgent(const ::artm::core::PhiMatrix& p_wt,
+                                          const ::artm::core::PhiMatrix& n_wt,
+                                          const float* tau) {
+  DecorrelatorPhiAgent* agent = new DecorrelatorPhiAgent(p_wt, n_wt);
+  std::shared_ptr<DecorrelatorPhiAgent> retval(agent);
+
+  // read the parameters from config and control their correctness
   std::unordered_map<std::string, int> all_topics;
   for (int i = 0; i < p_wt.topic_name().size(); ++i) {
     all_topics.insert(std::make_pair(p_wt.topic_name(i), i));
   }
 
-  bool use_all_classes = false;
-  if (config_.class_id_size() == 0) {
-    use_all_classes = true;
-  }
-
-  // proceed the regularization
-  for (int token_pwt_id = 0; token_pwt_id < p_wt.token_size(); ++token_pwt_id) {
-    const auto& token = p_wt.token(token_pwt_id);
-    if (!use_all_classes && !core::is_member(token.class_id, config_.class_id())) {
-      continue;
-    }
-
-    int token_nwt_id = n_wt.token_index(token);
-    if (token_nwt_id == -1) {
-      continue;
-    }
-
-    // count sum of weights
-    float weights_sum = 0.0f;
-
-    // simple case (without topic_pairs)
-    if (!use_topic_pairs) {
-      // create general normalizer
-      for (const auto& pair : topics_to_regularize) {
-        weights_sum += p_wt.get(token_pwt_id, pair.second);
+  agent->use_topic_pairs_ = (topic_pairs_.size() > 0);
+  if (!agent->use_topic_pairs_) {
+    std::vector<bool> is_regularized(p_wt.topic_size(), false);
+    for (const auto& s : (config_.topic_name().size() ? config_.topic_name() : p_wt.topic_name())) {
+      auto iter = all_topics.find(s);
+      if (iter == all_topics.end()) {
+        LOG(WARNING) << "Topic name " << s << " is not presented into model and will be ignored";
+        continue;
       }
 
-      // process every topic from topic_names
-      for (const auto& pair : topics_to_regularize) {
-        float weight = p_wt.get(token_pwt_id, pair.second);
-        float value = static_cast<float>(-weight * (weights_sum - weight));
-        r_wt->increase(token_nwt_id, pair.second, value * (tau != nullptr ? *tau : 1.0f));
+      if (!is_regularized[iter->second]) {
+        is_regularized[iter->second] = true;
+        agent->topic_index_.push_back(iter->second);
       }
-    } else {  // complex case
-      for (const auto& pair : topic_pairs_) {
-        weights_sum = 0.0f;
-
-        // check given topic exists in model
-        auto first_iter = all_topics.find(pair.first);
-        if (first_iter == all_topics.end()) {
-          continue;
-        }
+    }
 
-        // create custom normilizer for this topic
-        for (const auto& topic_and_value : pair.second) {
-          auto second_iter = all_topics.find(topic_and_value.first);
-          if (second_iter == all_topics.end()) {
-            continue;
-          }
+    agent->use_all_topics_ = (static_cast<int>(agent->topic_index_.size()) == p_wt.topic_size());
+  } else {
+    agent->pair_begin_.push_back(0);
+    for (const auto& pair : topic_pairs_) {
+      // check given topic exists in model
+      auto first_iter = all_topics.find(pair.first);
+      if (first_iter == all_topics.end()) {
+        continue;
+      }
 
-          weights_sum += p_wt.get(token_pwt_id, second_iter->second) * topic_and_value.second;
+      for (const auto& topic_and_value : pair.second) {
+        auto second_iter = all_topics.find(topic_and_value.first);
+        if (second_iter != all_topics.end()) {
+          agent->second_topic_index_.push_back(second_iter->second);
+          agent->pair_value_.push_back(topic_and_value.second);
         }
-
-        // process this topic value
-        float weight = p_wt.get(token_pwt_id, first_iter->second);
-        float value = static_cast<float>(-weight * (weights_sum - weight));
-        r_wt->increase(token_nwt_id, first_iter->second, value * (tau != nullptr ? *tau : 1.0f));
       }
+
+      agent->first_topic_index_.push_back(first_iter->second);
+      agent->pair_begin_.push_back(static_cast<int>(agent->second_topic_index_.size()));
     }
   }
-  return true;
+
+  agent->class_ids_ = core::ClassIdSet(config_.class_id());
+  if (tau != nullptr) {
+    agent->tau_ = *tau;
+  }
+
+  return retval;
 }
 
 google::protobuf::RepeatedPtrField<std::string> DecorrelatorPhi::topics_to_regularize() {
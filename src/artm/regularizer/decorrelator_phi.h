@@ -23,16 +23,56 @@ Note, that in case of topic_pairs usage the topic_names parameter will be ignore
 
 #pragma once
 
+#include <memory>
 #include <unordered_map>
 #include <string>
+#include <vector>
 
 #include "artm/regularizer_interface.h"
+#include "artm/core/class_id_registry.h"
 
 namespace artm {
 namespace regularizer {
 
 typedef std::unordered_map<std::string, std::unordered_map<std::string, float> > TopicMap;
 
+// DecorrelatorPhiAgent resolves topic names into flat arrays of topic indices once per regularization,
+// so that each token takes one read of its p_wt row and O(T) operations (O(pairs) with topic_pairs).
+class DecorrelatorPhiAgent : public RegularizePhiAgent {
+ public:
+  DecorrelatorPhiAgent(const ::artm::core::PhiMatrix& p_wt, const ::artm::core::PhiMatrix& n_wt)
+    : p_wt_(p_wt)
+    , n_wt_(n_wt)
+    , same_tokens_(p_wt.shape_version() == n_wt.shape_version())
+    , use_topic_pairs_(false)
+    , use_all_topics_(false)
+    , tau_(1.0f) { }
+
+  virtual void Apply(int token_begin, int token_end, ::artm::core::PhiMatrix* r_wt) const;
+
+ private:
+  friend class DecorrelatorPhi;
+
+  const ::artm::core::PhiMatrix& p_wt_;
+  const ::artm::core::PhiMatrix& n_wt_;
+  bool same_tokens_;  // p_wt and n_wt have the same tokens in the same order
+  bool use_topic_pairs_;
+  bool use_all_topics_;
+
+  // simple case: topics to regularize
+  std::vector<int> topic_index_;
+
+  // topic_pairs case: regularized topics first_topic_index_[i] are decorrelated with
+  // second_topic_index_[j] with weight pair_value_[j] for j in [pair_begin_[i], pair_begin_[i + 1])
+  std::vector<int> first_topic_index_;
+  std::vector<int> pair_begin_;
+  std::vector<int> second_topic_index_;
+  std::vector<float> pair_value_;
+
+  core::ClassIdSet class_ids_;  // empty == all
+  float tau_;
+};
+
 class DecorrelatorPhi : public RegularizerInterface {
  public:
   explicit DecorrelatorPhi(const DecorrelatorPhiConfig& config)
@@ -45,6 +85,11 @@ class DecorrelatorPhi : public RegularizerInterface {
                              ::artm::core::PhiMatrix* r_wt,
                              const float* tau);
 
+  virtual std::shared_ptr<RegularizePhiAgent>
+  CreateRegularizePhiAgent(const ::artm::core::PhiMatrix& p_wt,
+                           const ::artm::core::PhiMatrix& n_wt,
+                           const float* tau);
+
   virtual google::protobuf::RepeatedPtrField<std::string> topics_to_regularize();
   virtual google::protobuf::RepeatedPtrField<std::string> class_ids_to_regularize();
 
@@ -13,82 +13,102 @@
 namespace artm {
 namespace regularizer {
 
+void ImproveCoherencePhiAgent::Apply(int token_begin, int token_end, ::artm::core::PhiMatrix* r_wt) const {
+  const int topic_size = n_wt_.topic_size();
+
+  std::vector<float> values(topic_size, 0.0f);
+  std::vector<float> n_wt_row(topic_size, 0.0f);
+  for (int token_id = token_begin; token_id < token_end; ++token_id) {
+    if (!class_ids_.contains(n_wt_.class_index(token_id))) {
+      continue;
+    }
+
+    const auto& token = n_wt_.token(token_id);
+
+    core::CoocRow cooc_tokens_info = dictionary_->token_cooc_values(token);
+    if (cooc_tokens_info.empty()) {
+      continue;
+    }
+
+    values.assign(topic_size, 0.0f);
+    for (int i = 0; i < cooc_tokens_info.size(); ++i) {
+      float mult_coef = cooc_tokens_info.value(i);
+      int cooc_token_index = dict_to_phi_indices_[cooc_tokens_info.column(i)];
+      if (cooc_token_index == -1) {
+        continue;
+      }
+
+      n_wt_.get(cooc_token_index, &n_wt_row);
+      for (int topic_id : topics_to_regularize_) {
+        values[topic_id] += n_wt_row[topic_id] * mult_coef;
+      }
+    }
+
+    for (auto& v : values) {
+      v *= tau_;
+    }
+
+    r_wt->increase(token_id, values);
+  }
+}
+
 bool ImproveCoherencePhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
                                         const ::artm::core::PhiMatrix& n_wt,
                                         ::artm::core::PhiMatrix* r_wt,
                                         const float* tau) {
-  const int topic_size = n_wt.topic_size();
-  const int token_size = n_wt.token_size();
-
-  std::vector<bool> topics_to_regularize;
-  if (config_.topic_name().size() == 0) {
-    topics_to_regularize.assign(topic_size, true);
-  } else {
-    topics_to_regularize = core::is_member(n_wt.topic_name(), config_.topic_name());
+  auto agent = CreateRegularizePhiAgent(p_wt, n_wt, tau);
+  if (agent == nullptr) {
+    LOG(WARNING) << "There's no dictionary for ImproveCoherence regularizer. Cancel it's launch.";
+    return false;
   }
 
-  bool use_all_classes = false;
-  if (config_.class_id_size() == 0) {
-    use_all_classes = true;
-  }
+  agent->Apply(0, n_wt.token_size(), r_wt);
+  return true;
+}
 
+std::shared_ptr<RegularizePhiAgent>
+ImproveCoherencePhi::CreateRegularizePhiAgent(const ::artm::core::PhiMatrix& p_wt,
+                                              const ::artm::core::PhiMatrix& n_wt,
+                                              const float* tau) {
   if (!config_.has_dictionary_name()) {
-    LOG(WARNING) << "There's no dictionary for ImproveCoherence regularizer. Cancel it's launch.";
-    return false;
+    return nullptr;
   }
 
   auto dictionary_ptr = dictionary(config_.dictionary_name());
   if (dictionary_ptr == nullptr) {
-    LOG(WARNING) << "There's no dictionary for ImproveCoherence regularizer. Cancel it's launch.";
-    return false;
+    return nullptr;
   }
 
-  // create the conversion from index if token in Dictionary -> index of token in Phi
-  // -1 means that token from dictionary doesn't present in Phi matrix
-  std::vector<int> dict_to_phi_indices(dictionary_ptr->size(), -1);
-  for (int index = 0; index < dictionary_ptr->size(); ++index) {
-    const auto& entry = dictionary_ptr->entries()[index];
-    dict_to_phi_indices[index] = n_wt.token_index(entry.token());
-  }
+  ImproveCoherencePhiAgent* agent = new ImproveCoherencePhiAgent(n_wt);
+  std::shared_ptr<ImproveCoherencePhiAgent> retval(agent);
 
-  // proceed the regularization
-  for (int token_id = 0; token_id < token_size; ++token_id) {
-    const auto& token = n_wt.token(token_id);
-    if (!use_all_classes && !core::is_member(token.class_id, config_.class_id())) {
-      continue;
-    }
-
-    auto cooc_tokens_info = dictionary_ptr->token_cooc_values(token);
-    if (cooc_tokens_info == nullptr) {
-      continue;
+  const int topic_size = n_wt.topic_size();
+  if (config_.topic_name().size() == 0) {
+    for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+      agent->topics_to_regularize_.push_back(topic_id);
     }
-
-    std::vector<float> values(topic_size, 0.0);
-    for (const auto& elem : *cooc_tokens_info) {
-      float mult_coef = elem.second;
-      int cooc_token_index = dict_to_phi_indices[elem.first];
-      if (cooc_token_index == -1) {
-        continue;
-      }
-
-      for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
-        if (!topics_to_regularize[topic_id]) {
-          continue;
-        }
-
-        values[topic_id] += n_wt.get(cooc_token_index, topic_id) * mult_coef;
+  } else {
+    std::vector<bool> is_member = core::is_member(n_wt.topic_name(), config_.topic_name());
+    for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+      if (is_member[topic_id]) {
+        agent->topics_to_regularize_.push_back(topic_id);
       }
     }
+  }
 
-    if (tau != nullptr) {
-      for (auto& v : values) {
-        v *= *tau;
-      }
-    }
+  agent->dict_to_phi_indices_.assign(dictionary_ptr->size(), -1);
+  for (int index = 0; index < dictionary_ptr->size(); ++index) {
+    const auto& entry = dictionary_ptr->entries()[index];
+    agent->dict_to_phi_indices_[index] = n_wt.token_index(entry.token());
+  }
 
-    r_wt->increase(token_id, values);
+  agent->dictionary_ = dictionary_ptr;
+  agent->class_ids_ = core::ClassIdSet(config_.class_id());
+  if (tau != nullptr) {
+    agent->tau_ = *tau;
   }
-  return true;
+
+  return retval;
 }
 
 google::protobuf::RepeatedPtrField<std::string> ImproveCoherencePhi::topics_to_regularize() {
@@ -20,13 +20,37 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "artm/regularizer_interface.h"
+#include "artm/core/class_id_registry.h"
 
 namespace artm {
 namespace regularizer {
 
+class ImproveCoherencePhiAgent : public RegularizePhiAgent {
+ public:
+  explicit ImproveCoherencePhiAgent(const ::artm::core::PhiMatrix& n_wt)
+    : n_wt_(n_wt)
+    , tau_(1.0f) { }
+
+  virtual void Apply(int token_begin, int token_end, ::artm::core::PhiMatrix* r_wt) const;
+
+ private:
+  friend class ImproveCoherencePhi;
+
+  const ::artm::core::PhiMatrix& n_wt_;
+  std::shared_ptr<artm::core::Dictionary> dictionary_;
+
+  // conversion from index of token in Dictionary -> index of token in Phi (-1 if there's no such token)
+  std::vector<int> dict_to_phi_indices_;
+  std::vector<int> topics_to_regularize_;
+  core::ClassIdSet class_ids_;  // empty == all
+  float tau_;
+};
+
 class ImproveCoherencePhi : public RegularizerInterface {
  public:
   explicit ImproveCoherencePhi(const ImproveCoherencePhiConfig& config)
@@ -37,6 +61,11 @@ class ImproveCoherencePhi : public RegularizerInterface {
                              ::artm::core::PhiMatrix* r_wt,
                              const float* tau);
 
+  virtual std::shared_ptr<RegularizePhiAgent>
+  CreateRegularizePhiAgent(const ::artm::core::PhiMatrix& p_wt,
+                           const ::artm::core::PhiMatrix& n_wt,
+                           const float* tau);
+
   virtual google::protobuf::RepeatedPtrField<std::string> topics_to_regularize();
   virtual google::protobuf::RepeatedPtrField<std::string> class_ids_to_regularize();
 
@@ -6,6 +6,7 @@
 #include <string>
 #include <vector>
 
+#include "artm/core/class_id_registry.h"
 #include "artm/core/protobuf_helpers.h"
 #include "artm/core/phi_matrix.h"
 
@@ -29,10 +30,7 @@ bool LabelRegularizationPhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
     topics_to_regularize = core::is_member(n_wt.topic_name(), config_.topic_name());
   }
 
-  bool use_all_classes = false;
-  if (config_.class_id_size() == 0) {
-    use_all_classes = true;
-  }
+  const core::ClassIdSet class_ids(config_.class_id());  // empty == all
 
   std::shared_ptr<core::Dictionary> dictionary_ptr = nullptr;
   if (config_.has_dictionary_name()) {
@@ -41,11 +39,12 @@ bool LabelRegularizationPhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
 
   // proceed the regularization
   for (int token_id = 0; token_id < token_size; ++token_id) {
-    const auto& token = p_wt.token(token_id);
-    if (!use_all_classes && !core::is_member(token.class_id, config_.class_id())) {
+    if (!class_ids.contains(p_wt.class_index(token_id))) {
       continue;
     }
 
+    const auto& token = p_wt.token(token_id);
+
     float coefficient = 1.0f;
     if (dictionary_ptr != nullptr) {
       auto entry_ptr = dictionary_ptr->entry(token);
@@ -22,41 +22,18 @@ SmoothSparsePhi::SmoothSparsePhi(const SmoothSparsePhiConfig& config)
   }
 }
 
-bool SmoothSparsePhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
-                                    const ::artm::core::PhiMatrix& n_wt,
-                                    ::artm::core::PhiMatrix* r_wt,
-                                    const float* tau) {
-  // read the parameters from config and control their correctness
-  const int topic_size = p_wt.topic_size();
-
-  std::vector<bool> topics_to_regularize;
-  if (config_.topic_name().size() == 0) {
-    topics_to_regularize.assign(topic_size, true);
-  } else {
-    topics_to_regularize = core::is_member(p_wt.topic_name(), config_.topic_name());
-  }
-
-  bool use_all_classes = false;
-  if (config_.class_id_size() == 0) {
-    use_all_classes = true;
-  }
-
-  std::shared_ptr<core::Dictionary> dictionary_ptr = nullptr;
-  if (config_.has_dictionary_name()) {
-    dictionary_ptr = dictionary(config_.dictionary_name());
-  }
-
-  // proceed the regularization
-  for (int token_pwt_id = 0; token_pwt_id < p_wt.token_size(); ++token_pwt_id) {
-    float coefficient = 1.0f;
-    const auto& token = p_wt.token(token_pwt_id);
-
-    if (!use_all_classes && !core::is_member(token.class_id, config_.class_id())) {
+void SmoothSparsePhiAgent::Apply(int token_begin, int token_end, ::artm::core::PhiMatrix* r_wt) const {
+  std::vector<float> p_wt_row(p_wt_.topic_size(), 0.0f);
+  for (int token_nwt_id = token_begin; token_nwt_id < token_end; ++token_nwt_id) {
+    if (!class_ids_.contains(n_wt_.class_index(token_nwt_id))) {
       continue;
     }
 
-    if (dictionary_ptr != nullptr) {
-      auto entry_ptr = dictionary_ptr->entry(token);
+    float coefficient = 1.0f;
+    const auto& token = n_wt_.token(token_nwt_id);
+
+    if (dictionary_ != nullptr) {
+      auto entry_ptr = dictionary_->entry(token);
 
       // don't process tokens without value in the dictionary
       if (entry_ptr == nullptr) {
@@ -66,20 +43,60 @@ bool SmoothSparsePhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
       coefficient = entry_ptr->token_value();
     }
 
-    int token_nwt_id = n_wt.token_index(token);
-    if (token_nwt_id == -1) {
+    int token_pwt_id = same_tokens_ ? token_nwt_id : p_wt_.token_index(token);
+    if (token_pwt_id == -1) {
       continue;
     }
 
+    p_wt_.get(token_pwt_id, &p_wt_row);
+    for (int topic_id : topics_to_regularize_) {
+      float value = transform_function_->apply(p_wt_row[topic_id]);
+      r_wt->increase(token_nwt_id, topic_id, coefficient * value * tau_);
+    }
+  }
+}
+
+bool SmoothSparsePhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
+                                    const ::artm::core::PhiMatrix& n_wt,
+                                    ::artm::core::PhiMatrix* r_wt,
+                                    const float* tau) {
+  auto agent = CreateRegularizePhiAgent(p_wt, n_wt, tau);
+  agent->Apply(0, n_wt.token_size(), r_wt);
+  return true;
+}
+
+std::shared_ptr<RegularizePhiAgent>
+SmoothSparsePhi::CreateRegularizePhiAgent(const ::artm::core::PhiMatrix& p_wt,
+                                          const ::artm::core::PhiMatrix& n_wt,
+                                          const float* tau) {
+  SmoothSparsePhiAgent* agent = new SmoothSparsePhiAgent(p_wt, n_wt, transform_function_);
+  std::shared_ptr<SmoothSparsePhiAgent> retval(agent);
+
+  // read the parameters from config and control their correctness
+  const int topic_size = p_wt.topic_size();
+  if (config_.topic_name().size() == 0) {
+    for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+      agent->topics_to_regularize_.push_back(topic_id);
+    }
+  } else {
+    std::vector<bool> is_member = core::is_member(p_wt.topic_name(), config_.topic_name());
     for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
-      if (topics_to_regularize[topic_id]) {
-        float value = transform_function_->apply(p_wt.get(token_pwt_id, topic_id));
-        r_wt->increase(token_nwt_id, topic_id, coefficient * value * (tau != nullptr ? *tau : 1.0f));
+      if (is_member[topic_id]) {
+        agent->topics_to_regularize_.push_back(topic_id);
       }
     }
   }
 
-  return true;
+  agent->class_ids_ = core::ClassIdSet(config_.class_id());
+  if (config_.has_dictionary_name()) {
+    agent->dictionary_ = dictionary(config_.dictionary_name());
+  }
+
+  if (tau != nullptr) {
+    agent->tau_ = *tau;
+  }
+
+  return retval;
 }
 
 google::protobuf::RepeatedPtrField<std::string> SmoothSparsePhi::topics_to_regularize() {
@@ -26,13 +26,42 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "artm/regularizer_interface.h"
+#include "artm/core/class_id_registry.h"
 #include "artm/core/transform_function.h"
 
 namespace artm {
 namespace regularizer {
 
+class SmoothSparsePhiAgent : public RegularizePhiAgent {
+ public:
+  SmoothSparsePhiAgent(const ::artm::core::PhiMatrix& p_wt,
+                       const ::artm::core::PhiMatrix& n_wt,
+                       std::shared_ptr<artm::core::TransformFunction> func)
+    : p_wt_(p_wt)
+    , n_wt_(n_wt)
+    , same_tokens_(p_wt.shape_version() == n_wt.shape_version())
+    , transform_function_(func)
+    , tau_(1.0f) { }
+
+  virtual void Apply(int token_begin, int token_end, ::artm::core::PhiMatrix* r_wt) const;
+
+ private:
+  friend class SmoothSparsePhi;
+
+  const ::artm::core::PhiMatrix& p_wt_;
+  const ::artm::core::PhiMatrix& n_wt_;
+  bool same_tokens_;  // p_wt and n_wt have the same tokens in the same order
+
+  std::shared_ptr<artm::core::TransformFunction> transform_function_;
+  std::shared_ptr<artm::core::Dictionary> dictionary_;
+  std::vector<int> topics_to_regularize_;
+  core::ClassIdSet class_ids_;  // empty == all
+  float tau_;
+};
+
 class SmoothSparsePhi : public RegularizerInterface {
  public:
   explicit SmoothSparsePhi(const SmoothSparsePhiConfig& config);
@@ -42,6 +71,11 @@ class SmoothSparsePhi : public RegularizerInterface {
                              ::artm::core::PhiMatrix* r_wt,
                              const float* tau);
 
+  virtual std::shared_ptr<RegularizePhiAgent>
+  CreateRegularizePhiAgent(const ::artm::core::PhiMatrix& p_wt,
+                           const ::artm::core::PhiMatrix& n_wt,
+                           const float* tau);
+
   virtual google::protobuf::RepeatedPtrField<std::string> topics_to_regularize();
   virtual google::protobuf::RepeatedPtrField<std::string> class_ids_to_regularize();
 
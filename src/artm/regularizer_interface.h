@@ -48,6 +48,20 @@ class RegularizePtdwAgent {
   virtual void Apply(int item_index, int inner_iter, ::artm::utility::LocalPhiMatrix<float>* ptdw) const = 0;
 };
 
+// RegularizePhiAgent calculates phi regularizer for a range of tokens.
+// The agent is created once per regularization of the model (see RegularizerInterface::CreateRegularizePhiAgent),
+// and then PhiMatrixOperations::InvokePhiRegularizers calls Apply concurrently from several threads,
+// each time with a different range of tokens. Therefore Apply must follow these rules:
+//    - add values only to rows [token_begin, token_end) of r_wt (token ids are given in terms of n_wt);
+//    - never modify the state of the agent, of the regularizer, or of any shared object.
+// Any preparation that looks at the whole matrix (for example, sums over all tokens)
+// should be done when the agent is created.
+class RegularizePhiAgent {
+ public:
+  virtual ~RegularizePhiAgent() { }
+  virtual void Apply(int token_begin, int token_end, ::artm::core::PhiMatrix* r_wt) const = 0;
+};
+
 // RegularizerInterface is the base class for all regularizers in BigARTM.
 // See any class in 'src/regularizer' folder for an example of how to implement new regularizer.
 // Keep in mind that scres can be applied to either theta matrix, ptdw matrix or phi matrix.
@@ -85,6 +99,17 @@ class RegularizerInterface {
                              ::artm::core::PhiMatrix* r_wt,
                              const float* tau = nullptr) { return false; }
 
+  // Token-parallel alternative to RegularizePhi. The same rules apply to p_wt, n_wt and tau.
+  // Return nullptr if the regularizer does not support parallel execution
+  // (or has nothing to do); then RegularizePhi is called on a single thread.
+  // p_wt and n_wt are guarantied to outlive the agent.
+  virtual std::shared_ptr<RegularizePhiAgent>
+  CreateRegularizePhiAgent(const ::artm::core::PhiMatrix& p_wt,
+                           const ::artm::core::PhiMatrix& n_wt,
+                           const float* tau = nullptr) {
+    return nullptr;
+  }
+
   virtual google::protobuf::RepeatedPtrField<std::string> topics_to_regularize() {
     return google::protobuf::RepeatedPtrField<std::string>();
   }
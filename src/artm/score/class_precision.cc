@@ -18,7 +18,7 @@ void ClassPrecision::AppendScore(
     const std::vector<artm::core::Token>& token_dict,
     const artm::core::PhiMatrix& p_wt,
     const artm::ProcessBatchesArgs& args,
-    const std::vector<float>& theta,
+    const float* theta,
     Score* score) {
   if (!args.has_predict_class_id()) {
     return;
@@ -43,7 +43,7 @@ class ClassPrecision : public ScoreCalculatorInterface {
       const std::vector<artm::core::Token>& token_dict,
       const artm::core::PhiMatrix& p_wt,
       const artm::ProcessBatchesArgs& args,
-      const std::vector<float>& theta,
+      const float* theta,
       Score* score);
 
   virtual ScoreType score_type() const { return ::artm::ScoreType_ClassPrecision; }
@@ -8,6 +8,7 @@
 #include <algorithm>
 #include <sstream>
 
+#include "artm/core/class_id_registry.h"
 #include "artm/core/exceptions.h"
 #include "artm/core/helpers.h"
 #include "artm/core/protobuf_helpers.h"
@@ -33,7 +34,30 @@ void Perplexity::AppendScore(
   const std::vector<artm::core::Token>& token_dict,
   const artm::core::PhiMatrix& p_wt,
   const artm::ProcessBatchesArgs& args,
-  const std::vector<float>& theta,
+  const float* theta,
+  Score* score) {
+  const Item* item_ptr = &item;
+  AppendItems(&item_ptr, 1, batch, token_dict, p_wt, args, theta, score);
+}
+
+void Perplexity::AppendScore(
+  const Batch& batch,
+  const std::vector<artm::core::Token>& token_dict,
+  const artm::core::PhiMatrix& p_wt,
+  const artm::ProcessBatchesArgs& args,
+  const float* theta,
+  Score* score) {
+  AppendItems(batch.item().data(), batch.item_size(), batch, token_dict, p_wt, args, theta, score);
+}
+
+void Perplexity::AppendItems(
+  const Item* const* items,
+  int items_size,
+  const Batch& batch,
+  const std::vector<artm::core::Token>& token_dict,
+  const artm::core::PhiMatrix& p_wt,
+  const artm::ProcessBatchesArgs& args,
+  const float* theta,
   Score* score) {
   const int topic_size = p_wt.topic_size();
 
@@ -56,21 +80,15 @@ void Perplexity::AppendScore(
     }
   }
 
-  // fields of proto messages for all classes
-  std::unordered_map<::artm::core::TransactionTypeName, float> transaction_weight_map;
-  std::unordered_map<::artm::core::TransactionTypeName, double> normalizer_map;
-  std::unordered_map<::artm::core::TransactionTypeName, double> raw_map;
-  std::unordered_map<::artm::core::TransactionTypeName, ::google::protobuf::int64> zero_words_map;
-
-  double normalizer = 0.0;
-  double raw = 0.0;
-  ::google::protobuf::int64 zero_words = 0;
-
+  // Transaction typenames are numbered once per call, and the values of all items are accumulated
+  // in the arrays below; without transaction typenames all transactions go to the single slot.
+  std::vector<::artm::core::TransactionTypeName> tt_names;
+  std::vector<float> tt_weights;
   auto func = [&](const artm::core::TransactionTypeName& name, float value) {  // NOLINT
-    transaction_weight_map.emplace(name, value);
-    normalizer_map.emplace(name, 0.0);
-    raw_map.emplace(name, 0.0);
-    zero_words_map.emplace(name, 0);
+    if (std::find(tt_names.begin(), tt_names.end(), name) == tt_names.end()) {
+      tt_names.push_back(name);
+      tt_weights.push_back(value);
+    }
   };
 
   if (config_.transaction_typename_size() == 0) {
@@ -87,173 +105,192 @@ void Perplexity::AppendScore(
         }
       }
     }
-    if (transaction_weight_map.empty()) {
+    if (tt_names.empty()) {
       LOG_FIRST_N(ERROR, 100) << "None of requested transaction typenames are presented in model."
                               << " Score calculation will be skipped";
       return;
     }
   }
 
-  const bool use_tt = !transaction_weight_map.empty();
+  const bool use_tt = !tt_names.empty();
+  const int requested_tt_size = static_cast<int>(tt_names.size());
+
+  // slot of each transaction typename of the batch; typenames that were not requested get zero weight
+  std::vector<int> batch_tt_slot(batch.transaction_typename_size(), 0);
+  if (use_tt) {
+    for (int i = 0; i < batch.transaction_typename_size(); ++i) {
+      const auto& name = batch.transaction_typename(i);
+      auto iter = std::find(tt_names.begin(), tt_names.end(), name);
+      batch_tt_slot[i] = static_cast<int>(iter - tt_names.begin());
+      if (iter == tt_names.end()) {
+        tt_names.push_back(name);
+        tt_weights.push_back(0.0f);
+      }
+    }
+  }
+
+  const int slot_size = use_tt ? static_cast<int>(tt_names.size()) : 1;
+  auto tt_slot = [&](const Item& item, int t_index) {  // NOLINT
+    return use_tt ? batch_tt_slot[item.transaction_typename_id(t_index)] : 0;
+  };
 
-  std::unordered_map<artm::core::ClassId, float> class_id_to_weight;
+  core::ClassWeights class_weights;
   if (config_.class_id_size() == 0) {
     for (int i = 0; (i < args.class_id_size()) && (i < args.class_weight_size()); ++i) {
-      class_id_to_weight.emplace(args.class_id(i), args.class_weight(i));
+      class_weights.Add(args.class_id(i), args.class_weight(i));
     }
   } else {
     for (const auto& class_id : config_.class_id()) {
       for (int i = 0; (i < args.class_id_size()) && (i < args.class_weight_size()); ++i) {
         if (class_id == args.class_id(i)) {
-          class_id_to_weight.emplace(args.class_id(i), args.class_weight(i));
+          class_weights.Add(args.class_id(i), args.class_weight(i));
           break;
         }
       }
     }
-    if (class_id_to_weight.empty()) {
+    if (class_weights.use_all_classes()) {
       LOG_FIRST_N(ERROR, 100) << "None of requested class ids are presented in model."
         << " Score calculation will be skipped";
       return;
     }
   }
 
-  bool use_class_weight = !class_id_to_weight.empty();
+  // weight of each token of the batch, and its index in p_wt (found on first use)
+  const int kUnknownIndex = -2;
+  std::vector<float> token_class_weight;
+  if (!class_weights.use_all_classes()) {
+    token_class_weight = class_weights.token_weights(batch);
+  }
+  std::vector<int> p_wt_token_index(batch.token_size(), kUnknownIndex);
 
-  auto t_func = [&](int s_idx, int e_idx) -> float {  // NOLINT
+  auto t_func = [&](const Item& item, int s_idx, int e_idx) -> float {  // NOLINT
     float transaction_weight = 0.0f;
     for (int idx = s_idx; idx < e_idx; ++idx) {
       const int token_id = item.token_id(idx);
       const float token_weight = item.token_weight(idx);
-
-      float class_weight = 1.0f;
-      if (use_class_weight) {
-        artm::core::ClassId class_id = batch.class_id(token_id);
-        auto iter = class_id_to_weight.find(class_id);
-        class_weight = (iter == class_id_to_weight.end()) ? 0.0f : iter->second;
-      }
-
+      const float class_weight = token_class_weight.empty() ? 1.0f : token_class_weight[token_id];
       transaction_weight += (token_weight * class_weight);
     }
     return transaction_weight;
   };
 
-  // count perplexity normalizer n_d
-  for (int t_index = 0; t_index < item.transaction_start_index_size() - 1; ++t_index) {
-    const int start_index = item.transaction_start_index(t_index);
-    const int end_index = item.transaction_start_index(t_index + 1);
-
-    float transaction_weight = t_func(start_index, end_index);
-    if (use_tt) {
-      float tt_weight = 0.0f;
-      const auto& tt_name = batch.transaction_typename(item.transaction_typename_id(t_index));
-      auto iter = transaction_weight_map.find(tt_name);
-      if (iter != transaction_weight_map.end()) {
-        tt_weight = iter->second;
-      }
-      normalizer_map[tt_name] += tt_weight * transaction_weight;
-    } else {
-      normalizer += transaction_weight;
+  std::vector<double> normalizer(slot_size, 0.0);
+  std::vector<double> raw(slot_size, 0.0);
+  std::vector< ::google::protobuf::int64> zero_words(slot_size, 0);
+  std::vector<double> item_normalizer(slot_size, 0.0);
+  std::vector<float> helper_vector(topic_size, 0.0f);
+  std::vector<float> phi_values(topic_size, 1.0f);
+
+  for (int item_index = 0; item_index < items_size; ++item_index) {
+    const Item& item = *items[item_index];
+    const float* item_theta = theta + static_cast<int64_t>(item_index) * topic_size;
+
+    // count perplexity normalizer n_d
+    item_normalizer.assign(slot_size, 0.0);
+    for (int t_index = 0; t_index < item.transaction_start_index_size() - 1; ++t_index) {
+      const int start_index = item.transaction_start_index(t_index);
+      const int end_index = item.transaction_start_index(t_index + 1);
+
+      const int slot = tt_slot(item, t_index);
+      const float tt_weight = use_tt ? tt_weights[slot] : 1.0f;
+      item_normalizer[slot] += tt_weight * t_func(item, start_index, end_index);
     }
-  }
 
-  // count raw values
-  std::vector<float> helper_vector(topic_size, 0.0f);
-  for (int t_index = 0; t_index < item.transaction_start_index_size() - 1; ++t_index) {
-    const int start_index = item.transaction_start_index(t_index);
-    const int end_index = item.transaction_start_index(t_index + 1);
-
-    double sum = 0.0;
-    const auto& tt_name = batch.transaction_typename(item.transaction_typename_id(t_index));
-    float transaction_weight = t_func(start_index, end_index);
-
-    float tt_weight = 1.0f;
-    if (use_tt) {
-      auto iter = transaction_weight_map.find(tt_name);
-      if (iter == transaction_weight_map.end()) {
+    // count raw values
+    for (int t_index = 0; t_index < item.transaction_start_index_size() - 1; ++t_index) {
+      const int start_index = item.transaction_start_index(t_index);
+      const int end_index = item.transaction_start_index(t_index + 1);
+
+      double sum = 0.0;
+      const int slot = tt_slot(item, t_index);
+      if (slot >= requested_tt_size && use_tt) {
         continue;
       }
-      tt_weight = iter->second;
-    }
 
-    if (core::isZero(transaction_weight)) {
-      continue;
-    }
+      float transaction_weight = t_func(item, start_index, end_index);
+      if (core::isZero(transaction_weight)) {
+        continue;
+      }
 
-    std::vector<float> phi_values(topic_size, 1.0f);
-    for (int token_id = start_index; token_id < end_index; ++token_id) {
-      const auto& temp_token = token_dict[item.token_id(token_id)];
-      const auto token = artm::core::Token(temp_token.class_id, temp_token.keyword);
+      phi_values.assign(topic_size, 1.0f);
+      for (int token_id = start_index; token_id < end_index; ++token_id) {
+        const int batch_token_id = item.token_id(token_id);
+        int& p_wt_token_id = p_wt_token_index[batch_token_id];
+        if (p_wt_token_id == kUnknownIndex) {
+          p_wt_token_id = p_wt.token_index(token_dict[batch_token_id]);
+        }
 
-      int p_wt_token_index = p_wt.token_index(token);
-      if (p_wt_token_index == ::artm::core::PhiMatrix::kUndefIndex) {
-        // ignore tokens that doe not belong to the model
-        continue;
+        if (p_wt_token_id == ::artm::core::PhiMatrix::kUndefIndex) {
+          // ignore tokens that doe not belong to the model
+          continue;
+        }
+
+        p_wt.get(p_wt_token_id, &helper_vector);
+        for (int topic_index = 0; topic_index < topic_size; topic_index++) {
+          phi_values[topic_index] *= helper_vector[topic_index];
+        }
       }
 
-      p_wt.get(p_wt_token_index, &helper_vector);
       for (int topic_index = 0; topic_index < topic_size; topic_index++) {
-        phi_values[topic_index] *= helper_vector[topic_index];
+        sum += item_theta[topic_index] * phi_values[topic_index];
       }
-    }
-
-    for (int topic_index = 0; topic_index < topic_size; topic_index++) {
-      sum += theta[topic_index] * phi_values[topic_index];
-    }
 
-    if (core::isZero(sum)) {
-      if (use_document_unigram_model) {
-        sum = transaction_weight / (use_tt ? normalizer_map[tt_name] : normalizer);
-      } else {
-        sum = 1.0;
-        bool failed = true;
-        const artm::core::Token* err_token;
-        for (int token_id = start_index; token_id < end_index; ++token_id) {
-          const auto& temp_token = token_dict[item.token_id(token_id)];
-          const auto token = artm::core::Token(temp_token.class_id, temp_token.keyword);
-
-          auto entry_ptr = dictionary_ptr->entry(token);
-          if (entry_ptr != nullptr && entry_ptr->token_value()) {
-            sum *= entry_ptr->token_value();
-          } else {
-            err_token = &token;
-            break;
-          }
-          if (token_id == end_index - 1) {
-            failed = false;
+      if (core::isZero(sum)) {
+        if (use_document_unigram_model) {
+          sum = transaction_weight / item_normalizer[slot];
+        } else {
+          sum = 1.0;
+          bool failed = true;
+          const artm::core::Token* err_token = nullptr;
+          for (int token_id = start_index; token_id < end_index; ++token_id) {
+            const auto& token = token_dict[item.token_id(token_id)];
+            auto entry_ptr = dictionary_ptr->entry(token);
+            if (entry_ptr != nullptr && entry_ptr->token_value()) {
+              sum *= entry_ptr->token_value();
+            } else {
+              err_token = &token;
+              break;
+            }
+            if (token_id == end_index - 1) {
+              failed = false;
+            }
           }
-        }
 
-        if (failed) {
-          LOG_FIRST_N(WARNING, 100)
-            << "Error in perplexity dictionary for token " << err_token->keyword << ", class " << err_token->class_id
-            << " (and potentially for other tokens)"
-            << ". Verify that the token exists in the dictionary and it's value > 0. "
-            << "Document unigram model will be used for this token "
-            << "(and for all other tokens under the same conditions).";
-          sum = transaction_weight / (use_tt ? normalizer_map[tt_name] : normalizer);
+          if (failed) {
+            LOG_FIRST_N(WARNING, 100)
+              << "Error in perplexity dictionary for token " << err_token->keyword << ", class " << err_token->class_id
+              << " (and potentially for other tokens)"
+              << ". Verify that the token exists in the dictionary and it's value > 0. "
+              << "Document unigram model will be used for this token "
+              << "(and for all other tokens under the same conditions).";
+            sum = transaction_weight / item_normalizer[slot];
+          }
         }
+        ++zero_words[slot];
       }
-      // the presence of class_id in the maps here and below is guaranteed
-      ++(use_tt ? zero_words_map[tt_name] : zero_words);
+      raw[slot] += transaction_weight * log(sum);
+    }
+
+    for (int slot = 0; slot < slot_size; ++slot) {
+      normalizer[slot] += item_normalizer[slot];
     }
-    (use_tt ? raw_map[tt_name] : raw) += transaction_weight * log(sum);
   }
 
   // prepare results
   PerplexityScore perplexity_score;
   if (use_tt) {
-    for (auto iter = normalizer_map.begin(); iter != normalizer_map.end(); ++iter) {
+    for (int slot = 0; slot < slot_size; ++slot) {
       auto tt_info = perplexity_score.add_transaction_typename_info();
-      tt_info->set_transaction_typename(iter->first);
+      tt_info->set_transaction_typename(tt_names[slot]);
 
-      tt_info->set_normalizer(iter->second);
-      tt_info->set_raw(raw_map[iter->first]);
-      tt_info->set_zero_words(zero_words_map[iter->first]);
+      tt_info->set_normalizer(normalizer[slot]);
+      tt_info->set_raw(raw[slot]);
+      tt_info->set_zero_words(zero_words[slot]);
     }
   } else {
-    perplexity_score.set_normalizer(normalizer);
-    perplexity_score.set_raw(raw);
-    perplexity_score.set_zero_words(zero_words);
+    perplexity_score.set_normalizer(normalizer[0]);
+    perplexity_score.set_raw(raw[0]);
+    perplexity_score.set_zero_words(zero_words[0]);
   }
 
   AppendScore(perplexity_score, score);
@@ -40,12 +40,31 @@ class Perplexity : public ScoreCalculatorInterface {
       const std::vector<artm::core::Token>& token_dict,
       const artm::core::PhiMatrix& p_wt,
       const artm::ProcessBatchesArgs& args,
-      const std::vector<float>& theta,
+      const float* theta,
+      Score* score);
+
+  virtual void AppendScore(
+      const Batch& batch,
+      const std::vector<artm::core::Token>& token_dict,
+      const artm::core::PhiMatrix& p_wt,
+      const artm::ProcessBatchesArgs& args,
+      const float* theta,
       Score* score);
 
   virtual ScoreType score_type() const { return ::artm::ScoreType_Perplexity; }
 
  private:
+  // Accumulates the items in native form and appends them to the score at once
+  void AppendItems(
+      const Item* const* items,
+      int items_size,
+      const Batch& batch,
+      const std::vector<artm::core::Token>& token_dict,
+      const artm::core::PhiMatrix& p_wt,
+      const artm::ProcessBatchesArgs& args,
+      const float* theta,
+      Score* score);
+
   PerplexityScoreConfig config_;
 };
 
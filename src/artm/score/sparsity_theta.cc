@@ -18,8 +18,26 @@ void SparsityTheta::AppendScore(
     const std::vector<artm::core::Token>& token_dict,
     const artm::core::PhiMatrix& p_wt,
     const artm::ProcessBatchesArgs& args,
-    const std::vector<float>& theta,
+    const float* theta,
     Score* score) {
+  AppendItems(1, p_wt, theta, score);
+}
+
+void SparsityTheta::AppendScore(
+    const Batch& batch,
+    const std::vector<artm::core::Token>& token_dict,
+    const artm::core::PhiMatrix& p_wt,
+    const artm::ProcessBatchesArgs& args,
+    const float* theta,
+    Score* score) {
+  AppendItems(batch.item_size(), p_wt, theta, score);
+}
+
+void SparsityTheta::AppendItems(int items_size, const artm::core::PhiMatrix& p_wt, const float* theta, Score* score) {
+  if (items_size == 0) {
+    return;
+  }
+
   const int topic_size = p_wt.topic_size();
 
   std::vector<bool> topics_to_score;
@@ -32,16 +50,19 @@ void SparsityTheta::AppendScore(
   }
 
   ::google::protobuf::int64 zero_topics_count = 0;
-  for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
-    if ((fabs(theta[topic_index]) < config_.eps()) &&
-        topics_to_score[topic_index]) {
-      ++zero_topics_count;
+  for (int item_index = 0; item_index < items_size; ++item_index) {
+    const float* item_theta = theta + static_cast<int64_t>(item_index) * topic_size;
+    for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
+      if ((fabs(item_theta[topic_index]) < config_.eps()) &&
+          topics_to_score[topic_index]) {
+        ++zero_topics_count;
+      }
     }
   }
 
   SparsityThetaScore sparsity_theta_score;
   sparsity_theta_score.set_zero_topics(zero_topics_count);
-  sparsity_theta_score.set_total_topics(topics_to_score_size);
+  sparsity_theta_score.set_total_topics(topics_to_score_size * items_size);
   AppendScore(sparsity_theta_score, score);
 }
 
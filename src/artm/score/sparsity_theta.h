@@ -38,12 +38,22 @@ class SparsityTheta : public ScoreCalculatorInterface {
       const std::vector<artm::core::Token>& token_dict,
       const artm::core::PhiMatrix& p_wt,
       const artm::ProcessBatchesArgs& args,
-      const std::vector<float>& theta,
+      const float* theta,
+      Score* score);
+
+  virtual void AppendScore(
+      const Batch& batch,
+      const std::vector<artm::core::Token>& token_dict,
+      const artm::core::PhiMatrix& p_wt,
+      const artm::ProcessBatchesArgs& args,
+      const float* theta,
       Score* score);
 
   virtual ScoreType score_type() const { return ::artm::ScoreType_SparsityTheta; }
 
  private:
+  void AppendItems(int items_size, const artm::core::PhiMatrix& p_wt, const float* theta, Score* score);
+
   SparsityThetaScoreConfig config_;
 };
 
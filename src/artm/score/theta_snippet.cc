@@ -16,7 +16,7 @@ void ThetaSnippet::AppendScore(
     const std::vector<artm::core::Token>& token_dict,
     const artm::core::PhiMatrix& p_wt,
     const artm::ProcessBatchesArgs& args,
-    const std::vector<float>& theta,
+    const float* theta,
     Score* score) {
   const int topic_size = p_wt.topic_size();
 
@@ -3,6 +3,7 @@
 // Author: Murat Apishev (great-mel@yandex.ru)
 
 #include "artm/core/exceptions.h"
+#include "artm/core/class_id_registry.h"
 #include "artm/core/protobuf_helpers.h"
 
 #include "artm/score/topic_mass_phi.h"
@@ -24,10 +25,7 @@ std::shared_ptr<Score> TopicMassPhi::CalculateScore(const artm::core::PhiMatrix&
     topics_to_score_size = config_.topic_name_size();
   }
 
-  bool use_all_classes = false;
-  if (config_.class_id_size() == 0) {
-    use_all_classes = true;
-  }
+  const core::ClassIdSet class_ids(config_.class_id());  // empty == all
 
   std::vector<float> topic_mass;
   topic_mass.assign(topics_to_score_size, 0.0f);
@@ -35,8 +33,7 @@ std::shared_ptr<Score> TopicMassPhi::CalculateScore(const artm::core::PhiMatrix&
   double numerator = 0.0;
 
   for (int token_index = 0; token_index < token_size; token_index++) {
-    const auto& token = p_wt.token(token_index);
-    if ((!use_all_classes && !core::is_member(token.class_id, config_.class_id()))) {
+    if (!class_ids.contains(p_wt.class_index(token_index))) {
       continue;
     }
 
@@ -16,6 +16,19 @@ std::shared_ptr<const ::artm::core::PhiMatrix> ScoreCalculatorInterface::GetPhiM
   return instance_->GetPhiMatrixSafe(model_name);
 }
 
+void ScoreCalculatorInterface::AppendScore(const Batch& batch,
+                                           const std::vector<artm::core::Token>& token_dict,
+                                           const artm::core::PhiMatrix& p_wt,
+                                           const artm::ProcessBatchesArgs& args,
+                                           const float* theta,
+                                           Score* score) {
+  const int topic_size = p_wt.topic_size();
+  for (int item_index = 0; item_index < batch.item_size(); ++item_index) {
+    const float* item_theta = theta + static_cast<int64_t>(item_index) * topic_size;
+    AppendScore(batch.item(item_index), batch, token_dict, p_wt, args, item_theta, score);
+  }
+}
+
 std::shared_ptr<Score> ScoreCalculatorInterface::CalculateScore() {
   auto phi_matrix = GetPhiMatrix(model_name());
   return CalculateScore(*phi_matrix);
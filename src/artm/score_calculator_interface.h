@@ -50,15 +50,27 @@ class ScoreCalculatorInterface {
 
   virtual void AppendScore(const Score& score, Score* target) { return; }
 
+  // theta points to topic_size weights of the item
   virtual void AppendScore(
       const Item& item,
       const Batch& batch,
       const std::vector<artm::core::Token>& token_dict_,
       const artm::core::PhiMatrix& p_wt,
       const artm::ProcessBatchesArgs& args,
-      const std::vector<float>& theta,
+      const float* theta,
       Score* score) { }
 
+  // Appends all items of the batch; theta points to item_size columns of topic_size weights.
+  // The default implementation calls AppendScore for each item. Scores may override it
+  // to prepare their settings once per batch and to append a single partial score.
+  virtual void AppendScore(
+      const Batch& batch,
+      const std::vector<artm::core::Token>& token_dict,
+      const artm::core::PhiMatrix& p_wt,
+      const artm::ProcessBatchesArgs& args,
+      const float* theta,
+      Score* score);
+
   virtual void AppendScore(
       const Batch& batch,
       const artm::core::PhiMatrix& p_wt,
@@ -4,10 +4,19 @@
 
 #include <boost/filesystem.hpp>
 
+#if defined(_WIN32)
+#include <windows.h>  // NOLINT
+#undef ERROR
+#else
+#include <dlfcn.h>
+#endif
+
 #include <algorithm>
 #include <cstdlib>
+#include <map>
 #include <memory>
 #include <mutex>  // NOLINT
+#include <string>
 #include <tuple>
 #include <vector>
 #include <utility>
@@ -123,6 +132,63 @@ class BuiltinBlas : public Blas {
   virtual bool is_loaded() { return true; }
 };
 
+// ExternalBlas loads CBLAS interface from a shared library.
+// Blas::RowMajor, Blas::Trans, etc. match the values of CBLAS enums,
+// so the function pointers are assigned directly to cblas_* functions.
+// CBLAS has no csr2csc routine, so scsr2csc is always the builtin one.
+class ExternalBlas : public Blas {
+ public:
+  explicit ExternalBlas(const std::string& library_name) : handle_(nullptr) {
+#if defined(_WIN32)
+    handle_ = LoadLibraryA(library_name.c_str());
+#else
+    handle_ = dlopen(library_name.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+    if (handle_ == nullptr) {
+      LOG(WARNING) << "Unable to load BLAS library " << library_name;
+      return;
+    }
+
+    sgemm = reinterpret_cast<blas_sgemm_type*>(symbol("cblas_sgemm"));
+    sdot = reinterpret_cast<blas_sdot_type*>(symbol("cblas_sdot"));
+    saxpy = reinterpret_cast<blas_saxpy_type*>(symbol("cblas_saxpy"));
+    scsr2csc = builtin_scsr2csc;
+
+    if (sgemm == nullptr || sdot == nullptr || saxpy == nullptr) {
+      LOG(WARNING) << "Library " << library_name << " does not provide CBLAS interface";
+      close();
+      return;
+    }
+
+    LOG(INFO) << "BLAS library " << library_name << " is loaded";
+  }
+
+  virtual ~ExternalBlas() { close(); }
+  virtual bool is_loaded() { return handle_ != nullptr; }
+
+ private:
+  void* symbol(const char* name) {
+#if defined(_WIN32)
+    return reinterpret_cast<void*>(GetProcAddress(static_cast<HMODULE>(handle_), name));
+#else
+    return dlsym(handle_, name);
+#endif
+  }
+
+  void close() {
+    if (handle_ != nullptr) {
+#if defined(_WIN32)
+      FreeLibrary(static_cast<HMODULE>(handle_));
+#else
+      dlclose(handle_);
+#endif
+      handle_ = nullptr;
+    }
+  }
+
+  void* handle_;
+};
+
 }  // namespace
 
 
@@ -131,5 +197,34 @@ Blas* Blas::builtin() {
   return &impl;
 }
 
+Blas* Blas::load(const std::string& library_name) {
+  std::string name = library_name;
+  if (name.empty()) {
+    const char* env = getenv("ARTM_BLAS_LIBRARY");
+    if (env != nullptr) {
+      name = env;
+    }
+  }
+
+  if (name.empty()) {
+    return builtin();
+  }
+
+  static std::mutex lock;
+  static std::map<std::string, std::shared_ptr<ExternalBlas>> libraries;
+
+  std::lock_guard<std::mutex> guard(lock);
+  std::shared_ptr<ExternalBlas>& library = libraries[name];
+  if (library == nullptr) {
+    library = std::make_shared<ExternalBlas>(name);
+    if (!library->is_loaded()) {
+      // Logged once per library name, as load() is called by every processor
+      LOG(ERROR) << "BLAS library " << name << " is not loaded, falling back to the builtin implementation";
+    }
+  }
+
+  return library->is_loaded() ? static_cast<Blas*>(library.get()) : builtin();
+}
+
 }  // namespace utility
 }  // namespace artm
@@ -4,6 +4,7 @@
 
 #include <assert.h>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "boost/exception/diagnostic_information.hpp"
@@ -58,6 +59,12 @@ class Blas {
 
   static Blas* builtin();
 
+  // Loads CBLAS routines (cblas_sgemm, cblas_sdot, cblas_saxpy) from a shared library at runtime,
+  // e.g. libopenblas.so.0, libblis.so or mkl_rt.dll. If library_name is empty then the library
+  // is taken from ARTM_BLAS_LIBRARY environment variable. Libraries are loaded once and cached.
+  // Falls back to builtin() when no library is configured, or when it fails to load (which is logged).
+  static Blas* load(const std::string& library_name);
+
  protected:
   Blas() { }  // Singleton (make constructor private)
 };
@@ -192,6 +199,7 @@ class CsrMatrix {
     val_.resize(nnz);
     col_ind_.resize(nnz);
     row_ptr_.resize(m + 1);
+    UseOwnData();
   }
 
   explicit CsrMatrix(int n, std::vector<T>* val, std::vector<int>* row_ptr, std::vector<int>* col_ind) {
@@ -202,35 +210,77 @@ class CsrMatrix {
     val_.swap(*val);
     row_ptr_.swap(*row_ptr);
     col_ind_.swap(*col_ind);
+    UseOwnData();
+  }
+
+  // Creates a read-only view of external arrays (for example, of a memory-mapped batch).
+  // The arrays must outlive the matrix. Non-const accessors copy the arrays into the matrix on first use.
+  CsrMatrix(int m, int n, int nnz, const T* val, const int* row_ptr, const int* col_ind)
+      : m_(m), n_(n), nnz_(nnz), val_ptr_(val), row_ptr_ptr_(row_ptr), col_ind_ptr_(col_ind) {
+    assert(val != nullptr && row_ptr != nullptr && col_ind != nullptr);
   }
 
+  CsrMatrix(const CsrMatrix<T>& rhs)
+      : m_(rhs.m_), n_(rhs.n_), nnz_(rhs.nnz_),
+        val_(rhs.val_ptr_, rhs.val_ptr_ + rhs.nnz_),
+        row_ptr_(rhs.row_ptr_ptr_, rhs.row_ptr_ptr_ + rhs.m_ + 1),
+        col_ind_(rhs.col_ind_ptr_, rhs.col_ind_ptr_ + rhs.nnz_) {
+    UseOwnData();
+  }
+
+  CsrMatrix<T>& operator=(const CsrMatrix<T>& rhs) = delete;
+
   void Transpose(artm::utility::Blas* blas) {
     std::vector<int> row_ptr_new_(n_ + 1);
     blas->scsr2csc(m_, n_, nnz_, val(), row_ptr(), col_ind(), val(), col_ind(), &row_ptr_new_[0]);
     int tmp = m_; m_ = n_; n_ = tmp;  // swat(m, n)
     row_ptr_.swap(row_ptr_new_);
+    UseOwnData();
   }
 
-  T* val() { return &val_[0]; }
-  const T* val() const { return &val_[0]; }
+  T* val() { Detach(); return &val_[0]; }
+  const T* val() const { return val_ptr_; }
 
-  int* row_ptr() { return &row_ptr_[0]; }
-  const int* row_ptr() const { return &row_ptr_[0]; }
+  int* row_ptr() { Detach(); return &row_ptr_[0]; }
+  const int* row_ptr() const { return row_ptr_ptr_; }
 
-  int* col_ind() { return &col_ind_[0]; }
-  const int* col_ind() const { return &col_ind_[0]; }
+  int* col_ind() { Detach(); return &col_ind_[0]; }
+  const int* col_ind() const { return col_ind_ptr_; }
 
   int m() const { return m_; }
   int n() const { return n_; }
   int nnz() const { return nnz_; }
 
+  // Returns true if the matrix does not own its data (see the constructor for external arrays)
+  bool is_view() const { return row_ptr_.empty(); }
+
  private:
+  void UseOwnData() {
+    val_ptr_ = val_.data();
+    row_ptr_ptr_ = row_ptr_.data();
+    col_ind_ptr_ = col_ind_.data();
+  }
+
+  void Detach() {
+    if (!is_view()) {
+      return;
+    }
+
+    val_.assign(val_ptr_, val_ptr_ + nnz_);
+    row_ptr_.assign(row_ptr_ptr_, row_ptr_ptr_ + m_ + 1);
+    col_ind_.assign(col_ind_ptr_, col_ind_ptr_ + nnz_);
+    UseOwnData();
+  }
+
   int m_;
   int n_;
   int nnz_;
   std::vector<T> val_;
   std::vector<int> row_ptr_;
   std::vector<int> col_ind_;
+  const T* val_ptr_;
+  const int* row_ptr_ptr_;
+  const int* col_ind_ptr_;
 };
 
 template<typename T>
@@ -0,0 +1,381 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#include "artm/utility/simd_kernels.h"
+
+#include <atomic>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ARTM_SIMD_X86
+#define ARTM_TARGET_AVX2 __attribute__((target("avx2")))
+#define ARTM_TARGET_AVX512 __attribute__((target("avx512f")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define ARTM_SIMD_X86
+#define ARTM_TARGET_AVX2
+#define ARTM_TARGET_AVX512
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#define ARTM_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+// Fused multiply-add would change the rounding and break bit-exactness between the kernels
+// (GCC and Clang also get -ffp-contract=off for this file, see CMakeLists.txt).
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#endif
+
+namespace artm {
+namespace utility {
+
+namespace {
+
+const int kBlock = SimdKernels::kNumPartialSums;
+
+// Reduces 16 partial sums in the canonical order: s[j] += s[j + width] for width = 8, 4, 2, 1.
+float reduce_partial_sums(float* sum) {
+  for (int width = kBlock / 2; width > 0; width /= 2) {
+    for (int j = 0; j < width; ++j) {
+      sum[j] += sum[j + width];
+    }
+  }
+  return sum[0];
+}
+
+// Copies x[begin..end) and y[begin..end) into zero-padded buffers of kBlock elements.
+inline void copy_tail(int begin, int end, const float* x, const float* y, float* x_tail, float* y_tail) {
+  for (int k = begin; k < end; ++k) {
+    x_tail[k - begin] = x[k];
+    y_tail[k - begin] = y[k];
+  }
+}
+
+// =======================================================
+// Scalar kernels
+// =======================================================
+
+float scalar_sdot(int size, const float* x, const float* y) {
+  float sum[kBlock] = { 0.0f };
+  for (int k = 0; k < size; ++k) {
+    sum[k & (kBlock - 1)] += x[k] * y[k];
+  }
+  return reduce_partial_sums(sum);
+}
+
+float scalar_sdoti(int size, const float* x, const int* indx, const float* y) {
+  float sum[kBlock] = { 0.0f };
+  for (int k = 0; k < size; ++k) {
+    sum[indx[k] & (kBlock - 1)] += x[k] * y[indx[k]];
+  }
+  return reduce_partial_sums(sum);
+}
+
+void scalar_saxpy(int size, float alpha, const float* x, float* y) {
+  for (int k = 0; k < size; ++k) {
+    y[k] += alpha * x[k];
+  }
+}
+
+void scalar_saxpyi(int size, float alpha, const float* x, const int* indx, float* y) {
+  for (int k = 0; k < size; ++k) {
+    y[indx[k]] += alpha * x[k];
+  }
+}
+
+// Sequential kernels are the loops that the E-step used before SimdKernels.
+// They accumulate into a single sum, so their results differ from other kernels in the last bits.
+float sequential_sdot(int size, const float* x, const float* y) {
+  float sum = 0.0f;
+  for (int k = 0; k < size; ++k) {
+    sum += x[k] * y[k];
+  }
+  return sum;
+}
+
+float sequential_sdoti(int size, const float* x, const int* indx, const float* y) {
+  float sum = 0.0f;
+  for (int k = 0; k < size; ++k) {
+    sum += x[k] * y[indx[k]];
+  }
+  return sum;
+}
+
+// =======================================================
+// AVX2 and AVX-512 kernels
+// =======================================================
+
+#if defined(ARTM_SIMD_X86)
+
+bool cpu_supports_avx2() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+  __cpuid(info, 1);
+  const bool has_osxsave = (info[2] & (1 << 27)) != 0;
+  const bool has_avx = (info[2] & (1 << 28)) != 0;
+  if (!has_osxsave || !has_avx || (_xgetbv(0) & 0x6) != 0x6) {
+    return false;
+  }
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool cpu_supports_avx512() {
+#if defined(_MSC_VER)
+  if (!cpu_supports_avx2() || (_xgetbv(0) & 0xe6) != 0xe6) {
+    return false;
+  }
+  int info[4];
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 16)) != 0;
+#else
+  return __builtin_cpu_supports("avx512f");
+#endif
+}
+
+// Reduces 16 partial sums, stored as lo = s[0..7] and hi = s[8..15], in the canonical order.
+ARTM_TARGET_AVX2 inline float avx2_reduce(__m256 lo, __m256 hi) {
+  __m256 sum8 = _mm256_add_ps(lo, hi);
+  __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+  __m128 sum2 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+  __m128 sum1 = _mm_add_ss(sum2, _mm_shuffle_ps(sum2, sum2, 1));
+  return _mm_cvtss_f32(sum1);
+}
+
+ARTM_TARGET_AVX2 float avx2_sdot(int size, const float* x, const float* y) {
+  __m256 lo = _mm256_setzero_ps();
+  __m256 hi = _mm256_setzero_ps();
+  const int blocked_size = size - size % kBlock;
+  for (int k = 0; k < blocked_size; k += kBlock) {
+    lo = _mm256_add_ps(lo, _mm256_mul_ps(_mm256_loadu_ps(x + k), _mm256_loadu_ps(y + k)));
+    hi = _mm256_add_ps(hi, _mm256_mul_ps(_mm256_loadu_ps(x + k + 8), _mm256_loadu_ps(y + k + 8)));
+  }
+
+  if (blocked_size < size) {
+    float x_tail[kBlock] = { 0.0f }, y_tail[kBlock] = { 0.0f };
+    copy_tail(blocked_size, size, x, y, x_tail, y_tail);
+    lo = _mm256_add_ps(lo, _mm256_mul_ps(_mm256_loadu_ps(x_tail), _mm256_loadu_ps(y_tail)));
+    hi = _mm256_add_ps(hi, _mm256_mul_ps(_mm256_loadu_ps(x_tail + 8), _mm256_loadu_ps(y_tail + 8)));
+  }
+
+  return avx2_reduce(lo, hi);
+}
+
+// Products are computed with vector gathers, but accumulated by scalar code,
+// because the partial sum is defined by the topic index indx[k], not by the position k.
+ARTM_TARGET_AVX2 float avx2_sdoti(int size, const float* x, const int* indx, const float* y) {
+  float sum[kBlock] = { 0.0f };
+  float products[8];
+  const int blocked_size = size - size % 8;
+  for (int k = 0; k < blocked_size; k += 8) {
+    __m256i indx_k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indx + k));
+    _mm256_storeu_ps(products, _mm256_mul_ps(_mm256_loadu_ps(x + k), _mm256_i32gather_ps(y, indx_k, 4)));
+    for (int j = 0; j < 8; ++j) {
+      sum[indx[k + j] & (kBlock - 1)] += products[j];
+    }
+  }
+
+  for (int k = blocked_size; k < size; ++k) {
+    sum[indx[k] & (kBlock - 1)] += x[k] * y[indx[k]];
+  }
+  return reduce_partial_sums(sum);
+}
+
+ARTM_TARGET_AVX2 void avx2_saxpy(int size, float alpha, const float* x, float* y) {
+  const __m256 a = _mm256_set1_ps(alpha);
+  const int blocked_size = size - size % 8;
+  for (int k = 0; k < blocked_size; k += 8) {
+    _mm256_storeu_ps(y + k, _mm256_add_ps(_mm256_loadu_ps(y + k), _mm256_mul_ps(a, _mm256_loadu_ps(x + k))));
+  }
+
+  for (int k = blocked_size; k < size; ++k) {
+    y[k] += alpha * x[k];
+  }
+}
+
+ARTM_TARGET_AVX512 float avx512_sdot(int size, const float* x, const float* y) {
+  __m512 sum = _mm512_setzero_ps();
+  const int blocked_size = size - size % kBlock;
+  for (int k = 0; k < blocked_size; k += kBlock) {
+    sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_loadu_ps(x + k), _mm512_loadu_ps(y + k)));
+  }
+
+  if (blocked_size < size) {
+    const __mmask16 mask = static_cast<__mmask16>((1 << (size - blocked_size)) - 1);
+    __m512 x_tail = _mm512_maskz_loadu_ps(mask, x + blocked_size);
+    __m512 y_tail = _mm512_maskz_loadu_ps(mask, y + blocked_size);
+    sum = _mm512_add_ps(sum, _mm512_mul_ps(x_tail, y_tail));
+  }
+
+  __m256 hi = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(sum), 1));
+  return avx2_reduce(_mm512_castps512_ps256(sum), hi);
+}
+
+ARTM_TARGET_AVX512 float avx512_sdoti(int size, const float* x, const int* indx, const float* y) {
+  float sum[kBlock] = { 0.0f };
+  float products[kBlock];
+  const int blocked_size = size - size % kBlock;
+  for (int k = 0; k < blocked_size; k += kBlock) {
+    __m512i indx_k = _mm512_loadu_si512(indx + k);
+    _mm512_storeu_ps(products, _mm512_mul_ps(_mm512_loadu_ps(x + k), _mm512_i32gather_ps(indx_k, y, 4)));
+    for (int j = 0; j < kBlock; ++j) {
+      sum[indx[k + j] & (kBlock - 1)] += products[j];
+    }
+  }
+
+  for (int k = blocked_size; k < size; ++k) {
+    sum[indx[k] & (kBlock - 1)] += x[k] * y[indx[k]];
+  }
+  return reduce_partial_sums(sum);
+}
+
+ARTM_TARGET_AVX512 void avx512_saxpy(int size, float alpha, const float* x, float* y) {
+  const __m512 a = _mm512_set1_ps(alpha);
+  const int blocked_size = size - size % kBlock;
+  for (int k = 0; k < blocked_size; k += kBlock) {
+    _mm512_storeu_ps(y + k, _mm512_add_ps(_mm512_loadu_ps(y + k), _mm512_mul_ps(a, _mm512_loadu_ps(x + k))));
+  }
+
+  for (int k = blocked_size; k < size; ++k) {
+    y[k] += alpha * x[k];
+  }
+}
+
+ARTM_TARGET_AVX512 void avx512_saxpyi(int size, float alpha, const float* x, const int* indx, float* y) {
+  const __m512 a = _mm512_set1_ps(alpha);
+  const int blocked_size = size - size % kBlock;
+  for (int k = 0; k < blocked_size; k += kBlock) {
+    __m512i indx_k = _mm512_loadu_si512(indx + k);
+    __m512 y_k = _mm512_i32gather_ps(indx_k, y, 4);
+    _mm512_i32scatter_ps(y, indx_k, _mm512_add_ps(y_k, _mm512_mul_ps(a, _mm512_loadu_ps(x + k))), 4);
+  }
+
+  for (int k = blocked_size; k < size; ++k) {
+    y[indx[k]] += alpha * x[k];
+  }
+}
+
+#endif  // ARTM_SIMD_X86
+
+// =======================================================
+// NEON kernels
+// =======================================================
+
+#if defined(ARTM_SIMD_NEON)
+
+// Reduces 16 partial sums, stored as four registers s[0..3], s[4..7], s[8..11], s[12..15].
+inline float neon_reduce(float32x4_t s0, float32x4_t s1, float32x4_t s2, float32x4_t s3) {
+  float32x4_t sum4 = vaddq_f32(vaddq_f32(s0, s2), vaddq_f32(s1, s3));
+  float32x2_t sum2 = vadd_f32(vget_low_f32(sum4), vget_high_f32(sum4));
+  return vget_lane_f32(sum2, 0) + vget_lane_f32(sum2, 1);
+}
+
+float neon_sdot(int size, const float* x, const float* y) {
+  float32x4_t s0 = vdupq_n_f32(0.0f), s1 = s0, s2 = s0, s3 = s0;
+  const int blocked_size = size - size % kBlock;
+  for (int k = 0; k < blocked_size; k += kBlock) {
+    s0 = vaddq_f32(s0, vmulq_f32(vld1q_f32(x + k), vld1q_f32(y + k)));
+    s1 = vaddq_f32(s1, vmulq_f32(vld1q_f32(x + k + 4), vld1q_f32(y + k + 4)));
+    s2 = vaddq_f32(s2, vmulq_f32(vld1q_f32(x + k + 8), vld1q_f32(y + k + 8)));
+    s3 = vaddq_f32(s3, vmulq_f32(vld1q_f32(x + k + 12), vld1q_f32(y + k + 12)));
+  }
+
+  if (blocked_size < size) {
+    float x_tail[kBlock] = { 0.0f }, y_tail[kBlock] = { 0.0f };
+    copy_tail(blocked_size, size, x, y, x_tail, y_tail);
+    s0 = vaddq_f32(s0, vmulq_f32(vld1q_f32(x_tail), vld1q_f32(y_tail)));
+    s1 = vaddq_f32(s1, vmulq_f32(vld1q_f32(x_tail + 4), vld1q_f32(y_tail + 4)));
+    s2 = vaddq_f32(s2, vmulq_f32(vld1q_f32(x_tail + 8), vld1q_f32(y_tail + 8)));
+    s3 = vaddq_f32(s3, vmulq_f32(vld1q_f32(x_tail + 12), vld1q_f32(y_tail + 12)));
+  }
+
+  return neon_reduce(s0, s1, s2, s3);
+}
+
+void neon_saxpy(int size, float alpha, const float* x, float* y) {
+  const float32x4_t a = vdupq_n_f32(alpha);
+  const int blocked_size = size - size % 4;
+  for (int k = 0; k < blocked_size; k += 4) {
+    vst1q_f32(y + k, vaddq_f32(vld1q_f32(y + k), vmulq_f32(a, vld1q_f32(x + k))));
+  }
+
+  for (int k = blocked_size; k < size; ++k) {
+    y[k] += alpha * x[k];
+  }
+}
+
+#endif  // ARTM_SIMD_NEON
+
+std::atomic<SimdKernels*>& preferred_kernels() {
+  static std::atomic<SimdKernels*> preferred(nullptr);
+  return preferred;
+}
+
+}  // namespace
+
+SimdKernels* SimdKernels::scalar() {
+  static SimdKernels impl("scalar", scalar_sdot, scalar_sdoti, scalar_saxpy, scalar_saxpyi);
+  return &impl;
+}
+
+SimdKernels* SimdKernels::sequential() {
+  static SimdKernels impl("sequential", sequential_sdot, sequential_sdoti, scalar_saxpy, scalar_saxpyi);
+  return &impl;
+}
+
+SimdKernels* SimdKernels::avx2() {
+#if defined(ARTM_SIMD_X86)
+  static const bool is_supported = cpu_supports_avx2();
+  static SimdKernels impl("avx2", avx2_sdot, avx2_sdoti, avx2_saxpy, scalar_saxpyi);
+  return is_supported ? &impl : nullptr;
+#else
+  return nullptr;
+#endif
+}
+
+SimdKernels* SimdKernels::avx512() {
+#if defined(ARTM_SIMD_X86)
+  static const bool is_supported = cpu_supports_avx512();
+  static SimdKernels impl("avx512", avx512_sdot, avx512_sdoti, avx512_saxpy, avx512_saxpyi);
+  return is_supported ? &impl : nullptr;
+#else
+  return nullptr;
+#endif
+}
+
+SimdKernels* SimdKernels::neon() {
+#if defined(ARTM_SIMD_NEON)
+  static SimdKernels impl("neon", neon_sdot, scalar_sdoti, neon_saxpy, scalar_saxpyi);
+  return &impl;
+#else
+  return nullptr;
+#endif
+}
+
+SimdKernels* SimdKernels::best() {
+  SimdKernels* preferred = preferred_kernels().load();
+  if (preferred != nullptr) {
+    return preferred;
+  }
+
+  static SimdKernels* detected = avx512() != nullptr ? avx512() :
+                                 avx2() != nullptr ? avx2() :
+                                 neon() != nullptr ? neon() : scalar();
+  return detected;
+}
+
+void SimdKernels::set_preferred(SimdKernels* kernels) {
+  preferred_kernels().store(kernels);
+}
+
+}  // namespace utility
+}  // namespace artm
@@ -0,0 +1,63 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#pragma once
+
+#include <string>
+
+#include "boost/utility.hpp"
+
+typedef float simd_sdot_type(int size, const float* x, const float* y);
+typedef float simd_sdoti_type(int size, const float* x, const int* indx, const float* y);
+typedef void simd_saxpy_type(int size, float alpha, const float* x, float* y);
+typedef void simd_saxpyi_type(int size, float alpha, const float* x, const int* indx, float* y);
+
+namespace artm {
+namespace utility {
+
+// SimdKernels class provides hand-vectorized versions of the level-1 operations
+// from the inner loop of the E-step (see ProcessorHelpers::InferThetaAndUpdateNwtSparse).
+// The naming follows sparse BLAS: sdoti and saxpyi take an array of indices into y.
+//
+// All implementations return bit-exact results. For this all dot products
+// accumulate into 16 partial sums (the product for topic t goes into the sum t % 16,
+// where t is k for sdot and indx[k] for sdoti), and then reduce the partial sums pairwise
+// in a fixed order. Multiplications and additions are never fused, so the scalar fallback
+// gives exactly the same floats as AVX2, AVX-512 or NEON kernels. Also, because skipping
+// a zero product never changes a partial sum, sdoti over the non-zero topics of a sparse row
+// gives exactly the same result as sdot over the full dense row.
+// The only exception is sequential(), kept to measure how far the kernels are from the old loops.
+class SimdKernels : boost::noncopyable {
+ public:
+  simd_sdot_type* sdot;      // sum_k x[k] * y[k]
+  simd_sdoti_type* sdoti;    // sum_k x[k] * y[indx[k]]
+  simd_saxpy_type* saxpy;    // y[k] += alpha * x[k]
+  simd_saxpyi_type* saxpyi;  // y[indx[k]] += alpha * x[k], indices must be unique
+
+  const std::string& name() const { return name_; }
+
+  static const int kNumPartialSums = 16;
+
+  static SimdKernels* scalar();
+  static SimdKernels* sequential();  // the loops used before SimdKernels, not bit-exact with others
+  static SimdKernels* avx2();    // nullptr if not supported by the CPU or by the compiler
+  static SimdKernels* avx512();  // nullptr if not supported by the CPU or by the compiler
+  static SimdKernels* neon();    // nullptr if not supported by the CPU or by the compiler
+
+  // Returns the fastest kernels supported by the CPU (detected once via CPUID),
+  // unless a specific implementation was forced by set_preferred.
+  static SimdKernels* best();
+
+  // Forces best() to return given kernels; nullptr restores the runtime dispatch.
+  // Intended for tests and benchmarks.
+  static void set_preferred(SimdKernels* kernels);
+
+ private:
+  SimdKernels(const std::string& name, simd_sdot_type* sdot, simd_sdoti_type* sdoti,
+              simd_saxpy_type* saxpy, simd_saxpyi_type* saxpyi)
+      : sdot(sdot), sdoti(sdoti), saxpy(saxpy), saxpyi(saxpyi), name_(name) { }
+
+  std::string name_;
+};
+
+}  // namespace utility
+}  // namespace artm
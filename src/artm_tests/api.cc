@@ -35,9 +35,9 @@ int ArtmExecute(int master_id, const ArgsT& args, FuncT func) {
   return HandleErrorCode(func(master_id, blob.size(), StringAsArray(&blob)));
 }
 
-template<typename ResultT, typename ArgsT, typename FuncT>
-ResultT ArtmRequest(int master_id, const ArgsT& args, FuncT func) {
-  int length = ArtmExecute(master_id, args, func);
+template<typename ResultT>
+ResultT ArtmCopyResult(int64_t length) {
+  length = HandleErrorCode(length);
 
   std::string result_blob;
   result_blob.resize(length);
@@ -48,6 +48,11 @@ ResultT ArtmRequest(int master_id, const ArgsT& args, FuncT func) {
   return result;
 }
 
+template<typename ResultT, typename ArgsT, typename FuncT>
+ResultT ArtmRequest(int master_id, const ArgsT& args, FuncT func) {
+  return ArtmCopyResult<ResultT>(ArtmExecute(master_id, args, func));
+}
+
 TopicModel Api::AttachTopicModel(const AttachModelArgs& args, Matrix* matrix) {
   GetTopicModelArgs topic_args;
   topic_args.set_model_name(args.model_name());
@@ -73,6 +78,48 @@ TopicModel Api::AttachTopicModel(const AttachModelArgs& args, Matrix* matrix) {
   return retval;
 }
 
+// Copies the values of ArtmRequestXxxExternal, given the number of rows in its result
+template<typename ResultT, typename ArgsT>
+static void CopyRequestedValues(const ArgsT& args, const ResultT& result, int num_rows, std::string* values) {
+  const int64_t num_values = (args.matrix_layout() == MatrixLayout_Sparse) ?
+    3 * result.num_values() : static_cast<int64_t>(num_rows) * result.num_topics();
+  values->resize(sizeof(float) * num_values);
+  HandleErrorCode(ArtmCopyRequestedObject(values->size(), StringAsArray(values)));
+}
+
+// Queries the size of the matrix, and then writes its values into 'values' via ArtmRequestXxxToBuffer
+template<typename ResultT, typename ArgsT, typename FuncT>
+static ResultT RequestToBuffer(int master_id, const ArgsT& args, FuncT func, std::string* values) {
+  std::string blob;
+  SerializeMessageToString(args, &blob);
+
+  ResultT retval = ArtmCopyResult<ResultT>(func(master_id, blob.size(), StringAsArray(&blob), 0, nullptr));
+  const int64_t num_values = retval.num_values();
+  values->resize(sizeof(float) * ((args.matrix_layout() == MatrixLayout_Sparse) ? 3 * num_values : num_values));
+  return ArtmCopyResult<ResultT>(func(master_id, blob.size(), StringAsArray(&blob),
+                                      values->size(), StringAsArray(values)));
+}
+
+ThetaMatrix Api::RequestThetaMatrixExternal(const GetThetaMatrixArgs& args, std::string* values) {
+  ThetaMatrix retval = ArtmRequest<ThetaMatrix>(master_model_.id(), args, ArtmRequestThetaMatrixExternal);
+  CopyRequestedValues(args, retval, retval.item_id_size(), values);
+  return retval;
+}
+
+TopicModel Api::RequestTopicModelExternal(const GetTopicModelArgs& args, std::string* values) {
+  TopicModel retval = ArtmRequest<TopicModel>(master_model_.id(), args, ArtmRequestTopicModelExternal);
+  CopyRequestedValues(args, retval, retval.token_size(), values);
+  return retval;
+}
+
+ThetaMatrix Api::RequestThetaMatrixToBuffer(const GetThetaMatrixArgs& args, std::string* values) {
+  return RequestToBuffer<ThetaMatrix>(master_model_.id(), args, ArtmRequestThetaMatrixToBuffer, values);
+}
+
+TopicModel Api::RequestTopicModelToBuffer(const GetTopicModelArgs& args, std::string* values) {
+  return RequestToBuffer<TopicModel>(master_model_.id(), args, ArtmRequestTopicModelToBuffer, values);
+}
+
 int Api::ClearThetaCache(const ClearThetaCacheArgs& args) {
   return ArtmExecute(master_model_.id(), args, ArtmClearThetaCache);
 }
@@ -31,6 +31,12 @@ class Api {
   int ClearScoreCache(const ClearScoreCacheArgs& args);
   int ClearScoreArrayCache(const ClearScoreArrayCacheArgs& args);
 
+  // Return the matrix without values, and put the values into 'values' (as ArtmCopyRequestedObject would copy them)
+  ThetaMatrix RequestThetaMatrixExternal(const GetThetaMatrixArgs& args, std::string* values);
+  TopicModel RequestTopicModelExternal(const GetTopicModelArgs& args, std::string* values);
+  ThetaMatrix RequestThetaMatrixToBuffer(const GetThetaMatrixArgs& args, std::string* values);
+  TopicModel RequestTopicModelToBuffer(const GetTopicModelArgs& args, std::string* values);
+
   // Test helpers
   ::artm::FitOfflineMasterModelArgs Initialize(const std::vector<std::shared_ptr< ::artm::Batch> >& batches,
                                                ::artm::ImportBatchesArgs* import_batches_args = nullptr,
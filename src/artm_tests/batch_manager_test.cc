@@ -1,5 +1,6 @@
 // Copyright 2017, Additive Regularization of Topic Models.
 
+#include <future>  // NOLINT
 #include <memory>
 
 #include "gtest/gtest.h"
@@ -36,3 +37,21 @@ TEST(BatchManager, Basic) {
   batch_manager.Callback(u2);
   ASSERT_TRUE(batch_manager.IsEverythingProcessed());
 }
+
+TEST(BatchManager, Wait) {
+  ::artm::core::BatchManager batch_manager;
+  boost::uuids::random_generator new_uuid;
+  boost::uuids::uuid u1(new_uuid()), u2(new_uuid());
+
+  ASSERT_TRUE(batch_manager.Wait());
+  batch_manager.Add(u1);
+  batch_manager.Add(u2);
+  ASSERT_FALSE(batch_manager.Wait(/* timeout_milliseconds = */ 0));
+
+  auto waiter = std::async(std::launch::async, [&batch_manager]() { return batch_manager.Wait(); });
+  batch_manager.Callback(u1);
+  ASSERT_FALSE(batch_manager.Wait(/* timeout_milliseconds = */ 10));
+  batch_manager.Callback(u2);
+  ASSERT_TRUE(waiter.get());
+  ASSERT_TRUE(batch_manager.Wait(/* timeout_milliseconds = */ 0));
+}
@@ -0,0 +1,52 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#include "artm/core/batch_token_id_cache.h"
+
+#include "gtest/gtest.h"
+
+#include "artm/core/common.h"
+#include "artm/core/dense_phi_matrix.h"
+#include "artm_tests/test_mother.h"
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=BatchTokenIdCache.*
+TEST(BatchTokenIdCache, FindTokenIds) {
+  auto batch = ::artm::test::TestMother::GenerateBatches(/* batches_size = */ 1, /* nTokens = */ 10)[0];
+  for (int token_index = 0; token_index < batch->token_size(); ++token_index) {
+    batch->add_class_id(::artm::core::DefaultClass);
+  }
+
+  ::google::protobuf::RepeatedPtrField<std::string> topic_name;
+  topic_name.Add()->assign("topic");
+  ::artm::core::DensePhiMatrix p_wt("pwt", topic_name, /* min_sparsity_rate = */ 0.0f);
+  for (int token_index = batch->token_size() - 1; token_index >= 1; --token_index) {
+    p_wt.AddToken(::artm::core::Token(batch->class_id(token_index), batch->token(token_index)));
+  }
+
+  ::artm::core::BatchTokenIdCache cache;
+  auto token_id = cache.FindTokenIds(*batch, p_wt);
+  ASSERT_EQ(*token_id, *::artm::core::BatchTokenIdCache::CalculateTokenIds(*batch, p_wt));
+  ASSERT_EQ((*token_id)[0], -1);
+  ASSERT_EQ((*token_id)[1], batch->token_size() - 2);
+
+  // Matrices reshaped from p_wt share its shape version, and therefore the cache entries
+  ::artm::core::DensePhiMatrix n_wt("nwt", topic_name, /* min_sparsity_rate = */ 0.0f);
+  n_wt.Reshape(p_wt);
+  ASSERT_EQ(n_wt.shape_version(), p_wt.shape_version());
+  ASSERT_EQ(cache.FindTokenIds(*batch, n_wt), token_id);
+  ASSERT_EQ(cache.FindTokenIds(*batch, p_wt), token_id);
+  ASSERT_EQ(cache.hit_count(), 2);
+  ASSERT_EQ(cache.miss_count(), 1);
+
+  // Adding a token invalidates the entry
+  p_wt.AddToken(::artm::core::Token(batch->class_id(0), batch->token(0)));
+  ASSERT_NE(n_wt.shape_version(), p_wt.shape_version());
+  auto new_token_id = cache.FindTokenIds(*batch, p_wt);
+  ASSERT_EQ((*new_token_id)[0], batch->token_size() - 1);
+  ASSERT_EQ(cache.miss_count(), 2);
+
+  // Both versions are kept
+  ASSERT_EQ(cache.FindTokenIds(*batch, n_wt), token_id);
+  ASSERT_EQ(cache.FindTokenIds(*batch, p_wt), new_token_id);
+  ASSERT_EQ(cache.miss_count(), 2);
+}
@@ -1,5 +1,8 @@
 // Copyright 2017, Additive Regularization of Topic Models.
 
+#include <string>
+#include <vector>
+
 #include "gtest/gtest.h"
 
 #include "artm/utility/blas.h"
@@ -80,3 +83,39 @@ TEST(Blas, scsr2csc) {
     EXPECT_EQ(csr_row_ptr2[i], csr_row_ptr[i]);
   }
 }
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=Blas.Load
+TEST(Blas, Load) {
+  ASSERT_EQ(Blas::load("this_blas_library_does_not_exist"), Blas::builtin());
+
+#if defined(_WIN32)
+  const std::string library_name = "libopenblas.dll";
+#else
+  const std::string library_name = "libopenblas.so.0";
+#endif
+  Blas* external = Blas::load(library_name);
+  if (external == Blas::builtin()) {
+    return;  // OpenBLAS is not installed
+  }
+
+  ASSERT_TRUE(external->is_loaded());
+  ASSERT_EQ(external, Blas::load(library_name));
+
+  const int m = 5, n = 7, k = 11;
+  std::vector<float> a(m * k), b(n * k), c_builtin(m * n, 0.0f), c_external(m * n, 0.0f);
+  for (int i = 0; i < m * k; ++i) {
+    a[i] = static_cast<float>(i % 13) / 13.0f;
+  }
+  for (int i = 0; i < n * k; ++i) {
+    b[i] = static_cast<float>(i % 7) / 7.0f;
+  }
+
+  Blas::builtin()->sgemm(Blas::RowMajor, Blas::NoTrans, Blas::Trans,
+      m, n, k, 1.0, &a[0], k, &b[0], k, 0, &c_builtin[0], n);
+  external->sgemm(Blas::RowMajor, Blas::NoTrans, Blas::Trans,
+      m, n, k, 1.0, &a[0], k, &b[0], k, 0, &c_external[0], n);
+  for (int i = 0; i < m * n; ++i) {
+    EXPECT_NEAR(c_builtin[i], c_external[i], 1e-4);
+  }
+}
@@ -1,19 +1,27 @@
 // Copyright 2017, Additive Regularization of Topic Models.
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 
 #include "boost/uuid/random_generator.hpp"
 #include "boost/uuid/uuid.hpp"
 #include "boost/filesystem.hpp"
+#include "boost/thread.hpp"
 
 #include "artm/cpp_interface.h"
+#include "artm/core/cache_manager.h"
 #include "artm/core/common.h"
+#include "artm/core/exceptions.h"
+#include "artm/core/instance.h"
+#include "artm/core/processor_helpers.h"
+#include "artm/core/theta_cache_entry.h"
 #include "artm_tests/test_mother.h"
 #include "artm_tests/api.h"
 
-void RunTest(bool disk_cache, std::string ptd_name) {
+void RunTest(bool disk_cache, std::string ptd_name, int64_t memory_budget = 0) {
   const int nTokens = 10;
   const int batches_size = 3;
   const int nTopics = 8;
@@ -32,6 +40,7 @@ void RunTest(bool disk_cache, std::string ptd_name) {
   if (disk_cache) {
     master_config.set_disk_cache_path(target_path);
   }
+  master_config.set_theta_cache_memory_budget(memory_budget);
   ::artm::MasterModel master_component(master_config);
   ::artm::test::Api api(master_component);
   EXPECT_TRUE(master_component.info().config().cache_theta());
@@ -44,11 +53,64 @@ void RunTest(bool disk_cache, std::string ptd_name) {
   }
 
   if (ptd_name.empty()) {
-    EXPECT_GT(master_component.info().cache_entry_size(), 0);
+    auto info = master_component.info();
+    EXPECT_GT(info.cache_entry_size(), 0);
+
+    // Each batch misses the cache on the first pass, and then finds its entry
+    const auto& theta_cache = info.theta_cache();
+    EXPECT_EQ(theta_cache.num_entries(), batches_size);
+    EXPECT_EQ(theta_cache.num_misses(), batches_size);
+    EXPECT_EQ(theta_cache.num_hits() + theta_cache.num_disk_hits(), 2 * batches_size);
+    EXPECT_EQ(theta_cache.memory_budget(), memory_budget);
+    if (memory_budget > 0) {
+      EXPECT_LE(theta_cache.byte_size(), memory_budget);
+      EXPECT_GT(theta_cache.num_evictions(), 0);
+      EXPECT_GT(theta_cache.num_disk_entries(), 0);
+      EXPECT_GT(theta_cache.disk_byte_size(), 0);
+    } else if (!disk_cache) {
+      EXPECT_EQ(theta_cache.num_evictions(), 0);
+      EXPECT_EQ(theta_cache.num_disk_entries(), 0);
+      EXPECT_GT(theta_cache.byte_size(), 0);
+    }
   }
   ::artm::ThetaMatrix theta1 = master_component.GetThetaMatrix();
   EXPECT_EQ(theta1.num_topics(), nTopics);
   EXPECT_GE(theta1.item_id_size(), 1);
+
+  // Theta matrix, written straight into a buffer, matches the result of ArtmRequestThetaMatrixExternal
+  for (bool sparse : { false, true }) {
+    for (bool all_topics : { true, false }) {
+      ::artm::GetThetaMatrixArgs get_theta_args;
+      if (sparse) {
+        get_theta_args.set_matrix_layout(::artm::MatrixLayout_Sparse);
+        get_theta_args.set_eps(0.1f);
+      }
+      if (!all_topics) {
+        get_theta_args.add_topic_name("Topic5");
+        get_theta_args.add_topic_name("Topic2");
+      }
+
+      std::string external_values, buffer_values;
+      ::artm::ThetaMatrix external = api.RequestThetaMatrixExternal(get_theta_args, &external_values);
+      ::artm::ThetaMatrix written = api.RequestThetaMatrixToBuffer(get_theta_args, &buffer_values);
+      if (!sparse) {
+        EXPECT_EQ(written.num_values(), static_cast<int64_t>(written.item_id_size()) * written.num_topics());
+        external.set_num_values(written.num_values());
+      }
+      EXPECT_EQ(external.SerializeAsString(), written.SerializeAsString());
+      EXPECT_EQ(external_values, buffer_values);
+    }
+  }
+
+  ::artm::Matrix theta1_values;
+  master_component.GetThetaMatrix(::artm::GetThetaMatrixArgs(), &theta1_values);
+  ASSERT_EQ(theta1_values.no_rows(), theta1.item_id_size());
+  ASSERT_EQ(theta1_values.no_columns(), nTopics);
+  for (int item_index = 0; item_index < theta1.item_id_size(); ++item_index) {
+    for (int topic_index = 0; topic_index < nTopics; ++topic_index) {
+      EXPECT_EQ(theta1_values(item_index, topic_index), theta1.item_weights(item_index).value(topic_index));
+    }
+  }
   auto config = master_component.config();
   config.set_num_document_passes(0);
   master_component.Reconfigure(config);
@@ -80,8 +142,217 @@ TEST(CacheManager, DiskCache) {
   RunTest(true, /*ptd_name=*/ "");
 }
 
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CacheManager.MemoryBudget
+TEST(CacheManager, MemoryBudget) {
+  // The budget is smaller than the cache, so some of the entries are evicted into a temporary folder
+  RunTest(false, /*ptd_name=*/ "", /*memory_budget=*/ 1500);
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CacheManager.SpillFolder
+TEST(CacheManager, SpillFolder) {
+  ::artm::MasterModelConfig master_config = ::artm::test::TestMother::GenerateMasterModelConfig(/* nTopics = */ 4);
+  master_config.set_theta_cache_memory_budget(1);  // every entry is evicted to the temporary folder
+  auto instance = std::make_shared< ::artm::core::Instance>(master_config);
+
+  auto entry = std::make_shared< ::artm::core::ThetaCacheEntry>(master_config.topic_name(), /* sparse = */ false);
+  const float values[] = { 0.25f, 0.25f, 0.25f, 0.25f };
+  entry->AddItem(0, "item", values);
+  instance->cache_manager()->UpdateCacheEntry("batch", entry);
+
+  ::artm::Batch batch;
+  batch.set_id("batch");
+  std::string file_name = instance->cache_manager()->FindCacheEntry(batch)->file_name();
+  ASSERT_FALSE(file_name.empty());
+  boost::filesystem::path folder = boost::filesystem::path(file_name).parent_path();
+
+  // The copy shares the evicted entry, so the folder is removed together with the copy
+  std::shared_ptr< ::artm::core::Instance> copy = instance->Duplicate();
+  instance.reset();
+  EXPECT_TRUE(boost::filesystem::exists(file_name));
+  EXPECT_EQ(copy->cache_manager()->FindCacheEntry(batch)->file_name(), file_name);
+
+  copy.reset();
+  EXPECT_FALSE(boost::filesystem::exists(file_name));
+  EXPECT_FALSE(boost::filesystem::exists(folder));
+}
+
 // To run this particular test:
 // artm_tests.exe --gtest_filter=CacheManager.PtdName
 TEST(CacheManager, PtdName) {
   RunTest(false, /*ptd_name=*/ "ptd");
 }
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CacheManager.ThetaCacheEntry
+TEST(CacheManager, ThetaCacheEntry) {
+  using ::artm::core::ThetaCacheEntry;
+  ::google::protobuf::RepeatedPtrField<std::string> topic_name;
+  for (int topic_index = 0; topic_index < 3; ++topic_index) {
+    topic_name.Add()->assign("topic_" + std::to_string(topic_index));
+  }
+
+  std::string file_name = artm::test::Helpers::getUniqueString() + ".cache";
+  for (bool sparse : { false, true }) {
+    ThetaCacheEntry entry(topic_name, sparse);
+    const float values[] = { 0.5f, 0.25f, 0.25f };
+    const int topic_index[] = { 2, 0 };
+    for (int item_index = 0; item_index < 4; ++item_index) {
+      std::string title = (item_index == 1) ? std::string() : "item_" + std::to_string(item_index);
+      if (sparse) {
+        entry.AddItem(item_index * 10, title, values, topic_index, item_index % 3);
+      } else {
+        entry.AddItem(item_index * 10, title, values);
+      }
+    }
+
+    entry.Save(file_name);
+    std::shared_ptr<ThetaCacheEntry> loaded = ThetaCacheEntry::Load(file_name, /* remove_file = */ true);
+    ASSERT_EQ(loaded->file_name(), file_name);
+    ASSERT_EQ(loaded->sparse(), sparse);
+    ASSERT_EQ(loaded->topic_size(), 3);
+    ASSERT_EQ(loaded->topic_name().Get(2), "topic_2");
+    ASSERT_EQ(loaded->item_size(), entry.item_size());
+    ASSERT_EQ(loaded->num_values(), entry.num_values());
+    for (int item_index = 0; item_index < entry.item_size(); ++item_index) {
+      EXPECT_EQ(loaded->item_id(item_index), item_index * 10);
+      EXPECT_EQ(loaded->item_title(item_index), entry.item_title(item_index));
+      ASSERT_EQ(loaded->item_value_size(item_index), sparse ? item_index % 3 : 3);
+      for (int index = 0; index < loaded->item_value_size(item_index); ++index) {
+        EXPECT_EQ(loaded->item_values(item_index)[index], values[index]);
+        if (sparse) {
+          EXPECT_EQ(loaded->item_topic_index(item_index)[index], topic_index[index]);
+        }
+      }
+    }
+
+    // The file is removed together with the entry
+    loaded.reset();
+    EXPECT_FALSE(boost::filesystem::exists(file_name));
+  }
+
+  // Empty entries are also written and mapped
+  ThetaCacheEntry empty_entry(topic_name, /* sparse = */ false);
+  empty_entry.Save(file_name);
+  EXPECT_EQ(ThetaCacheEntry::Load(file_name, /* remove_file = */ false)->item_size(), 0);
+
+  // Truncated files are detected
+  boost::filesystem::resize_file(file_name, boost::filesystem::file_size(file_name) - 1);
+  EXPECT_THROW(ThetaCacheEntry::Load(file_name, /* remove_file = */ true), ::artm::core::CorruptedMessageException);
+  EXPECT_FALSE(boost::filesystem::exists(file_name));
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CacheManager.InitializeThetaFromCache
+TEST(CacheManager, InitializeThetaFromCache) {
+  const int topic_size = 4;
+  ::google::protobuf::RepeatedPtrField<std::string> topic_name;
+  for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
+    topic_name.Add()->assign("topic_" + std::to_string(topic_index));
+  }
+
+  ::artm::Batch batch;
+  batch.set_id("batch");
+  for (int item_index = 0; item_index < 6; ++item_index) {
+    batch.add_item()->set_title("item_" + std::to_string(item_index));
+  }
+
+  ::artm::ProcessBatchesArgs args;
+  args.set_reuse_theta(true);
+
+  // Entry in the order of the batch
+  ::artm::core::ThetaCacheEntry entry(topic_name, /* sparse = */ false);
+  std::vector<float> values(topic_size);
+  for (int item_index = 0; item_index < batch.item_size(); ++item_index) {
+    std::fill(values.begin(), values.end(), static_cast<float>(item_index));
+    entry.AddItem(item_index, batch.item(item_index).title(), values.data());
+  }
+
+  auto theta = ::artm::core::ProcessorHelpers::InitializeTheta(topic_size, batch, args, &entry);
+  for (int item_index = 0; item_index < batch.item_size(); ++item_index) {
+    for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
+      ASSERT_EQ((*theta)(topic_index, item_index), static_cast<float>(item_index));
+    }
+  }
+
+  // Entry in the reverse order, without the first item of the batch
+  ::artm::core::ThetaCacheEntry reversed_entry(topic_name, /* sparse = */ false);
+  for (int item_index = batch.item_size() - 1; item_index >= 1; --item_index) {
+    std::fill(values.begin(), values.end(), static_cast<float>(item_index));
+    reversed_entry.AddItem(item_index, batch.item(item_index).title(), values.data());
+  }
+
+  theta = ::artm::core::ProcessorHelpers::InitializeTheta(topic_size, batch, args, &reversed_entry);
+  for (int item_index = 0; item_index < batch.item_size(); ++item_index) {
+    const float expected_value = (item_index == 0) ? 1.0f / topic_size : static_cast<float>(item_index);
+    for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
+      ASSERT_EQ((*theta)(topic_index, item_index), expected_value);
+    }
+  }
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CacheManager.PtdConcurrentUpdates
+TEST(CacheManager, PtdConcurrentUpdates) {
+  const int nTopics = 4;
+  const int num_threads = 4;
+  const int num_batches = 16;
+  const int num_items = 100;
+
+  ::artm::MasterModelConfig master_config = ::artm::test::TestMother::GenerateMasterModelConfig(nTopics);
+  master_config.set_ptd_name("ptd");
+  ::artm::core::Instance instance(master_config);
+  ::artm::core::CacheManager* cache_manager = instance.cache_manager();
+
+  // Consecutive batches share half of their documents; the values only depend on the document
+  auto document_value = [](int document, int topic_index) {
+    return static_cast<float>(document * nTopics + topic_index);
+  };
+  std::vector<std::shared_ptr<::artm::core::ThetaCacheEntry>> entries;
+  std::vector<float> values(nTopics);
+  for (int batch_index = 0; batch_index < num_batches; ++batch_index) {
+    auto entry = std::make_shared<::artm::core::ThetaCacheEntry>(master_config.topic_name(), /* sparse = */ false);
+    for (int item_index = 0; item_index < num_items; ++item_index) {
+      const int document = batch_index * num_items / 2 + item_index;
+      for (int topic_index = 0; topic_index < nTopics; ++topic_index) {
+        values[topic_index] = document_value(document, topic_index);
+      }
+      entry->AddItem(document, "doc_" + std::to_string(document), values.data());
+    }
+    entries.push_back(entry);
+  }
+
+  std::vector<std::shared_ptr<boost::thread>> threads;
+  for (int thread_index = 0; thread_index < num_threads; ++thread_index) {
+    threads.push_back(std::make_shared<boost::thread>([&, thread_index]() {
+      for (int batch_index = thread_index; batch_index < num_batches; batch_index += num_threads) {
+        cache_manager->UpdateCacheEntry("batch_" + std::to_string(batch_index), entries[batch_index]);
+      }
+    }));
+  }
+  for (auto& thread : threads) {
+    thread->join();
+  }
+
+  const int num_documents = (num_batches + 1) * num_items / 2;
+  ASSERT_EQ(instance.GetPhiMatrixSafe("ptd")->token_size(), num_documents);
+
+  // Documents that are not in ptd matrix are skipped
+  ::artm::Batch batch;
+  batch.set_id("batch");
+  for (int document = -1; document <= num_documents; ++document) {
+    ::artm::Item* item = batch.add_item();
+    item->set_id(document);
+    item->set_title("doc_" + std::to_string(document));
+  }
+
+  std::shared_ptr<const ::artm::core::ThetaCacheEntry> cached_theta = cache_manager->FindCacheEntry(batch);
+  ASSERT_EQ(cached_theta->item_size(), num_documents);
+  for (int item_index = 0; item_index < cached_theta->item_size(); ++item_index) {
+    ASSERT_EQ(cached_theta->item_id(item_index), item_index);
+    for (int topic_index = 0; topic_index < nTopics; ++topic_index) {
+      ASSERT_EQ(cached_theta->item_values(item_index)[topic_index], document_value(item_index, topic_index));
+    }
+  }
+}
@@ -1,5 +1,14 @@
 // Copyright 2017, Additive Regularization of Topic Models.
 
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "boost/filesystem.hpp"
 
 #include "gtest/gtest.h"
@@ -217,6 +226,95 @@ TEST(CollectionParser, Multiclass) {
   catch (...) { }
 }
 
+::artm::TopicModel fitOfflineFromFolder(const std::string& batch_folder, ::artm::PerplexityScore* perplexity_score) {
+  ::artm::MasterModelConfig master_config = ::artm::test::TestMother::GenerateMasterModelConfig(3);
+  master_config.set_num_processors(1);
+  ::artm::test::Helpers::ConfigurePerplexityScore("PerplexityScore", &master_config);
+  ::artm::MasterModel master(master_config);
+
+  ::artm::GatherDictionaryArgs gather_args;
+  gather_args.set_data_path(batch_folder);
+  gather_args.set_dictionary_target_name("dictionary");
+  master.GatherDictionary(gather_args);
+
+  ::artm::InitializeModelArgs init_model_args;
+  init_model_args.set_dictionary_name("dictionary");
+  init_model_args.set_model_name(master_config.pwt_name());
+  init_model_args.mutable_topic_name()->CopyFrom(master_config.topic_name());
+  master.InitializeModel(init_model_args);
+
+  ::artm::FitOfflineMasterModelArgs fit_offline_args;
+  fit_offline_args.set_batch_folder(batch_folder);
+  fit_offline_args.set_num_collection_passes(3);
+  master.FitOfflineModel(fit_offline_args);
+
+  ::artm::GetScoreValueArgs get_score_args;
+  get_score_args.set_score_name("PerplexityScore");
+  *perplexity_score = master.GetScoreAs< ::artm::PerplexityScore>(get_score_args);
+  return master.GetTopicModel();
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CollectionParser.ColumnarBatches
+TEST(CollectionParser, ColumnarBatches) {
+  std::string protobuf_folder = artm::test::Helpers::getUniqueString();
+  std::string columnar_folder = artm::test::Helpers::getUniqueString();
+
+  ::artm::CollectionParserConfig config;
+  config.set_format(::artm::CollectionParserConfig_CollectionFormat_MatrixMarket);
+  config.set_num_items_per_batch(4);
+  config.set_name_type(::artm::CollectionParserConfig_BatchNameType_Code);
+  config.set_vocab_file_path((::artm::test::Helpers::getTestDataDir() / "deerwestere.txt").string());
+  config.set_docword_file_path((::artm::test::Helpers::getTestDataDir() / "deerwestere.mm").string());
+
+  config.set_target_folder(protobuf_folder);
+  ::artm::ParseCollection(config);
+
+  config.set_target_folder(columnar_folder);
+  config.set_batch_format(::artm::CollectionParserConfig_BatchFormat_Columnar);
+  ::artm::ParseCollection(config);
+
+  auto columnar_batches = ::artm::core::Helpers::ListAllBatches(columnar_folder);
+  ASSERT_EQ(columnar_batches.size(), 3);
+  for (const auto& columnar_path : columnar_batches) {
+    ASSERT_EQ(columnar_path.extension().string(), ::artm::core::kColumnarBatchExtension);
+
+    ::artm::Batch protobuf_batch, columnar_batch;
+    fs::path protobuf_path = fs::path(protobuf_folder) / (columnar_path.stem().string() + ".batch");
+    ::artm::core::Helpers::LoadBatch(protobuf_path.string(), &protobuf_batch);
+    ::artm::core::Helpers::LoadBatch(columnar_path.string(), &columnar_batch);
+
+    protobuf_batch.clear_id();
+    columnar_batch.clear_id();
+    ASSERT_EQ(protobuf_batch.DebugString(), columnar_batch.DebugString());
+  }
+
+  ::artm::PerplexityScore protobuf_perplexity, columnar_perplexity;
+  ::artm::TopicModel protobuf_model = fitOfflineFromFolder(protobuf_folder, &protobuf_perplexity);
+  ::artm::TopicModel columnar_model = fitOfflineFromFolder(columnar_folder, &columnar_perplexity);
+
+  // The order of tokens depends on the order of batch files in the folder
+  ASSERT_EQ(protobuf_model.token_size(), columnar_model.token_size());
+  std::map<std::string, int> columnar_token_index;
+  for (int i = 0; i < columnar_model.token_size(); ++i) {
+    columnar_token_index[columnar_model.token(i)] = i;
+  }
+
+  for (int i = 0; i < protobuf_model.token_size(); ++i) {
+    ASSERT_EQ(columnar_token_index.count(protobuf_model.token(i)), 1);
+    const auto& protobuf_values = protobuf_model.token_weights(i);
+    const auto& columnar_values = columnar_model.token_weights(columnar_token_index[protobuf_model.token(i)]);
+    ASSERT_EQ(protobuf_values.value_size(), columnar_values.value_size());
+    for (int j = 0; j < protobuf_values.value_size(); ++j) {
+      ASSERT_APPROX_EQ(protobuf_values.value(j), columnar_values.value(j));
+    }
+  }
+  ASSERT_APPROX_EQ(protobuf_perplexity.value(), columnar_perplexity.value());
+
+  try { fs::remove_all(protobuf_folder); fs::remove_all(columnar_folder); }
+  catch (...) { }
+}
+
 // To run this particular test:
 // artm_tests.exe --gtest_filter=CollectionParser.VowpalWabbit
 TEST(CollectionParser, VowpalWabbit) {
@@ -352,4 +450,143 @@ TEST(CollectionParser, TransactionVowpalWabbit) {
   try { fs::remove_all(target_folder); }
   catch (...) {}
 }
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CollectionParser.Cooccurrences
+TEST(CollectionParser, Cooccurrences) {
+  std::string target_folder = artm::test::Helpers::getUniqueString();
+  fs::create_directory(target_folder);
+  const std::string docword_path = (fs::path(target_folder) / "docword.txt").string();
+  const std::string vocab_path = (fs::path(target_folder) / "vocab.txt").string();
+  const std::string cooc_tf_path = (fs::path(target_folder) / "cooc_tf.txt").string();
+  const std::string cooc_df_path = (fs::path(target_folder) / "cooc_df.txt").string();
+  const std::string ppmi_tf_path = (fs::path(target_folder) / "ppmi_tf.txt").string();
+
+  const int num_tokens = 20;
+  const int window_width = 2;
+  {
+    std::ofstream vocab(vocab_path);
+    for (int i = 0; i < num_tokens; ++i) {
+      vocab << "w" << i << "\n";
+    }
+  }
+
+  // Expected co-occurrences, gathered directly from the documents
+  typedef std::pair<std::string, std::string> TokenPair;
+  std::map<TokenPair, int> expected_tf;
+  std::map<TokenPair, std::set<int>> expected_df;
+  std::map<std::string, int> num_of_pairs_token_occurred_in;  // including pairs of the same tokens
+  int total_num_of_pairs = 0;
+  {
+    std::ofstream docword(docword_path);
+    for (int doc_id = 0; doc_id < 300; ++doc_id) {
+      std::vector<std::string> tokens;
+      for (int i = 0; i < 6 + doc_id % 7; ++i) {
+        tokens.push_back("w" + std::to_string((doc_id * 7 + i * i * 3) % (num_tokens + 1)));  // w20 is not in vocab
+      }
+
+      docword << "doc" << doc_id;
+      for (const auto& token : tokens) {
+        docword << " " << token;
+      }
+      docword << "\n";
+
+      for (int i = 0; i < static_cast<int>(tokens.size()); ++i) {
+        for (int j = i + 1; j <= i + window_width && j < static_cast<int>(tokens.size()); ++j) {
+          if (tokens[i] == "w20" || tokens[j] == "w20") {
+            continue;
+          }
+          num_of_pairs_token_occurred_in[tokens[i]]++;
+          num_of_pairs_token_occurred_in[tokens[j]]++;
+          total_num_of_pairs += 2;
+          if (tokens[i] == tokens[j]) {
+            continue;
+          }
+          for (const auto& pair : { TokenPair(tokens[i], tokens[j]), TokenPair(tokens[j], tokens[i]) }) {
+            expected_tf[pair]++;
+            expected_df[pair].insert(doc_id);
+          }
+        }
+      }
+    }
+  }
+
+  ::artm::CollectionParserConfig config;
+  config.set_format(::artm::CollectionParserConfig_CollectionFormat_VowpalWabbit);
+  config.set_target_folder(target_folder);
+  config.set_docword_file_path(docword_path);
+  config.set_vocab_file_path(vocab_path);
+  config.set_num_items_per_batch(1);  // many co-occurrence batches, that are merged in several stages
+  config.set_num_threads(2);
+  config.set_gather_cooc(true);
+  config.set_gather_cooc_tf(true);
+  config.set_gather_cooc_df(true);
+  config.set_cooc_tf_file_path(cooc_tf_path);
+  config.set_cooc_df_file_path(cooc_df_path);
+  config.set_ppmi_tf_file_path(ppmi_tf_path);
+  config.set_cooc_window_width(window_width);
+
+  ::artm::CollectionParserInfo info = ::artm::ParseCollection(config);
+  ASSERT_GT(info.cooc_bytes_spilled(), 0);
+  ASSERT_GT(info.cooc_peak_memory(), 0);
+
+  auto read_cooc_file = [](const std::string& path) {  // NOLINT
+    std::map<TokenPair, float> retval;
+    std::ifstream file(path);
+    std::string line;
+    std::string prev_first_token;
+    while (std::getline(file, line)) {
+      std::stringstream ss(line);
+      std::string first_token;
+      std::string elem;
+      ss >> first_token;
+      EXPECT_LT(prev_first_token.empty() ? -1 : std::stoi(prev_first_token.substr(1)),
+                std::stoi(first_token.substr(1)));  // lines are sorted by token id
+      prev_first_token = first_token;
+      while (ss >> elem) {
+        size_t split_index = elem.find(':');
+        retval[TokenPair(first_token, elem.substr(0, split_index))] = std::stof(elem.substr(split_index + 1));
+      }
+    }
+    return retval;
+  };
+
+  std::map<TokenPair, float> cooc_tf = read_cooc_file(cooc_tf_path);
+  ASSERT_EQ(cooc_tf.size(), expected_tf.size());
+  for (const auto& elem : expected_tf) {
+    ASSERT_EQ(cooc_tf[elem.first], elem.second);
+  }
+
+  std::map<TokenPair, float> cooc_df = read_cooc_file(cooc_df_path);
+  ASSERT_EQ(cooc_df.size(), expected_df.size());
+  for (const auto& elem : expected_df) {
+    ASSERT_EQ(cooc_df[elem.first], elem.second.size());
+  }
+
+  // ppmi is written only for the pairs with positive pmi
+  std::map<TokenPair, float> ppmi_tf = read_cooc_file(ppmi_tf_path);
+  int num_of_positive_ppmi = 0;
+  for (const auto& elem : expected_tf) {
+    double pmi = log((static_cast<double>(total_num_of_pairs) / num_of_pairs_token_occurred_in[elem.first.first]) /
+                     (num_of_pairs_token_occurred_in[elem.first.second] / static_cast<double>(elem.second)));
+    if (pmi > 0.0) {
+      num_of_positive_ppmi++;
+      ASSERT_NEAR(ppmi_tf[elem.first], pmi, 1e-4);
+    }
+  }
+  ASSERT_GT(num_of_positive_ppmi, 0);
+  ASSERT_EQ(ppmi_tf.size(), num_of_positive_ppmi);
+
+  // temporary files of co-occurrence statistics are removed
+  int num_of_files = 0;
+  for (fs::directory_iterator it(target_folder); it != fs::directory_iterator(); ++it) {
+    if (it->path().extension() != ".batch") {
+      num_of_files++;
+    }
+  }
+  ASSERT_EQ(num_of_files, 5);
+
+  try { fs::remove_all(target_folder); }
+  catch (...) {}
+}
 // vim: set ts=2 sw=2 sts=2:
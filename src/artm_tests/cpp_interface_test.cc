@@ -1,5 +1,7 @@
 // Copyright 2017, Additive Regularization of Topic Models.
 
+#include <fstream>
+
 #include "boost/thread.hpp"
 #include "gtest/gtest.h"
 
@@ -12,6 +14,9 @@
 #include "artm/cpp_interface.h"
 #include "artm/core/exceptions.h"
 #include "artm/core/common.h"
+#include "artm/core/dictionary.h"
+#include "artm/core/dictionary_operations.h"
+#include "artm/core/phi_matrix_file.h"
 #include "artm/core/protobuf_helpers.h"
 #include "artm/core/phi_matrix_operations.h"
 
@@ -687,6 +692,221 @@ TEST(CppInterface, AttachModel) {
   catch (...) { }
 }
 
+// artm_tests.exe --gtest_filter=CppInterface.BinaryModelFormat
+TEST(CppInterface, BinaryModelFormat) {
+  int nTopics = 17, nBatches = 5, nTokens = 50;
+  std::string target_folder = artm::test::Helpers::getUniqueString();
+  ASSERT_TRUE(boost::filesystem::create_directory(target_folder));
+  auto batches = ::artm::test::TestMother::GenerateBatches(nBatches, nTokens);
+  artm::MasterModelConfig master_config = ::artm::test::TestMother::GenerateMasterModelConfig(nTopics);
+  artm::MasterModel master(master_config);
+  ::artm::test::Api api(master);
+  auto offlineArgs = api.Initialize(batches);
+
+  ::artm::GetTopicModelArgs get_model_args;
+  get_model_args.set_model_name(master_config.pwt_name());
+  ::artm::TopicModel pwt_model = master.GetTopicModel(get_model_args);
+
+  for (auto format : { artm::ExportModelArgs_Format_Binary, artm::ExportModelArgs_Format_BinaryDense }) {
+    for (bool attach : { false, true }) {
+      if (attach && format != artm::ExportModelArgs_Format_BinaryDense) {
+        continue;
+      }
+
+      artm::ExportModelArgs export_args;
+      export_args.set_model_name(master_config.pwt_name());
+      export_args.set_file_name((fs::path(target_folder) / artm::test::Helpers::getUniqueString()).string());
+      export_args.set_format(format);
+      master.ExportModel(export_args);
+
+      artm::ImportModelArgs import_args;
+      import_args.set_model_name("import_pwt");
+      import_args.set_file_name(export_args.file_name());
+      import_args.set_attach(attach);
+      master.ImportModel(import_args);
+
+      bool ok = false;
+      get_model_args.set_model_name("import_pwt");
+      ::artm::test::Helpers::CompareTopicModels(pwt_model, master.GetTopicModel(get_model_args), &ok);
+      ASSERT_TRUE(ok);
+      master.DisposeModel("import_pwt");
+    }
+  }
+
+  {
+    // Read-only model replaces p_wt and gives the same theta matrix
+    ::artm::TransformMasterModelArgs transform_args;
+    for (auto& batch : batches) {
+      transform_args.add_batch()->CopyFrom(*batch);
+    }
+    ::artm::ThetaMatrix theta = master.Transform(transform_args);
+
+    artm::ExportModelArgs export_args;
+    export_args.set_model_name(master_config.pwt_name());
+    export_args.set_file_name((fs::path(target_folder) / artm::test::Helpers::getUniqueString()).string());
+    export_args.set_format(artm::ExportModelArgs_Format_BinaryDense);
+    master.ExportModel(export_args);
+
+    artm::ImportModelArgs import_args;
+    import_args.set_model_name(master_config.pwt_name());
+    import_args.set_file_name(export_args.file_name());
+    import_args.set_read_only(true);
+    master.ImportModel(import_args);
+
+    ::artm::ThetaMatrix shared_theta = master.Transform(transform_args);
+    ASSERT_EQ(theta.item_id_size(), shared_theta.item_id_size());
+    for (int item_index = 0; item_index < theta.item_id_size(); ++item_index) {
+      for (int topic_index = 0; topic_index < nTopics; ++topic_index) {
+        ASSERT_APPROX_EQ(theta.item_weights(item_index).value(topic_index),
+                         shared_theta.item_weights(item_index).value(topic_index));
+      }
+    }
+
+    bool ok = false;
+    get_model_args.set_model_name(master_config.pwt_name());
+    ::artm::test::Helpers::CompareTopicModels(pwt_model, master.GetTopicModel(get_model_args), &ok);
+    ASSERT_TRUE(ok);
+
+    ::artm::AttachModelArgs attach_args;
+    attach_args.set_model_name(master_config.pwt_name());
+    ::artm::Matrix attached_pwt;
+    ASSERT_THROW(api.AttachTopicModel(attach_args, &attached_pwt), artm::InvalidOperationException);
+
+    // Values of read-only model are verified only on request
+    export_args.set_file_name((fs::path(target_folder) / artm::test::Helpers::getUniqueString()).string());
+    master.ExportModel(export_args);
+    {
+      std::fstream fout(export_args.file_name(), std::fstream::in | std::fstream::out | std::fstream::binary);
+      ::artm::core::PhiMatrixFileHeader header;
+      fout.read(reinterpret_cast<char*>(&header), sizeof(header));
+      fout.seekp(header.value_offset);
+      fout.put(0x01);
+    }
+
+    import_args.set_model_name("corrupted_pwt");
+    import_args.set_file_name(export_args.file_name());
+    master.ImportModel(import_args);
+    master.DisposeModel("corrupted_pwt");
+    import_args.set_verify_checksum(true);
+    ASSERT_THROW(master.ImportModel(import_args), artm::CorruptedMessageException);
+  }
+
+  // Sparse layout, and the detection of corrupted values
+  ::google::protobuf::RepeatedPtrField<std::string> topic_name;
+  for (int topic_index = 0; topic_index < nTopics; ++topic_index) {
+    topic_name.Add()->assign("topic" + boost::lexical_cast<std::string>(topic_index));
+  }
+
+  ::artm::core::DensePhiMatrix phi_matrix("phi", topic_name, 0.0f);
+  std::vector<float> values(nTopics, 0.0f);
+  for (int token_index = 0; token_index < nTokens; ++token_index) {
+    phi_matrix.AddToken(::artm::core::Token("@class" + boost::lexical_cast<std::string>(token_index % 2),
+                                            "token" + boost::lexical_cast<std::string>(token_index)));
+    std::fill(values.begin(), values.end(), 0.0f);
+    values[token_index % nTopics] = 1.0f + token_index;
+    phi_matrix.set(token_index, values);
+  }
+
+  std::string sparse_file = (fs::path(target_folder) / artm::test::Helpers::getUniqueString()).string();
+  ::artm::core::PhiMatrixFile::Save(phi_matrix, sparse_file, /* force_dense =*/ false, /* num_threads =*/ 2);
+  {
+    ::artm::core::PhiMatrixFile file(sparse_file, /* writable =*/ false);
+    ASSERT_EQ(file.layout(), ::artm::core::PhiMatrixFile::Sparse);
+    ASSERT_EQ(file.nnz(), nTokens);
+
+    ::artm::core::DensePhiMatrix loaded("phi", topic_name, 0.0f);
+    file.CopyTo(&loaded, /* num_threads =*/ 2);
+    ASSERT_EQ(loaded.token_size(), nTokens);
+    for (int token_index = 0; token_index < nTokens; ++token_index) {
+      ASSERT_EQ(loaded.token(token_index), phi_matrix.token(token_index));
+      for (int topic_index = 0; topic_index < nTopics; ++topic_index) {
+        ASSERT_EQ(loaded.get(token_index, topic_index), phi_matrix.get(token_index, topic_index));
+      }
+    }
+  }
+
+  {
+    // Flip a bit in the last value of the file
+    std::fstream fout(sparse_file, std::fstream::in | std::fstream::out | std::fstream::binary);
+    ::artm::core::PhiMatrixFileHeader header;
+    fout.read(reinterpret_cast<char*>(&header), sizeof(header));
+    fout.seekp(header.value_offset + sizeof(float) * header.nnz - 1);
+    fout.put(0x01);
+  }
+
+  ::artm::core::PhiMatrixFile corrupted_file(sparse_file, /* writable =*/ false);
+  ::artm::core::DensePhiMatrix corrupted("phi", topic_name, 0.0f);
+  ASSERT_THROW(corrupted_file.CopyTo(&corrupted, /* num_threads =*/ 2), ::artm::core::CorruptedMessageException);
+  ASSERT_THROW(corrupted_file.VerifyValues(/* num_threads =*/ 1), ::artm::core::CorruptedMessageException);
+
+  try { boost::filesystem::remove_all(target_folder); }
+  catch (...) { }
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CppInterface.RequestTopicModelToBuffer
+TEST(CppInterface, RequestTopicModelToBuffer) {
+  int nTopics = 7, nBatches = 3, nTokens = 40;
+  auto batches = ::artm::test::TestMother::GenerateBatches(nBatches, nTokens);
+  artm::MasterModelConfig master_config = ::artm::test::TestMother::GenerateMasterModelConfig(nTopics);
+  artm::MasterModel master(master_config);
+  ::artm::test::Api api(master);
+  master.FitOfflineModel(api.Initialize(batches));
+
+  // Phi matrix, written straight into a buffer, matches the result of ArtmRequestTopicModelExternal
+  for (bool sparse : { false, true }) {
+    for (int filter = 0; filter < 3; ++filter) {
+      ::artm::GetTopicModelArgs args;
+      args.set_model_name(master_config.pwt_name());
+      if (sparse) {
+        args.set_matrix_layout(::artm::MatrixLayout_Sparse);
+        args.set_eps(0.01f);
+      }
+      if (filter == 1) {
+        args.add_topic_name("Topic6");
+        args.add_topic_name("Topic0");
+        args.add_topic_name("Topic3");
+      }
+      if (filter == 2) {
+        args.add_token("token7");
+        args.add_token("no_such_token");
+        args.add_token("token2");
+      }
+
+      std::string external_values, buffer_values;
+      ::artm::TopicModel external = api.RequestTopicModelExternal(args, &external_values);
+      ::artm::TopicModel written = api.RequestTopicModelToBuffer(args, &buffer_values);
+      if (!sparse) {
+        ASSERT_EQ(written.num_values(), static_cast<int64_t>(written.token_size()) * written.num_topics());
+        external.set_num_values(written.num_values());
+      }
+      ASSERT_GT(written.num_values(), 0);
+      EXPECT_EQ(external.SerializeAsString(), written.SerializeAsString());
+      EXPECT_EQ(external_values, buffer_values);
+
+      // The buffer must have exactly the requested size
+      std::string blob = args.SerializeAsString();
+      EXPECT_EQ(ArtmRequestTopicModelToBuffer(master.id(), blob.size(), blob.c_str(),
+                                              buffer_values.size() - sizeof(float), &buffer_values[0]),
+                ARTM_INVALID_OPERATION);
+    }
+  }
+
+  ::artm::GetTopicModelArgs args;
+  args.set_model_name(master_config.pwt_name());
+  ::artm::TopicModel topic_model = master.GetTopicModel(args);
+  ::artm::Matrix matrix;
+  ::artm::TopicModel topic_model_info = master.GetTopicModel(args, &matrix);
+  ASSERT_EQ(topic_model_info.token_size(), topic_model.token_size());
+  ASSERT_EQ(matrix.no_rows(), topic_model.token_size());
+  ASSERT_EQ(matrix.no_columns(), nTopics);
+  for (int token_index = 0; token_index < topic_model.token_size(); ++token_index) {
+    for (int topic_index = 0; topic_index < nTopics; ++topic_index) {
+      ASSERT_EQ(matrix(token_index, topic_index), topic_model.token_weights(token_index).value(topic_index));
+    }
+  }
+}
+
 // artm_tests.exe --gtest_filter=CppInterface.AsyncProcessBatches
 TEST(CppInterface, AsyncProcessBatches) {
   int nTopics = 17, nBatches = 5, nTokens = 50;
@@ -786,6 +1006,125 @@ TEST(CppInterface, Dictionaries) {
   catch (...) { }
 }
 
+// artm_tests.exe --gtest_filter=CppInterface.DictionaryCoocMatrix
+TEST(CppInterface, DictionaryCoocMatrix) {
+  ::artm::core::Dictionary dictionary("cooc_dictionary");
+  for (int i = 0; i < 4; ++i) {
+    dictionary.AddEntry(::artm::core::DictionaryEntry(
+      ::artm::core::Token(::artm::core::DefaultClass, "token" + std::to_string(i)), 0.25f, 1.0f, 1.0f));
+  }
+
+  dictionary.AddCoocValue(2, 3, 1.0f);
+  dictionary.AddCoocValue(2, 0, 2.0f);
+  dictionary.AddCoocValue(2, 3, 5.0f);  // duplicates are ignored
+  dictionary.AddCoocValue(0, 1, 3.0f);
+
+  // co-occurrences are not visible until the dictionary is finalized
+  ASSERT_TRUE(dictionary.token_cooc_values(2).empty());
+  dictionary.FinalizeCooc();
+
+  ::artm::core::Token token2(::artm::core::DefaultClass, "token2");
+  ::artm::core::CoocRow row = dictionary.token_cooc_values(token2);
+  ASSERT_EQ(row.size(), 2);
+  ASSERT_EQ(row.column(0), 0);
+  ASSERT_EQ(row.value(0), 2.0f);
+  ASSERT_EQ(row.column(1), 3);
+  ASSERT_EQ(row.value(1), 1.0f);
+  ASSERT_EQ(row.find(3)->second, 1.0f);
+  ASSERT_TRUE(row.find(1) == row.end());
+  ASSERT_TRUE(dictionary.token_cooc_values(1).empty());
+  ASSERT_TRUE(dictionary.token_cooc_values(::artm::core::Token(::artm::core::DefaultClass, "unknown")).empty());
+  ASSERT_EQ(dictionary.cooc_values().non_empty_row_size(), 2);
+
+  float sum = 0.0f;
+  for (const auto& elem : row) {
+    sum += elem.second;
+  }
+  ASSERT_EQ(sum, 3.0f);
+
+  // values added after finalization are merged with the existing ones
+  dictionary.AddCoocValue(2, 1, 4.0f);
+  dictionary.AddCoocValue(2, 0, 7.0f);
+  dictionary.FinalizeCooc();
+  row = dictionary.token_cooc_values(2);
+  ASSERT_EQ(row.size(), 3);
+  ASSERT_EQ(row.find(0)->second, 2.0f);
+  ASSERT_EQ(row.find(1)->second, 4.0f);
+  ASSERT_EQ(std::distance(row.begin(), row.end()), 3);
+
+  // the matrix can be saved and memory-mapped back
+  std::string file_name = ::artm::test::Helpers::getUniqueString() + ".cooc";
+  dictionary.cooc_values().Save(file_name);
+  {
+    ::artm::core::CoocMatrix mapped_matrix;
+    mapped_matrix.Open(file_name);
+    ASSERT_EQ(mapped_matrix.nnz(), 4);
+    ASSERT_EQ(mapped_matrix.row_size(), dictionary.cooc_values().row_size());
+    for (int index = 0; index < mapped_matrix.row_size(); ++index) {
+      ::artm::core::CoocRow expected = dictionary.cooc_values().row(index);
+      ::artm::core::CoocRow actual = mapped_matrix.row(index);
+      ASSERT_EQ(actual.size(), expected.size());
+      for (int i = 0; i < actual.size(); ++i) {
+        ASSERT_EQ(actual.column(i), expected.column(i));
+        ASSERT_EQ(actual.value(i), expected.value(i));
+      }
+    }
+
+    ::artm::core::CoocMatrix copy(mapped_matrix);
+    ASSERT_EQ(copy.row(0).find(1)->second, 3.0f);
+  }
+
+  // column ids out of the range of tokens are rejected
+  {
+    ::artm::core::CoocMatrixHeader header;
+    std::fstream file(file_name.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    ASSERT_EQ(header.file_size, static_cast<int64_t>(boost::filesystem::file_size(file_name)));
+    const int32_t column = header.row_size;
+    file.seekp(header.column_offset);
+    file.write(reinterpret_cast<const char*>(&column), sizeof(column));
+  }
+
+  ::artm::core::CoocMatrix corrupted_matrix;
+  ASSERT_THROW(corrupted_matrix.Open(file_name), ::artm::core::CorruptedMessageException);
+
+  try { boost::filesystem::remove(file_name); }
+  catch (...) { }
+
+  // binary export keeps the co-occurrences in CSR files, that are memory-mapped on import
+  ::artm::ExportDictionaryArgs export_args;
+  export_args.set_file_name(::artm::test::Helpers::getUniqueString() + ".dict");
+  export_args.set_dictionary_name(dictionary.name());
+  export_args.set_format(::artm::ExportDictionaryArgs_Format_Binary);
+  ::artm::core::DictionaryOperations::Export(export_args, dictionary);
+  ASSERT_THROW(::artm::core::DictionaryOperations::Export(export_args, dictionary),
+               ::artm::core::DiskWriteException);
+
+  ::artm::ImportDictionaryArgs import_args;
+  import_args.set_file_name(export_args.file_name());
+  import_args.set_dictionary_name("imported_dictionary");
+  {
+    auto imported = ::artm::core::DictionaryOperations::Import(import_args);
+    imported->FinalizeCooc();
+    ASSERT_EQ(imported->size(), dictionary.size());
+    ASSERT_LT(imported->cooc_values().ByteSize(), dictionary.cooc_values().ByteSize());
+    ASSERT_EQ(imported->cooc_values().nnz(), dictionary.cooc_values().nnz());
+    row = imported->token_cooc_values(token2);
+    ASSERT_EQ(row.size(), 3);
+    ASSERT_EQ(row.find(0)->second, 2.0f);
+    ASSERT_EQ(row.find(1)->second, 4.0f);
+    ASSERT_EQ(row.find(3)->second, 1.0f);
+  }
+
+  file_name = export_args.file_name();
+  for (const std::string& name : ::artm::core::Dictionary::CoocFileNames(file_name)) {
+    try { boost::filesystem::remove(name); }
+    catch (...) { }
+  }
+  try { boost::filesystem::remove(file_name); }
+  catch (...) { }
+}
+
 // artm_tests.exe --gtest_filter=ProtobufMessages.Json
 TEST(ProtobufMessages, Json) {
   ::artm::MasterModelConfig config, config2;
@@ -1,5 +1,6 @@
 // Copyright 2019, Additive Regularization of Topic Models.
 
+#include <string>
 #include <vector>
 
 #include "boost/filesystem.hpp"
@@ -8,6 +9,7 @@
 
 #include "artm/cpp_interface.h"
 #include "artm/core/common.h"
+#include "artm/utility/blas.h"
 
 #include "artm_tests/test_mother.h"
 #include "artm_tests/api.h"
@@ -452,3 +454,154 @@ TEST(MasterModel, TestReshapeTokensSmoothSparsePhi) {
   reg_config.add_class_id("@default_class");
   testReorderTokens(::artm::RegularizerType_SmoothSparsePhi, reg_config, 0.1);
 }
+
+::artm::test::TestMother::FitOfflineResult runFitOfflineWithPhiMatrixType(::artm::PhiMatrixType phi_matrix_type) {
+  auto batches = ::artm::test::TestMother::GenerateBatches(/* batches_size = */ 4, /* nTokens = */ 30);
+  auto result = ::artm::test::TestMother::FitOfflineModel(8, [phi_matrix_type](::artm::MasterModelConfig* config) {
+    config->set_num_processors(1);  // keep the order of n_wt updates deterministic
+    config->set_phi_matrix_type(phi_matrix_type);
+
+    ::artm::RegularizerConfig* reg_phi = config->add_regularizer_config();
+    reg_phi->set_type(::artm::RegularizerType_SmoothSparsePhi);
+    reg_phi->set_tau(-0.1);
+    reg_phi->set_name("SparsePhi");
+    reg_phi->set_config(::artm::SmoothSparsePhiConfig().SerializeAsString());
+  }, batches);
+
+  for (const auto& model_info : result.info.model()) {
+    if (phi_matrix_type == ::artm::PhiMatrixType_Contiguous) {
+      EXPECT_NE(model_info.type().find("ContiguousPhiMatrix"), std::string::npos);
+    } else {
+      EXPECT_NE(model_info.type().find("DensePhiMatrix"), std::string::npos);
+    }
+  }
+
+  return result;
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=MasterModel.TestContiguousPhiMatrix
+TEST(MasterModel, TestContiguousPhiMatrix) {
+  auto dense = runFitOfflineWithPhiMatrixType(::artm::PhiMatrixType_Dense);
+  auto contiguous = runFitOfflineWithPhiMatrixType(::artm::PhiMatrixType_Contiguous);
+
+  bool ok = false;
+  ::artm::test::Helpers::CompareTopicModels(dense.topic_model, contiguous.topic_model, &ok);
+  ASSERT_TRUE(ok);
+  ASSERT_APPROX_EQ(dense.perplexity_score.value(), contiguous.perplexity_score.value());
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=MasterModel.TestThreadLocalNwt
+TEST(MasterModel, TestThreadLocalNwt) {
+  auto batches = ::artm::test::TestMother::GenerateBatches(/* batches_size = */ 8, /* nTokens = */ 30);
+  auto fit_offline = [&batches](bool use_thread_local_nwt) {  // NOLINT
+    return ::artm::test::TestMother::FitOfflineModel(8, [use_thread_local_nwt](::artm::MasterModelConfig* config) {
+      config->set_num_processors(4);
+      config->set_use_thread_local_nwt(use_thread_local_nwt);
+    }, batches);
+  };
+
+  auto shared = fit_offline(false);
+  auto thread_local_nwt = fit_offline(true);
+
+  bool ok = false;
+  ::artm::test::Helpers::CompareTopicModels(shared.topic_model, thread_local_nwt.topic_model, &ok);
+  ASSERT_TRUE(ok);
+
+  // Shards are reduced by disjoint lock stripes, so n_wt locks must never be contended
+  const ::artm::MasterComponentInfo& thread_local_info = thread_local_nwt.info;
+  for (const auto& model_info : thread_local_info.model()) {
+    if (model_info.name() == thread_local_info.config().nwt_name()) {
+      ASSERT_EQ(model_info.lock_contention_count(), 0);
+      ASSERT_EQ(model_info.lock_contention_time_ns(), 0);
+    }
+  }
+}
+
+::artm::test::TestMother::FitOfflineResult runFitOfflineWithOptForAvx(bool opt_for_avx,
+                                                                     const std::string& blas_library) {
+  // The batch holds more items than one GEMM block of the E-step
+  const int nTokens = 30, nDocs = 300;
+  auto batches = ::artm::test::TestMother::GenerateBatches(/* batches_size = */ 1, nTokens);
+  for (int iDoc = 1; iDoc < nDocs; ++iDoc) {
+    ::artm::Item* item = batches[0]->add_item();
+    item->set_id(iDoc);
+    for (int iToken = 0; iToken < nTokens; ++iToken) {
+      if ((iToken + 1) * (iDoc + 3) % 7 < 3) {
+        item->add_token_id(iToken);
+        item->add_transaction_start_index(item->transaction_start_index_size());
+        item->add_token_weight(static_cast<float>(1 + (iToken + iDoc) % 3));
+      }
+    }
+    item->add_transaction_start_index(item->transaction_start_index_size());
+  }
+
+  return ::artm::test::TestMother::FitOfflineModel(8, [&](::artm::MasterModelConfig* config) {  // NOLINT
+    config->set_opt_for_avx(opt_for_avx);
+    config->set_blas_library(blas_library);
+  }, batches);
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=MasterModel.TestGemmEStep
+TEST(MasterModel, TestGemmEStep) {
+  auto avx = runFitOfflineWithOptForAvx(true, "");
+
+  // Without an external BLAS library the items are processed one by one; with OpenBLAS (when it is installed)
+  // the dense blocks of items of the batch are processed as GEMM
+#if defined(_WIN32)
+  const std::string openblas = "libopenblas.dll";
+#else
+  const std::string openblas = "libopenblas.so.0";
+#endif
+  std::vector<std::string> blas_libraries = { "" };
+  if (::artm::utility::Blas::load(openblas) != ::artm::utility::Blas::builtin()) {
+    blas_libraries.push_back(openblas);
+  }
+
+  for (const std::string& blas_library : blas_libraries) {
+    auto gemm = runFitOfflineWithOptForAvx(false, blas_library);
+
+    bool ok = false;
+    ::artm::test::Helpers::CompareTopicModels(avx.topic_model, gemm.topic_model, &ok);
+    ASSERT_TRUE(ok);
+    ASSERT_APPROX_EQ(avx.perplexity_score.value(), gemm.perplexity_score.value());
+  }
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=MasterModel.TestBatchPrefetch
+TEST(MasterModel, TestBatchPrefetch) {
+  const int nBatches = 8, nPasses = 3;
+  std::string batch_folder = artm::test::Helpers::getUniqueString();
+  ::artm::test::TestMother::GenerateBatches(nBatches, /* nTokens = */ 30, batch_folder);
+
+  auto fit_offline = [&batch_folder](int num_prefetch_batches) {  // NOLINT
+    return ::artm::test::TestMother::FitOfflineModel(8, [num_prefetch_batches](::artm::MasterModelConfig* config) {
+      config->set_num_processors(1);
+      config->set_num_prefetch_batches(num_prefetch_batches);
+    }, batch_folder);
+  };
+
+  auto result = fit_offline(0);
+  auto prefetch_result = fit_offline(2);
+
+  bool ok = false;
+  ::artm::test::Helpers::CompareTopicModels(result.topic_model, prefetch_result.topic_model, &ok);
+  ASSERT_TRUE(ok);
+
+  ASSERT_EQ(result.info.pipeline().num_prefetched_batches(), 0);
+  ASSERT_EQ(result.info.pipeline().num_prefetch_misses(), 0);
+
+  // Each batch is either taken from the prefetcher or loaded by the processor itself
+  const auto& pipeline = prefetch_result.info.pipeline();
+  ASSERT_EQ(pipeline.num_prefetched_batches() + pipeline.num_prefetch_misses(), nBatches * nPasses);
+  ASSERT_EQ(pipeline.prefetched_byte_size(), 0);
+  if (pipeline.num_prefetched_batches() > 0) {
+    ASSERT_GT(pipeline.peak_prefetched_byte_size(), 0);
+  }
+
+  try { boost::filesystem::remove_all(batch_folder); }
+  catch (...) { }
+}
@@ -8,6 +8,8 @@
 #include "boost/filesystem.hpp"
 
 #include "artm/cpp_interface.h"
+#include "artm/core/class_id_registry.h"
+#include "artm/core/dense_phi_matrix.h"
 #include "artm/core/exceptions.h"
 #include "artm/core/common.h"
 
@@ -602,3 +604,41 @@ TEST(MultipleClasses, GetTopicModel) {
   args_theta.set_eps(0.05f);
   VerifySparseVersusDenseThetaMatrix(args_theta, &master);
 }
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=MultipleClasses.ClassIdRegistry
+TEST(MultipleClasses, ClassIdRegistry) {
+  ::artm::core::ClassIdRegistry& registry = ::artm::core::ClassIdRegistry::singleton();
+  const int class_a = registry.Register("@class_registry_a");
+  const int class_b = registry.Register("@class_registry_b");
+  EXPECT_NE(class_a, class_b);
+  EXPECT_EQ(registry.Register("@class_registry_a"), class_a);
+  EXPECT_EQ(registry.Find("@class_registry_b"), class_b);
+  EXPECT_EQ(registry.Find("@class_registry_unknown"), ::artm::core::ClassIdRegistry::kUndefIndex);
+  EXPECT_EQ(registry.class_id(class_b), "@class_registry_b");
+
+  ::google::protobuf::RepeatedPtrField<std::string> topic_name;
+  topic_name.Add()->assign("topic_0");
+  ::artm::core::DensePhiMatrix phi("phi", topic_name, 0.0f);
+  phi.AddToken(::artm::core::Token("@class_registry_a", "token_0"));
+  phi.AddToken(::artm::core::Token("@class_registry_b", "token_0"));
+  phi.AddToken(::artm::core::Token("@class_registry_a", "token_1"));
+  EXPECT_EQ(phi.class_index(0), class_a);
+  EXPECT_EQ(phi.class_index(1), class_b);
+  EXPECT_EQ(phi.class_index(2), class_a);
+
+  ::google::protobuf::RepeatedPtrField<std::string> class_ids;
+  EXPECT_TRUE(::artm::core::ClassIdSet(class_ids).contains(class_b));
+  class_ids.Add()->assign("@class_registry_b");
+  ::artm::core::ClassIdSet class_id_set(class_ids);
+  EXPECT_FALSE(class_id_set.contains(class_a));
+  EXPECT_TRUE(class_id_set.contains(class_b));
+  EXPECT_FALSE(class_id_set.contains(::artm::core::ClassIdRegistry::kUndefIndex));
+
+  ::artm::core::ClassWeights class_weights;
+  EXPECT_EQ(class_weights.weight(class_a), 1.0f);
+  class_weights.Add("@class_registry_a", 0.5f);
+  class_weights.Add("@class_registry_a", 2.0f);  // the first weight wins, as in ProcessBatchesArgs
+  EXPECT_EQ(class_weights.weight(class_a), 0.5f);
+  EXPECT_EQ(class_weights.weight(class_b), 0.0f);
+}
@@ -1,13 +1,21 @@
 // Copyright 2017, Additive Regularization of Topic Models.
 
 #include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "gtest/gtest.h"
 
 #include "artm/cpp_interface.h"
 #include "artm/core/common.h"
+#include "artm/core/contiguous_phi_matrix.h"
+#include "artm/core/dense_phi_matrix.h"
+#include "artm/core/dictionary.h"
 #include "artm/core/instance.h"
+#include "artm/core/phi_matrix_operations.h"
+#include "artm/regularizer/biterms_phi.h"
+#include "artm/regularizer/decorrelator_phi.h"
 
 #include "artm_tests/test_mother.h"
 #include "artm_tests/api.h"
@@ -378,3 +386,297 @@ TEST(Regularizers, RelativeRegularization) {
     ASSERT_NEAR(sparsity_scores.back().value(), true_score[i], 1e-3);
   }
 }
+
+// artm_tests.exe --gtest_filter=Regularizers.ParallelPhiRegularizers
+TEST(Regularizers, ParallelPhiRegularizers) {
+  // One batch, so that the E-step is the same for any number of processors;
+  // enough tokens to split the M-step into several blocks
+  auto batches = ::artm::test::TestMother::GenerateBatches(/* batches_size = */ 1, /* nTokens = */ 10000);
+  auto fit_offline = [&batches](int num_processors) {  // NOLINT
+    return ::artm::test::TestMother::FitOfflineModel(8, [num_processors](::artm::MasterModelConfig* config) {
+      config->set_num_processors(num_processors);
+
+      ::artm::RegularizerConfig* relative_config = config->add_regularizer_config();
+      relative_config->set_name("RelativeSparsePhi");
+      relative_config->set_type(::artm::RegularizerType_SmoothSparsePhi);
+      relative_config->set_tau(-0.5);
+      relative_config->set_gamma(0.5);
+      relative_config->set_config(::artm::SmoothSparsePhiConfig().SerializeAsString());
+
+      ::artm::SmoothSparsePhiConfig smooth_config;
+      smooth_config.add_topic_name("Topic0");
+      smooth_config.add_topic_name("Topic1");
+      ::artm::RegularizerConfig* absolute_config = config->add_regularizer_config();
+      absolute_config->set_name("SmoothPhi");
+      absolute_config->set_type(::artm::RegularizerType_SmoothSparsePhi);
+      absolute_config->set_tau(0.1);
+      absolute_config->set_config(smooth_config.SerializeAsString());
+    }, batches);
+  };
+
+  auto serial = fit_offline(1);
+  auto parallel = fit_offline(4);
+
+  bool ok = false;
+  ::artm::test::Helpers::CompareTopicModels(serial.topic_model, parallel.topic_model, &ok);
+  ASSERT_TRUE(ok);
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=PhiMatrixOperations.ParallelFindPwt
+TEST(PhiMatrixOperations, ParallelFindPwt) {
+  using ::artm::core::PhiMatrixOperations;
+  const int nTokens = 10000, nTopics = 7;  // several blocks of the normalize kernel
+
+  ::google::protobuf::RepeatedPtrField<std::string> topic_name;
+  for (int i = 0; i < nTopics; ++i) {
+    topic_name.Add()->assign("topic" + std::to_string(i));
+  }
+
+  ::artm::core::DensePhiMatrix n_wt("nwt", topic_name, /* min_sparsity_rate = */ 0.6f);
+  ::artm::core::DensePhiMatrix r_wt("rwt", topic_name, /* min_sparsity_rate = */ 0.6f);
+  for (int token_id = 0; token_id < nTokens; ++token_id) {
+    // Runs of tokens of the same class, one class only appears at the end
+    const std::string class_id = (token_id > 9000) ? "@third" : ((token_id / 700) % 2 ? "@first" : "@second");
+    n_wt.AddToken(::artm::core::Token(class_id, "token" + std::to_string(token_id)));
+  }
+  r_wt.Reshape(n_wt);
+
+  for (int token_id = 0; token_id < nTokens; ++token_id) {
+    for (int topic_id = 0; topic_id < nTopics; ++topic_id) {
+      const int somewhat_random = (token_id * 31 + topic_id * 17) % 23;
+      n_wt.set(token_id, topic_id, (somewhat_random < 12) ? 0.0f : somewhat_random * 0.37f);
+      r_wt.set(token_id, topic_id, (somewhat_random % 5) - 2.0f);
+    }
+  }
+  // A topic with no positive values in one of the classes
+  for (int token_id = 9001; token_id < nTokens; ++token_id) {
+    n_wt.set(token_id, 0, 0.0f);
+    r_wt.set(token_id, 0, -1.0f);
+  }
+
+  ::artm::core::Normalizers n_t = PhiMatrixOperations::FindNormalizers(n_wt, r_wt, /* num_threads = */ 1);
+  ::artm::core::Normalizers n_t_parallel = PhiMatrixOperations::FindNormalizers(n_wt, r_wt, /* num_threads = */ 4);
+  ASSERT_EQ(n_t.size(), 3);
+  ASSERT_EQ(n_t, n_t_parallel);
+  ASSERT_EQ(n_t["@third"][0], 0.0f);
+
+  ::artm::core::DensePhiMatrix p_wt("pwt", topic_name, /* min_sparsity_rate = */ 0.6f);
+  ::artm::core::ContiguousPhiMatrix p_wt_parallel("pwt", topic_name, /* min_sparsity_rate = */ 0.6f);
+  p_wt.Reshape(n_wt);
+  p_wt_parallel.Reshape(n_wt);
+  PhiMatrixOperations::FindPwt(n_wt, r_wt, &p_wt, /* num_threads = */ 1);
+  PhiMatrixOperations::FindPwt(n_wt, r_wt, &p_wt_parallel, /* num_threads = */ 4);
+
+  for (int token_id = 0; token_id < nTokens; ++token_id) {
+    const std::vector<float>& nt = n_t[n_wt.token(token_id).class_id];
+    for (int topic_id = 0; topic_id < nTopics; ++topic_id) {
+      const float expected = (nt[topic_id] <= 0) ? 0.0f :
+        std::max(n_wt.get(token_id, topic_id) + r_wt.get(token_id, topic_id), 0.0f) / nt[topic_id];
+      ASSERT_EQ(p_wt.get(token_id, topic_id), expected);
+      ASSERT_EQ(p_wt_parallel.get(token_id, topic_id), expected);
+    }
+  }
+
+  // Normalization in place; the first topic of @third class has no positive values
+  PhiMatrixOperations::FindPwt(n_wt, &n_wt, /* num_threads = */ 3);
+  for (const auto& class_n_t : PhiMatrixOperations::FindNormalizers(n_wt)) {
+    for (int topic_id = 0; topic_id < nTopics; ++topic_id) {
+      const float expected = (class_n_t.first == "@third" && topic_id == 0) ? 0.0f : 1.0f;
+      ASSERT_NEAR(class_n_t.second[topic_id], expected, 1e-4);
+    }
+  }
+}
+
+// artm_tests.exe --gtest_filter=Regularizers.DecorrelatorPhi
+TEST(Regularizers, DecorrelatorPhi) {
+  const int nTopics = 5;
+  ::artm::MasterModelConfig master_config = ::artm::test::TestMother::GenerateMasterModelConfig(nTopics);
+  ::artm::core::DensePhiMatrix p_wt("pwt", master_config.topic_name(), 0.0f);
+  ::artm::core::DensePhiMatrix n_wt("nwt", master_config.topic_name(), 0.0f);
+  for (int i = 0; i < 6; ++i) {
+    p_wt.AddToken(::artm::core::Token(::artm::core::DefaultClass, "token" + std::to_string(i)));
+    for (int topic_id = 0; topic_id < nTopics; ++topic_id) {
+      p_wt.set(i, topic_id, 0.1f * ((i + 2 * topic_id) % 7 + 1));
+    }
+  }
+
+  // n_wt has its own order of tokens and one token that does not present in p_wt
+  for (int i = 6; i >= 0; --i) {
+    n_wt.AddToken(::artm::core::Token(::artm::core::DefaultClass, "token" + std::to_string(i)));
+  }
+
+  auto expected_value = [&p_wt](int token_id, int topic_id, const std::vector<std::pair<int, float>>& pairs) {
+    float weights_sum = 0.0f;
+    for (const auto& pair : pairs) {
+      weights_sum += p_wt.get(token_id, pair.first) * pair.second;
+    }
+    float weight = p_wt.get(token_id, topic_id);
+    return -weight * (weights_sum - weight);
+  };
+
+  // simple case, two topics
+  ::artm::DecorrelatorPhiConfig config;
+  config.add_topic_name("Topic1");
+  config.add_topic_name("Topic3");
+  ::artm::regularizer::DecorrelatorPhi simple_regularizer(config);
+
+  ::artm::core::DensePhiMatrix r_wt("rwt", master_config.topic_name(), 0.0f);
+  r_wt.Reshape(n_wt);
+  float tau = 2.0f;
+  ASSERT_TRUE(simple_regularizer.RegularizePhi(p_wt, n_wt, &r_wt, &tau));
+  for (int i = 0; i < 6; ++i) {
+    int token_nwt_id = n_wt.token_index(p_wt.token(i));
+    for (int topic_id = 0; topic_id < nTopics; ++topic_id) {
+      float expected = 0.0f;
+      if (topic_id == 1 || topic_id == 3) {
+        expected = tau * expected_value(i, topic_id, { { 1, 1.0f }, { 3, 1.0f } });
+      }
+      ASSERT_NEAR(r_wt.get(token_nwt_id, topic_id), expected, 1e-6);
+    }
+  }
+
+  for (int topic_id = 0; topic_id < nTopics; ++topic_id) {
+    ASSERT_EQ(r_wt.get(n_wt.token_index(::artm::core::Token(::artm::core::DefaultClass, "token6")), topic_id), 0.0f);
+  }
+
+  // topic_pairs case; pairs with unknown topics are ignored
+  ::artm::DecorrelatorPhiConfig pairs_config;
+  const std::vector<std::string> first = { "Topic0", "Topic0", "Topic2", "Topic4", "Unknown" };
+  const std::vector<std::string> second = { "Topic1", "Topic4", "Topic0", "Unknown", "Topic0" };
+  const std::vector<float> value = { 0.5f, 2.0f, 1.5f, 1.0f, 1.0f };
+  for (int i = 0; i < static_cast<int>(first.size()); ++i) {
+    pairs_config.add_first_topic_name(first[i]);
+    pairs_config.add_second_topic_name(second[i]);
+    pairs_config.add_value(value[i]);
+  }
+  ::artm::regularizer::DecorrelatorPhi pairs_regularizer(pairs_config);
+
+  ::artm::core::DensePhiMatrix pairs_r_wt("rwt", master_config.topic_name(), 0.0f);
+  pairs_r_wt.Reshape(n_wt);
+  auto agent = pairs_regularizer.CreateRegularizePhiAgent(p_wt, n_wt, nullptr);
+  ASSERT_NE(agent, nullptr);
+  agent->Apply(0, 3, &pairs_r_wt);
+  agent->Apply(3, n_wt.token_size(), &pairs_r_wt);
+  for (int i = 0; i < 6; ++i) {
+    int token_nwt_id = n_wt.token_index(p_wt.token(i));
+    ASSERT_NEAR(pairs_r_wt.get(token_nwt_id, 0), expected_value(i, 0, { { 1, 0.5f }, { 4, 2.0f } }), 1e-6);
+    ASSERT_NEAR(pairs_r_wt.get(token_nwt_id, 2), expected_value(i, 2, { { 0, 1.5f } }), 1e-6);
+    ASSERT_NEAR(pairs_r_wt.get(token_nwt_id, 4), expected_value(i, 4, {}), 1e-6);
+    ASSERT_EQ(pairs_r_wt.get(token_nwt_id, 1), 0.0f);
+    ASSERT_EQ(pairs_r_wt.get(token_nwt_id, 3), 0.0f);
+  }
+}
+
+// artm_tests.exe --gtest_filter=Regularizers.BitermsPhi
+TEST(Regularizers, BitermsPhi) {
+  const int nTopics = 4;
+  const int nTokens = 6;
+  ::artm::MasterModelConfig master_config = ::artm::test::TestMother::GenerateMasterModelConfig(nTopics);
+
+  std::string dictionary_name = ::artm::test::Helpers::getUniqueString();
+  auto dictionary = std::make_shared< ::artm::core::Dictionary>(dictionary_name);
+  ::artm::core::DensePhiMatrix n_wt("nwt", master_config.topic_name(), 0.0f);
+  for (int i = 0; i < nTokens; ++i) {
+    ::artm::core::Token token(::artm::core::DefaultClass, "token" + std::to_string(i));
+    dictionary->AddEntry(::artm::core::DictionaryEntry(token, 0.0f, 1.0f, 1.0f));
+    n_wt.AddToken(token);
+    for (int topic_id = 0; topic_id < nTopics; ++topic_id) {
+      n_wt.set(i, topic_id, static_cast<float>((i + 3 * topic_id) % 5));
+    }
+  }
+
+  // the dictionary also has a token that does not present in the model
+  dictionary->AddEntry(::artm::core::DictionaryEntry(
+    ::artm::core::Token(::artm::core::DefaultClass, "unknown"), 0.0f, 1.0f, 1.0f));
+  for (int i = 0; i < nTokens + 1; ++i) {
+    for (int j = 0; j < nTokens + 1; ++j) {
+      if (i != j && (i + j) % 3 != 0) {
+        dictionary->AddCoocValue(i, j, 0.5f + i + 2 * j);
+      }
+    }
+  }
+  dictionary->FinalizeCooc();
+  ::artm::core::ThreadSafeDictionaryCollection::singleton().set(dictionary_name, dictionary);
+
+  // p_wt has zeros, that are skipped with use_sparse_topics
+  ::artm::core::ContiguousPhiMatrix p_wt("pwt", master_config.topic_name(), 0.0f);
+  p_wt.Reshape(n_wt);
+  ::artm::core::DensePhiMatrix dense_p_wt("pwt", master_config.topic_name(), 0.0f);
+  dense_p_wt.Reshape(n_wt);
+  for (int i = 0; i < nTokens; ++i) {
+    for (int topic_id = 0; topic_id < nTopics; ++topic_id) {
+      p_wt.set(i, topic_id, 0.05f * n_wt.get(i, topic_id));
+      dense_p_wt.set(i, topic_id, 0.05f * n_wt.get(i, topic_id));
+    }
+  }
+
+  std::vector<float> n_t(nTopics, 0.0f);
+  for (int i = 0; i < nTokens; ++i) {
+    for (int topic_id = 0; topic_id < nTopics; ++topic_id) {
+      n_t[topic_id] += n_wt.get(i, topic_id);
+    }
+  }
+
+  const std::vector<int> topics = { 0, 1, 3 };
+  auto expected_value = [&](int token_id, int topic_id) {  // NOLINT
+    float value = 0.0f;
+    ::artm::core::CoocRow row = dictionary->token_cooc_values(token_id);
+    for (int i = 0; i < row.size(); ++i) {
+      if (row.column(i) >= nTokens) {
+        continue;
+      }
+
+      float norm = 0.0f;
+      for (int t : topics) {
+        norm += n_t[t] * p_wt.get(token_id, t) * p_wt.get(row.column(i), t);
+      }
+
+      float p_tuw = n_t[topic_id] * p_wt.get(token_id, topic_id) * p_wt.get(row.column(i), topic_id);
+      if (norm > 0.0f && p_tuw > 0.0f) {
+        value += p_tuw / norm * row.value(i);
+      }
+    }
+    return value;
+  };
+
+  for (bool use_sparse_topics : { true, false }) {
+    ::artm::BitermsPhiConfig config;
+    config.set_dictionary_name(dictionary_name);
+    config.set_use_sparse_topics(use_sparse_topics);
+    config.add_topic_name("Topic0");
+    config.add_topic_name("Topic1");
+    config.add_topic_name("Topic3");
+    ::artm::regularizer::BitermsPhi regularizer(config);
+
+    ::artm::core::DensePhiMatrix r_wt("rwt", master_config.topic_name(), 0.0f);
+    r_wt.Reshape(n_wt);
+    float tau = 2.0f;
+    ASSERT_TRUE(regularizer.RegularizePhi(p_wt, n_wt, &r_wt, &tau));
+
+    // the agent gives the same values on token ranges and on non-contiguous p_wt
+    ::artm::core::DensePhiMatrix agent_r_wt("rwt", master_config.topic_name(), 0.0f);
+    agent_r_wt.Reshape(n_wt);
+    auto agent = regularizer.CreateRegularizePhiAgent(dense_p_wt, n_wt, &tau);
+    ASSERT_NE(agent, nullptr);
+    agent->Apply(0, 2, &agent_r_wt);
+    agent->Apply(2, nTokens, &agent_r_wt);
+
+    for (int i = 0; i < nTokens; ++i) {
+      for (int topic_id = 0; topic_id < nTopics; ++topic_id) {
+        float expected = (topic_id == 2) ? 0.0f : tau * expected_value(i, topic_id);
+        ASSERT_NEAR(r_wt.get(i, topic_id), expected, 1e-5);
+        ASSERT_NEAR(agent_r_wt.get(i, topic_id), expected, 1e-5);
+      }
+    }
+  }
+
+  // the regularizer is skipped without a dictionary
+  ::artm::regularizer::BitermsPhi no_dictionary_regularizer((::artm::BitermsPhiConfig()));
+  ::artm::core::DensePhiMatrix r_wt("rwt", master_config.topic_name(), 0.0f);
+  r_wt.Reshape(n_wt);
+  ASSERT_EQ(no_dictionary_regularizer.CreateRegularizePhiAgent(p_wt, n_wt, nullptr), nullptr);
+  ASSERT_FALSE(no_dictionary_regularizer.RegularizePhi(p_wt, n_wt, &r_wt, nullptr));
+
+  ::artm::core::ThreadSafeDictionaryCollection::singleton().erase(dictionary_name);
+}
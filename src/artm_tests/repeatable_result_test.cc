@@ -1,5 +1,10 @@
 // Copyright 2017, Additive Regularization of Topic Models.
 
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
 #include "boost/thread.hpp"
 #include "gtest/gtest.h"
 
@@ -12,6 +17,7 @@
 #include "artm/core/token.h"
 
 #include "artm/core/call_on_destruction.h"
+#include "artm/utility/simd_kernels.h"
 
 #include "artm_tests/test_mother.h"
 #include "artm_tests/api.h"
@@ -19,9 +25,7 @@
 using artm::core::Helpers;
 using artm::core::Token;
 
-std::string runOfflineTest() {
-  const int nTopics = 5;
-
+void fitOfflineModel(int nTopics, ::artm::TopicModel* topic_model, std::vector< ::artm::ThetaMatrix>* theta_matrices) {
   ::artm::MasterModelConfig master_config = ::artm::test::TestMother::GenerateMasterModelConfig(nTopics);
   master_config.set_cache_theta(true);
   master_config.set_num_processors(1);
@@ -38,15 +42,24 @@ std::string runOfflineTest() {
     master_component.FitOfflineModel(offline_args);
   }
 
-  ::artm::TopicModel topic_model = master_component.GetTopicModel();
-  std::stringstream ss;
-  ss << "Topic model:\n" << ::artm::test::Helpers::DescribeTopicModel(topic_model);
-  ss << "Theta matrix:\n";
+  *topic_model = master_component.GetTopicModel();
   for (unsigned i = 0; i < batches.size(); ++i) {
     ::artm::TransformMasterModelArgs args;
     args.add_batch_filename(batches[i]->id());
     args.set_theta_matrix_type(::artm::ThetaMatrixType_Dense);
-    auto theta_matrix = master_component.Transform(args);
+    theta_matrices->push_back(master_component.Transform(args));
+  }
+}
+
+std::string runOfflineTest(int nTopics = 5) {
+  ::artm::TopicModel topic_model;
+  std::vector< ::artm::ThetaMatrix> theta_matrices;
+  fitOfflineModel(nTopics, &topic_model, &theta_matrices);
+
+  std::stringstream ss;
+  ss << "Topic model:\n" << ::artm::test::Helpers::DescribeTopicModel(topic_model);
+  ss << "Theta matrix:\n";
+  for (const auto& theta_matrix : theta_matrices) {
     ss << ::artm::test::Helpers::DescribeThetaMatrix(theta_matrix);
   }
 
@@ -63,6 +76,132 @@ TEST(RepeatableResult, Offline) {
   ASSERT_EQ(first_result, second_result);
 }
 
+std::vector< ::artm::utility::SimdKernels*> getSupportedSimdKernels() {
+  std::vector< ::artm::utility::SimdKernels*> retval;
+  for (auto kernels : { ::artm::utility::SimdKernels::avx2(),
+                        ::artm::utility::SimdKernels::avx512(),
+                        ::artm::utility::SimdKernels::neon() }) {
+    if (kernels != nullptr) {
+      retval.push_back(kernels);
+    }
+  }
+  return retval;
+}
+
+// artm_tests.exe --gtest_filter=RepeatableResult.SimdKernels
+TEST(RepeatableResult, SimdKernels) {
+  ::artm::utility::SimdKernels* scalar = ::artm::utility::SimdKernels::scalar();
+  const int y_size = 1200;
+  std::vector<float> y = Helpers::GenerateRandomVector(y_size, 17);
+  for (float& value : y) {
+    value -= 0.5f;
+  }
+
+  for (int size : { 0, 1, 7, 15, 16, 17, 31, 32, 33, 100, 1000 }) {
+    std::vector<float> x = Helpers::GenerateRandomVector(size, size + 1);
+    std::vector<int> indx;
+    for (int k = 0; k < size; ++k) {
+      indx.push_back((k * 7 + 3) % y_size);
+    }
+
+    for (auto kernels : getSupportedSimdKernels()) {
+      ASSERT_EQ(scalar->sdot(size, x.data(), y.data()), kernels->sdot(size, x.data(), y.data())) << kernels->name();
+      ASSERT_EQ(scalar->sdoti(size, x.data(), indx.data(), y.data()),
+                kernels->sdoti(size, x.data(), indx.data(), y.data())) << kernels->name();
+
+      std::vector<float> expected(y), actual(y);
+      scalar->saxpy(size, 0.37f, x.data(), expected.data());
+      kernels->saxpy(size, 0.37f, x.data(), actual.data());
+      ASSERT_EQ(expected, actual) << kernels->name();
+
+      expected = y; actual = y;
+      scalar->saxpyi(size, -1.3f, x.data(), indx.data(), expected.data());
+      kernels->saxpyi(size, -1.3f, x.data(), indx.data(), actual.data());
+      ASSERT_EQ(expected, actual) << kernels->name();
+    }
+
+    // sdoti over the non-zero elements must be equal to sdot over the dense vector
+    std::vector<float> dense_x(size, 0.0f), sparse_x;
+    std::vector<int> sparse_indx;
+    for (int k = 0; k < size; k += 3) {
+      dense_x[k] = x[k];
+      sparse_x.push_back(x[k]);
+      sparse_indx.push_back(k);
+    }
+
+    const float dense_result = scalar->sdot(size, dense_x.data(), y.data());
+    ASSERT_EQ(dense_result, scalar->sdoti(sparse_x.size(), sparse_x.data(), sparse_indx.data(), y.data()));
+    for (auto kernels : getSupportedSimdKernels()) {
+      ASSERT_EQ(dense_result, kernels->sdot(size, dense_x.data(), y.data())) << kernels->name();
+      ASSERT_EQ(dense_result, kernels->sdoti(sparse_x.size(), sparse_x.data(), sparse_indx.data(), y.data()))
+        << kernels->name();
+    }
+  }
+}
+
+// artm_tests.exe --gtest_filter=RepeatableResult.SimdKernelsOffline
+TEST(RepeatableResult, SimdKernelsOffline) {
+  ::artm::core::call_on_destruction c([&]() {  // NOLINT
+    ::artm::utility::SimdKernels::set_preferred(nullptr);
+  });
+
+  // 37 topics exercise both the vectorized blocks and the tail of each kernel
+  const int nTopics = 37;
+  ::artm::utility::SimdKernels::set_preferred(::artm::utility::SimdKernels::scalar());
+  std::string scalar_result = runOfflineTest(nTopics);
+
+  for (auto kernels : getSupportedSimdKernels()) {
+    ::artm::utility::SimdKernels::set_preferred(kernels);
+    std::string result = runOfflineTest(nTopics);
+    ASSERT_EQ(scalar_result, result) << kernels->name();
+  }
+}
+
+// artm_tests.exe --gtest_filter=RepeatableResult.SimdKernelsVsSequentialLoops
+TEST(RepeatableResult, SimdKernelsVsSequentialLoops) {
+  ::artm::core::call_on_destruction c([&]() {  // NOLINT
+    ::artm::utility::SimdKernels::set_preferred(nullptr);
+  });
+
+  const int nTopics = 37;
+  ::artm::TopicModel expected_model, actual_model;
+  std::vector< ::artm::ThetaMatrix> expected_theta, actual_theta;
+  ::artm::utility::SimdKernels::set_preferred(::artm::utility::SimdKernels::sequential());
+  fitOfflineModel(nTopics, &expected_model, &expected_theta);
+  ::artm::utility::SimdKernels::set_preferred(nullptr);
+  fitOfflineModel(nTopics, &actual_model, &actual_theta);
+
+  // Partial sums change the rounding of p_dw compared to the sequential loops used before SimdKernels
+  float max_phi_diff = 0.0f;
+  ASSERT_EQ(expected_model.token_size(), actual_model.token_size());
+  for (int i = 0; i < expected_model.token_weights_size(); ++i) {
+    ASSERT_EQ(expected_model.token(i), actual_model.token(i));
+    for (int k = 0; k < expected_model.token_weights(i).value_size(); ++k) {
+      max_phi_diff = std::max(max_phi_diff, std::abs(expected_model.token_weights(i).value(k) -
+                                                     actual_model.token_weights(i).value(k)));
+    }
+  }
+
+  float max_theta_diff = 0.0f;
+  ASSERT_EQ(expected_theta.size(), actual_theta.size());
+  for (unsigned b = 0; b < expected_theta.size(); ++b) {
+    ASSERT_EQ(expected_theta[b].item_id_size(), actual_theta[b].item_id_size());
+    for (int d = 0; d < expected_theta[b].item_weights_size(); ++d) {
+      for (int k = 0; k < expected_theta[b].item_weights(d).value_size(); ++k) {
+        max_theta_diff = std::max(max_theta_diff, std::abs(expected_theta[b].item_weights(d).value(k) -
+                                                           actual_theta[b].item_weights(d).value(k)));
+      }
+    }
+  }
+
+  RecordProperty("max_phi_diff", std::to_string(max_phi_diff));
+  RecordProperty("max_theta_diff", std::to_string(max_theta_diff));
+  std::cout << ::artm::utility::SimdKernels::best()->name() << " vs sequential loops: max |p_wt| diff = "
+            << max_phi_diff << ", max |theta| diff = " << max_theta_diff << std::endl;
+  ASSERT_LT(max_phi_diff, 1e-5);
+  ASSERT_LT(max_theta_diff, 1e-5);
+}
+
 // artm_tests.exe --gtest_filter=RepeatableResult.RandomGenerator
 TEST(RepeatableResult, RandomGenerator) {
   int num = 10;
@@ -8,7 +8,9 @@
 
 #include "artm/cpp_interface.h"
 #include "artm/core/common.h"
+#include "artm/core/dense_phi_matrix.h"
 #include "artm/core/instance.h"
+#include "artm/score/perplexity.h"
 
 #include "artm_tests/test_mother.h"
 #include "artm_tests/api.h"
@@ -142,6 +144,68 @@ TEST(Scores, Perplexity) {
   ASSERT_EQ(score.transaction_typename_info_size(), 0);
 }
 
+// artm_tests.exe --gtest_filter=Scores.PerplexityAppendBatch
+TEST(Scores, PerplexityAppendBatch) {
+  int nTokens = 60, nDocs = 10, nTopics = 10;
+
+  ::artm::ScoreConfig score_config;
+  score_config.set_config(::artm::PerplexityScoreConfig().SerializeAsString());
+  score_config.set_type(::artm::ScoreType_Perplexity);
+  score_config.set_name("perplexity");
+  ::artm::score::Perplexity perplexity(score_config);
+
+  artm::Batch batch = ::artm::test::Helpers::GenerateBatch(nTokens, nDocs, "@default_class", "@some_class");
+  std::vector< ::artm::core::Token> token_dict;
+  ::google::protobuf::RepeatedPtrField<std::string> topic_name;
+  for (int topic_index = 0; topic_index < nTopics; ++topic_index) {
+    topic_name.Add()->assign("topic_" + std::to_string(topic_index));
+  }
+
+  // the last tokens are not in the model, and every tenth token has zero probability in all topics
+  ::artm::core::DensePhiMatrix p_wt("pwt", topic_name, 0.0f);
+  for (int token_index = 0; token_index < nTokens; ++token_index) {
+    token_dict.push_back(::artm::core::Token(batch.class_id(token_index), batch.token(token_index)));
+    if (token_index < nTokens - 5) {
+      const int token_id = p_wt.AddToken(token_dict.back());
+      for (int topic_index = 0; (topic_index < nTopics) && (token_index % 10 != 0); ++topic_index) {
+        p_wt.set(token_id, topic_index, ((token_index + topic_index) % 3) / 50.0f);
+      }
+    }
+  }
+
+  std::vector<float> theta(nTopics * nDocs);
+  for (size_t i = 0; i < theta.size(); ++i) {
+    theta[i] = ((i % 7) + 1) / 30.0f;
+  }
+
+  ::artm::ProcessBatchesArgs args;
+  args.add_class_id("@default_class");
+  args.add_class_weight(0.5f);
+  args.add_class_id("@some_class");
+  args.add_class_weight(2.0f);
+
+  // appending the whole batch must give the same score as appending item by item
+  auto batch_score = perplexity.CreateScore();
+  static_cast< ::artm::ScoreCalculatorInterface&>(perplexity).AppendScore(
+    batch, token_dict, p_wt, args, theta.data(), batch_score.get());
+
+  auto item_score = perplexity.CreateScore();
+  for (int item_index = 0; item_index < nDocs; ++item_index) {
+    perplexity.AppendScore(batch.item(item_index), batch, token_dict, p_wt, args,
+                           theta.data() + item_index * nTopics, item_score.get());
+  }
+
+  const auto& batch_perplexity = static_cast<const ::artm::PerplexityScore&>(*batch_score);
+  const auto& item_perplexity = static_cast<const ::artm::PerplexityScore&>(*item_score);
+  ASSERT_GT(batch_perplexity.normalizer(), 0.0);
+  ASSERT_LT(batch_perplexity.raw(), 0.0);
+  ASSERT_GT(batch_perplexity.zero_words(), 0);
+  ASSERT_NEAR(batch_perplexity.normalizer(), item_perplexity.normalizer(), 1e-6 * item_perplexity.normalizer());
+  ASSERT_NEAR(batch_perplexity.raw(), item_perplexity.raw(), -1e-6 * item_perplexity.raw());
+  ASSERT_EQ(batch_perplexity.zero_words(), item_perplexity.zero_words());
+  ASSERT_NEAR(batch_perplexity.value(), item_perplexity.value(), 1e-4 * item_perplexity.value());
+}
+
 // artm_tests.exe --gtest_filter=Scores.ScoreTrackerExportImport
 TEST(Scores, ScoreTrackerExportImport) {
   int nTokens = 60, nDocs = 10, nTopics = 10, nPasses = 5;
@@ -10,11 +10,27 @@
 #include "artm/cpp_interface.h"
 #include "artm/core/helpers.h"
 
+#include "artm_tests/api.h"
+
 namespace artm {
 namespace test {
 
 namespace fs = boost::filesystem;
 
+namespace {
+
+TestMother::FitOfflineResult GetFitOfflineResult(MasterModel* master_model) {
+  TestMother::FitOfflineResult result;
+  GetScoreValueArgs get_score_args;
+  get_score_args.set_score_name("PerplexityScore");
+  result.perplexity_score = master_model->GetScoreAs<PerplexityScore>(get_score_args);
+  result.info = master_model->info();
+  result.topic_model = master_model->GetTopicModel();
+  return result;
+}
+
+}  // namespace
+
 artm::Batch Helpers::GenerateBatch(int nTokens, int nDocs,
                                    const std::string& class1, const std::string& class2) {
   artm::Batch batch;
@@ -238,5 +254,48 @@ void TestMother::GenerateBatches(int batches_size, int nTokens, const std::strin
   }
 }
 
+TestMother::FitOfflineResult TestMother::FitOfflineModel(
+    int nTopics, const std::function<void(MasterModelConfig*)>& configure_master_model,
+    const std::vector<std::shared_ptr< ::artm::Batch>>& batches) {
+  MasterModelConfig config = GenerateMasterModelConfig(nTopics);
+  Helpers::ConfigurePerplexityScore("PerplexityScore", &config);
+  configure_master_model(&config);
+
+  MasterModel master_model(config);
+  Api api(master_model);
+
+  FitOfflineMasterModelArgs fit_offline_args = api.Initialize(batches);
+  fit_offline_args.set_num_collection_passes(3);
+  master_model.FitOfflineModel(fit_offline_args);
+  return GetFitOfflineResult(&master_model);
+}
+
+TestMother::FitOfflineResult TestMother::FitOfflineModel(
+    int nTopics, const std::function<void(MasterModelConfig*)>& configure_master_model,
+    const std::string& batch_folder) {
+  MasterModelConfig config = GenerateMasterModelConfig(nTopics);
+  Helpers::ConfigurePerplexityScore("PerplexityScore", &config);
+  configure_master_model(&config);
+
+  MasterModel master_model(config);
+
+  GatherDictionaryArgs gather_args;
+  gather_args.set_data_path(batch_folder);
+  gather_args.set_dictionary_target_name("dictionary");
+  master_model.GatherDictionary(gather_args);
+
+  InitializeModelArgs init_model_args;
+  init_model_args.set_dictionary_name("dictionary");
+  init_model_args.set_model_name(config.pwt_name());
+  init_model_args.mutable_topic_name()->CopyFrom(config.topic_name());
+  master_model.InitializeModel(init_model_args);
+
+  FitOfflineMasterModelArgs fit_offline_args;
+  fit_offline_args.set_batch_folder(batch_folder);
+  fit_offline_args.set_num_collection_passes(3);
+  master_model.FitOfflineModel(fit_offline_args);
+  return GetFitOfflineResult(&master_model);
+}
+
 }  // namespace test
 }  // namespace artm
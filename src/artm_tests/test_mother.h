@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -47,6 +49,23 @@ class TestMother {
     int batches_size, int nTokens, ::artm::DictionaryData* dictionary = nullptr);
   static void GenerateBatches(int batches_size, int nTokens, const std::string& target_folder);
 
+  struct FitOfflineResult {
+    TopicModel topic_model;
+    PerplexityScore perplexity_score;  // score "PerplexityScore" after the last pass
+    MasterComponentInfo info;
+  };
+
+  // Fits the model of GenerateMasterModelConfig(nTopics), changed by configure_master_model,
+  // over the batches for three collection passes. Used by the tests that compare two configurations.
+  static FitOfflineResult FitOfflineModel(int nTopics,
+                                          const std::function<void(MasterModelConfig*)>& configure_master_model,
+                                          const std::vector<std::shared_ptr< ::artm::Batch>>& batches);
+
+  // The same over the batches of batch_folder; the model is initialized from the dictionary of the folder.
+  static FitOfflineResult FitOfflineModel(int nTopics,
+                                          const std::function<void(MasterModelConfig*)>& configure_master_model,
+                                          const std::string& batch_folder);
+
  private:
   const std::string regularizer_name;
 };
@@ -2,7 +2,9 @@
 
 #include "artm/core/thread_safe_holder.h"
 
+#include <atomic>
 #include <future>  // NOLINT
+#include <vector>
 
 #include "boost/thread/mutex.hpp"
 #include "boost/thread/future.hpp"
@@ -12,6 +14,7 @@
 
 using ::artm::core::ThreadSafeHolder;
 using ::artm::core::ThreadSafeCollectionHolder;
+using ::artm::core::WorkStealingQueue;
 
 // To run this particular test:
 // artm_tests.exe --gtest_filter=ThreadSafeHolder.*
@@ -33,6 +36,118 @@ TEST(ThreadSafeHolder, Basic) {
   EXPECT_FALSE(collection_holder.has_key(key1));
 }
 
+// To run this particular test:
+// artm_tests.exe --gtest_filter=WorkStealingQueue.*
+TEST(WorkStealingQueue, Basic) {
+  WorkStealingQueue<int> queue;
+  queue.set_num_workers(2);
+  for (int i = 0; i < 4; ++i) {
+    queue.push(i);
+  }
+
+  // Tasks are distributed round-robin; both owners and thieves pop from the front
+  int value = -1;
+  ASSERT_EQ(queue.size(), 4);
+  ASSERT_TRUE(queue.try_pop(0, &value));
+  EXPECT_EQ(value, 0);
+  ASSERT_TRUE(queue.try_pop(0, &value));
+  EXPECT_EQ(value, 2);
+  ASSERT_TRUE(queue.try_pop(0, &value));
+  EXPECT_EQ(value, 1);
+  ASSERT_TRUE(queue.try_pop(1, &value));
+  EXPECT_EQ(value, 3);
+  ASSERT_FALSE(queue.try_pop(1, &value));
+  ASSERT_TRUE(queue.empty());
+}
+
+TEST(WorkStealingQueue, Stealing) {
+  const int num_workers = 3, num_tasks = 9;
+  WorkStealingQueue<int> queue;
+  queue.set_num_workers(num_workers);
+  for (int i = 0; i < num_tasks; ++i) {
+    queue.push(i);
+  }
+
+  // Worker 1 drains its own deque, then steals the other deques one by one, each in the order of push
+  const std::vector<int> expected = { 1, 4, 7, 2, 5, 8, 0, 3, 6 };
+  for (int expected_value : expected) {
+    int value = -1;
+    ASSERT_TRUE(queue.try_pop(1, &value));
+    EXPECT_EQ(value, expected_value);
+  }
+  ASSERT_TRUE(queue.empty());
+
+  // Only thieves are running; each task must be taken exactly once
+  const int num_thieves = 4, num_stolen_tasks = 10000;
+  queue.set_num_workers(num_thieves + 1);
+  for (int i = 0; i < num_stolen_tasks; ++i) {
+    queue.push(i);
+  }
+
+  std::vector<std::atomic<int>> taken(num_stolen_tasks);
+  for (auto& counter : taken) {
+    counter = 0;
+  }
+
+  std::vector<std::future<void>> thieves;
+  for (int thief_index = 0; thief_index < num_thieves; ++thief_index) {
+    thieves.push_back(std::async(std::launch::async, [&queue, &taken, thief_index]() {
+      int value;
+      // Thief deques are drained first, then the deque of the idle worker is stolen concurrently
+      while (queue.try_pop(thief_index + 1, &value)) {
+        taken[value]++;
+      }
+    }));
+  }
+
+  for (auto& thief : thieves) {
+    thief.wait();
+  }
+
+  ASSERT_TRUE(queue.empty());
+  for (int i = 0; i < num_stolen_tasks; ++i) {
+    ASSERT_EQ(taken[i], 1);
+  }
+}
+
+TEST(WorkStealingQueue, BlockingPop) {
+  const int num_workers = 3, num_tasks = 1000;
+  WorkStealingQueue<int> queue;
+  queue.set_num_workers(num_workers);
+
+  std::atomic<bool> is_stopping(false);
+  std::atomic<int> sum(0), count(0);
+  std::vector<std::future<void>> workers;
+  for (int worker_index = 0; worker_index < num_workers; ++worker_index) {
+    workers.push_back(std::async(std::launch::async, [&, worker_index]() {
+      int value;
+      while (queue.pop(worker_index, is_stopping, &value)) {
+        sum += value;
+        count++;
+      }
+    }));
+  }
+
+  int expected_sum = 0;
+  for (int i = 0; i < num_tasks; ++i) {
+    queue.push(i);
+    expected_sum += i;
+  }
+
+  while (count < num_tasks) {
+    std::this_thread::yield();
+  }
+
+  is_stopping = true;
+  queue.notify_all();
+  for (auto& worker : workers) {
+    worker.wait();
+  }
+
+  ASSERT_EQ(sum, expected_sum);
+  ASSERT_TRUE(queue.empty());
+}
+
 // To run this particular test:
 // artm_tests.exe --gtest_filter=Async.*
 TEST(Async, Std) {
@@ -0,0 +1,175 @@
+// Copyright 2018, Additive Regularization of Topic Models.
+
+#include "artm/core/token_index.h"
+
+#include <chrono>  // NOLINT
+#include <iostream>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "artm/core/dense_phi_matrix.h"
+#include "artm/utility/memory_usage.h"
+
+using ::artm::core::ClassId;
+using ::artm::core::Token;
+using ::artm::core::TokenIndex;
+
+namespace {
+
+std::vector<Token> GenerateTokens(int num_tokens, int num_classes) {
+  std::vector<Token> retval;
+  retval.reserve(num_tokens);
+  for (int i = 0; i < num_tokens; ++i) {
+    retval.push_back(Token("@class_" + std::to_string(i % num_classes), "token_" + std::to_string(i)));
+  }
+  return retval;
+}
+
+double ElapsedSeconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=TokenIndex.*
+TEST(TokenIndex, Basic) {
+  const int num_tokens = 10000;
+  std::vector<Token> tokens = GenerateTokens(num_tokens, 3);
+
+  TokenIndex index;
+  EXPECT_TRUE(index.empty());
+  for (int i = 0; i < num_tokens; ++i) {
+    ASSERT_EQ(index.Add(tokens[i]), i);
+  }
+
+  // Adding existing tokens does not change the index
+  for (int i = 0; i < num_tokens; i += 7) {
+    ASSERT_EQ(index.Add(tokens[i].class_id, tokens[i].keyword), i);
+  }
+  ASSERT_EQ(index.size(), num_tokens);
+
+  for (int i = 0; i < num_tokens; ++i) {
+    ASSERT_EQ(index.Find(tokens[i]), i);
+    ASSERT_EQ(index.Find(tokens[i].class_id, tokens[i].keyword), i);
+    ASSERT_EQ(index.keyword(i), tokens[i].keyword);
+    ASSERT_EQ(index.class_id(i), tokens[i].class_id);
+    ASSERT_EQ(index.token(i), tokens[i]);
+  }
+
+  // Keyword and class_id must both match
+  EXPECT_EQ(index.Find("@class_1", "token_0"), TokenIndex::kUndefIndex);
+  EXPECT_EQ(index.Find("@class_0", "token_1"), TokenIndex::kUndefIndex);
+  EXPECT_EQ(index.Find("@class_0", "token_"), TokenIndex::kUndefIndex);
+  EXPECT_EQ(index.Find("", ""), TokenIndex::kUndefIndex);
+  EXPECT_EQ(index.Add("", ""), num_tokens);
+  EXPECT_EQ(index.Find(Token("", "")), num_tokens);
+
+  TokenIndex copy(index);
+  index.Clear();
+  EXPECT_EQ(index.size(), 0);
+  EXPECT_EQ(index.Find(tokens[0]), TokenIndex::kUndefIndex);
+  EXPECT_EQ(copy.Find(tokens[num_tokens - 1]), num_tokens - 1);
+
+  index.Swap(&copy);
+  EXPECT_EQ(index.size(), num_tokens + 1);
+  EXPECT_EQ(copy.size(), 0);
+  EXPECT_EQ(index.Find(tokens[num_tokens / 2]), num_tokens / 2);
+}
+
+TEST(TokenIndex, TokenCollection) {
+  const int num_tokens = 1000;
+  std::vector<Token> tokens = GenerateTokens(num_tokens, 3);
+
+  ::artm::core::TokenCollection collection;
+  for (int i = 0; i < num_tokens; ++i) {
+    ASSERT_EQ(collection.AddToken(tokens[i]), i);
+  }
+
+  const int64_t version = collection.version();
+  ASSERT_EQ(collection.AddToken(tokens[num_tokens / 2]), num_tokens / 2);
+  ASSERT_EQ(collection.version(), version);
+  ASSERT_EQ(collection.token_size(), num_tokens);
+
+  for (int i = 0; i < num_tokens; ++i) {
+    ASSERT_EQ(collection.token_id(tokens[i]), i);
+    ASSERT_EQ(collection.token_id(tokens[i].class_id, tokens[i].keyword), i);
+    ASSERT_EQ(collection.token(i), tokens[i]);
+  }
+
+  EXPECT_FALSE(collection.has_token(Token("@class_1", "token_0")));
+  EXPECT_EQ(collection.token_id("@class_0", "token_1"), TokenIndex::kUndefIndex);
+
+  ::artm::core::TokenCollection other;
+  other.Swap(&collection);
+  EXPECT_EQ(collection.token_size(), 0);
+  EXPECT_FALSE(collection.has_token(tokens[0]));
+  EXPECT_EQ(other.token_id(tokens[num_tokens - 1]), num_tokens - 1);
+}
+
+// Compares the token lookup of phi matrix against std::unordered_map<Token, int, TokenHasher>.
+// It is disabled because it takes several minutes and tens of gigabytes of memory; to run it:
+// artm_tests.exe --gtest_filter=TokenIndex.DISABLED_Benchmark --gtest_also_run_disabled_tests
+TEST(TokenIndex, DISABLED_Benchmark) {
+  for (int num_tokens : { 1000000, 10000000, 50000000 }) {
+    std::vector<Token> tokens = GenerateTokens(num_tokens, 4);
+
+    {
+      auto start = std::chrono::steady_clock::now();
+      std::unordered_map<Token, int, ::artm::core::TokenHasher> token_map;
+      for (int i = 0; i < num_tokens; ++i) {
+        token_map.insert(std::make_pair(tokens[i], i));
+      }
+      const double add_time = ElapsedSeconds(start);
+
+      start = std::chrono::steady_clock::now();
+      int64_t checksum = 0;
+      for (int i = num_tokens - 1; i >= 0; --i) {
+        checksum += token_map.find(tokens[i])->second;
+      }
+      const double find_time = ElapsedSeconds(start);
+
+      std::cout << "std::unordered_map, " << num_tokens << " tokens: add " << add_time << " sec, find "
+                << find_time << " sec, " << ::artm::utility::getMemoryUsage(token_map) / (1024 * 1024)
+                << " MB without the keys (checksum " << checksum << ")" << std::endl;
+    }
+
+    {
+      auto start = std::chrono::steady_clock::now();
+      ::google::protobuf::RepeatedPtrField<std::string> topic_name;
+      topic_name.Add()->assign("topic_0");
+      ::artm::core::DensePhiMatrix phi("phi", topic_name, 0.0f);
+      for (int i = 0; i < num_tokens; ++i) {
+        phi.AddToken(tokens[i]);
+      }
+      const double add_time = ElapsedSeconds(start);
+
+      start = std::chrono::steady_clock::now();
+      int64_t checksum = 0;
+      for (int i = num_tokens - 1; i >= 0; --i) {
+        checksum += phi.token_index(tokens[i]);
+      }
+      const double find_time = ElapsedSeconds(start);
+
+      TokenIndex index;
+      index.Reserve(num_tokens);
+      for (int i = 0; i < num_tokens; ++i) {
+        index.Add(tokens[i]);
+      }
+
+      start = std::chrono::steady_clock::now();
+      for (int i = num_tokens - 1; i >= 0; --i) {
+        checksum -= index.Find(tokens[i].class_id, tokens[i].keyword);
+      }
+      const double find_strings_time = ElapsedSeconds(start);
+
+      std::cout << "DensePhiMatrix, " << num_tokens << " tokens: add " << add_time << " sec, find "
+                << find_time << " sec, find by strings " << find_strings_time << " sec, TokenIndex "
+                << index.ByteSize() / (1024 * 1024) << " MB (checksum " << checksum << ")" << std::endl;
+      ASSERT_EQ(checksum, 0);
+    }
+  }
+}